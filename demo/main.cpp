@@ -1,12 +1,58 @@
 #include<iostream>
+#include<cstring>
+#include<cstdlib>
+#include<chrono>
 #include<interface.h>
 using namespace std;
 
-int main()
+// Usage:
+//   YgoMasterArchiveTool                                   interactive menu
+//   YgoMasterArchiveTool [--socket path] --daemon          serve requests on a local socket
+//   YgoMasterArchiveTool [--socket path] --client cmd [key=value ...]
+//   YgoMasterArchiveTool --startup-bench [runs]            time to the first prompt and to the loaded ArchiveList
+int main(int argc, char** argv)
 {
+    std::string socketPath = "";
+    int arg = 1;
+    if (arg + 1 < argc && 0 == strcmp(argv[arg], "--socket")) {
+        socketPath = argv[arg + 1];
+        arg += 2;
+    }
+
+    if (arg < argc && 0 == strcmp(argv[arg], "--client")) {
+        return RunYgoMasterClient(socketPath, argc - arg - 1, argv + arg + 1);
+    }
+
+    if (arg < argc && 0 == strcmp(argv[arg], "--startup-bench")) {
+        const int runs = (arg + 1 < argc) ? atoi(argv[arg + 1]) : 5;
+        for (int i = 0; i < runs; ++i) {
+            IYgoMasterMgr* mgr;
+            const auto begin = chrono::steady_clock::now();
+            GetYgoMasterMgr(&mgr);
+            //Only startup is measured, jobs that change the archives stay off
+            const bool started = mgr->Start(false);
+            const auto prompt = chrono::steady_clock::now();
+            const bool ready = started && mgr->WaitReady();
+            const auto loaded = chrono::steady_clock::now();
+            delete mgr;
+            if (!ready) {
+                printf("Startup failed.\n");
+                return 1;
+            }
+            printf("Run %d: prompt %.2f ms, ArchiveList loaded %.2f ms\n", i + 1,
+                chrono::duration<double, milli>(prompt - begin).count(), chrono::duration<double, milli>(loaded - begin).count());
+        }
+        return 0;
+    }
+
     IYgoMasterMgr* mgr;
     GetYgoMasterMgr(&mgr);
-    mgr->Run();
+    if (arg < argc && 0 == strcmp(argv[arg], "--daemon")) {
+        mgr->RunDaemon(socketPath);
+    }
+    else {
+        mgr->Run();
+    }
     delete mgr;
     return 0;
 }
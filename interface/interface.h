@@ -1,8 +1,19 @@
+#include<string>
 
 class IYgoMasterMgr 
 {
 public:
+    virtual ~IYgoMasterMgr() {}
     virtual void Run() = 0;
+    // Keep the archive index in memory and serve requests on a local socket until a shutdown request
+    virtual void RunDaemon(const std::string& socketPath) = 0;
+    // What Run does before its first prompt: read config, ArchiveLists are read in the background.
+    // Without backgroundJobs only the lists are loaded, migration, usage scan, tiering and trash reaping do not run.
+    virtual bool Start(const bool backgroundJobs = true) = 0;
+    // Wait until the ArchiveLists read in the background by Start are loaded
+    virtual bool WaitReady() = 0;
 };
 
-void GetYgoMasterMgr(IYgoMasterMgr** imp);
\ No newline at end of file
+void GetYgoMasterMgr(IYgoMasterMgr** imp);
+// Thin client: send "cmd key=value..." to the daemon, print the reply and return the exit code
+int RunYgoMasterClient(const std::string& socketPath, int argc, char** argv);
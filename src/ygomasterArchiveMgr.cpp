@@ -1,36 +1,192 @@
 #include "ygomasterArchiveMgr.h"
+#include "ygomasterDaemon.h"
+#include "ygomasterFileView.h"
+#include "ygomasterJsonPatch.h"
+#include "ygomasterTreeWalker.h"
+#include "ygomasterBinary.h"
+#include "ygomasterDurableFile.h"
+#include "ygomasterSlots.h"
+#include "ygomasterFileLock.h"
+#include "ygomasterJsonTree.h"
+#include "ygomasterTimeline.h"
+#include "ygomasterBundle.h"
 #include <cjson/cJSON.h>
 #include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <set>
 
 namespace fs = std::filesystem;
 
 YgoMasterArchiveMgr::YgoMasterArchiveMgr()
 {
-	m_YMDataPath = "";
-	m_configPath = fs::current_path().string() + "\\config.json";
-	m_YMListPath = fs::current_path().string() + "\\ArchiveList.json";
-	m_archivesPath = fs::current_path().string() + "\\Archives";
-	m_currentArchiveIndex = 0;
+	m_configPath = (fs::current_path() / "config.json").string();
+	m_activeInstall = nullptr;
+	m_daemonServer = nullptr;
+	m_stopping = false;
+	for (int i = 0; i < static_cast<int>(EIoOperation::SIZE_OF_OPERATIONS); ++i) {
+		m_ioBudgets[i] = GetDefaultIoBudget(static_cast<EIoOperation>(i));
+	}
 }
 
-void YgoMasterArchiveMgr::Run()
+YgoMasterArchiveMgr::~YgoMasterArchiveMgr()
+{
+	m_stopping = true;
+	for (auto& thread : m_backgroundThreads) {
+		thread.join();
+	}
+}
+
+bool YgoMasterArchiveMgr::LoadInstalls(const bool deferred, const bool backgroundJobs)
 {
 	if (!ReadConfig()) {
 		printf("Read config failed.\n");
-		return;
+		return false;
+	}
+	printf("Read config done: %s\n", m_configPath.c_str());
+
+	std::shared_lock<std::shared_mutex> lock(m_installsMutex);
+	std::vector<bool> loaded;
+	for (const auto& install : m_installs) {
+		//A missing ArchiveList means a first run, whose first backup is made before going on
+		std::error_code ec;
+		if (deferred && fs::exists(install->m_YMListPath, ec)) {
+			loaded.push_back(false);
+			continue;
+		}
+		if (!backgroundJobs) {
+			printf("ArchiveList %s of install %s does not exist, run the tool once to create it.\n",
+				install->m_YMListPath.c_str(), install->m_name.c_str());
+			return false;
+		}
+		printf("Loading install %s...\n", install->m_name.c_str());
+		if (!ReadYMList(*install)) {
+			printf("Read ArchiveList failed for install %s.\n", install->m_name.c_str());
+			return false;
+		}
+		install->m_loadPromise.set_value(true);
+		loaded.push_back(true);
+	}
+	m_activeInstall = m_installs.front();
+	if (!deferred) {
+		printf("Read ArchiveList done.\n");
+	}
+	//Deleted archives are unlinked while the tool is in use, trash of an earlier run first
+	for (const auto& install : m_installs) {
+		if (!backgroundJobs) break;
+		m_backgroundThreads.emplace_back([this, install]() {
+			while (!m_stopping) {
+				if (install->m_trashPending.exchange(false)) {
+					ReapTrash(*install);
+				}
+				std::this_thread::sleep_for(std::chrono::seconds(1));
+			}
+		});
+	}
+	//Archives of older versions are moved to the sharded layout while the tool is in use,
+	//archives age while it runs, so tiering repeats until it stops
+	for (size_t i = 0; i < m_installs.size(); ++i) {
+		const auto& install = m_installs[i];
+		const bool load = !loaded[i];
+		m_backgroundThreads.emplace_back([this, install, load, backgroundJobs]() {
+			if (load) {
+				const bool ok = ReadYMList(*install, false);
+				install->m_loadPromise.set_value(ok);
+				if (!ok) {
+					return;
+				}
+			}
+			//Without background jobs nothing of the install is written, only the list is loaded
+			if (!backgroundJobs) {
+				return;
+			}
+			ValidateDataDir(*install);
+			MigrateFlatArchives(*install);
+			{
+				std::shared_lock<std::shared_mutex> lock(install->m_dataMutex);
+				std::lock_guard<std::mutex> usageLock(install->m_usageMutex);
+				EnsureUsageIndex(*install);
+			}
+			while (!m_stopping) {
+				TierArchives(*install);
+				for (int i = 0; i < COLD_TIERING_INTERVAL && !m_stopping; ++i) {
+					std::this_thread::sleep_for(std::chrono::seconds(1));
+				}
+			}
+		});
+	}
+	return true;
+}
+
+bool YgoMasterArchiveMgr::WaitInstallLoaded(YgoInstallContext& ctx)
+{
+	if (ctx.m_loaded.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+		printf("Loading ArchiveList of install %s...\n", ctx.m_name.c_str());
 	}
-	printf("Read config done: %s\n", m_YMListPath.c_str());
+	if (!ctx.m_loaded.get()) {
+		printf("ArchiveList of install %s could not be read.\n", ctx.m_name.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool YgoMasterArchiveMgr::WaitReady()
+{
+	std::shared_lock<std::shared_mutex> lock(m_installsMutex);
+	bool ok = !m_installs.empty();
+	for (const auto& install : m_installs) {
+		ok = install->m_loaded.get() && ok;
+	}
+	return ok;
+}
+
+void YgoMasterArchiveMgr::ValidateDataDir(YgoInstallContext& ctx)
+{
+	//The menu is up before this runs, so a wrong path is reported instead of asked for again
+	std::error_code ec;
+	if (!fs::is_directory(ctx.m_YMDataPath, ec)) {
+		printf("Warning: YgoMaster Data directory %s of install %s not found, check YMDataPath in config file.\n",
+			ctx.m_YMDataPath.c_str(), ctx.m_name.c_str());
+	}
+	else if (!fs::exists(fs::path(ctx.m_YMDataPath) / sc_YgoPlayerJsonSearchPath, ec)) {
+		printf("Warning: %s of install %s holds no %s.\n", ctx.m_YMDataPath.c_str(), ctx.m_name.c_str(),
+			sc_YgoPlayerJsonSearchPath.c_str());
+	}
+}
+
+// Comma separated patterns of a partial restore, empty ones are dropped
+static void SplitPatterns(const std::string& text, std::vector<std::string>& result)
+{
+	size_t begin = 0;
+	while (begin <= text.size()) {
+		size_t comma = text.find(',', begin);
+		if (comma == std::string::npos) comma = text.size();
+		if (comma > begin) {
+			result.push_back(text.substr(begin, comma - begin));
+		}
+		begin = comma + 1;
+	}
+}
+
+bool YgoMasterArchiveMgr::Start(const bool backgroundJobs)
+{
+	//The prompt comes up right away, ArchiveLists are read meanwhile and listed only when asked
+	return LoadInstalls(true, backgroundJobs);
+}
 
-	if (!ReadYMList()) {
-		printf("Read ArchiveList failed.\n");
+void YgoMasterArchiveMgr::Run()
+{
+	if (!Start()) {
 		return;
 	}
-	printf("Read ArchiveList done.\n");
 
 	int input = 0;
 	while (true)
 	{
+		YgoInstallContext& ctx = *m_activeInstall;
 		printf("\n*========== YgoMaster Archive Manager ==========*\n");
+		printf("Install: %s (%s)\n", ctx.m_name.c_str(), ctx.m_YMDataPath.c_str());
 		for (const auto& option : sc_InputOptions) {
 			printf("%d. %s\n", static_cast<int>(option.first), option.second.c_str());
 		}
@@ -45,13 +201,17 @@ void YgoMasterArchiveMgr::Run()
 			continue;
 		}
 
+		if (input != static_cast<int>(EInputOption::EXIT) && input != static_cast<int>(EInputOption::SWITCH_INSTALL)
+			&& !WaitInstallLoaded(ctx)) {
+			continue;
+		}
 		switch (input)
 		{
 		case static_cast<int>(EInputOption::EXIT):
 			printf("Exiting...\n");
 			return;
 		case static_cast<int>(EInputOption::DISPLAY_ARCHIVE_LIST):
-			QuerryArchiveList(DEFAULT_MAX_ARCHIVE_LIST_SIZE, true, false);
+			QuerryArchiveList(ctx, DEFAULT_MAX_ARCHIVE_LIST_SIZE, true, false);
 			break;
 		case static_cast<int>(EInputOption::DISPLAY_ARCHIVE_DETAIL):
 		{
@@ -64,11 +224,11 @@ void YgoMasterArchiveMgr::Run()
 				printf("Invalid input, please enter a number.\n");
 				continue;
 			}
-			DisplayArchiveDetail(archiveID);
+			DisplayArchiveDetail(ctx, archiveID);
 			break;
 		}
 		case static_cast<int>(EInputOption::BACKUP_ARCHIVE_COPY):
-			if (BackupAndCreateNewArchive()) {
+			if (BackupAndCreateNewArchive(ctx)) {
 				printf("New archive created successfully.\n");
 			}
 			else {
@@ -76,7 +236,7 @@ void YgoMasterArchiveMgr::Run()
 			}
 			break;
 		case static_cast<int>(EInputOption::BACKUP_ARCHIVE_REPLACE):
-			if (BackupArchive(m_currentArchiveIndex, false)) {
+			if (BackupArchive(ctx, ctx.m_currentArchiveIndex, false)) {
 				printf("Current archive updated successfully.\n");
 			}
 			else {
@@ -94,7 +254,7 @@ void YgoMasterArchiveMgr::Run()
 				printf("Invalid input, please enter a number.\n");
 				continue;
 			}
-			if (DeleteArchive(archiveID)) {
+			if (DeleteArchive(ctx, archiveID)) {
 				printf("ArchiveID %d deleted successfully.\n", archiveID);
 			}
 			else {
@@ -113,7 +273,7 @@ void YgoMasterArchiveMgr::Run()
 				printf("Invalid input, please enter a number.\n");
 				continue;
 			}
-			if (RestoreArchive(archiveID, false)) {
+			if (RestoreArchive(ctx, archiveID, false)) {
 				printf("ArchiveID %d restored successfully.\n", archiveID);
 			}
 			else {
@@ -132,7 +292,7 @@ void YgoMasterArchiveMgr::Run()
 				printf("Invalid input, please enter a number.\n");
 				continue;
 			}
-			if (RestoreArchive(archiveID, true)) {
+			if (RestoreArchive(ctx, archiveID, true)) {
 				printf("ArchiveID %d restored successfully with backup.\n", archiveID);
 			}
 			else {
@@ -140,6 +300,152 @@ void YgoMasterArchiveMgr::Run()
 			}
 			break;
 		}
+		case static_cast<int>(EInputOption::SEARCH_ARCHIVE):
+		{
+			std::string keyword;
+			printf("Enter keyword to search: ");
+			std::cin >> keyword;
+			SearchArchives(ctx, keyword);
+			break;
+		}
+		case static_cast<int>(EInputOption::SWITCH_INSTALL):
+			SwitchInstall();
+			break;
+		case static_cast<int>(EInputOption::SEARCH_CARD):
+		{
+			uint32_t cardId;
+			int minCount;
+			printf("Enter card id and minimum count (e.g. 4007 1): ");
+			std::cin >> cardId >> minCount;
+			if (std::cin.fail() || minCount < 0) {
+				std::cin.clear(); // Clear the error flag
+				std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n'); // Discard invalid input
+				printf("Invalid input, please enter two numbers.\n");
+				continue;
+			}
+			SearchCard(ctx, cardId, static_cast<uint16_t>(std::min(minCount, 65535)));
+			break;
+		}
+		case static_cast<int>(EInputOption::BULK_EDIT):
+		{
+			std::string selector, fieldPath, value;
+			printf("Enter archives to edit (all, ArchiveIDs like 1,2,5, or a keyword): ");
+			std::cin >> selector;
+			printf("Enter Player.json field (e.g. Gems): ");
+			std::cin >> fieldPath;
+			printf("Enter new value: ");
+			std::cin >> value;
+			std::vector<int> archiveIDs;
+			SelectArchives(ctx, selector, archiveIDs);
+			BulkPatchField(ctx, archiveIDs, sc_YgoPlayerJsonSearchPath, fieldPath, MakeJsonValueText(value));
+			break;
+		}
+		case static_cast<int>(EInputOption::VERIFY_ARCHIVE):
+		{
+			int archiveID;
+			printf("Enter ArchiveID to verify (-1 for current archive): ");
+			std::cin >> archiveID;
+			if (std::cin.fail()) {
+				std::cin.clear(); // Clear the error flag
+				std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n'); // Discard invalid input
+				printf("Invalid input, please enter a number.\n");
+				continue;
+			}
+			YgoVerifyResult result;
+			VerifyArchive(ctx, archiveID, result);
+			break;
+		}
+		case static_cast<int>(EInputOption::SWITCH_ARCHIVE):
+		{
+			int archiveID;
+			printf("Enter ArchiveID to switch to: ");
+			std::cin >> archiveID;
+			if (std::cin.fail()) {
+				std::cin.clear(); // Clear the error flag
+				std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n'); // Discard invalid input
+				printf("Invalid input, please enter a number.\n");
+				continue;
+			}
+			if (SwitchArchive(ctx, archiveID)) {
+				printf("Switched to ArchiveID %d.\n", archiveID);
+			}
+			else {
+				printf("Switch to ArchiveID %d failed.\n", archiveID);
+			}
+			break;
+		}
+		case static_cast<int>(EInputOption::DIFF_ARCHIVES):
+		{
+			int beforeID, afterID;
+			printf("Enter two ArchiveIDs to compare, older first (%d for the current Data): ", DIFF_DATA_ID);
+			std::cin >> beforeID >> afterID;
+			if (std::cin.fail()) {
+				std::cin.clear(); // Clear the error flag
+				std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n'); // Discard invalid input
+				printf("Invalid input, please enter two numbers.\n");
+				continue;
+			}
+			DisplayArchiveDiff(ctx, beforeID, afterID);
+			break;
+		}
+		case static_cast<int>(EInputOption::TIMELINE):
+		{
+			std::string exportPath;
+			printf("Enter export file (.csv or .json), or - to only display: ");
+			std::cin >> exportPath;
+			DisplayTimeline(ctx, exportPath);
+			break;
+		}
+		case static_cast<int>(EInputOption::EXPORT_ARCHIVES):
+		{
+			std::string selector, bundlePath;
+			printf("Enter archives to export (all, ArchiveIDs like 1,2,5, or a keyword): ");
+			std::cin >> selector;
+			printf("Enter bundle file (e.g. archives%s): ", sc_bundleExtension.c_str());
+			std::cin >> bundlePath;
+			std::vector<int> archiveIDs;
+			SelectArchives(ctx, selector, archiveIDs);
+			ExportArchives(ctx, archiveIDs, bundlePath);
+			break;
+		}
+		case static_cast<int>(EInputOption::IMPORT_BUNDLE):
+		{
+			std::string bundlePath;
+			printf("Enter bundle file: ");
+			std::cin >> bundlePath;
+			ImportArchives(ctx, bundlePath);
+			break;
+		}
+		case static_cast<int>(EInputOption::RESTORE_FILES):
+		{
+			int archiveID;
+			std::string patterns, current;
+			printf("Enter ArchiveID to restore files from: ");
+			std::cin >> archiveID;
+			if (std::cin.fail()) {
+				std::cin.clear(); // Clear the error flag
+				std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n'); // Discard invalid input
+				printf("Invalid input, please enter a number.\n");
+				continue;
+			}
+			printf("Enter target names or path globs, comma separated (e.g. Settings.json,Players/**/Player.json): ");
+			std::cin >> patterns;
+			printf("Make it the current archive? (y/n): ");
+			std::cin >> current;
+			YgoRestoreFilter filter;
+			SplitPatterns(patterns, filter.m_patterns);
+			RestoreArchiveFiles(ctx, archiveID, filter, current == "y" || current == "Y");
+			break;
+		}
+		case static_cast<int>(EInputOption::DECK_HISTORY):
+		{
+			std::string deckName;
+			printf("Enter deck name: ");
+			std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n'); // Clear the input buffer
+			std::getline(std::cin, deckName);
+			DisplayDeckHistory(ctx, deckName);
+			break;
+		}
 		default:
 			break;
 		}
@@ -151,28 +457,43 @@ bool YgoMasterArchiveMgr::ReadConfig()
 {
 	/*
 	* Read the config file, if not exist, create a default one.
-	* If read success, return true and set result to YMListPath.
+	* If read success, return true and fill m_installs.
 	*/
 
 	//If config file not exist, create a default one and return
 	if (!fs::exists(m_configPath)) {
 		printf("Config file not exist, creating a default one.\n");
+		auto install = std::make_shared<YgoInstallContext>();
+		install->m_name = sc_defaultInstallName;
+		install->m_YMListPath = (fs::current_path() / "ArchiveList.json").string();
+		install->m_archivesPath = (fs::current_path() / "Archives").string();
+
 		cJSON* root = cJSON_CreateObject();
 		if (!root) {
 			printf("Create JSON object failed.\n");
 			return false;
 		}
 
-		if (!CheckYMDataDir()) {
+		if (!CheckYMDataDir(*install)) {
 			cJSON_Delete(root);
 			printf("YgoMaster Data directory not found in default search paths.\n");
 			return false;
 		}
 
 		cJSON_AddStringToObject(root, "Desc", sc_configDescText.c_str());
-		cJSON_AddStringToObject(root, "YMListPath", m_YMListPath.c_str());
-		cJSON_AddStringToObject(root, "YMDataPath", m_YMDataPath.c_str());
-		cJSON_AddStringToObject(root, "ArchivesPath", m_archivesPath.c_str());
+		cJSON_AddStringToObject(root, "YMListPath", install->m_YMListPath.c_str());
+		cJSON_AddStringToObject(root, "YMDataPath", install->m_YMDataPath.c_str());
+		cJSON_AddStringToObject(root, "ArchivesPath", install->m_archivesPath.c_str());
+		cJSON_AddNumberToObject(root, "SmallFileThreshold", static_cast<double>(install->m_smallFileThreshold));
+		cJSON_AddItemToObject(root, "Installs", cJSON_CreateArray());
+		cJSON* budgetsItem = cJSON_AddObjectToObject(root, "IoBudgets");
+		for (int i = 0; i < static_cast<int>(EIoOperation::SIZE_OF_OPERATIONS); ++i) {
+			cJSON_AddItemToObject(budgetsItem, sc_ioOperationNames[i], CreateIoBudgetItem(m_ioBudgets[i]));
+		}
+		cJSON* coldItem = cJSON_AddObjectToObject(root, "ColdStorage");
+		cJSON_AddBoolToObject(coldItem, "Enabled", m_coldPolicy.m_enabled);
+		cJSON_AddNumberToObject(coldItem, "KeepRecent", m_coldPolicy.m_keepRecent);
+		cJSON_AddNumberToObject(coldItem, "KeepDays", m_coldPolicy.m_keepDays);
 		char* jsonFileString = cJSON_Print(root);
 
 		std::ofstream outFile(m_configPath);
@@ -194,100 +515,139 @@ bool YgoMasterArchiveMgr::ReadConfig()
 		cJSON_free(jsonFileString);
 		cJSON_Delete(root);
 		printf("Default config file created at %s\n", m_configPath.c_str());
+
+		std::unique_lock<std::shared_mutex> lock(m_installsMutex);
+		m_installs.push_back(install);
 		return true;
 	}
 
 	//Read config file
 	printf("Reading config file at %s\n", m_configPath.c_str());
-	std::ifstream file(m_configPath, std::ios::binary | std::ios::ate);
-	if (!file.is_open()) {
+	YgoFileView file;
+	if (!file.Open(m_configPath)) {
 		printf("Open config file failed.\n");
 		return false;
 	}
-	std::streamsize size = file.tellg();
-	if (size <= 0) {
+	if (file.Size() == 0) {
 		printf("Config file is empty.\n");
 		return false;
 	}
 
-	file.seekg(0, std::ios::beg);
-	std::vector<char> buffer(size + 1);
-	if (!file.read(buffer.data(), size)) {
-		printf("Read config file failed.\n");
-		return false;
-	}
-	buffer[size] = '\0';
-	file.close();
-
 	//Parse JSON
 	printf("Parsing config file.\n");
-	cJSON* root = cJSON_Parse(buffer.data());
+	cJSON* root = cJSON_ParseWithLength(file.Data(), file.Size());
+	file.Close();
 	if (!root) {
 		printf("Parse config file failed.\n");
 		return false;
 	}
-	cJSON* ymListPath = cJSON_GetObjectItem(root, "YMListPath");
-	cJSON* ymDataPath = cJSON_GetObjectItem(root, "YMDataPath");
-	cJSON* archivesPath = cJSON_GetObjectItem(root, "ArchivesPath");
-	if (cJSON_IsString(ymListPath) && (ymListPath->valuestring != nullptr)
-		&& cJSON_IsString(ymDataPath) && (ymDataPath->valuestring != nullptr)
-		&& cJSON_IsString(archivesPath) && (archivesPath->valuestring != nullptr)
-		) {
-		m_YMListPath = ymListPath->valuestring;
-		m_YMDataPath = ymDataPath->valuestring;
-		m_archivesPath = archivesPath->valuestring;
+
+	cJSON* budgetsItem = cJSON_GetObjectItem(root, "IoBudgets");
+	for (int i = 0; i < static_cast<int>(EIoOperation::SIZE_OF_OPERATIONS); ++i) {
+		ReadIoBudget(cJSON_GetObjectItem(budgetsItem, sc_ioOperationNames[i]), m_ioBudgets[i]);
+	}
+	cJSON* coldItem = cJSON_GetObjectItem(root, "ColdStorage");
+	cJSON* coldEnabled = cJSON_GetObjectItem(coldItem, "Enabled");
+	cJSON* coldKeepRecent = cJSON_GetObjectItem(coldItem, "KeepRecent");
+	cJSON* coldKeepDays = cJSON_GetObjectItem(coldItem, "KeepDays");
+	if (cJSON_IsBool(coldEnabled)) {
+		m_coldPolicy.m_enabled = cJSON_IsTrue(coldEnabled);
+	}
+	if (cJSON_IsNumber(coldKeepRecent) && coldKeepRecent->valueint >= 0) {
+		m_coldPolicy.m_keepRecent = coldKeepRecent->valueint;
+	}
+	if (cJSON_IsNumber(coldKeepDays) && coldKeepDays->valueint >= 0) {
+		m_coldPolicy.m_keepDays = coldKeepDays->valueint;
+	}
+
+	//Top level paths describe the default install, "Installs" adds more
+	cJSON* thresholdItem = cJSON_GetObjectItem(root, "SmallFileThreshold");
+	const uint64_t defaultThreshold = (cJSON_IsNumber(thresholdItem) && thresholdItem->valuedouble >= 0)
+		? static_cast<uint64_t>(thresholdItem->valuedouble) : DEFAULT_SMALL_FILE_THRESHOLD;
+	auto readInstall = [defaultThreshold](cJSON* item, const std::string& defaultName) -> std::shared_ptr<YgoInstallContext> {
+		cJSON* nameItem = cJSON_GetObjectItem(item, "Name");
+		cJSON* ymListPath = cJSON_GetObjectItem(item, "YMListPath");
+		cJSON* ymDataPath = cJSON_GetObjectItem(item, "YMDataPath");
+		cJSON* archivesPath = cJSON_GetObjectItem(item, "ArchivesPath");
+		if (!(cJSON_IsString(ymListPath) && (ymListPath->valuestring != nullptr)
+			&& cJSON_IsString(ymDataPath) && (ymDataPath->valuestring != nullptr)
+			&& cJSON_IsString(archivesPath) && (archivesPath->valuestring != nullptr))
+			) {
+			return nullptr;
+		}
+		auto install = std::make_shared<YgoInstallContext>();
+		install->m_name = (cJSON_IsString(nameItem) && nameItem->valuestring != nullptr) ? nameItem->valuestring : defaultName;
+		install->m_YMListPath = ymListPath->valuestring;
+		install->m_YMDataPath = ymDataPath->valuestring;
+		install->m_archivesPath = archivesPath->valuestring;
+		cJSON* thresholdItem = cJSON_GetObjectItem(item, "SmallFileThreshold");
+		install->m_smallFileThreshold = (cJSON_IsNumber(thresholdItem) && thresholdItem->valuedouble >= 0)
+			? static_cast<uint64_t>(thresholdItem->valuedouble) : defaultThreshold;
+		return install;
+	};
+
+	std::vector<std::shared_ptr<YgoInstallContext>> installs;
+	auto defaultInstall = readInstall(root, sc_defaultInstallName);
+	if (!defaultInstall) {
+		printf("Config file format error: YMListPath, YMDataPath or ArchivesPath is missing.\n");
 		cJSON_Delete(root);
-		return true;
+		return false;
+	}
+	installs.push_back(defaultInstall);
+
+	cJSON* installsArray = cJSON_GetObjectItem(root, "Installs");
+	if (installsArray && cJSON_IsArray(installsArray)) {
+		int count = cJSON_GetArraySize(installsArray);
+		for (int i = 0; i < count; ++i) {
+			auto install = readInstall(cJSON_GetArrayItem(installsArray, i), "Install" + std::to_string(i + 1));
+			if (!install) {
+				printf("Install %d in config file is incomplete, skipping.\n", i + 1);
+				continue;
+			}
+			bool duplicate = false;
+			for (const auto& other : installs) {
+				if (other->m_name == install->m_name || other->m_YMListPath == install->m_YMListPath) {
+					duplicate = true;
+					break;
+				}
+			}
+			if (duplicate) {
+				printf("Install %s duplicates another install, skipping.\n", install->m_name.c_str());
+				continue;
+			}
+			installs.push_back(install);
+		}
 	}
 	cJSON_Delete(root);
 
-	return false;
+	std::unique_lock<std::shared_mutex> lock(m_installsMutex);
+	m_installs = std::move(installs);
+	return true;
 }
 
-bool YgoMasterArchiveMgr::ReadYMList()
+bool YgoMasterArchiveMgr::ReadYMList(YgoInstallContext& ctx, const bool display)
 {
 	/*
 	* Read the YgoMaster save list, if not exist, create a default one.
 	* Return false if read failed.
 	*/
 
-	if (!fs::exists(m_YMListPath)) {
+	if (!fs::exists(ctx.m_YMListPath)) {
 		printf("ArchiveList file not exist, creating a default one.\n");
-		cJSON* root = cJSON_CreateObject();
-		cJSON_AddItemToObject(root, "Currently in use ArchiveID", cJSON_CreateNumber(m_currentArchiveIndex));
-		cJSON_AddItemToObject(root, "ArchivesCount", cJSON_CreateNumber(0));
-		cJSON_AddItemToObject(root, "Archives", cJSON_CreateArray());
-		char* jsonFileString = cJSON_Print(root);
-
-		std::ofstream outFile(m_YMListPath);
-		if (!outFile) {
-			printf("Create ArchiveList file failed at %s\n", m_YMListPath.c_str());
-			cJSON_free(jsonFileString);
-			cJSON_Delete(root);
-			return false;
-		}
-		outFile << jsonFileString;
-		if (!outFile) {
-			printf("Write to ArchiveList file failed at %s\n", m_YMListPath.c_str());
-			outFile.close();
-			cJSON_free(jsonFileString);
-			cJSON_Delete(root);
-			return false;
-		}
-		outFile.close();
-		cJSON_free(jsonFileString);
-		cJSON_Delete(root);
-
-		//Create the first archive
-		if (!BackupArchive(0)) {
+		std::lock_guard<std::recursive_mutex> writeLock(ctx.m_writeMutex);
+		ListUpdate update(*this, ctx, true);
+		//The empty list and the first archive are written with one commit
+		if (!update.Root() || !BackupArchive(ctx, 0) || !update.Commit()) {
 			printf("Create first archive failed.\n");
 			return false;
 		}
 	}
 
 	//Read ArchiveList file
-	printf("Reading ArchiveList file at %s\n", m_YMListPath.c_str());
-	if (!QuerryArchiveList(DEFAULT_MAX_ARCHIVE_LIST_SIZE, true, true))
+	if (display) {
+		printf("Reading ArchiveList file at %s\n", ctx.m_YMListPath.c_str());
+	}
+	if (!QuerryArchiveList(ctx, DEFAULT_MAX_ARCHIVE_LIST_SIZE, display, true))
 	{
 		printf("Read ArchiveList file failed.\n");
 		return false;
@@ -296,13 +656,13 @@ bool YgoMasterArchiveMgr::ReadYMList()
 	return true;
 }
 
-bool YgoMasterArchiveMgr::CheckYMDataDir()
+bool YgoMasterArchiveMgr::CheckYMDataDir(YgoInstallContext& ctx)
 {
 	for (const auto& dir : sc_YgoArchiveSearchPaths) {
-		fs::path potentialPath = fs::current_path().string() + fs::path(dir).string();
+		fs::path potentialPath = (fs::current_path() / fs::path(dir)).lexically_normal();
 		if (fs::exists(potentialPath) && fs::is_directory(potentialPath)) {
-			m_YMDataPath = potentialPath.string();
-			printf("YgoMaster Data directory found at %s\n", m_YMDataPath.c_str());
+			ctx.m_YMDataPath = potentialPath.string();
+			printf("YgoMaster Data directory found at %s\n", ctx.m_YMDataPath.c_str());
 			return true;
 		}
 	}
@@ -315,8 +675,8 @@ bool YgoMasterArchiveMgr::CheckYMDataDir()
 		std::cin >> inputPath;
 		fs::path userPath(inputPath);
 		if (fs::exists(userPath) && fs::is_directory(userPath)) {
-			m_YMDataPath = userPath.string();
-			printf("YgoMaster Data directory set to %s\n", m_YMDataPath.c_str());
+			ctx.m_YMDataPath = userPath.string();
+			printf("YgoMaster Data directory set to %s\n", ctx.m_YMDataPath.c_str());
 			return true;
 		}
 		else {
@@ -327,23 +687,66 @@ bool YgoMasterArchiveMgr::CheckYMDataDir()
 	return false;
 }
 
-bool YgoMasterArchiveMgr::QuerryArchiveList(const int maxSize, const bool display, const bool updateArchives)
+bool YgoMasterArchiveMgr::QuerryArchiveList(YgoInstallContext& ctx, const int maxSize, const bool display, const bool updateArchives)
 {
-	//Display the archive list, if updateArchives is true, update m_archives
-	std::ifstream inFile(m_YMListPath);
-	if (!inFile.is_open()) {
-		printf("Open ArchiveList file failed.\n");
-		return false;
+	//Display the archive list, if updateArchives is true, update ctx.m_archives
+	if (updateArchives) {
+		std::lock_guard<std::recursive_mutex> writeLock(ctx.m_writeMutex);
+		std::unique_lock<std::shared_mutex> lock(ctx.m_dataMutex);
+		return QuerryArchiveListLocked(ctx, maxSize, display, true);
 	}
-	std::string jsonContent((std::istreambuf_iterator<char>(inFile)), 
-		std::istreambuf_iterator<char>());
-	inFile.close();
-	if (jsonContent.empty()) {
-		printf("ArchiveList file is empty.\n");
-		return false;
+	std::shared_lock<std::shared_mutex> lock(ctx.m_dataMutex);
+	return QuerryArchiveListLocked(ctx, maxSize, display, false);
+}
+
+// Fill info from one entry of the Archives array, missing fields keep their defaults
+static void ReadArchiveItem(cJSON* archiveItem, YgoArchiveInfo& info)
+{
+	cJSON* idItem = cJSON_GetObjectItem(archiveItem, "id");
+	cJSON* nameItem = cJSON_GetObjectItem(archiveItem, "Name");
+	cJSON* pathItem = cJSON_GetObjectItem(archiveItem, "Path");
+	cJSON* timeItem = cJSON_GetObjectItem(archiveItem, "LastBackupTime");
+	cJSON* descItem = cJSON_GetObjectItem(archiveItem, "Description");
+	if (idItem && cJSON_IsNumber(idItem)) {
+		info.m_id = static_cast<int>(cJSON_GetNumberValue(idItem));
+	}
+	if (nameItem && cJSON_IsString(nameItem)) {
+		info.m_name = cJSON_GetStringValue(nameItem);
+	}
+	if (pathItem && cJSON_IsString(pathItem)) {
+		info.m_path = cJSON_GetStringValue(pathItem);
+	}
+	if (timeItem && cJSON_IsString(timeItem)) {
+		info.m_time = cJSON_GetStringValue(timeItem);
+	}
+	if (descItem && cJSON_IsString(descItem)) {
+		info.m_desc = cJSON_GetStringValue(descItem);
 	}
+	cJSON* fileItem = nullptr;
+	cJSON_ArrayForEach(fileItem, cJSON_GetObjectItem(archiveItem, "InlineFiles")) {
+		if (cJSON_IsString(fileItem) && fileItem->string) {
+			info.m_inlineFiles.emplace_back(fileItem->string, fileItem->valuestring);
+		}
+	}
+}
 
-	cJSON* root = cJSON_Parse(jsonContent.c_str());
+bool YgoMasterArchiveMgr::QuerryArchiveListLocked(YgoInstallContext& ctx, const int maxSize, const bool display, const bool updateArchives)
+{
+	cJSON* root = nullptr;
+	{
+		//Other processes may list at the same time, only their commits wait
+		YgoListLockGuard fileLock(ctx.m_YMListPath, YgoFileLock::SHARED);
+		YgoFileView inFile;
+		if (!inFile.Open(ctx.m_YMListPath)) {
+			printf("Open ArchiveList file failed.\n");
+			return false;
+		}
+		if (inFile.Size() == 0) {
+			printf("ArchiveList file is empty.\n");
+			return false;
+		}
+		root = cJSON_ParseWithLength(inFile.Data(), inFile.Size());
+	}
 	if (!root) {
 		printf("Parse ArchiveList file failed.\n");
 		return false;
@@ -355,153 +758,1314 @@ bool YgoMasterArchiveMgr::QuerryArchiveList(const int maxSize, const bool displa
 		cJSON_Delete(root);
 		return false;
 	}
+	if (updateArchives) {
+		LoadArchiveTable(ctx, root);
+		std::error_code ec;
+		ctx.m_listWriteTime = fs::last_write_time(ctx.m_YMListPath, ec);
+	}
 	int size = cJSON_GetArraySize(archivesArray);
 	int displaySize = (maxSize == -1 || size < maxSize) ? size : maxSize;
-	printf("*------------------ Archive List ------------------*\n");
-	printf("There are total %d archives, displaying %d archives:\n", size, displaySize);
-	for (int i = 0; i < size; ++i) {
-		cJSON* archiveItem = cJSON_GetArrayItem(archivesArray, i);
-		if (!archiveItem) continue;
-		YgoArchiveInfo info;
-		cJSON* idItem = cJSON_GetObjectItem(archiveItem, "id");
-		cJSON* nameItem = cJSON_GetObjectItem(archiveItem, "Name");
-		cJSON* pathItem = cJSON_GetObjectItem(archiveItem, "Path");
-		cJSON* timeItem = cJSON_GetObjectItem(archiveItem, "LastBackupTime");
-		cJSON* descItem = cJSON_GetObjectItem(archiveItem, "Description");
-		if (idItem && cJSON_IsNumber(idItem)) {
-			info.m_id = static_cast<int>(cJSON_GetNumberValue(idItem));
-		}
-		if (nameItem && cJSON_IsString(nameItem)) {
-			info.m_name = cJSON_GetStringValue(nameItem);
-		}
-		if (pathItem && cJSON_IsString(pathItem)) {
-			info.m_path = cJSON_GetStringValue(pathItem);
-		}
-		if (timeItem && cJSON_IsString(timeItem)) {
-			info.m_time = cJSON_GetStringValue(timeItem);
+	if (display) {
+		//Counted by the background thread, shown once it is done
+		std::unique_lock<std::mutex> usageLock(ctx.m_usageMutex);
+		printf("*------------------ Archive List ------------------*\n");
+		printf("There are total %d archives, displaying %d archives:\n", size, displaySize);
+		if (ctx.m_usageIndex.IsLoaded()) {
+			printf("Archives use %s, %s of it shared between archives.\n", FormatByteSize(ctx.m_usageIndex.TotalBytes()).c_str(),
+				FormatByteSize(ctx.m_usageIndex.SharedBytes()).c_str());
 		}
-		if (descItem && cJSON_IsString(descItem)) {
-			info.m_desc = cJSON_GetStringValue(descItem);
-		}
-		if (updateArchives) {
-			m_archives[info.m_id] = info;
-			if (info.m_id == m_currentArchiveIndex) {
-				m_currentArchiveIndex = i;
-			}
-		}
-		if (display && i < displaySize) {
+		for (int i = 0; i < displaySize; ++i) {
+			cJSON* archiveItem = cJSON_GetArrayItem(archivesArray, i);
+			if (!archiveItem) continue;
+			YgoArchiveInfo info;
+			ReadArchiveItem(archiveItem, info);
 			printf("\tArchiveID: %d,\n \tName: %s,\n \tLast update time: %s\n \tDescription: %s\n",
 				info.m_id,
 				info.m_name.c_str(),
 				info.m_time.c_str(),
 				info.m_desc.c_str());
+			if (ctx.m_usageIndex.HasArchive(info.m_id)) {
+				const YgoUsageIndex::Usage usage = ctx.m_usageIndex.GetUsage(info.m_id);
+				printf(" \tDisk usage: %s exclusive, %s shared\n", FormatByteSize(usage.m_exclusiveBytes).c_str(),
+					FormatByteSize(usage.m_sharedBytes).c_str());
+			}
 			printf("--------------------------------------------------\n");
 		}
+		if (size > displaySize) {
+			printf("...\n");
+		}
+		printf("*--------------------------------------------------*\n");
 	}
-	if (size > displaySize) {
-		printf("...\n");
-	}
-	printf("*--------------------------------------------------*\n");
 	cJSON_Delete(root);
 	return true;
 }
 
-void YgoMasterArchiveMgr::DisplayArchiveDetail(const int archiveID)
+void YgoMasterArchiveMgr::LoadArchiveTable(YgoInstallContext& ctx, cJSON* root)
 {
-	//Display detailed info for a specific archiveID, if archiveID is -1 display current archive
-	if (m_archives.empty()) {
-		printf("No archives available to display.\n");
-		return;
+	cJSON* archivesArray = cJSON_GetObjectItem(root, "Archives");
+	ctx.m_archives.Clear();
+	ctx.m_archives.Reserve(static_cast<size_t>(cJSON_GetArraySize(archivesArray)));
+	cJSON* currentID = cJSON_GetObjectItem(root, "Currently in use ArchiveID");
+	if (currentID && cJSON_IsNumber(currentID)) {
+		ctx.m_currentArchiveIndex = currentID->valueint;
 	}
-
-	const int displayID = (-1 == archiveID) ? m_archives[m_currentArchiveIndex].m_id : archiveID;
-	const auto& archiveIt = m_archives.find(displayID);
-	if (archiveIt == m_archives.end()) {
-		printf("ArchiveID %d not found.\n", displayID);
-		return;
+	cJSON* archiveItem = nullptr;
+	cJSON_ArrayForEach(archiveItem, archivesArray) {
+		YgoArchiveInfo info;
+		ReadArchiveItem(archiveItem, info);
+		ctx.m_archives.Upsert(info);
 	}
+}
 
-	const YgoArchiveInfo& archive = archiveIt->second;
-	const std::string playerJsonPath = archive.m_path + sc_YgoPlayerJsonSearchPath;
-	const std::string settingsJsonPath = archive.m_path + sc_YgoSettingsJsonSearchPath;
-	if (!fs::exists(playerJsonPath) || !fs::exists(settingsJsonPath)) {
-		printf("Warning: Some important files are missing in this archive.\n");
-		printf("Missing files:\n");
-		if (!fs::exists(playerJsonPath)) {
-			printf("\t%s\n", playerJsonPath.c_str());
-		}
-		if (!fs::exists(settingsJsonPath)) {
-			printf("\t%s\n", settingsJsonPath.c_str());
+// Index of the Archives entry of list with archiveID, -1 if there is none
+static int FindArchiveItemIndex(cJSON* list, const int archiveID)
+{
+	int index = 0;
+	cJSON* archiveItem = nullptr;
+	cJSON_ArrayForEach(archiveItem, cJSON_GetObjectItem(list, "Archives")) {
+		cJSON* idItem = cJSON_GetObjectItem(archiveItem, "id");
+		if (cJSON_IsNumber(idItem) && idItem->valueint == archiveID) {
+			return index;
 		}
-		printf("This archive was not backed up properly or damaged !\n");
+		++index;
 	}
+	return -1;
+}
 
-	bool readPlayerSuccess = false;
-	int code = 0;
-	int gems = 0;
-	//Read Player.json
-	std::ifstream playerFile(playerJsonPath, std::ios::binary);
-	if (playerFile.is_open()) {
-		std::string jsonContent((std::istreambuf_iterator<char>(playerFile)),
-			std::istreambuf_iterator<char>());
-		playerFile.close();
-		cJSON* root = cJSON_Parse(jsonContent.c_str());
-		if (root) {
-			cJSON* codeItem = cJSON_GetObjectItem(root, "Code");
-			if (codeItem && cJSON_IsNumber(codeItem)) {
-				code = static_cast<int>(cJSON_GetNumberValue(codeItem));
-			}
-			cJSON* gemsItem = cJSON_GetObjectItem(root, "Gems");
-			if (gemsItem && cJSON_IsNumber(gemsItem)) {
-				gems = static_cast<int>(cJSON_GetNumberValue(gemsItem));
-			}
-			cJSON_Delete(root);
-			readPlayerSuccess = true;
+static int GetArchiveItemID(cJSON* archiveItem)
+{
+	cJSON* idItem = cJSON_GetObjectItem(archiveItem, "id");
+	return cJSON_IsNumber(idItem) ? idItem->valueint : -1;
+}
+
+// Whether an Archives entry of the list file at listPath points at snapshotPath, caller holds the list lock
+static bool ListRefersToPath(const std::string& listPath, const std::string& snapshotPath)
+{
+	YgoFileView view;
+	if (!view.Open(listPath)) {
+		return false;
+	}
+	cJSON* root = cJSON_ParseWithLength(view.Data(), view.Size());
+	bool found = false;
+	cJSON* archiveItem = nullptr;
+	cJSON_ArrayForEach(archiveItem, cJSON_GetObjectItem(root, "Archives")) {
+		cJSON* pathItem = cJSON_GetObjectItem(archiveItem, "Path");
+		if (cJSON_IsString(pathItem) && snapshotPath == pathItem->valuestring) {
+			found = true;
+			break;
 		}
 	}
+	cJSON_Delete(root);
+	return found;
+}
 
-	bool unlockAllCards = false;
-	int defaultsGems = 0;
+static fs::path GetSnapshotLockPath(const YgoInstallContext& ctx, const std::string& snapshotPath)
+{
+	const fs::path locksDir = fs::path(ctx.m_archivesPath) / sc_snapshotLocksDirName;
+	std::error_code ec;
+	fs::create_directories(locksDir, ec);
+	return locksDir / (fs::path(snapshotPath).filename().string() + sc_lockExtension);
+}
+
+// Apply the edits made from base to ours onto theirs, the list another process wrote meanwhile.
+// Entries are matched by id: ours replaces changed entries, entries removed from base are removed,
+// entries both sides added with one id keep the id on their side and get a new one on ours.
+static void MergeListChanges(cJSON* base, cJSON* ours, cJSON* theirs)
+{
+	cJSON* theirArchives = cJSON_GetObjectItem(theirs, "Archives");
+	if (!cJSON_IsArray(theirArchives)) {
+		cJSON_DeleteItemFromObject(theirs, "Archives");
+		theirArchives = cJSON_AddArrayToObject(theirs, "Archives");
+	}
+	cJSON* archiveItem = nullptr;
+	cJSON_ArrayForEach(archiveItem, cJSON_GetObjectItem(base, "Archives")) {
+		const int archiveID = GetArchiveItemID(archiveItem);
+		const int theirIndex = FindArchiveItemIndex(theirs, archiveID);
+		if (FindArchiveItemIndex(ours, archiveID) < 0 && theirIndex >= 0) {
+			cJSON_DeleteItemFromArray(theirArchives, theirIndex);
+		}
+	}
+
+	int nextID = 0;
+	for (cJSON* list : { ours, theirs }) {
+		cJSON_ArrayForEach(archiveItem, cJSON_GetObjectItem(list, "Archives")) {
+			nextID = std::max(nextID, GetArchiveItemID(archiveItem) + 1);
+		}
+	}
+	std::unordered_map<int, int> renumbered;
+	cJSON_ArrayForEach(archiveItem, cJSON_GetObjectItem(ours, "Archives")) {
+		const int archiveID = GetArchiveItemID(archiveItem);
+		const int baseIndex = FindArchiveItemIndex(base, archiveID);
+		cJSON* baseItem = (baseIndex >= 0) ? cJSON_GetArrayItem(cJSON_GetObjectItem(base, "Archives"), baseIndex) : nullptr;
+		if (baseItem && cJSON_Compare(baseItem, archiveItem, true)) {
+			continue;
+		}
+		cJSON* item = cJSON_Duplicate(archiveItem, true);
+		int theirIndex = FindArchiveItemIndex(theirs, archiveID);
+		if (!baseItem && theirIndex >= 0) {
+			printf("ArchiveID %d was also created by another process, this one becomes ArchiveID %d.\n", archiveID, nextID);
+			renumbered[archiveID] = nextID;
+			cJSON_SetNumberValue(cJSON_GetObjectItem(item, "id"), nextID++);
+			theirIndex = -1;
+		}
+		//An entry another process deleted while we updated it comes back with the files we wrote,
+		//unless its snapshot went to the trash meanwhile
+		if (baseItem && theirIndex < 0) {
+			cJSON* pathItem = cJSON_GetObjectItem(item, "Path");
+			std::error_code ec;
+			if (!cJSON_IsString(pathItem) || !fs::exists(pathItem->valuestring, ec)) {
+				printf("ArchiveID %d was deleted by another process meanwhile, this update of it is dropped.\n", archiveID);
+				cJSON_Delete(item);
+				continue;
+			}
+		}
+		if (theirIndex >= 0) {
+			cJSON_ReplaceItemInArray(theirArchives, theirIndex, item);
+		}
+		else {
+			cJSON_AddItemToArray(theirArchives, item);
+		}
+	}
+
+	cJSON* value = nullptr;
+	cJSON_ArrayForEach(value, ours) {
+		const std::string name = value->string ? value->string : "";
+		if (name.empty() || "Archives" == name || "ArchivesCount" == name) continue;
+		cJSON* baseValue = cJSON_GetObjectItem(base, name.c_str());
+		if (baseValue && cJSON_Compare(baseValue, value, true)) continue;
+		cJSON* item = cJSON_Duplicate(value, true);
+		if ("Currently in use ArchiveID" == name && cJSON_IsNumber(item) && renumbered.count(item->valueint)) {
+			cJSON_SetNumberValue(item, renumbered[item->valueint]);
+		}
+		if (cJSON_GetObjectItem(theirs, name.c_str())) {
+			cJSON_ReplaceItemInObject(theirs, name.c_str(), item);
+		}
+		else {
+			cJSON_AddItemToObject(theirs, name.c_str(), item);
+		}
+	}
+	cJSON_DeleteItemFromObject(theirs, "ArchivesCount");
+	cJSON_AddNumberToObject(theirs, "ArchivesCount", cJSON_GetArraySize(theirArchives));
+}
+
+cJSON* YgoMasterArchiveMgr::BeginListUpdate(YgoInstallContext& ctx, const bool create)
+{
+	if (0 == ctx.m_listDepth) {
+		ctx.m_listBaseText.clear();
+		{
+			YgoListLockGuard fileLock(ctx.m_YMListPath, YgoFileLock::SHARED);
+			YgoFileView view;
+			if (view.Open(ctx.m_YMListPath)) {
+				ctx.m_listBaseText.assign(view.Data(), view.Size());
+			}
+		}
+		ctx.m_listRoot = ctx.m_listBaseText.empty() ? nullptr : cJSON_ParseWithLength(ctx.m_listBaseText.data(), ctx.m_listBaseText.size());
+		if (!ctx.m_listRoot && create && !fs::exists(ctx.m_YMListPath)) {
+			ctx.m_listRoot = cJSON_CreateObject();
+			cJSON_AddItemToObject(ctx.m_listRoot, "Currently in use ArchiveID", cJSON_CreateNumber(ctx.m_currentArchiveIndex));
+			cJSON_AddItemToObject(ctx.m_listRoot, "ArchivesCount", cJSON_CreateNumber(0));
+			cJSON_AddItemToObject(ctx.m_listRoot, "Archives", cJSON_CreateArray());
+			ctx.m_listChanged = true;
+		}
+		if (!ctx.m_listRoot) {
+			return nullptr;
+		}
+	}
+	++ctx.m_listDepth;
+	return ctx.m_listRoot;
+}
+
+bool YgoMasterArchiveMgr::EndListUpdate(YgoInstallContext& ctx, const bool committed, const bool reloadTable)
+{
+	if (committed) {
+		ctx.m_listChanged = true;
+		//Later steps of the same operation already see the edited list
+		if (reloadTable) {
+			std::unique_lock<std::shared_mutex> lock(ctx.m_dataMutex);
+			LoadArchiveTable(ctx, ctx.m_listRoot);
+			ctx.m_tableAhead = true;
+		}
+	}
+	if (--ctx.m_listDepth > 0) {
+		return true;
+	}
+	bool written = true;
+	if (ctx.m_listChanged) {
+		bool merged = false;
+		{
+			//Only the read-merge-write excludes other processes, the copies of the operation ran before
+			YgoListLockGuard fileLock(ctx.m_YMListPath, YgoFileLock::EXCLUSIVE);
+			std::string diskText;
+			YgoFileView view;
+			if (view.Open(ctx.m_YMListPath)) {
+				diskText.assign(view.Data(), view.Size());
+			}
+			view.Close();
+			if (diskText != ctx.m_listBaseText) {
+				cJSON* theirs = diskText.empty() ? nullptr : cJSON_ParseWithLength(diskText.data(), diskText.size());
+				cJSON* base = ctx.m_listBaseText.empty() ? cJSON_CreateObject()
+					: cJSON_ParseWithLength(ctx.m_listBaseText.data(), ctx.m_listBaseText.size());
+				if (theirs && base) {
+					printf("ArchiveList was changed by another process meanwhile, merging the changes.\n");
+					MergeListChanges(base, ctx.m_listRoot, theirs);
+					cJSON_Delete(ctx.m_listRoot);
+					ctx.m_listRoot = theirs;
+					merged = true;
+				}
+				else {
+					printf("ArchiveList on disk cannot be parsed, it is replaced by this update.\n");
+					cJSON_Delete(theirs);
+				}
+				cJSON_Delete(base);
+			}
+			char* text = cJSON_Print(ctx.m_listRoot);
+			written = text && DurableReplaceFile(ctx.m_YMListPath, text);
+			cJSON_free(text);
+		}
+		std::unique_lock<std::shared_mutex> lock(ctx.m_dataMutex);
+		ctx.m_tableAhead = false;
+		if (written) {
+			if (merged) {
+				LoadArchiveTable(ctx, ctx.m_listRoot);
+			}
+			std::error_code ec;
+			ctx.m_listWriteTime = fs::last_write_time(ctx.m_YMListPath, ec);
+		}
+		else {
+			printf("Write ArchiveList file failed, edits of this operation are lost.\n");
+			QuerryArchiveListLocked(ctx, 0, false, true);
+		}
+	}
+	cJSON_Delete(ctx.m_listRoot);
+	ctx.m_listRoot = nullptr;
+	ctx.m_listChanged = false;
+	ctx.m_listBaseText.clear();
+	return written;
+}
+
+void YgoMasterArchiveMgr::DisplayArchiveDetail(YgoInstallContext& ctx, const int archiveID)
+{
+	//Display detailed info for a specific archiveID, if archiveID is -1 display current archive
+	std::shared_lock<std::shared_mutex> lock(ctx.m_dataMutex);
+	if (ctx.m_archives.Empty()) {
+		printf("No archives available to display.\n");
+		return;
+	}
+
+	const int displayID = (-1 == archiveID) ? ctx.m_currentArchiveIndex : archiveID;
+	YgoArchiveInfo archive;
+	if (!ctx.m_archives.Get(displayID, archive)) {
+		printf("ArchiveID %d not found.\n", displayID);
+		return;
+	}
+
+	const std::string playerJsonPath = (fs::path(archive.m_path) / sc_YgoPlayerJsonSearchPath).string();
+	const std::string settingsJsonPath = (fs::path(archive.m_path) / sc_YgoSettingsJsonSearchPath).string();
+	const bool playerJsonExists = ArchiveFileExists(archive.m_path, sc_YgoPlayerJsonSearchPath);
+	bool settingsJsonExists = ArchiveFileExists(archive.m_path, sc_YgoSettingsJsonSearchPath);
+	if (!settingsJsonExists) {
+		//Small Settings.json is kept inside ArchiveList
+		ReadInlineFiles(ctx, archive.m_id, archive.m_inlineFiles);
+		for (const auto& file : archive.m_inlineFiles) {
+			settingsJsonExists = settingsJsonExists || file.first == sc_YgoSettingsJsonSearchPath;
+		}
+	}
+	if (!playerJsonExists || !settingsJsonExists) {
+		printf("Warning: Some important files are missing in this archive.\n");
+		printf("Missing files:\n");
+		if (!playerJsonExists) {
+			printf("\t%s\n", playerJsonPath.c_str());
+		}
+		if (!settingsJsonExists) {
+			printf("\t%s\n", settingsJsonPath.c_str());
+		}
+		printf("This archive was not backed up properly or damaged !\n");
+	}
+
+	YgoArchiveSummary summary;
+	GetArchiveSummary(ctx, archive, summary);
+
+	bool unlockAllCards = false;
+	int defaultsGems = 0;
 
 	//Found the archive, display details
 	printf("*------------------ Archive Detail ------------------*\n");
 	printf("\tArchiveID: %d\n", archive.m_id);
-	if (readPlayerSuccess) {
-		printf("\tPlayer Code: %d\n", code);
-		printf("\tPlayer Gems: %d\n", gems);
+	if (summary.m_valid) {
+		printf("\tPlayer Code: %d\n", summary.m_code);
+		printf("\tPlayer Gems: %d\n", summary.m_gems);
+	}
+	else {
+		printf("\tPlayer Code: N/A (Failed to read Player.json)\n");
+		printf("\tPlayer Gems: N/A (Failed to read Player.json)\n");
+	}
+	printf("\tPlayer Name: %s\n", archive.m_name.c_str());
+	printf("\tArchive Path: %s\n", archive.m_path.c_str());
+	printf("\tStorage: %s\n", IsColdTarget(archive.m_path, sc_playersTargetName) ? "cold (compressed, restores are slower)" : "hot");
+	{
+		std::lock_guard<std::mutex> usageLock(ctx.m_usageMutex);
+		if (ctx.m_usageIndex.HasArchive(archive.m_id)) {
+			const YgoUsageIndex::Usage usage = ctx.m_usageIndex.GetUsage(archive.m_id);
+			printf("\tDisk usage: %s exclusive (freed by deleting it), %s shared with other archives\n",
+				FormatByteSize(usage.m_exclusiveBytes).c_str(), FormatByteSize(usage.m_sharedBytes).c_str());
+		}
+	}
+	printf("\tLast update time: %s\n", archive.m_time.c_str());
+	printf("\tDescription: %s\n", archive.m_desc.c_str());
+	printf("*----------------------------------------------------*\n");
+	return;
+}
+
+bool YgoMasterArchiveMgr::GetArchiveSummary(YgoInstallContext& ctx, const YgoArchiveInfo& archive, YgoArchiveSummary& result)
+{
+	{
+		std::lock_guard<std::mutex> lock(ctx.m_summaryMutex);
+		auto it = ctx.m_summaries.find(archive.m_id);
+		if (it != ctx.m_summaries.end()) {
+			result = it->second;
+			return result.m_valid;
+		}
+	}
+
+	//Read Player.json, standalone or packed
+	YgoArchiveSummary summary;
+	YgoFileView jsonContent;
+	if (ReadArchiveFile(archive.m_path, sc_YgoPlayerJsonSearchPath, jsonContent)) {
+		cJSON* root = cJSON_ParseWithLength(jsonContent.Data(), jsonContent.Size());
+		if (root) {
+			cJSON* codeItem = cJSON_GetObjectItem(root, "Code");
+			if (codeItem && cJSON_IsNumber(codeItem)) {
+				summary.m_code = static_cast<int>(cJSON_GetNumberValue(codeItem));
+			}
+			cJSON* gemsItem = cJSON_GetObjectItem(root, "Gems");
+			if (gemsItem && cJSON_IsNumber(gemsItem)) {
+				summary.m_gems = static_cast<int>(cJSON_GetNumberValue(gemsItem));
+			}
+			cJSON_Delete(root);
+			summary.m_valid = true;
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(ctx.m_summaryMutex);
+	ctx.m_summaries[archive.m_id] = summary;
+	result = summary;
+	return result.m_valid;
+}
+
+void YgoMasterArchiveMgr::InvalidateSummary(YgoInstallContext& ctx, const int archiveID)
+{
+	std::lock_guard<std::mutex> lock(ctx.m_summaryMutex);
+	if (-1 == archiveID) {
+		ctx.m_summaries.clear();
+	}
+	else {
+		ctx.m_summaries.erase(archiveID);
+	}
+}
+
+void YgoMasterArchiveMgr::SearchArchives(YgoInstallContext& ctx, const std::string& keyword)
+{
+	//Display archives whose name, description or time contains keyword
+	std::shared_lock<std::shared_mutex> lock(ctx.m_dataMutex);
+	int found = 0;
+	printf("*------------------ Search Result ------------------*\n");
+	std::vector<size_t> rows;
+	ctx.m_archives.Filter(keyword, rows);
+	for (size_t row : rows) {
+		YgoArchiveInfo info;
+		ctx.m_archives.GetRow(row, info);
+		printf("\tArchiveID: %d,\n \tName: %s,\n \tLast update time: %s\n \tDescription: %s\n",
+			info.m_id,
+			info.m_name.c_str(),
+			info.m_time.c_str(),
+			info.m_desc.c_str());
+		printf("--------------------------------------------------\n");
+		++found;
+	}
+	printf("Found %d archives matching \"%s\".\n", found, keyword.c_str());
+	printf("*---------------------------------------------------*\n");
+}
+
+void YgoMasterArchiveMgr::EnsureCardIndex(YgoInstallContext& ctx)
+{
+	bool changed = false;
+	if (!ctx.m_cardIndex.IsLoaded()) {
+		ctx.m_cardIndex.Load((fs::path(ctx.m_archivesPath) / sc_cardIndexFileName).string());
+	}
+	//Drop archives deleted since the index was written
+	std::vector<int> stale;
+	for (int archiveID : ctx.m_cardIndex.Archives()) {
+		if (!ctx.m_archives.Contains(archiveID)) {
+			stale.push_back(archiveID);
+		}
+	}
+	for (int archiveID : stale) {
+		ctx.m_cardIndex.RemoveArchive(archiveID);
+		changed = true;
+	}
+	//Index new archives, archives made before the side file existed are read once from Player.json
+	for (size_t row = 0; row < ctx.m_archives.Size(); ++row) {
+		const int archiveID = ctx.m_archives.Ids()[row];
+		if (ctx.m_cardIndex.HasArchive(archiveID)) {
+			continue;
+		}
+		const std::string archivePath = ctx.m_archives.PathAt(row);
+		YgoCardInventory inventory;
+		if (!ReadCardInventory(archivePath, inventory)) {
+			if (!ExtractCardInventory(archivePath, sc_YgoPlayerJsonSearchPath, sc_YgoDecksSearchPath, inventory)) {
+				continue;
+			}
+			WriteCardInventory(archivePath, inventory);
+		}
+		ctx.m_cardIndex.AddArchive(archiveID, inventory);
+		changed = true;
+	}
+	if (changed) {
+		ctx.m_cardIndex.Save();
+	}
+}
+
+void YgoMasterArchiveMgr::UpdateCardIndex(YgoInstallContext& ctx, const int archiveID, const std::string& archivePath)
+{
+	std::shared_lock<std::shared_mutex> lock(ctx.m_dataMutex);
+	std::lock_guard<std::mutex> indexLock(ctx.m_cardIndexMutex);
+	if (!ctx.m_cardIndex.IsLoaded()) {
+		//Loading syncs every archive, including archiveID
+		EnsureCardIndex(ctx);
+		return;
+	}
+	EnsureCardIndex(ctx);
+	YgoCardInventory inventory;
+	if (!archivePath.empty() && ReadCardInventory(archivePath, inventory)) {
+		ctx.m_cardIndex.AddArchive(archiveID, inventory);
+		ctx.m_cardIndex.Save();
+	}
+}
+
+void YgoMasterArchiveMgr::EnsureUsageIndex(YgoInstallContext& ctx)
+{
+	bool changed = false;
+	if (!ctx.m_usageIndex.IsLoaded()) {
+		ctx.m_usageIndex.Load((fs::path(ctx.m_archivesPath) / sc_usageIndexFileName).string());
+	}
+	//Drop archives deleted since the index was written
+	for (const int archiveID : ctx.m_usageIndex.ArchiveIDs()) {
+		if (!ctx.m_archives.Contains(archiveID)) {
+			ctx.m_usageIndex.RemoveArchive(archiveID);
+			changed = true;
+		}
+	}
+	//Only archives the index has never seen are walked
+	for (size_t row = 0; row < ctx.m_archives.Size(); ++row) {
+		const int archiveID = ctx.m_archives.Ids()[row];
+		if (ctx.m_usageIndex.HasArchive(archiveID)) {
+			continue;
+		}
+		YgoArchiveFootprint footprint;
+		if (ScanArchiveFootprint(ctx.m_archives.PathAt(row), footprint)) {
+			ctx.m_usageIndex.AddArchive(archiveID, footprint);
+			changed = true;
+		}
+	}
+	if (changed) {
+		ctx.m_usageIndex.Save();
+	}
+}
+
+void YgoMasterArchiveMgr::UpdateArchiveUsage(YgoInstallContext& ctx, const std::vector<int>& archiveIDs)
+{
+	std::shared_lock<std::shared_mutex> lock(ctx.m_dataMutex);
+	std::lock_guard<std::mutex> usageLock(ctx.m_usageMutex);
+	if (!ctx.m_usageIndex.IsLoaded()) {
+		//Loading scans every archive, the background thread does it
+		return;
+	}
+	for (const int archiveID : archiveIDs) {
+		const size_t row = ctx.m_archives.Find(archiveID);
+		YgoArchiveFootprint footprint;
+		if (YgoArchiveTable::npos != row && ScanArchiveFootprint(ctx.m_archives.PathAt(row), footprint)) {
+			ctx.m_usageIndex.AddArchive(archiveID, footprint);
+		}
+		else {
+			ctx.m_usageIndex.RemoveArchive(archiveID);
+		}
+	}
+	ctx.m_usageIndex.Save();
+}
+
+void YgoMasterArchiveMgr::SearchCard(YgoInstallContext& ctx, const uint32_t cardId, const uint16_t minCount)
+{
+	std::shared_lock<std::shared_mutex> lock(ctx.m_dataMutex);
+	std::lock_guard<std::mutex> indexLock(ctx.m_cardIndexMutex);
+	EnsureCardIndex(ctx);
+	std::vector<YgoCardIndex::Posting> postings;
+	ctx.m_cardIndex.FindCard(cardId, minCount, postings);
+	printf("*------------------ Card %u ------------------*\n", cardId);
+	for (const auto& posting : postings) {
+		const size_t row = ctx.m_archives.Find(posting.m_archiveID);
+		if (YgoArchiveTable::npos == row) continue;
+		printf("\tArchiveID: %d, Count: %u, Name: %s, Last update time: %s\n",
+			posting.m_archiveID,
+			static_cast<unsigned>(posting.m_count),
+			ctx.m_archives.NameAt(row).c_str(),
+			ctx.m_archives.TimeAt(row).c_str());
+	}
+	printf("Found %d archives owning at least %u copies of card %u.\n",
+		static_cast<int>(postings.size()), static_cast<unsigned>(minCount), cardId);
+	printf("*---------------------------------------------*\n");
+}
+
+void YgoMasterArchiveMgr::DisplayDeckHistory(YgoInstallContext& ctx, const std::string& deckName)
+{
+	std::shared_lock<std::shared_mutex> lock(ctx.m_dataMutex);
+	std::lock_guard<std::mutex> indexLock(ctx.m_cardIndexMutex);
+	EnsureCardIndex(ctx);
+	std::vector<int> containing;
+	ctx.m_cardIndex.FindDeck(deckName, containing);
+	if (containing.empty()) {
+		printf("No archive contains deck \"%s\".\n", deckName.c_str());
+		return;
+	}
+
+	//Walk archives in backup time order
+	const YgoArchiveTable& table = ctx.m_archives;
+	std::vector<size_t> timeline;
+	for (size_t row = 0; row < table.Size(); ++row) {
+		if (ctx.m_cardIndex.HasArchive(table.Ids()[row])) {
+			timeline.push_back(row);
+		}
+	}
+	std::sort(timeline.begin(), timeline.end(), [&table](const size_t a, const size_t b) {
+		return (table.TimeKeyAt(a) != table.TimeKeyAt(b)) ? table.TimeKeyAt(a) < table.TimeKeyAt(b) : a < b;
+	});
+	size_t firstSeen = YgoArchiveTable::npos;
+	size_t lastSeen = YgoArchiveTable::npos;
+	size_t lostIn = YgoArchiveTable::npos;
+	for (size_t row : timeline) {
+		if (std::binary_search(containing.begin(), containing.end(), table.Ids()[row])) {
+			firstSeen = (YgoArchiveTable::npos != firstSeen) ? firstSeen : row;
+			lastSeen = row;
+			lostIn = YgoArchiveTable::npos;
+		}
+		else if (YgoArchiveTable::npos != lastSeen && YgoArchiveTable::npos == lostIn) {
+			lostIn = row;
+		}
+	}
+	printf("*------------------ Deck \"%s\" ------------------*\n", deckName.c_str());
+	printf("\tIn %d archives.\n", static_cast<int>(containing.size()));
+	if (YgoArchiveTable::npos != firstSeen) {
+		printf("\tFirst seen: ArchiveID %d (%s)\n", table.Ids()[firstSeen], table.TimeAt(firstSeen).c_str());
+		printf("\tLast seen: ArchiveID %d (%s)\n", table.Ids()[lastSeen], table.TimeAt(lastSeen).c_str());
+	}
+	if (YgoArchiveTable::npos != lostIn) {
+		printf("\tMissing since: ArchiveID %d (%s)\n", table.Ids()[lostIn], table.TimeAt(lostIn).c_str());
+	}
+	else {
+		printf("\tStill present in the latest archive.\n");
+	}
+	printf("*-------------------------------------------------*\n");
+}
+
+bool YgoMasterArchiveMgr::SwitchArchive(YgoInstallContext& ctx, const int archiveID)
+{
+	std::lock_guard<std::recursive_mutex> writeLock(ctx.m_writeMutex);
+	YgoArchiveInfo archive;
+	if (!ctx.m_archives.Get(archiveID, archive)) {
+		printf("ArchiveID %d not found.\n", archiveID);
+		return false;
+	}
+	ListUpdate update(*this, ctx);
+	if (!update.Root()) {
+		printf("Parse ArchiveList file failed for switch.\n");
+		return false;
+	}
+	printf("Switching to ArchiveID %d...\n", archiveID);
+	std::vector<std::pair<std::string, std::string>> inlineFiles;
+	ReadInlineFiles(ctx, archiveID, inlineFiles, update.Root());
+	YgoTargetContext tc;
+	tc.m_dataPath = ctx.m_YMDataPath;
+	tc.m_archivePath = archive.m_path;
+	tc.m_inlineFiles = &inlineFiles;
+	const std::unique_ptr<YgoIoThrottle> throttle = CreateIoThrottle(EIoOperation::RESTORE);
+	tc.m_throttle = throttle.get();
+	//Linkable targets swap a symlink, the others are small enough to restore
+	const bool switched = AllBackupTargets([&](auto target) {
+		using Target = decltype(target);
+		if constexpr (Target::Linkable) {
+			if (LinkArchiveSlot(ctx, archive, Target::Name, tc.m_throttle)) {
+				return true;
+			}
+			printf("Cannot link %s, restoring it instead.\n", Target::Name);
+		}
+		return Target::Restore(tc);
+	});
+	if (!switched) {
+		return false;
+	}
+	cJSON* currentID = cJSON_GetObjectItem(update.Root(), "Currently in use ArchiveID");
+	if (!currentID || !cJSON_IsNumber(currentID)) {
+		printf("ArchiveList file format error: Currently in use ArchiveID is not a number..\n");
+		return false;
+	}
+	cJSON_SetNumberValue(currentID, archiveID);
+	if (!update.Commit()) {
+		printf("Write ArchiveList file failed for switch.\n");
+		return false;
+	}
+	//A target restored instead of linked went into a working copy of another archive
+	FollowCurrentSlot(ctx);
+	return true;
+}
+
+bool YgoMasterArchiveMgr::VerifyArchive(YgoInstallContext& ctx, const int archiveID, YgoVerifyResult& result)
+{
+	result = YgoVerifyResult();
+	std::shared_lock<std::shared_mutex> lock(ctx.m_dataMutex);
+	const int targetID = (-1 == archiveID) ? ctx.m_currentArchiveIndex : archiveID;
+	const size_t row = ctx.m_archives.Find(targetID);
+	if (YgoArchiveTable::npos == row) {
+		printf("ArchiveID %d not found.\n", targetID);
+		return false;
+	}
+	const std::string archivePath = ctx.m_archives.PathAt(row);
+	const bool compareData = (targetID == ctx.m_currentArchiveIndex);
+	printf("Verifying ArchiveID %d at %s...\n", targetID, archivePath.c_str());
+
+	std::vector<std::pair<std::string, std::string>> inlineFiles;
+	ReadInlineFiles(ctx, targetID, inlineFiles);
+	YgoTargetContext tc;
+	tc.m_dataPath = ctx.m_YMDataPath;
+	tc.m_archivePath = archivePath;
+	tc.m_inlineFiles = &inlineFiles;
+	tc.m_compareData = compareData;
+	ForEachBackupTarget([&](auto target) { decltype(target)::Verify(tc, result); });
+
+	YgoFileView jsonContent;
+	cJSON* root = ReadArchiveFile(archivePath, sc_YgoPlayerJsonSearchPath, jsonContent)
+		? cJSON_ParseWithLength(jsonContent.Data(), jsonContent.Size()) : nullptr;
+	if (!root) {
+		printf("\tPlayer.json cannot be read or parsed.\n");
+		++result.m_problems;
+	}
+	cJSON_Delete(root);
+
+	printf("ArchiveID %d: %llu files, %llu bytes, %d problems", targetID,
+		static_cast<unsigned long long>(result.m_files), static_cast<unsigned long long>(result.m_bytes), result.m_problems);
+	if (compareData) {
+		printf(", %d files differ from Data", result.m_changed);
+	}
+	printf(".\n");
+	return 0 == result.m_problems;
+}
+
+bool YgoMasterArchiveMgr::LoadDiffSide(YgoInstallContext& ctx, const int archiveID, YgoJsonTree& player, YgoJsonTree& settings)
+{
+	std::string settingsText;
+	bool hasSettings = false;
+	if (DIFF_DATA_ID == archiveID) {
+		//Data changes all the time, so its tree is built from the files
+		if (!BuildPlayerTree(ctx.m_YMDataPath, sc_YgoPlayerJsonSearchPath, sc_YgoDecksSearchPath, player)) {
+			printf("Player.json of Data directory %s cannot be read.\n", ctx.m_YMDataPath.c_str());
+			return false;
+		}
+		YgoFileView view;
+		if (view.Open(fs::path(ctx.m_YMDataPath) / sc_YgoSettingsJsonSearchPath)) {
+			settingsText.assign(view.Data(), view.Size());
+			hasSettings = true;
+		}
+	}
+	else {
+		YgoArchiveInfo archive;
+		if (!ctx.m_archives.Get(archiveID, archive)) {
+			printf("ArchiveID %d not found.\n", archiveID);
+			return false;
+		}
+		if (!LoadPlayerTree(archive.m_path, sc_YgoPlayerJsonSearchPath, sc_YgoDecksSearchPath, player)) {
+			printf("Player.json of ArchiveID %d cannot be read.\n", archiveID);
+			return false;
+		}
+		std::vector<std::pair<std::string, std::string>> inlineFiles;
+		ReadInlineFiles(ctx, archiveID, inlineFiles);
+		for (const auto& file : inlineFiles) {
+			if (file.first == sc_YgoSettingsJsonSearchPath) {
+				settingsText = file.second;
+				hasSettings = true;
+			}
+		}
+		YgoFileView view;
+		if (!hasSettings && ReadArchiveFile(archive.m_path, sc_YgoSettingsJsonSearchPath, view)) {
+			settingsText.assign(view.Data(), view.Size());
+			hasSettings = true;
+		}
+	}
+	//Settings.json is small, its tree is always built
+	cJSON* root = hasSettings ? cJSON_ParseWithLength(settingsText.data(), settingsText.size()) : nullptr;
+	settings.Build(root);
+	cJSON_Delete(root);
+	return true;
+}
+
+bool YgoMasterArchiveMgr::DiffArchives(YgoInstallContext& ctx, const int beforeID, const int afterID, YgoArchiveDiff& result)
+{
+	result = YgoArchiveDiff();
+	YgoJsonTree beforePlayer, beforeSettings, afterPlayer, afterSettings;
+	{
+		std::shared_lock<std::shared_mutex> lock(ctx.m_dataMutex);
+		if (!LoadDiffSide(ctx, beforeID, beforePlayer, beforeSettings) || !LoadDiffSide(ctx, afterID, afterPlayer, afterSettings)) {
+			return false;
+		}
+	}
+	uint64_t visited = 0;
+	YgoJsonTree::Diff(beforePlayer, afterPlayer, result.m_changes, &visited);
+	result.m_visitedNodes += visited;
+	const size_t playerChanges = result.m_changes.size();
+	YgoJsonTree::Diff(beforeSettings, afterSettings, result.m_changes, &visited);
+	result.m_visitedNodes += visited;
+	result.m_totalNodes = beforePlayer.NodeCount() + afterPlayer.NodeCount() + beforeSettings.NodeCount() + afterSettings.NodeCount();
+	for (size_t i = playerChanges; i < result.m_changes.size(); ++i) {
+		result.m_changes[i].m_path.insert(result.m_changes[i].m_path.begin(), "Settings");
+	}
+	//Decks are shown by the name players gave them
+	for (const auto& change : result.m_changes) {
+		if (change.m_path.size() < 2 || change.m_path[0] != "Decks" || result.m_deckNames.count(change.m_path[1])) {
+			continue;
+		}
+		std::string name;
+		if (!afterPlayer.FindText({ "Decks", change.m_path[1], "name" }, name)) {
+			beforePlayer.FindText({ "Decks", change.m_path[1], "name" }, name);
+		}
+		//FindText gives JSON text, the name is a string
+		if (name.size() >= 2 && '"' == name.front() && '"' == name.back()) {
+			name = name.substr(1, name.size() - 2);
+		}
+		result.m_deckNames[change.m_path[1]] = name;
+	}
+	return true;
+}
+
+// "path: before -> after" of a change, path from its element first
+static std::string FormatJsonChange(const YgoJsonChange& change, const size_t first)
+{
+	std::string text;
+	for (size_t i = first; i < change.m_path.size(); ++i) {
+		text += (i > first ? "/" : "") + change.m_path[i];
+	}
+	switch (change.m_kind)
+	{
+	case YgoJsonChange::ADDED:
+		return text + (text.empty() ? "" : " ") + "added: " + change.m_after;
+	case YgoJsonChange::REMOVED:
+		return text + (text.empty() ? "" : " ") + "removed: " + change.m_before;
+	default:
+		return text + ": " + change.m_before + " -> " + change.m_after;
+	}
+}
+
+void YgoMasterArchiveMgr::DisplayArchiveDiff(YgoInstallContext& ctx, const int beforeID, const int afterID)
+{
+	YgoArchiveDiff diff;
+	if (!DiffArchives(ctx, beforeID, afterID, diff)) {
+		printf("Compare failed.\n");
+		return;
+	}
+	auto label = [](const int archiveID) {
+		return (DIFF_DATA_ID == archiveID) ? std::string("Data") : "ArchiveID " + std::to_string(archiveID);
+	};
+	printf("*------------------ %s -> %s ------------------*\n", label(beforeID).c_str(), label(afterID).c_str());
+	if (diff.m_changes.empty()) {
+		printf("Player.json, decks and Settings.json are identical.\n");
+	}
+
+	std::vector<const YgoJsonChange*> gems, cards, player, settings;
+	std::vector<std::string> deckFiles;
+	std::unordered_map<std::string, std::vector<const YgoJsonChange*>> decks;
+	for (const auto& change : diff.m_changes) {
+		const auto& path = change.m_path;
+		if (path.size() >= 2 && "Decks" == path[0]) {
+			if (!decks.count(path[1])) {
+				deckFiles.push_back(path[1]);
+			}
+			decks[path[1]].push_back(&change);
+		}
+		else if (path.size() == 2 && "Player" == path[0] && "Gems" == path[1]) {
+			gems.push_back(&change);
+		}
+		else if (path.size() >= 3 && "Player" == path[0] && "Cards" == path[1]) {
+			cards.push_back(&change);
+		}
+		else if (!path.empty() && "Settings" == path[0]) {
+			settings.push_back(&change);
+		}
+		else {
+			player.push_back(&change);
+		}
+	}
+
+	for (const auto* change : gems) {
+		printf("Gems: %s -> %s\n", change->m_before.empty() ? "none" : change->m_before.c_str(),
+			change->m_after.empty() ? "none" : change->m_after.c_str());
+	}
+	auto listChanges = [](const std::vector<const YgoJsonChange*>& changes, const size_t first, const char* prefix) {
+		for (size_t i = 0; i < changes.size() && i < DIFF_MAX_LISTED_CHANGES; ++i) {
+			printf("\t%s%s\n", prefix, FormatJsonChange(*changes[i], first).c_str());
+		}
+		if (changes.size() > DIFF_MAX_LISTED_CHANGES) {
+			printf("\t... %zu more\n", changes.size() - DIFF_MAX_LISTED_CHANGES);
+		}
+	};
+	if (!cards.empty()) {
+		int added = 0, removed = 0;
+		for (const auto* change : cards) {
+			//A card entry itself came or went, changes inside an entry are count changes
+			if (change->m_path.size() == 3) {
+				added += (YgoJsonChange::ADDED == change->m_kind) ? 1 : 0;
+				removed += (YgoJsonChange::REMOVED == change->m_kind) ? 1 : 0;
+			}
+		}
+		printf("Cards: %d added, %d removed, %d changed\n", added, removed, static_cast<int>(cards.size()) - added - removed);
+		listChanges(cards, 2, "Card ");
+	}
+	if (!deckFiles.empty()) {
+		printf("Decks: %zu changed\n", deckFiles.size());
+		for (size_t i = 0; i < deckFiles.size() && i < DIFF_MAX_LISTED_CHANGES; ++i) {
+			const auto& changes = decks[deckFiles[i]];
+			const std::string& name = diff.m_deckNames[deckFiles[i]];
+			const char* what = (changes.size() == 1 && changes[0]->m_path.size() == 2)
+				? ((YgoJsonChange::ADDED == changes[0]->m_kind) ? "added" : "removed") : "changed";
+			printf("\tDeck \"%s\" (%s) %s", name.empty() ? deckFiles[i].c_str() : name.c_str(), deckFiles[i].c_str(), what);
+			if (0 == strcmp(what, "changed")) {
+				printf(", %zu fields", changes.size());
+			}
+			printf("\n");
+		}
+		if (deckFiles.size() > DIFF_MAX_LISTED_CHANGES) {
+			printf("\t... %zu more\n", deckFiles.size() - DIFF_MAX_LISTED_CHANGES);
+		}
+	}
+	if (!player.empty()) {
+		printf("Other Player.json fields: %zu changed\n", player.size());
+		listChanges(player, 1, "");
+	}
+	if (!settings.empty()) {
+		printf("Settings.json: %zu changed\n", settings.size());
+		listChanges(settings, 1, "");
+	}
+	printf("Compared %llu of %llu tree nodes.\n", static_cast<unsigned long long>(diff.m_visitedNodes),
+		static_cast<unsigned long long>(diff.m_totalNodes));
+	printf("*--------------------------------------------------*\n");
+}
+
+void YgoMasterArchiveMgr::BuildTimeline(YgoInstallContext& ctx, std::vector<YgoTimelinePoint>& result, size_t* readCount)
+{
+	std::lock_guard<std::mutex> timelineLock(ctx.m_timelineMutex);
+	result.clear();
+	std::vector<std::string> paths;
+	std::unordered_set<int> archiveIDs;
+	{
+		std::shared_lock<std::shared_mutex> lock(ctx.m_dataMutex);
+		result.resize(ctx.m_archives.Size());
+		paths.reserve(ctx.m_archives.Size());
+		YgoArchiveInfo info;
+		for (size_t row = 0; row < ctx.m_archives.Size(); ++row) {
+			ctx.m_archives.GetRow(row, info);
+			result[row].m_archiveID = info.m_id;
+			result[row].m_time = info.m_time;
+			result[row].m_name = info.m_name;
+			paths.push_back(info.m_path);
+			archiveIDs.insert(info.m_id);
+		}
+	}
+
+	YgoTimelineCache cache;
+	cache.Load((fs::path(ctx.m_archivesPath) / sc_timelineCacheFileName).string());
+	//Checking an archive against the cache is two stats, only archives with new side files are read
+	std::vector<uint64_t> keys(result.size(), 0);
+	std::vector<char> read(result.size(), 0);
+	ParallelFor(result.size(), [&](size_t i) {
+		keys[i] = GetTimelineKey(paths[i]);
+		if (cache.Find(result[i].m_archiveID, keys[i], result[i])) {
+			return true;
+		}
+		ReadTimelineMetrics(paths[i], sc_YgoPlayerJsonSearchPath, sc_YgoDecksSearchPath, result[i]);
+		//Reading writes the side files of older archives, so the key is taken again
+		keys[i] = GetTimelineKey(paths[i]);
+		read[i] = 1;
+		return true;
+	});
+
+	size_t readArchives = 0;
+	for (size_t i = 0; i < result.size(); ++i) {
+		if (read[i]) {
+			cache.Store(keys[i], result[i]);
+			++readArchives;
+		}
+	}
+	cache.Retain(archiveIDs);
+	cache.Save();
+	std::sort(result.begin(), result.end(), [](const YgoTimelinePoint& a, const YgoTimelinePoint& b) {
+		return (a.m_time != b.m_time) ? a.m_time < b.m_time : a.m_archiveID < b.m_archiveID;
+	});
+	if (readCount) {
+		*readCount = readArchives;
+	}
+}
+
+void YgoMasterArchiveMgr::DisplayTimeline(YgoInstallContext& ctx, const std::string& exportPath)
+{
+	const auto start = std::chrono::steady_clock::now();
+	std::vector<YgoTimelinePoint> points;
+	size_t readCount = 0;
+	BuildTimeline(ctx, points, &readCount);
+	const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+	printf("*------------------ Timeline ------------------*\n");
+	printf("%zu archives, %zu read and %zu from cache in %lld ms.\n", points.size(), readCount, points.size() - readCount,
+		static_cast<long long>(elapsed));
+	const size_t first = (points.size() > TIMELINE_DISPLAY_ROWS) ? points.size() - TIMELINE_DISPLAY_ROWS : 0;
+	if (first > 0) {
+		printf("...\n");
+	}
+	for (size_t i = first; i < points.size(); ++i) {
+		const auto& point = points[i];
+		if (!point.m_valid) {
+			printf("\t%s ArchiveID %d: Player.json cannot be read\n", point.m_time.c_str(), point.m_archiveID);
+			continue;
+		}
+		printf("\t%s ArchiveID %d: Gems %lld, Cards %u (%llu copies), Decks %u\n", point.m_time.c_str(), point.m_archiveID,
+			static_cast<long long>(point.m_gems), point.m_distinctCards, static_cast<unsigned long long>(point.m_totalCards), point.m_decks);
+	}
+	printf("*--------------------------------------------------*\n");
+
+	if (exportPath.empty() || "-" == exportPath) {
+		return;
+	}
+	const std::string extension = fs::path(exportPath).extension().string();
+	if (extension != ".csv" && extension != ".json") {
+		printf("Export file must end with .csv or .json.\n");
+		return;
+	}
+	const std::string content = (".csv" == extension) ? FormatTimelineCsv(points) : FormatTimelineJson(points);
+	if (!ReplaceFileContent(exportPath, content)) {
+		printf("Write %s failed.\n", exportPath.c_str());
+		return;
+	}
+	printf("Timeline written to %s.\n", exportPath.c_str());
+}
+
+bool YgoMasterArchiveMgr::ExportArchives(YgoInstallContext& ctx, const std::vector<int>& archiveIDs, const std::string& bundlePath)
+{
+	//Archives must not be frozen, thawed or deleted while they are read
+	std::lock_guard<std::recursive_mutex> writeLock(ctx.m_writeMutex);
+	std::vector<YgoBundleSource> sources;
+	cJSON* root = nullptr;
+	{
+		YgoListLockGuard fileLock(ctx.m_YMListPath, YgoFileLock::SHARED);
+		root = ParseJsonFile(ctx.m_YMListPath);
+	}
+	for (int archiveID : archiveIDs) {
+		const int index = FindArchiveItemIndex(root, archiveID);
+		if (-1 == index) {
+			printf("ArchiveID %d not found, skipping.\n", archiveID);
+			continue;
+		}
+		//Path only means something on this machine, import gives the archive a new one
+		cJSON* entry = cJSON_Duplicate(cJSON_GetArrayItem(cJSON_GetObjectItem(root, "Archives"), index), true);
+		YgoBundleSource source;
+		cJSON* pathItem = cJSON_GetObjectItem(entry, "Path");
+		source.m_path = cJSON_IsString(pathItem) ? pathItem->valuestring : "";
+		cJSON_DeleteItemFromObject(entry, "Path");
+		char* text = cJSON_PrintUnformatted(entry);
+		source.m_entryJson = text ? text : "{}";
+		cJSON_free(text);
+		cJSON_Delete(entry);
+		sources.push_back(std::move(source));
+	}
+	cJSON_Delete(root);
+	if (sources.empty()) {
+		printf("No archive selected.\n");
+		return false;
+	}
+
+	printf("Exporting %zu archives to %s...\n", sources.size(), bundlePath.c_str());
+	const auto start = std::chrono::steady_clock::now();
+	YgoBundleStats stats;
+	if (!ExportBundle(bundlePath, sources, &stats)) {
+		printf("Export failed.\n");
+		return false;
+	}
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	printf("Exported %llu archives, %llu files, %s into %s in %.1f s (%s/s).\n",
+		static_cast<unsigned long long>(stats.m_archives), static_cast<unsigned long long>(stats.m_files),
+		FormatByteSize(stats.m_bytes).c_str(), FormatByteSize(stats.m_storedBytes).c_str(), seconds,
+		FormatByteSize(static_cast<uint64_t>(stats.m_bytes / std::max(seconds, 0.001))).c_str());
+	return true;
+}
+
+bool YgoMasterArchiveMgr::ImportArchives(YgoInstallContext& ctx, const std::string& bundlePath, std::vector<int>* importedIDs)
+{
+	std::lock_guard<std::recursive_mutex> writeLock(ctx.m_writeMutex);
+	//Entries of the bundle and the snapshot directories made for them, listed once the bundle was read completely
+	std::vector<std::pair<cJSON*, std::string>> imported;
+	auto beginArchive = [&](const std::string& entryJson) -> std::string {
+		cJSON* entry = cJSON_Parse(entryJson.c_str());
+		YgoArchiveInfo info;
+		if (!cJSON_IsObject(entry) || !CreateSnapshotDir(ctx, info)) {
+			printf("Bundle holds a damaged archive entry.\n");
+			cJSON_Delete(entry);
+			return "";
+		}
+		imported.emplace_back(entry, info.m_path);
+		return info.m_path;
+	};
+	printf("Importing %s...\n", bundlePath.c_str());
+	const auto start = std::chrono::steady_clock::now();
+	YgoBundleStats stats;
+	bool ok = ImportBundle(bundlePath, beginArchive, &stats);
+
+	std::vector<std::pair<int, std::string>> added;
+	if (ok) {
+		ListUpdate update(*this, ctx);
+		cJSON* archivesArray = cJSON_GetObjectItem(update.Root(), "Archives");
+		ok = cJSON_IsArray(archivesArray);
+		int nextID = 0;
+		cJSON* archiveItem = nullptr;
+		cJSON_ArrayForEach(archiveItem, archivesArray) {
+			nextID = std::max(nextID, GetArchiveItemID(archiveItem) + 1);
+		}
+		for (auto& item : imported) {
+			if (!ok) break;
+			//Same members as a backup, the time is kept so the history stays in order
+			YgoArchiveInfo info;
+			ReadArchiveItem(item.first, info);
+			cJSON* newArchive = cJSON_CreateObject();
+			cJSON_AddItemToObject(newArchive, "id", cJSON_CreateNumber(nextID));
+			cJSON_AddItemToObject(newArchive, "Name", cJSON_CreateString(info.m_name.c_str()));
+			cJSON_AddItemToObject(newArchive, "Path", cJSON_CreateString(item.second.c_str()));
+			cJSON_AddItemToObject(newArchive, "Description", cJSON_CreateString(info.m_desc.c_str()));
+			cJSON_AddItemToObject(newArchive, "LastBackupTime", cJSON_CreateString(info.m_time.c_str()));
+			cJSON* inlineItem = cJSON_DetachItemFromObject(item.first, "InlineFiles");
+			if (inlineItem) {
+				cJSON_AddItemToObject(newArchive, "InlineFiles", inlineItem);
+			}
+			cJSON_AddItemToArray(archivesArray, newArchive);
+			added.emplace_back(nextID++, item.second);
+		}
+		if (ok) {
+			cJSON* archivesCount = cJSON_GetObjectItem(update.Root(), "ArchivesCount");
+			if (archivesCount && cJSON_IsNumber(archivesCount)) {
+				cJSON_SetNumberValue(archivesCount, cJSON_GetArraySize(archivesArray));
+			}
+			ok = update.Commit();
+		}
+	}
+	for (auto& item : imported) {
+		cJSON_Delete(item.first);
+		if (!ok) {
+			RemoveTree(item.second);
+		}
+	}
+	if (!ok) {
+		printf("Import of %s failed, no archive was added.\n", bundlePath.c_str());
+		return false;
+	}
+
+	//Ids another process took meanwhile were renumbered by the commit, the snapshot paths are still ours
+	{
+		std::unordered_map<std::string, int> idOfPath;
+		std::shared_lock<std::shared_mutex> lock(ctx.m_dataMutex);
+		for (size_t row = 0; row < ctx.m_archives.Size(); ++row) {
+			idOfPath.emplace(ctx.m_archives.PathAt(row), ctx.m_archives.Ids()[row]);
+		}
+		for (auto& item : added) {
+			auto found = idOfPath.find(item.second);
+			item.first = (found != idOfPath.end()) ? found->second : -1;
+		}
+	}
+	std::vector<int> ids;
+	for (const auto& item : added) {
+		if (item.first < 0) continue;
+		//A working copy left by an earlier archive of this id is not this one
+		DropArchiveSlot(ctx, item.first);
+		UpdateCardIndex(ctx, item.first, item.second);
+		ids.push_back(item.first);
+	}
+	std::sort(ids.begin(), ids.end());
+	UpdateArchiveUsage(ctx, ids);
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	printf("Imported %llu archives, %llu files, %s in %.1f s.\n", static_cast<unsigned long long>(stats.m_archives),
+		static_cast<unsigned long long>(stats.m_files), FormatByteSize(stats.m_bytes).c_str(), seconds);
+	if (!ids.empty() && ids.back() - ids.front() + 1 == static_cast<int>(ids.size())) {
+		printf("New ArchiveIDs %d to %d.\n", ids.front(), ids.back());
+	}
+	else if (!ids.empty()) {
+		std::string idList;
+		for (const int id : ids) {
+			idList += (idList.empty() ? "" : ",") + std::to_string(id);
+		}
+		printf("New ArchiveIDs %s.\n", idList.c_str());
 	}
-	else {
-		printf("\tPlayer Code: N/A (Failed to read Player.json)\n");
-		printf("\tPlayer Gems: N/A (Failed to read Player.json)\n");
+	if (importedIDs) {
+		*importedIDs = std::move(ids);
 	}
-	printf("\tPlayer Name: %s\n", archive.m_name.c_str());
-	printf("\tArchive Path: %s\n", archive.m_path.c_str());
-	printf("\tLast update time: %s\n", archive.m_time.c_str());
-	printf("\tDescription: %s\n", archive.m_desc.c_str());
-	printf("*----------------------------------------------------*\n");
-	return;
+	return true;
+}
+
+void YgoMasterArchiveMgr::SelectArchives(YgoInstallContext& ctx, const std::string& selector, std::vector<int>& result)
+{
+	result.clear();
+	std::shared_lock<std::shared_mutex> lock(ctx.m_dataMutex);
+	const bool isIdList = !selector.empty() && selector.find_first_not_of("0123456789,") == std::string::npos;
+	if (isIdList) {
+		size_t begin = 0;
+		while (begin <= selector.size()) {
+			size_t comma = selector.find(',', begin);
+			if (comma == std::string::npos) comma = selector.size();
+			if (comma > begin) {
+				//Only digits get here, so the only failure left is a number out of range
+				const std::string idText = selector.substr(begin, comma - begin);
+				errno = 0;
+				const long long value = strtoll(idText.c_str(), nullptr, 10);
+				if (errno == ERANGE || value > std::numeric_limits<int>::max()) {
+					printf("ArchiveID %s is out of range, skipping.\n", idText.c_str());
+					begin = comma + 1;
+					continue;
+				}
+				const int archiveID = static_cast<int>(value);
+				if (ctx.m_archives.Contains(archiveID)) {
+					result.push_back(archiveID);
+				}
+				else {
+					printf("ArchiveID %d not found, skipping.\n", archiveID);
+				}
+			}
+			begin = comma + 1;
+		}
+		return;
+	}
+	if (selector == "all") {
+		result = ctx.m_archives.Ids();
+		return;
+	}
+	std::vector<size_t> rows;
+	ctx.m_archives.Filter(selector, rows);
+	for (size_t row : rows) {
+		result.push_back(ctx.m_archives.Ids()[row]);
+	}
+}
+
+int YgoMasterArchiveMgr::BulkPatchField(YgoInstallContext& ctx, const std::vector<int>& archiveIDs, const std::string& relPath,
+	const std::string& fieldPath, const std::string& valueText)
+{
+	/*
+	* Archives are independent files, so workers patch them concurrently.
+	* Writers of the install are serialized, the ArchiveList itself is not touched.
+	*/
+	std::lock_guard<std::recursive_mutex> writeLock(ctx.m_writeMutex);
+	std::vector<std::pair<int, std::string>> targets;
+	{
+		std::shared_lock<std::shared_mutex> lock(ctx.m_dataMutex);
+		for (int archiveID : archiveIDs) {
+			const size_t row = ctx.m_archives.Find(archiveID);
+			if (YgoArchiveTable::npos != row) {
+				targets.emplace_back(archiveID, ctx.m_archives.PathAt(row));
+			}
+		}
+	}
+	if (targets.empty()) {
+		printf("No archive selected.\n");
+		return 0;
+	}
+
+	const bool cardsChanged = (relPath == sc_YgoPlayerJsonSearchPath) && fieldPath.compare(0, 5, "Cards") == 0;
+	std::vector<EJsonPatchResult> results(targets.size(), EJsonPatchResult::FAILED);
+	ParallelFor(targets.size(), [&](size_t i) {
+		results[i] = PatchArchiveJsonField(targets[i].second, relPath, fieldPath, valueText);
+		if (results[i] == EJsonPatchResult::FAILED || results[i] == EJsonPatchResult::NOT_FOUND) {
+			return false;
+		}
+		if (cardsChanged) {
+			YgoCardInventory inventory;
+			if (ExtractCardInventory(targets[i].second, relPath, sc_YgoDecksSearchPath, inventory)) {
+				WriteCardInventory(targets[i].second, inventory);
+			}
+		}
+		if (relPath == sc_YgoPlayerJsonSearchPath) {
+			YgoJsonTree tree;
+			if (BuildPlayerTree(targets[i].second, relPath, sc_YgoDecksSearchPath, tree)) {
+				tree.Save(fs::path(targets[i].second) / sc_playerTreeFileName);
+			}
+		}
+		return true;
+	});
+
+	int inPlace = 0, rewritten = 0;
+	for (size_t i = 0; i < targets.size(); ++i) {
+		switch (results[i])
+		{
+		case EJsonPatchResult::PATCHED_IN_PLACE:
+			++inPlace;
+			break;
+		case EJsonPatchResult::REWRITTEN:
+			++rewritten;
+			break;
+		case EJsonPatchResult::NOT_FOUND:
+			printf("Field %s not found in ArchiveID %d.\n", fieldPath.c_str(), targets[i].first);
+			continue;
+		default:
+			printf("Edit ArchiveID %d failed.\n", targets[i].first);
+			continue;
+		}
+		InvalidateSummary(ctx, targets[i].first);
+	}
+	if (cardsChanged) {
+		std::shared_lock<std::shared_mutex> lock(ctx.m_dataMutex);
+		std::lock_guard<std::mutex> indexLock(ctx.m_cardIndexMutex);
+		if (ctx.m_cardIndex.IsLoaded()) {
+			for (const auto& target : targets) {
+				YgoCardInventory inventory;
+				if (ReadCardInventory(target.second, inventory)) {
+					ctx.m_cardIndex.AddArchive(target.first, inventory);
+				}
+			}
+			ctx.m_cardIndex.Save();
+		}
+	}
+	//Patching detaches shared files and thaws cold archives
+	std::vector<int> changedIDs;
+	for (size_t i = 0; i < targets.size(); ++i) {
+		if (EJsonPatchResult::PATCHED_IN_PLACE == results[i] || EJsonPatchResult::REWRITTEN == results[i]) {
+			changedIDs.push_back(targets[i].first);
+			DropArchiveSlot(ctx, targets[i].first);
+		}
+	}
+	UpdateArchiveUsage(ctx, changedIDs);
+	printf("Field %s set to %s in %d of %d archives (%d in place, %d rewritten).\n", fieldPath.c_str(), valueText.c_str(),
+		inPlace + rewritten, static_cast<int>(targets.size()), inPlace, rewritten);
+	return inPlace + rewritten;
 }
 
-bool YgoMasterArchiveMgr::GetNewYgoArchiveInfo(YgoArchiveInfo& result, const bool needDesc)
+bool YgoMasterArchiveMgr::GetNewYgoArchiveInfo(YgoInstallContext& ctx, YgoArchiveInfo& result, const bool needDesc, const std::string* presetDesc,
+	const EIoOperation io)
 {
+	//A replaced snapshot is rewritten in place, another process replacing or deleting it waits until its files are complete
+	YgoFileLock snapshotLock;
+	if (!result.m_path.empty()) {
+		snapshotLock.Lock(GetSnapshotLockPath(ctx, result.m_path), YgoFileLock::EXCLUSIVE);
+	}
 	//Backup targets files or directories, and fill the result structure
-	if (!CopyTargetFiles(result)) {
+	if (!CopyTargetFiles(ctx, result, io)) {
 		printf("Update target files failed.\n");
 		return false;
 	}
 
 	//Read Player.json to get player name
-	const std::string playerJsonPath = result.m_path + sc_YgoPlayerJsonSearchPath;
-	std::ifstream file(playerJsonPath, std::ios::binary);
-	if (!fs::exists(playerJsonPath)) {
+	YgoFileView jsonContent;
+	if (!ReadArchiveFile(result.m_path, sc_YgoPlayerJsonSearchPath, jsonContent)) {
 		printf("Cannot find Player.json in the backup archive, cannot get player name.\n");
 		return false;
 	}
-	std::string jsonContent((std::istreambuf_iterator<char>(file)),
-		std::istreambuf_iterator<char>());
-	file.close();
 
-	cJSON* root = cJSON_Parse(jsonContent.c_str());
+	cJSON* root = cJSON_ParseWithLength(jsonContent.Data(), jsonContent.Size());
 	if (!root) {
 		printf("Parse Player.json failed in the backup archive, cannot get player name.\n");
 	}
@@ -513,8 +2077,25 @@ bool YgoMasterArchiveMgr::GetNewYgoArchiveInfo(YgoArchiveInfo& result, const boo
 		else {
 			printf("PlayerName not found or invalid in Player.json, cannot get player name.\n");
 		}
+		//Card side file of the archive, read by the card index instead of Player.json
+		YgoCardInventory inventory;
+		if (!ExtractCardInventory(root, result.m_path, sc_YgoDecksSearchPath, inventory)
+			|| !WriteCardInventory(result.m_path, inventory)) {
+			printf("Write card inventory of %s failed.\n", result.m_path.c_str());
+		}
+		//Hash tree side file, diffs of this archive read it instead of Player.json
+		YgoJsonTree tree;
+		if (!BuildPlayerTree(result.m_path, sc_YgoPlayerJsonSearchPath, sc_YgoDecksSearchPath, tree, root)
+			|| !tree.Save(fs::path(result.m_path) / sc_playerTreeFileName)) {
+			printf("Write Player.tree of %s failed.\n", result.m_path.c_str());
+		}
 	}
 	cJSON_Delete(root);
+	snapshotLock.Unlock();
+	if (presetDesc) {
+		result.m_desc = *presetDesc;
+		return true;
+	}
 	printf("Backup newest archive done. \nEnter the description information of the archive and press Enter (default is empty): \n");
 	
 	std::string desc("");
@@ -526,67 +2107,475 @@ bool YgoMasterArchiveMgr::GetNewYgoArchiveInfo(YgoArchiveInfo& result, const boo
 	return true;
 }
 
-bool YgoMasterArchiveMgr::CopyTargetFiles(YgoArchiveInfo& result)
+// Snapshot ids are the local backup time with milliseconds, "2024_05_01_123059_042"
+static std::string FormatSnapshotId(const uint64_t milliseconds)
 {
-	const auto timestamp = std::chrono::system_clock::to_time_t(
-		std::chrono::system_clock::now());
+	const time_t timestamp = static_cast<time_t>(milliseconds / 1000);
 	char timeBuffer[20];
-
-#if defined(_WIN32)
 	struct tm timeInfo;
+#if defined(_WIN32)
 	localtime_s(&timeInfo, &timestamp);
-	std::strftime(timeBuffer, sizeof(timeBuffer), "%Y_%m_%d_%H%M%S", &timeInfo);
 #else
-	struct tm timeInfo;
 	localtime_r(&timestamp, &timeInfo);
-	std::strftime(timeBuffer, sizeof(timeBuffer), "%Y_%m_%d_%H%M%S", &timeInfo);
 #endif
+	std::strftime(timeBuffer, sizeof(timeBuffer), "%Y_%m_%d_%H%M%S", &timeInfo);
+	char result[32];
+	snprintf(result, sizeof(result), "%s_%03u", timeBuffer, static_cast<unsigned>(milliseconds % 1000));
+	return std::string(result);
+}
 
-	result.m_time = std::string(timeBuffer);
-	//Create archive directory if not exist
-	if (result.m_path.empty()) {
-		result.m_path = m_archivesPath + "\\" + result.m_time;
+// Shard directory of a snapshot id or of a flat "YYYY_MM_DD_HHMMSS" archive name
+static fs::path GetSnapshotShardDir(const std::string& archivesPath, const std::string& snapshotId)
+{
+	return fs::path(archivesPath) / snapshotId.substr(0, 4) / snapshotId.substr(5, 2);
+}
+
+static bool IsFlatArchiveName(const std::string& name)
+{
+	//"YYYY_MM_DD_HHMMSS" with an optional "_mmm"
+	if (name.size() != 17 && name.size() != 21) {
+		return false;
+	}
+	for (size_t i = 0; i < name.size(); ++i) {
+		const bool separator = (4 == i || 7 == i || 10 == i || 17 == i);
+		if (separator ? name[i] != '_' : !isdigit(static_cast<unsigned char>(name[i]))) {
+			return false;
+		}
 	}
+	return true;
+}
 
-	if (!fs::exists(result.m_path)) {
-		if (!fs::create_directories(result.m_path)) {
-			printf("Create archive directory %s failed.\n", result.m_path.c_str());
+// Next snapshot time in milliseconds, strictly after every id handed out before, caller holds ctx.m_writeMutex
+static uint64_t NextSnapshotMs(YgoInstallContext& ctx)
+{
+	const uint64_t now = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count());
+	ctx.m_lastSnapshotMs = std::max(now, ctx.m_lastSnapshotMs + 1);
+	return ctx.m_lastSnapshotMs;
+}
+
+bool YgoMasterArchiveMgr::CreateSnapshotDir(YgoInstallContext& ctx, YgoArchiveInfo& result)
+{
+	//create_directory fails on an existing directory, so another process never gets the same snapshot
+	for (int attempt = 0; attempt < 1000; ++attempt) {
+		const std::string snapshotId = FormatSnapshotId(NextSnapshotMs(ctx));
+		const fs::path shardDir = GetSnapshotShardDir(ctx.m_archivesPath, snapshotId);
+		std::error_code ec;
+		fs::create_directories(shardDir, ec);
+		if (fs::create_directory(shardDir / snapshotId, ec)) {
+			result.m_time = snapshotId;
+			result.m_path = (shardDir / snapshotId).string();
+			return true;
+		}
+		if (ec) {
+			printf("Create archive directory %s failed: %s\n", (shardDir / snapshotId).string().c_str(), ec.message().c_str());
 			return false;
 		}
 	}
+	printf("No free snapshot id in %s.\n", ctx.m_archivesPath.c_str());
+	return false;
+}
+
+void YgoMasterArchiveMgr::MigrateFlatArchives(YgoInstallContext& ctx)
+{
+	const fs::path archivesRoot = fs::path(ctx.m_archivesPath).lexically_normal();
+	int moved = 0;
+	while (!m_stopping) {
+		std::lock_guard<std::recursive_mutex> writeLock(ctx.m_writeMutex);
+		ListUpdate update(*this, ctx);
+		std::unique_lock<std::shared_mutex> lock(ctx.m_dataMutex);
+		cJSON* archivesArray = cJSON_GetObjectItem(update.Root(), "Archives");
+		if (!cJSON_IsArray(archivesArray)) {
+			return;
+		}
+		int batch = 0;
+		bool more = false;
+		cJSON* archiveItem = nullptr;
+		cJSON_ArrayForEach(archiveItem, archivesArray) {
+			cJSON* idItem = cJSON_GetObjectItem(archiveItem, "id");
+			cJSON* pathItem = cJSON_GetObjectItem(archiveItem, "Path");
+			if (!cJSON_IsNumber(idItem) || !cJSON_IsString(pathItem)) continue;
+			const fs::path flatPath = fs::path(pathItem->valuestring).lexically_normal();
+			const std::string name = flatPath.filename().string();
+			if (flatPath.parent_path() != archivesRoot || !IsFlatArchiveName(name)) continue;
+			if (batch == ARCHIVE_MIGRATION_BATCH_SIZE) {
+				more = true;
+				break;
+			}
+			//A rename done before an interrupted list write is picked up again here
+			const fs::path shardPath = GetSnapshotShardDir(ctx.m_archivesPath, name) / name;
+			std::error_code ec;
+			if (fs::exists(flatPath, ec)) {
+				fs::create_directories(shardPath.parent_path(), ec);
+				fs::rename(flatPath, shardPath, ec);
+			}
+			if (ec || !fs::exists(shardPath, ec)) {
+				continue;
+			}
+			cJSON_SetValuestring(pathItem, shardPath.string().c_str());
+			ctx.m_archives.SetPath(idItem->valueint, shardPath.string());
+			++batch;
+		}
+		lock.unlock();
+		//One durable commit per batch, the table was updated row by row above
+		if (batch > 0) {
+			if (!update.Commit(false)) {
+				printf("Write ArchiveList file failed during archive migration.\n");
+				break;
+			}
+			moved += batch;
+		}
+		if (!more) {
+			break;
+		}
+	}
+	if (moved > 0) {
+		printf("Moved %d archives of install %s to the sharded layout.\n", moved, ctx.m_name.c_str());
+	}
+}
+
+void YgoMasterArchiveMgr::TierArchives(YgoInstallContext& ctx)
+{
+	if (!m_coldPolicy.m_enabled) {
+		return;
+	}
+	const uint64_t nowMs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count());
+	const uint64_t keepMs = static_cast<uint64_t>(m_coldPolicy.m_keepDays) * 24 * 60 * 60 * 1000;
+	//Snapshot ids sort like the times they stand for
+	const std::string cutoff = FormatSnapshotId((nowMs > keepMs) ? nowMs - keepMs : 0);
+	std::vector<int> candidates;
+	{
+		std::shared_lock<std::shared_mutex> lock(ctx.m_dataMutex);
+		std::vector<size_t> rows(ctx.m_archives.Size());
+		for (size_t row = 0; row < rows.size(); ++row) {
+			rows[row] = row;
+		}
+		std::sort(rows.begin(), rows.end(), [&ctx](const size_t a, const size_t b) {
+			return ctx.m_archives.TimeKeyAt(a) > ctx.m_archives.TimeKeyAt(b);
+		});
+		for (size_t i = static_cast<size_t>(m_coldPolicy.m_keepRecent); i < rows.size(); ++i) {
+			const std::string time = ctx.m_archives.TimeAt(rows[i]);
+			//Backup times that are not snapshot ids cannot be dated, those archives stay hot
+			if ((time.size() != 17 && time.size() != 21) || time >= cutoff
+				|| ctx.m_archives.Ids()[rows[i]] == ctx.m_currentArchiveIndex) {
+				continue;
+			}
+			candidates.push_back(ctx.m_archives.Ids()[rows[i]]);
+		}
+	}
+	{
+		//Archives freeing the most space go first, one whose bytes are all shared with others frees nothing
+		std::lock_guard<std::mutex> usageLock(ctx.m_usageMutex);
+		if (ctx.m_usageIndex.IsLoaded()) {
+			std::vector<std::pair<uint64_t, int>> ranked;
+			for (const int archiveID : candidates) {
+				const YgoUsageIndex::Usage usage = ctx.m_usageIndex.GetUsage(archiveID);
+				if (!ctx.m_usageIndex.HasArchive(archiveID) || usage.m_exclusiveBytes > 0) {
+					ranked.emplace_back(usage.m_exclusiveBytes, archiveID);
+				}
+			}
+			std::stable_sort(ranked.begin(), ranked.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+			candidates.clear();
+			for (const auto& item : ranked) {
+				candidates.push_back(item.second);
+			}
+		}
+	}
 
-	//Copy target files or directories
-	for (const auto& target : sc_BackupTargets) {
-		fs::path sourcePath = fs::path(m_YMDataPath) / fs::path(target.second);
-		fs::path destPath = fs::path(result.m_path) / fs::path(target.second);
-		if (!fs::exists(sourcePath)) {
-			printf("Source path %s not exist, skipping.\n", sourcePath.string().c_str());
+	const fs::path storeDir = fs::path(ctx.m_archivesPath) / sc_coldStoreDirName;
+	const std::unique_ptr<YgoIoThrottle> throttle = CreateIoThrottle(EIoOperation::TIERING);
+	for (const int archiveID : candidates) {
+		if (m_stopping) {
+			return;
+		}
+		//Ids and paths stay as they are, readers find the cold copy through the manifest in the archive directory
+		std::lock_guard<std::recursive_mutex> writeLock(ctx.m_writeMutex);
+		YgoArchiveInfo archive;
+		if (!ctx.m_archives.Get(archiveID, archive) || archiveID == ctx.m_currentArchiveIndex) {
 			continue;
 		}
-		try {
-			if (target.first == IS_FILE) {
-				fs::copy_file(sourcePath, destPath, fs::copy_options::overwrite_existing);
+		YgoTargetContext tc;
+		tc.m_archivePath = archive.m_path;
+		tc.m_coldStorePath = storeDir.string();
+		tc.m_throttle = throttle.get();
+		if (!AllBackupTargets([&](auto target) { return decltype(target)::Freeze(tc); })) {
+			printf("Move ArchiveID %d to cold storage failed, it stays as it is.\n", archiveID);
+		}
+		UpdateArchiveUsage(ctx, { archiveID });
+	}
+
+	//Objects of deleted or thawed archives, only swept when every manifest could be read
+	std::lock_guard<std::recursive_mutex> writeLock(ctx.m_writeMutex);
+	//Freezes of other processes wait until the sweep is done, manifests they wrote before are in the list read here
+	std::error_code ec;
+	YgoFileLock storeLock;
+	if (!fs::is_directory(storeDir, ec) || !storeLock.Lock(GetColdLockPath(storeDir), YgoFileLock::EXCLUSIVE)) {
+		return;
+	}
+	RefreshArchivesIfChanged(ctx);
+	if (ctx.m_archives.Empty()) {
+		return;
+	}
+	std::unordered_set<std::string> referencedKeys;
+	for (size_t row = 0; row < ctx.m_archives.Size(); ++row) {
+		const std::string archivePath = ctx.m_archives.PathAt(row);
+		bool readable = true;
+		ForEachBackupTarget([&](auto target) {
+			if (!readable || !IsColdTarget(archivePath, decltype(target)::Name)) {
+				return;
 			}
-			else if (target.first == IS_DIRECTORY) {
-				fs::copy(sourcePath, destPath, fs::copy_options::recursive | fs::copy_options::overwrite_existing);
+			std::vector<YgoColdEntry> entries;
+			fs::path manifestStore;
+			readable = ReadColdTable(GetColdPath(archivePath, decltype(target)::Name), entries, manifestStore);
+			for (const auto& entry : entries) {
+				referencedKeys.insert(entry.m_key);
 			}
-			else {
-				printf("Unknown target type for %s, skipping.\n", sourcePath.string().c_str());
+		});
+		if (!readable) {
+			printf("Cold manifest of %s is damaged, the cold store is not swept.\n", archivePath.c_str());
+			return;
+		}
+	}
+	const size_t removed = SweepColdStore(storeDir, referencedKeys);
+	if (removed > 0) {
+		printf("Removed %d unused objects from the cold store of install %s.\n", static_cast<int>(removed), ctx.m_name.c_str());
+	}
+}
+
+std::string YgoMasterArchiveMgr::MoveToTrash(YgoInstallContext& ctx, const fs::path& path)
+{
+	const fs::path trashDir = fs::path(ctx.m_archivesPath) / sc_trashDirName;
+	std::error_code ec;
+	fs::create_directories(trashDir, ec);
+	//Trash names only have to differ from each other, the time keeps those of other runs and processes apart
+	const auto now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	for (int attempt = 0; attempt < 100; ++attempt) {
+		const std::string name = std::to_string(now) + "_" + std::to_string(attempt) + "_" + path.filename().string();
+		if (fs::exists(fs::symlink_status(trashDir / name, ec))) continue;
+		//A rename within the archives directory, as fast for a large archive as for a small one
+		fs::rename(path, trashDir / name, ec);
+		if (ec) {
+			printf("Move %s to the trash failed: %s\n", path.string().c_str(), ec.message().c_str());
+			return "";
+		}
+		ctx.m_trashPending = true;
+		return name;
+	}
+	return "";
+}
+
+void YgoMasterArchiveMgr::ReapTrash(YgoInstallContext& ctx)
+{
+	const fs::path trashDir = fs::path(ctx.m_archivesPath) / sc_trashDirName;
+	std::error_code ec;
+	std::vector<fs::path> items;
+	for (fs::directory_iterator it(trashDir, ec), end; !ec && it != end; it.increment(ec)) {
+		items.push_back(it->path());
+	}
+	if (items.empty()) {
+		return;
+	}
+	const std::unique_ptr<YgoIoThrottle> throttle = CreateIoThrottle(EIoOperation::PURGE);
+	YgoIoPriorityScope priority(throttle && throttle->Budget().m_idlePriority);
+	for (const auto& item : items) {
+		//One thread and one unlink at a time, the next run picks up whatever is left when the tool exits
+		std::vector<YgoTreeEntry> entries;
+		WalkTree(item, entries, false, 1);
+		for (const auto& entry : entries) {
+			if (m_stopping) {
+				return;
 			}
+			if (entry.m_type == YgoTreeEntry::DIRECTORY_ENTRY) continue;
+			if (throttle) {
+				throttle->Acquire(0);
+			}
+			fs::remove(item / entry.m_path, ec);
 		}
-		catch (const fs::filesystem_error& e) {
-			printf("Error copying %s to %s: %s\n",
-				sourcePath.string().c_str(),
-				destPath.string().c_str(),
-				e.what());
-			return false;
+		if (!RemoveTree(item, 1)) {
+			printf("Remove %s from the trash failed.\n", item.string().c_str());
 		}
 	}
+}
+
+std::unique_ptr<YgoIoThrottle> YgoMasterArchiveMgr::CreateIoThrottle(const EIoOperation io) const
+{
+	const YgoIoBudget& budget = m_ioBudgets[static_cast<int>(io)];
+	if (budget.Unlimited()) {
+		return nullptr;
+	}
+	return std::make_unique<YgoIoThrottle>(budget);
+}
 
+bool YgoMasterArchiveMgr::LinkArchiveSlot(YgoInstallContext& ctx, const YgoArchiveInfo& archive, const std::string& targetName, YgoIoThrottle* throttle)
+{
+	const fs::path livePath = fs::path(ctx.m_YMDataPath) / targetName;
+	const fs::path slotPath = GetSlotPath(ctx.m_archivesPath, archive.m_id, targetName);
+	std::error_code ec;
+	const bool isLink = fs::is_symlink(fs::symlink_status(livePath, ec));
+	const int linkedID = GetLinkedSlot(livePath, ctx.m_archivesPath);
+	if (isLink && linkedID < 0) {
+		printf("%s is a link not made by this tool, leaving it as is.\n", livePath.string().c_str());
+		return false;
+	}
+	if (linkedID == archive.m_id) {
+		return true;
+	}
+	if (!isLink && !ctx.m_archives.Contains(ctx.m_currentArchiveIndex)) {
+		printf("Current archive of %s is unknown, its data has no working copy to go to.\n", livePath.string().c_str());
+		return false;
+	}
+	//First switch to this archive, the only time its files are copied
+	if (!fs::exists(slotPath, ec)) {
+		printf("Preparing the working copy of %s for ArchiveID %d...\n", targetName.c_str(), archive.m_id);
+		fs::path tempPath = slotPath;
+		tempPath += ".tmp";
+		if (fs::exists(tempPath, ec) && !RemoveTree(tempPath)) {
+			printf("Remove %s failed.\n", tempPath.string().c_str());
+			return false;
+		}
+		if (!UnpackDirectory(archive.m_path, targetName, tempPath, throttle)) {
+			printf("Unpack ArchiveID %d to %s failed.\n", archive.m_id, tempPath.string().c_str());
+			RemoveTree(tempPath);
+			return false;
+		}
+		fs::rename(tempPath, slotPath, ec);
+		if (ec) {
+			printf("Rename %s failed: %s\n", tempPath.string().c_str(), ec.message().c_str());
+			return false;
+		}
+	}
+	//Data still holds a real directory, it becomes the working copy of the current archive
+	fs::path parkedPath("");
+	if (!isLink && fs::exists(livePath, ec)) {
+		parkedPath = GetSlotPath(ctx.m_archivesPath, ctx.m_currentArchiveIndex, targetName);
+		if (fs::exists(parkedPath, ec) && !RemoveTree(parkedPath)) {
+			printf("Remove stale working copy %s failed.\n", parkedPath.string().c_str());
+			return false;
+		}
+		if (!MoveDirectory(livePath, parkedPath)) {
+			return false;
+		}
+	}
+	if (!RelinkDirectory(livePath, slotPath)) {
+		if (!parkedPath.empty() && !MoveDirectory(parkedPath, livePath)) {
+			printf("Move %s back failed, the data is kept in %s.\n", livePath.string().c_str(), parkedPath.string().c_str());
+		}
+		return false;
+	}
 	return true;
 }
 
-bool YgoMasterArchiveMgr::ResetData(const int archiveID, const YMArchiveData& YMdataID)
+void YgoMasterArchiveMgr::FollowCurrentSlot(YgoInstallContext& ctx)
+{
+	ForEachBackupTarget([&](auto target) {
+		using Target = decltype(target);
+		if constexpr (Target::Linkable) {
+			const fs::path livePath = fs::path(ctx.m_YMDataPath) / Target::Name;
+			const int linkedID = GetLinkedSlot(livePath, ctx.m_archivesPath);
+			if (linkedID < 0 || linkedID == ctx.m_currentArchiveIndex) {
+				return;
+			}
+			//What Data shows is now the current archive, the archive it came from is rebuilt on its next switch
+			const fs::path fromPath = GetSlotPath(ctx.m_archivesPath, linkedID, Target::Name);
+			const fs::path slotPath = GetSlotPath(ctx.m_archivesPath, ctx.m_currentArchiveIndex, Target::Name);
+			std::error_code ec;
+			if (fs::exists(slotPath, ec) && !RemoveTree(slotPath)) {
+				printf("Remove stale working copy %s failed.\n", slotPath.string().c_str());
+				return;
+			}
+			if (!MoveDirectory(fromPath, slotPath)) {
+				return;
+			}
+			fs::remove(fromPath.parent_path(), ec);
+			if (!RelinkDirectory(livePath, slotPath) && MoveDirectory(slotPath, fromPath)) {
+				printf("Working copy of %s stays with ArchiveID %d.\n", Target::Name, linkedID);
+			}
+		}
+	});
+}
+
+void YgoMasterArchiveMgr::DropArchiveSlot(YgoInstallContext& ctx, const int archiveID)
+{
+	const fs::path slotDir = GetSlotPath(ctx.m_archivesPath, archiveID, "");
+	std::error_code ec;
+	if (!fs::exists(slotDir, ec)) {
+		return;
+	}
+	//A linked working copy is the live data, it follows the game and not the archive
+	bool slotInUse = false;
+	ForEachBackupTarget([&](auto target) {
+		slotInUse = slotInUse || (GetLinkedSlot(fs::path(ctx.m_YMDataPath) / decltype(target)::Name, ctx.m_archivesPath) == archiveID);
+	});
+	if (!slotInUse && MoveToTrash(ctx, slotDir).empty()) {
+		printf("Delete working copy %s failed.\n", slotDir.string().c_str());
+	}
+}
+
+bool YgoMasterArchiveMgr::CopyTargetFiles(YgoInstallContext& ctx, YgoArchiveInfo& result, const EIoOperation io)
+{
+	//Create archive directory if not exist
+	if (result.m_path.empty()) {
+		if (!CreateSnapshotDir(ctx, result)) {
+			return false;
+		}
+	}
+	else {
+		result.m_time = FormatSnapshotId(NextSnapshotMs(ctx));
+	}
+
+	if (!fs::exists(result.m_path)) {
+		if (!fs::create_directories(result.m_path)) {
+			printf("Create archive directory %s failed.\n", result.m_path.c_str());
+			return false;
+		}
+	}
+
+	//The newest other archive lends unchanged large files to this one
+	std::string referencePath("");
+	uint64_t referenceKey = 0;
+	for (size_t row = 0; row < ctx.m_archives.Size(); ++row) {
+		const std::string path = ctx.m_archives.PathAt(row);
+		if (path != result.m_path && ctx.m_archives.TimeKeyAt(row) >= referenceKey && fs::exists(path)) {
+			referenceKey = ctx.m_archives.TimeKeyAt(row);
+			referencePath = path;
+		}
+	}
+
+	//Each target backs itself up with its own policy
+	YgoTargetContext tc;
+	tc.m_dataPath = ctx.m_YMDataPath;
+	tc.m_archivePath = result.m_path;
+	tc.m_referencePath = referencePath;
+	tc.m_smallFileThreshold = ctx.m_smallFileThreshold;
+	tc.m_inlineFiles = &result.m_inlineFiles;
+	const std::unique_ptr<YgoIoThrottle> throttle = CreateIoThrottle(io);
+	tc.m_throttle = throttle.get();
+	result.m_inlineFiles.clear();
+	return AllBackupTargets([&](auto target) { return decltype(target)::Backup(tc); });
+}
+
+void YgoMasterArchiveMgr::ReadInlineFiles(YgoInstallContext& ctx, const int archiveID, std::vector<std::pair<std::string, std::string>>& result, cJSON* list)
+{
+	result.clear();
+	if (!list) {
+		//Loaded into the table with the list, so a lookup never parses ArchiveList again
+		const size_t row = ctx.m_archives.Find(archiveID);
+		if (YgoArchiveTable::npos != row) {
+			ctx.m_archives.InlineFilesAt(row, result);
+		}
+		return;
+	}
+	//A list being edited may hold entries the table does not have yet
+	const int index = FindArchiveItemIndex(list, archiveID);
+	if (index >= 0) {
+		YgoArchiveInfo info;
+		ReadArchiveItem(cJSON_GetArrayItem(cJSON_GetObjectItem(list, "Archives"), index), info);
+		result = std::move(info.m_inlineFiles);
+	}
+}
+
+bool YgoMasterArchiveMgr::ResetData(YgoInstallContext& ctx, const int archiveID, const YMArchiveData& YMdataID)
 {
 	const int dataID = static_cast<int>(YMdataID);
 	if (dataID < static_cast<int>(YMArchiveData::MIN_DATA)
@@ -596,12 +2585,12 @@ bool YgoMasterArchiveMgr::ResetData(const int archiveID, const YMArchiveData& YM
 		return false;
 	}
 
-	auto it = m_archives.find(archiveID);
-	if (it == m_archives.end()) {
+	std::lock_guard<std::recursive_mutex> writeLock(ctx.m_writeMutex);
+	YgoArchiveInfo archive;
+	if (!ctx.m_archives.Get(archiveID, archive)) {
 		printf("ArchiveID %d not found.\n", archiveID);
 		return false;
 	}
-	const YgoArchiveInfo& archive = it->second;
 
 	switch (dataID)
 	{
@@ -613,48 +2602,29 @@ bool YgoMasterArchiveMgr::ResetData(const int archiveID, const YMArchiveData& YM
 		std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n'); // Clear the input buffer
 		std::getline(std::cin, newDesc);
 		//Update ArchiveList file
-		std::fstream file(m_YMListPath,
-			std::ios::in | std::ios::out | std::ios::binary);
-		if (!file.is_open()) {
-			printf("Open ArchiveList file failed for reset.\n");
-			return false;
-		}
-		std::string jsonContent((std::istreambuf_iterator<char>(file)),
-			std::istreambuf_iterator<char>());
-		cJSON* root = cJSON_Parse(jsonContent.c_str());
-		if (!root) {
-			printf("Parse ArchiveList file failed for reset.\n");
-			file.close();
-			return false;
-		}
-		cJSON* archivesArray = cJSON_GetObjectItem(root, "Archives");
+		ListUpdate update(*this, ctx);
+		cJSON* archivesArray = cJSON_GetObjectItem(update.Root(), "Archives");
 		if (!archivesArray || !cJSON_IsArray(archivesArray)) {
-			printf("ArchiveList file format error: Archives is not an array.\n");
-			cJSON_Delete(root);
-			file.close();
+			printf("Parse ArchiveList file failed for reset.\n");
 			return false;
 		}
-		int size = cJSON_GetArraySize(archivesArray);
-		for (int i = 0; i < size; ++i) {
-			cJSON* archiveItem = cJSON_GetArrayItem(archivesArray, i);
-			if (!archiveItem) continue;
+		cJSON* archiveItem = nullptr;
+		cJSON_ArrayForEach(archiveItem, archivesArray) {
 			cJSON* idItem = cJSON_GetObjectItem(archiveItem, "id");
-			if (idItem && cJSON_IsNumber(idItem) && idItem->valueint == archiveID) {
-				cJSON* descItem = cJSON_GetObjectItem(archiveItem, "Description");
-				if (descItem && cJSON_IsString(descItem)) {
-					cJSON_SetValuestring(descItem, newDesc.c_str());
-					//Write back to file
-					std::string jsonFileString = std::string(cJSON_Print(root));
-					file.seekp(0, std::ios::beg);
-					file.write(jsonFileString.c_str(), jsonFileString.size());
-					cJSON_Delete(root);
-					file.close();
-					printf("Description for ArchiveID");
+			cJSON* descItem = cJSON_GetObjectItem(archiveItem, "Description");
+			if (idItem && cJSON_IsNumber(idItem) && idItem->valueint == archiveID
+				&& descItem && cJSON_IsString(descItem)) {
+				cJSON_SetValuestring(descItem, newDesc.c_str());
+				if (!update.Commit()) {
+					printf("Write ArchiveList file failed for reset.\n");
+					return false;
 				}
+				printf("Description for ArchiveID %d reset successfully.\n", archiveID);
+				return true;
 			}
 		}
-		printf(" %d reset successfully.\n", archiveID);
-		return true;
+		printf("Description of ArchiveID %d not found in ArchiveList file.\n", archiveID);
+		return false;
 	}
 	case static_cast<int>(YMArchiveData::ARCHIVE_DATA_GEMS):
 	{
@@ -668,70 +2638,62 @@ bool YgoMasterArchiveMgr::ResetData(const int archiveID, const YMArchiveData& YM
 			printf("Invalid input, please enter a non-negative number.\n");
 			return false;
 		}
-		//Update Player.json
-		const std::string playerJsonPath = archive.m_path + sc_YgoPlayerJsonSearchPath;
-		std::fstream file(playerJsonPath,
-			std::ios::in | std::ios::out | std::ios::binary);
-		if (!file.is_open()) {
-			printf("Open Player.json failed for reset.\n");
-			return false;
-		}
-		std::string jsonContent((std::istreambuf_iterator<char>(file)),
-			std::istreambuf_iterator<char>());
-		cJSON* root = cJSON_Parse(jsonContent.c_str());
-		if (!root) {
-			printf("Parse Player.json failed for reset.\n");
-			file.close();
-			return false;
-		}
-		cJSON* gemsItem = cJSON_GetObjectItem(root, "Gems");
-		if (gemsItem && cJSON_IsNumber(gemsItem)) {
-			cJSON_SetNumberValue(gemsItem, newGems);
-			//Write back to file
-			std::string jsonFileString = std::string(cJSON_Print(root));
-			file.seekp(0, std::ios::beg);
-			file.write(jsonFileString.c_str(), jsonFileString.size());
-			cJSON_Delete(root);
-			file.close();
+		//Patch the value in Player.json, standalone or packed, without re-printing the document
+		std::unique_lock<std::shared_mutex> lock(ctx.m_dataMutex);
+		const EJsonPatchResult result = PatchArchiveJsonField(archive.m_path, sc_YgoPlayerJsonSearchPath, "Gems", std::to_string(newGems));
+		if (EJsonPatchResult::PATCHED_IN_PLACE == result || EJsonPatchResult::REWRITTEN == result) {
+			InvalidateSummary(ctx, archiveID);
+			//Built again from Player.json by the next diff
+			std::error_code ec;
+			fs::remove(fs::path(archive.m_path) / sc_playerTreeFileName, ec);
+			DropArchiveSlot(ctx, archiveID);
 			printf("Player gems for ArchiveID %d reset successfully.\n", archiveID);
 			return true;
 		}
-		cJSON_Delete(root);
-		file.close();
+		if (EJsonPatchResult::FAILED == result) {
+			printf("Write Player.json failed for reset.\n");
+			return false;
+		}
 		printf("Gems item not found in Player.json, cannot reset.\n");
 		return false;
 	}
-	default:
-		break;
+	default:
+		break;
+	}
+	return false;
+}
+
+// Store the files a backup inlined as "InlineFiles": { name: content } of an ArchiveList entry
+static void AddInlineFiles(cJSON* archiveItem, const YgoArchiveInfo& info)
+{
+	if (info.m_inlineFiles.empty()) {
+		return;
+	}
+	cJSON* inlineItem = cJSON_AddObjectToObject(archiveItem, "InlineFiles");
+	for (const auto& file : info.m_inlineFiles) {
+		cJSON_AddItemToObject(inlineItem, file.first.c_str(), cJSON_CreateString(file.second.c_str()));
 	}
-	return false;
 }
 
-
-bool YgoMasterArchiveMgr::BackupArchive(const int targetID, const bool copy)
+bool YgoMasterArchiveMgr::BackupArchive(YgoInstallContext& ctx, const int targetID, const bool copy, const std::string* presetDesc, const EIoOperation io)
 {
 	/*
 	* Backup the latest archive to ArchiveList file for targetID.
 	* if copy is true, create a new archive entry.
+	* Writers of the install are serialized, readers are only blocked while ArchiveList is written.
 	*/
+	std::lock_guard<std::recursive_mutex> writeLock(ctx.m_writeMutex);
 	if (copy) {
 		printf("Creating a new archive entry in ArchiveList file...\n");
 	} else{
 		printf("Updating ArchiveList file for ArchiveID %d...\n", targetID);
 	}
 
-	std::fstream file(m_YMListPath,
-		std::ios::in | std::ios::out | std::ios::binary);
-	if (!file.is_open()) {
-		printf("Open ArchiveList file failed for backup.\n");
-		return false;
-	}
-	std::string jsonContent((std::istreambuf_iterator<char>(file)),
-		std::istreambuf_iterator<char>());
-	cJSON* root = cJSON_Parse(jsonContent.c_str());
+	//Joins the update of a restore with backup, so both are written with one commit
+	ListUpdate update(*this, ctx);
+	cJSON* root = update.Root();
 	if (!root) {
 		printf("Parse ArchiveList file failed for backup.\n");
-		file.close();
 		return false;
 	}
 
@@ -740,8 +2702,6 @@ bool YgoMasterArchiveMgr::BackupArchive(const int targetID, const bool copy)
 	if (!currentID || !cJSON_IsNumber(currentID)
 		|| !archivesArray || !cJSON_IsArray(archivesArray)) {
 		printf("ArchiveList file format error: Archives is not an array or Currently in use ArchiveID is not a number..\n");
-		cJSON_Delete(root);
-		file.close();
 		return false;
 	}
 
@@ -765,7 +2725,7 @@ bool YgoMasterArchiveMgr::BackupArchive(const int targetID, const bool copy)
 				if (pathItem && cJSON_IsString(pathItem)) {
 					newInfo.m_path = pathItem->valuestring;
 				}
-				if (GetNewYgoArchiveInfo(newInfo)) {
+				if (GetNewYgoArchiveInfo(ctx, newInfo, true, presetDesc, io)) {
 					//Update archive info
 					cJSON* nameItem = cJSON_GetObjectItem(archiveItem, "Name");
 					cJSON* pathItem = cJSON_GetObjectItem(archiveItem, "Path");
@@ -783,12 +2743,12 @@ bool YgoMasterArchiveMgr::BackupArchive(const int targetID, const bool copy)
 					if (timeItem && cJSON_IsString(timeItem)) {
 						cJSON_SetValuestring(timeItem, newInfo.m_time.c_str());
 					}
+					cJSON_DeleteItemFromObject(archiveItem, "InlineFiles");
+					AddInlineFiles(archiveItem, newInfo);
 					break;
 				}
 				else {
 					printf("Get new YgoArchiveInfo failed, cannot update archive info.\n");
-					cJSON_Delete(root);
-					file.close();
 					return false;
 				}
 			}
@@ -810,13 +2770,14 @@ bool YgoMasterArchiveMgr::BackupArchive(const int targetID, const bool copy)
 
 		// Get new archive info
 		YgoArchiveInfo newInfo;
-		if (GetNewYgoArchiveInfo(newInfo, (0!=size))) {
+		if (GetNewYgoArchiveInfo(ctx, newInfo, (0!=size), presetDesc, io)) {
 			cJSON* newArchive = cJSON_CreateObject();
 			cJSON_AddItemToObject(newArchive, "id", cJSON_CreateNumber(currentMaxID + 1));
 			cJSON_AddItemToObject(newArchive, "Name", cJSON_CreateString(newInfo.m_name.c_str()));
 			cJSON_AddItemToObject(newArchive, "Path", cJSON_CreateString(newInfo.m_path.c_str()));
 			cJSON_AddItemToObject(newArchive, "Description", cJSON_CreateString(newInfo.m_desc.c_str()));
 			cJSON_AddItemToObject(newArchive, "LastBackupTime", cJSON_CreateString(newInfo.m_time.c_str()));
+			AddInlineFiles(newArchive, newInfo);
 			cJSON_AddItemToArray(archivesArray, newArchive);
 			cJSON_SetNumberValue(currentID, currentMaxID + 1);
 			//Update ArchivesCount
@@ -828,191 +2789,812 @@ bool YgoMasterArchiveMgr::BackupArchive(const int targetID, const bool copy)
 		}
 		else {
 			printf("Get new YgoArchiveInfo failed, cannot create new archive entry.\n");
-			cJSON_Delete(root);
-			file.close();
 			return false;
 		}
 	}
-	//Write back to file
-	std::string jsonFileString = std::string(cJSON_Print(root));
-	file.seekp(0, std::ios::beg);
-	file.write(jsonFileString.c_str(), jsonFileString.size());
-
-	cJSON_Delete(root);
-	file.close();
-	// Update m_archives
-	m_archives.clear();
-	QuerryArchiveList(DEFAULT_MAX_ARCHIVE_LIST_SIZE, false, true);
+	//Write back to file, ctx.m_archives is reloaded from the edited list
+	if (!update.Commit()) {
+		printf("Write ArchiveList file failed for backup.\n");
+		return false;
+	}
+	std::shared_lock<std::shared_mutex> lock(ctx.m_dataMutex);
+	InvalidateSummary(ctx, ctx.m_currentArchiveIndex);
+	const int backupID = ctx.m_currentArchiveIndex;
+	const size_t backupRow = ctx.m_archives.Find(backupID);
+	const std::string backupPath = (YgoArchiveTable::npos != backupRow) ? ctx.m_archives.PathAt(backupRow) : "";
+	lock.unlock();
+	UpdateCardIndex(ctx, backupID, backupPath);
+	UpdateArchiveUsage(ctx, { backupID });
+	DropArchiveSlot(ctx, backupID);
+	FollowCurrentSlot(ctx);
 	printf("ArchiveList file updated successfully for ArchiveID %d.\n", targetID);
 	return true;
 }
 
-bool YgoMasterArchiveMgr::BackupAndCreateNewArchive()
+bool YgoMasterArchiveMgr::BackupAndCreateNewArchive(YgoInstallContext& ctx)
 {
 	//Create a new archive entry and backup the latest archive
-	if (BackupArchive(0, true)) {
+	if (BackupArchive(ctx, 0, true)) {
 		return true;
 	}
 	return false;
 }
 
-bool YgoMasterArchiveMgr::DeleteArchive(const int archiveID)
+bool YgoMasterArchiveMgr::DeleteArchive(YgoInstallContext& ctx, const int archiveID)
 {
 	//Delete a specific archive by archiveID
 	printf("Deleting ArchiveID %d...\n", archiveID);
-	auto it = m_archives.find(archiveID);
-	if (it == m_archives.end()) {
+	std::lock_guard<std::recursive_mutex> writeLock(ctx.m_writeMutex);
+	const size_t row = ctx.m_archives.Find(archiveID);
+	if (YgoArchiveTable::npos == row) {
 		printf("ArchiveID %d not found.\n", archiveID);
 		return false;
 	}
-	const std::string archivePath = it->second.m_path;
-	try {
-		if (fs::exists(archivePath)) {
-			fs::remove_all(archivePath);
-			printf("Archive directory %s deleted successfully.\n", archivePath.c_str());
-			//Update ArchiveList file
-			std::fstream file(m_YMListPath,
-				std::ios::in | std::ios::out | std::ios::binary);
-			if (!file.is_open()) {
-				printf("Open ArchiveList file failed for deletion.\n");
-				return false;
-			}
-			std::string jsonContent((std::istreambuf_iterator<char>(file)),
-				std::istreambuf_iterator<char>());
-			cJSON* root = cJSON_Parse(jsonContent.c_str());
-			if (!root) {
-				printf("Parse ArchiveList file failed for deletion.\n");
-				file.close();
-				return false;
-			}
-			cJSON* archivesArray = cJSON_GetObjectItem(root, "Archives");
-			if (!archivesArray || !cJSON_IsArray(archivesArray)) {
-				printf("ArchiveList file format error: Archives is not an array.\n");
-				cJSON_Delete(root);
-				file.close();
-				return false;
-			}
-			int size = cJSON_GetArraySize(archivesArray);
-			for (int i = 0; i < size; ++i) {
-				cJSON* archiveItem = cJSON_GetArrayItem(archivesArray, i);
-				if (!archiveItem) continue;
-				cJSON* idItem = cJSON_GetObjectItem(archiveItem, "id");
-				if (idItem && cJSON_IsNumber(idItem) && idItem->valueint == archiveID) {
-					//Found targetID, remove it from array
-					cJSON_DeleteItemFromArray(archivesArray, i);
-					//Update ArchivesCount
-					cJSON* archivesCount = cJSON_GetObjectItem(root, "ArchivesCount");
-					if (archivesCount && cJSON_IsNumber(archivesCount)) {
-						cJSON_SetNumberValue(archivesCount, cJSON_GetArraySize(archivesArray));
-						printf("Now there are %d archives in total.\n", archivesCount->valueint);
-					}
-					break;
-				}
-			}
-			//Write back to file
-			std::string jsonFileString = std::string(cJSON_Print(root));
-			file.seekp(0, std::ios::beg);
-			file.write(jsonFileString.c_str(), jsonFileString.size());
-			cJSON_Delete(root);
-			file.close();
+	const std::string archivePath = ctx.m_archives.PathAt(row);
 
-			//Remove from m_archives
-			m_archives.erase(it);
-			return true;
-		}
-		else {
-			printf("Archive directory %s does not exist, skipping deletion.\n", archivePath.c_str());
-			m_archives.erase(it);
-			return true;
+	//Update ArchiveList file
+	ListUpdate update(*this, ctx);
+	cJSON* archivesArray = cJSON_GetObjectItem(update.Root(), "Archives");
+	if (!archivesArray || !cJSON_IsArray(archivesArray)) {
+		printf("Parse ArchiveList file failed for deletion.\n");
+		return false;
+	}
+	int size = cJSON_GetArraySize(archivesArray);
+	for (int i = 0; i < size; ++i) {
+		cJSON* archiveItem = cJSON_GetArrayItem(archivesArray, i);
+		if (!archiveItem) continue;
+		cJSON* idItem = cJSON_GetObjectItem(archiveItem, "id");
+		if (idItem && cJSON_IsNumber(idItem) && idItem->valueint == archiveID) {
+			//Found targetID, remove it from array
+			cJSON_DeleteItemFromArray(archivesArray, i);
+			//Update ArchivesCount
+			cJSON* archivesCount = cJSON_GetObjectItem(update.Root(), "ArchivesCount");
+			if (archivesCount && cJSON_IsNumber(archivesCount)) {
+				cJSON_SetNumberValue(archivesCount, cJSON_GetArraySize(archivesArray));
+				printf("Now there are %d archives in total.\n", archivesCount->valueint);
+			}
+			break;
 		}
 	}
-	catch (const fs::filesystem_error& e) {
-		printf("Error deleting archive directory %s: %s\n", archivePath.c_str(), e.what());
+	//Write back to file, ctx.m_archives is reloaded from the edited list
+	if (!update.Commit()) {
+		printf("Write ArchiveList file failed for deletion.\n");
 		return false;
 	}
-
+	//The snapshot only goes to the trash once the list no longer shows it, so the reaper never unlinks a listed archive;
+	//a crash in between leaves a directory no archive refers to, never an entry pointing at a half deleted tree
+	std::error_code ec;
+	{
+		//A replace-backup of another process finishes its copy first, and a merge that kept the entry keeps the files;
+		//under the list lock either the merge sees the snapshot gone or this sees the entry back
+		YgoFileLock snapshotLock;
+		snapshotLock.Lock(GetSnapshotLockPath(ctx, archivePath), YgoFileLock::EXCLUSIVE);
+		YgoListLockGuard fileLock(ctx.m_YMListPath, YgoFileLock::EXCLUSIVE);
+		if (!fs::exists(fs::symlink_status(archivePath, ec))) {
+			printf("Archive directory %s does not exist, removed it from the list only.\n", archivePath.c_str());
+		}
+		else if (ListRefersToPath(ctx.m_YMListPath, archivePath)) {
+			printf("Archive directory %s was backed up again by another process meanwhile, it is kept.\n", archivePath.c_str());
+		}
+		else if (!MoveToTrash(ctx, archivePath).empty()) {
+			printf("Archive directory %s moved to the trash, its files are removed in the background.\n", archivePath.c_str());
+		}
+		else if (!RemoveTree(archivePath)) {
+			printf("Delete archive directory %s failed.\n", archivePath.c_str());
+		}
+	}
+	//The working copy goes too, unless Data still shows it
+	DropArchiveSlot(ctx, archiveID);
+	InvalidateSummary(ctx, archiveID);
+	UpdateCardIndex(ctx, archiveID, "");
+	UpdateArchiveUsage(ctx, { archiveID });
 	return true;
 }
 
-bool YgoMasterArchiveMgr::RestoreArchive(const int archiveID, const bool backup)
+bool YgoMasterArchiveMgr::RestoreArchive(YgoInstallContext& ctx, const int archiveID, const bool backup, const std::string* presetDesc)
 {
+	std::lock_guard<std::recursive_mutex> writeLock(ctx.m_writeMutex);
+	//The backup before restoring and the new current ArchiveID are written with one commit
+	ListUpdate update(*this, ctx);
+	if (!update.Root()) {
+		printf("Parse ArchiveList file failed for restore.\n");
+		return false;
+	}
 	if (backup) {
 		//Backup current data first
 		printf("Backing up current data before restoring...\n");
-		if (!BackupArchive(m_currentArchiveIndex, false)) {
+		if (!BackupArchive(ctx, ctx.m_currentArchiveIndex, false, presetDesc, EIoOperation::AUTO_BACKUP)) {
 			printf("Backup current data failed, cannot restore archive.\n");
 			return false;
 		}
 	}
 	printf("Restoring ArchiveID %d...\n", archiveID);
 	//Find the archive
-	auto it = m_archives.find(archiveID);
-	if (it == m_archives.end()) {
+	YgoArchiveInfo archive;
+	if (!ctx.m_archives.Get(archiveID, archive)) {
 		printf("ArchiveID %d not found.\n", archiveID);
 		return false;
 	}
-	const YgoArchiveInfo& archive = it->second;
 	//Copy target files or directories back to YMDataPath
-	for (const auto& target : sc_BackupTargets) {
-		fs::path sourcePath = fs::path(archive.m_path) / fs::path(target.second);
-		fs::path destPath = fs::path(m_YMDataPath) / fs::path(target.second);
-		if (!fs::exists(sourcePath)) {
-			printf("Source path %s not exist in the archive, skipping.\n", sourcePath.string().c_str());
-			continue;
+	std::vector<std::pair<std::string, std::string>> inlineFiles;
+	ReadInlineFiles(ctx, archiveID, inlineFiles, update.Root());
+	YgoTargetContext tc;
+	tc.m_dataPath = ctx.m_YMDataPath;
+	tc.m_archivePath = archive.m_path;
+	tc.m_inlineFiles = &inlineFiles;
+	const std::unique_ptr<YgoIoThrottle> throttle = CreateIoThrottle(EIoOperation::RESTORE);
+	tc.m_throttle = throttle.get();
+	if (!AllBackupTargets([&](auto target) { return decltype(target)::Restore(tc); })) {
+		return false;
+	}
+	printf("ArchiveID %d restored successfully.\n", archiveID);
+	//Update Currently in use ArchiveID in ArchiveList file
+	cJSON* currentID = cJSON_GetObjectItem(update.Root(), "Currently in use ArchiveID");
+	if (!currentID || !cJSON_IsNumber(currentID)) {
+		printf("ArchiveList file format error: Currently in use ArchiveID is not a number..\n");
+		return false;
+	}
+	cJSON_SetNumberValue(currentID, archiveID);
+	//Write back to file, ctx.m_currentArchiveIndex follows the edited list
+	if (!update.Commit()) {
+		printf("Write ArchiveList file failed for updating current archive index.\n");
+		return false;
+	}
+	//A linked Players was restored in place, so its working copy now belongs to archiveID
+	FollowCurrentSlot(ctx);
+	printf("Current archive index updated successfully to ArchiveID %d.\n", archiveID);
+	return true;
+}
+
+bool YgoMasterArchiveMgr::RestoreArchiveFiles(YgoInstallContext& ctx, const int archiveID, const YgoRestoreFilter& filter,
+	const bool makeCurrent, std::vector<std::string>* restoredFiles)
+{
+	if (!filter.IsSafe()) {
+		printf("Paths to restore must be relative and must not contain \"..\".\n");
+		return false;
+	}
+	std::lock_guard<std::recursive_mutex> writeLock(ctx.m_writeMutex);
+	const auto start = std::chrono::steady_clock::now();
+	ListUpdate update(*this, ctx);
+	if (!update.Root()) {
+		printf("Parse ArchiveList file failed for restore.\n");
+		return false;
+	}
+	YgoArchiveInfo archive;
+	if (!ctx.m_archives.Get(archiveID, archive)) {
+		printf("ArchiveID %d not found.\n", archiveID);
+		return false;
+	}
+	std::vector<std::pair<std::string, std::string>> inlineFiles;
+	ReadInlineFiles(ctx, archiveID, inlineFiles, update.Root());
+	YgoTargetContext tc;
+	tc.m_dataPath = ctx.m_YMDataPath;
+	tc.m_archivePath = archive.m_path;
+	tc.m_inlineFiles = &inlineFiles;
+	const std::unique_ptr<YgoIoThrottle> throttle = CreateIoThrottle(EIoOperation::RESTORE);
+	tc.m_throttle = throttle.get();
+	std::vector<std::string> restored;
+	if (!AllBackupTargets([&](auto target) { return decltype(target)::RestoreSelected(tc, filter, restored); })) {
+		printf("Restore files of ArchiveID %d failed.\n", archiveID);
+		return false;
+	}
+	if (restored.empty()) {
+		printf("No file of ArchiveID %d matches.\n", archiveID);
+		return false;
+	}
+
+	//Kept in the list, so every process sees what a partial restore put into Data
+	cJSON* root = update.Root();
+	cJSON* history = cJSON_GetObjectItem(root, "PartialRestores");
+	if (!cJSON_IsArray(history)) {
+		cJSON_DeleteItemFromObject(root, "PartialRestores");
+		history = cJSON_AddArrayToObject(root, "PartialRestores");
+	}
+	const uint64_t nowMs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count());
+	cJSON* record = cJSON_CreateObject();
+	cJSON_AddNumberToObject(record, "ArchiveID", archiveID);
+	cJSON_AddStringToObject(record, "Time", FormatSnapshotId(nowMs).c_str());
+	cJSON* patterns = cJSON_AddArrayToObject(record, "Patterns");
+	for (const auto& pattern : filter.m_patterns) {
+		cJSON_AddItemToArray(patterns, cJSON_CreateString(pattern.c_str()));
+	}
+	cJSON_AddNumberToObject(record, "FileCount", static_cast<double>(restored.size()));
+	cJSON* files = cJSON_AddArrayToObject(record, "Files");
+	for (size_t i = 0; i < restored.size() && i < PARTIAL_RESTORE_LISTED_FILES; ++i) {
+		cJSON_AddItemToArray(files, cJSON_CreateString(restored[i].c_str()));
+	}
+	cJSON_AddItemToArray(history, record);
+	while (cJSON_GetArraySize(history) > PARTIAL_RESTORE_HISTORY_SIZE) {
+		cJSON_DeleteItemFromArray(history, 0);
+	}
+	cJSON* currentID = cJSON_GetObjectItem(root, "Currently in use ArchiveID");
+	if (makeCurrent && cJSON_IsNumber(currentID)) {
+		cJSON_SetNumberValue(currentID, archiveID);
+	}
+	if (!update.Commit()) {
+		printf("Write ArchiveList file failed for restore.\n");
+		return false;
+	}
+	if (makeCurrent) {
+		FollowCurrentSlot(ctx);
+	}
+
+	const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+	printf("Restored %zu files of ArchiveID %d in %.1f ms:\n", restored.size(), archiveID, elapsed / 1000.0);
+	for (size_t i = 0; i < restored.size() && i < PARTIAL_RESTORE_LISTED_FILES; ++i) {
+		printf("\t%s\n", restored[i].c_str());
+	}
+	if (restored.size() > PARTIAL_RESTORE_LISTED_FILES) {
+		printf("\t...\n");
+	}
+	if (makeCurrent) {
+		printf("Current archive index updated successfully to ArchiveID %d.\n", archiveID);
+	}
+	if (restoredFiles) {
+		*restoredFiles = std::move(restored);
+	}
+	return true;
+}
+
+std::shared_ptr<YgoInstallContext> YgoMasterArchiveMgr::FindInstall(const std::string& name) const
+{
+	std::shared_lock<std::shared_mutex> lock(m_installsMutex);
+	for (const auto& install : m_installs) {
+		if (install->m_name == name) {
+			return install;
+		}
+	}
+	return nullptr;
+}
+
+bool YgoMasterArchiveMgr::SwitchInstall()
+{
+	std::vector<std::string> names;
+	{
+		std::shared_lock<std::shared_mutex> lock(m_installsMutex);
+		for (const auto& install : m_installs) {
+			names.push_back(install->m_name);
+		}
+	}
+	printf("*------------------ Installs ------------------*\n");
+	for (size_t i = 0; i < names.size(); ++i) {
+		printf("\t%zu. %s\n", i, names[i].c_str());
+	}
+	printf("*----------------------------------------------*\n");
+	printf("Enter install number: ");
+	int index;
+	std::cin >> index;
+	if (std::cin.fail() || index < 0 || index >= static_cast<int>(names.size())) {
+		std::cin.clear(); // Clear the error flag
+		std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n'); // Discard invalid input
+		printf("Invalid install number.\n");
+		return false;
+	}
+	auto install = FindInstall(names[index]);
+	if (!install) {
+		printf("Install %s not found.\n", names[index].c_str());
+		return false;
+	}
+	m_activeInstall = install;
+	printf("Switched to install %s.\n", install->m_name.c_str());
+	return true;
+}
+
+void YgoMasterArchiveMgr::RunDaemon(const std::string& socketPath)
+{
+	if (!LoadInstalls()) {
+		return;
+	}
+	const std::string path = socketPath.empty() ? (fs::current_path() / sc_daemonSocketName).string() : socketPath;
+	YgoDaemonServer server(path, [this](const std::string& request) { return HandleDaemonRequest(request); });
+	m_daemonServer = &server;
+	server.Run();
+	m_daemonServer = nullptr;
+}
+
+void YgoMasterArchiveMgr::RefreshArchivesIfChanged(YgoInstallContext& ctx)
+{
+	std::error_code ec;
+	const auto writeTime = fs::last_write_time(ctx.m_YMListPath, ec);
+	{
+		std::shared_lock<std::shared_mutex> lock(ctx.m_dataMutex);
+		if (ec || writeTime == ctx.m_listWriteTime) {
+			return;
+		}
+	}
+	{
+		//Only the table is replaced, so a reader does not wait for a running backup behind ctx.m_writeMutex;
+		//edits of a running update are not on disk yet, its commit merges the other changes in
+		std::unique_lock<std::shared_mutex> lock(ctx.m_dataMutex);
+		if (ctx.m_tableAhead || writeTime == ctx.m_listWriteTime) {
+			return;
+		}
+		printf("ArchiveList of install %s changed on disk, reloading.\n", ctx.m_name.c_str());
+		QuerryArchiveListLocked(ctx, DEFAULT_MAX_ARCHIVE_LIST_SIZE, false, true);
+	}
+	InvalidateSummary(ctx, -1);
+}
+
+int YgoMasterArchiveMgr::CoalescedBackup(YgoInstallContext& ctx, const int targetID, const bool copy, const std::string& desc, bool& coalesced)
+{
+	/*
+	* A job stays pending until it owns the install writer lock, requests asking for the same target, copy and
+	* description arriving meanwhile join it, other requests queue their own job.
+	* Once it starts copying a new request queues a new job, so a backup never misses later changes.
+	*/
+	const auto key = std::make_tuple(targetID, copy, desc);
+	std::shared_ptr<YgoBackupJob> job;
+	{
+		std::lock_guard<std::mutex> lock(ctx.m_backupQueueMutex);
+		auto found = ctx.m_pendingBackups.find(key);
+		coalesced = (found != ctx.m_pendingBackups.end());
+		if (!coalesced) {
+			found = ctx.m_pendingBackups.emplace(key, std::make_shared<YgoBackupJob>()).first;
+		}
+		job = found->second;
+	}
+	if (coalesced) {
+		return job->m_result.get();
+	}
+
+	std::lock_guard<std::recursive_mutex> writeLock(ctx.m_writeMutex);
+	{
+		std::lock_guard<std::mutex> lock(ctx.m_backupQueueMutex);
+		ctx.m_pendingBackups.erase(key);
+	}
+	int archiveID = -1;
+	//Daemon backups come from scripts and timers, so they run with the automatic budget
+	if (BackupArchive(ctx, targetID, copy, &desc, EIoOperation::AUTO_BACKUP)) {
+		std::shared_lock<std::shared_mutex> lock(ctx.m_dataMutex);
+		archiveID = ctx.m_currentArchiveIndex;
+	}
+	job->m_promise.set_value(archiveID);
+	return archiveID;
+}
+
+std::string YgoMasterArchiveMgr::HandleDaemonRequest(const std::string& request)
+{
+	/*
+	* Request: {"cmd": "...", "install": "...", ...}, install defaults to the first install.
+	* Reply: {"ok": true|false, "error": "...", ...}
+	*/
+	cJSON* reply = cJSON_CreateObject();
+	auto finish = [&reply](const bool ok, const char* error) {
+		cJSON_AddBoolToObject(reply, "ok", ok);
+		if (error) {
+			cJSON_AddStringToObject(reply, "error", error);
+		}
+		char* text = cJSON_PrintUnformatted(reply);
+		std::string result = text ? text : "{\"ok\":false}";
+		cJSON_free(text);
+		cJSON_Delete(reply);
+		return result;
+	};
+	auto addArchive = [](cJSON* object, const YgoArchiveInfo& info) {
+		cJSON_AddNumberToObject(object, "id", info.m_id);
+		cJSON_AddStringToObject(object, "Name", info.m_name.c_str());
+		cJSON_AddStringToObject(object, "Path", info.m_path.c_str());
+		cJSON_AddStringToObject(object, "Description", info.m_desc.c_str());
+		cJSON_AddStringToObject(object, "LastBackupTime", info.m_time.c_str());
+	};
+
+	cJSON* root = cJSON_ParseWithLength(request.data(), request.size());
+	if (!root) {
+		return finish(false, "invalid request");
+	}
+	cJSON* cmdItem = cJSON_GetObjectItem(root, "cmd");
+	cJSON* installItem = cJSON_GetObjectItem(root, "install");
+	cJSON* idItem = cJSON_GetObjectItem(root, "id");
+	const std::string cmd = cJSON_IsString(cmdItem) ? cmdItem->valuestring : "";
+
+	std::shared_ptr<YgoInstallContext> ctx;
+	if (cJSON_IsString(installItem)) {
+		ctx = FindInstall(installItem->valuestring);
+	}
+	else if (installItem) {
+		cJSON_Delete(root);
+		return finish(false, "install must be a name");
+	}
+	else {
+		std::shared_lock<std::shared_mutex> lock(m_installsMutex);
+		ctx = m_installs.empty() ? nullptr : m_installs.front();
+	}
+
+	if (cmd == "ping") {
+		cJSON_Delete(root);
+		return finish(true, nullptr);
+	}
+	if (cmd == "shutdown") {
+		cJSON_Delete(root);
+		if (m_daemonServer) {
+			m_daemonServer->Stop();
+		}
+		return finish(true, nullptr);
+	}
+	if (cmd == "installs") {
+		cJSON* array = cJSON_AddArrayToObject(reply, "installs");
+		std::shared_lock<std::shared_mutex> lock(m_installsMutex);
+		for (const auto& install : m_installs) {
+			cJSON* item = cJSON_CreateObject();
+			cJSON_AddStringToObject(item, "Name", install->m_name.c_str());
+			cJSON_AddStringToObject(item, "YMDataPath", install->m_YMDataPath.c_str());
+			cJSON_AddItemToArray(array, item);
+		}
+		cJSON_Delete(root);
+		return finish(true, nullptr);
+	}
+	if (!ctx) {
+		cJSON_Delete(root);
+		return finish(false, "install not found");
+	}
+	//Caller holds ctx->m_usageMutex
+	auto addUsage = [&ctx](cJSON* object, const int archiveID) {
+		if (ctx->m_usageIndex.HasArchive(archiveID)) {
+			const YgoUsageIndex::Usage usage = ctx->m_usageIndex.GetUsage(archiveID);
+			cJSON_AddNumberToObject(object, "ExclusiveBytes", static_cast<double>(usage.m_exclusiveBytes));
+			cJSON_AddNumberToObject(object, "SharedBytes", static_cast<double>(usage.m_sharedBytes));
 		}
-		try {
-			if (target.first == IS_FILE) {
-				fs::copy_file(sourcePath, destPath, fs::copy_options::overwrite_existing);
+	};
+	RefreshArchivesIfChanged(*ctx);
+
+	if (cmd == "list" || cmd == "search") {
+		cJSON* keywordItem = cJSON_GetObjectItem(root, "keyword");
+		const std::string keyword = cJSON_IsString(keywordItem) ? keywordItem->valuestring : "";
+		std::shared_lock<std::shared_mutex> lock(ctx->m_dataMutex);
+		std::vector<size_t> rows;
+		if (cmd == "search") {
+			ctx->m_archives.Filter(keyword, rows);
+		}
+		else {
+			for (size_t row = 0; row < ctx->m_archives.Size(); ++row) {
+				rows.push_back(row);
 			}
-			else if (target.first == IS_DIRECTORY) {
-				fs::copy(sourcePath, destPath, fs::copy_options::recursive | fs::copy_options::overwrite_existing);
+		}
+		cJSON_AddNumberToObject(reply, "current", ctx->m_currentArchiveIndex);
+		std::lock_guard<std::mutex> usageLock(ctx->m_usageMutex);
+		if (ctx->m_usageIndex.IsLoaded()) {
+			cJSON_AddNumberToObject(reply, "TotalBytes", static_cast<double>(ctx->m_usageIndex.TotalBytes()));
+			cJSON_AddNumberToObject(reply, "SharedBytes", static_cast<double>(ctx->m_usageIndex.SharedBytes()));
+		}
+		cJSON* array = cJSON_AddArrayToObject(reply, "archives");
+		YgoArchiveInfo info;
+		for (size_t row : rows) {
+			ctx->m_archives.GetRow(row, info);
+			cJSON* item = cJSON_CreateObject();
+			addArchive(item, info);
+			addUsage(item, info.m_id);
+			cJSON_AddItemToArray(array, item);
+		}
+		cJSON_Delete(root);
+		return finish(true, nullptr);
+	}
+	if (cmd == "detail") {
+		std::shared_lock<std::shared_mutex> lock(ctx->m_dataMutex);
+		const int archiveID = (cJSON_IsNumber(idItem) && idItem->valueint != -1) ? idItem->valueint : ctx->m_currentArchiveIndex;
+		cJSON_Delete(root);
+		YgoArchiveInfo info;
+		if (!ctx->m_archives.Get(archiveID, info)) {
+			return finish(false, "archive not found");
+		}
+		addArchive(reply, info);
+		{
+			std::lock_guard<std::mutex> usageLock(ctx->m_usageMutex);
+			addUsage(reply, info.m_id);
+		}
+		YgoArchiveSummary summary;
+		if (GetArchiveSummary(*ctx, info, summary)) {
+			cJSON_AddNumberToObject(reply, "Code", summary.m_code);
+			cJSON_AddNumberToObject(reply, "Gems", summary.m_gems);
+		}
+		return finish(true, nullptr);
+	}
+	if (cmd == "card") {
+		cJSON* minItem = cJSON_GetObjectItem(root, "min");
+		const int minCount = cJSON_IsNumber(minItem) ? minItem->valueint : 1;
+		if (!cJSON_IsNumber(idItem)) {
+			cJSON_Delete(root);
+			return finish(false, "id is required");
+		}
+		const uint32_t cardId = static_cast<uint32_t>(idItem->valuedouble);
+		cJSON_Delete(root);
+		std::shared_lock<std::shared_mutex> lock(ctx->m_dataMutex);
+		std::lock_guard<std::mutex> indexLock(ctx->m_cardIndexMutex);
+		EnsureCardIndex(*ctx);
+		std::vector<YgoCardIndex::Posting> postings;
+		ctx->m_cardIndex.FindCard(cardId, static_cast<uint16_t>(std::clamp(minCount, 0, 65535)), postings);
+		cJSON* array = cJSON_AddArrayToObject(reply, "archives");
+		for (const auto& posting : postings) {
+			YgoArchiveInfo info;
+			if (!ctx->m_archives.Get(posting.m_archiveID, info)) continue;
+			cJSON* item = cJSON_CreateObject();
+			addArchive(item, info);
+			cJSON_AddNumberToObject(item, "Count", posting.m_count);
+			cJSON_AddItemToArray(array, item);
+		}
+		return finish(true, nullptr);
+	}
+	if (cmd == "deck") {
+		cJSON* nameItem = cJSON_GetObjectItem(root, "name");
+		if (!cJSON_IsString(nameItem)) {
+			cJSON_Delete(root);
+			return finish(false, "name is required");
+		}
+		const std::string deckName = nameItem->valuestring;
+		cJSON_Delete(root);
+		std::shared_lock<std::shared_mutex> lock(ctx->m_dataMutex);
+		std::lock_guard<std::mutex> indexLock(ctx->m_cardIndexMutex);
+		EnsureCardIndex(*ctx);
+		std::vector<int> containing;
+		ctx->m_cardIndex.FindDeck(deckName, containing);
+		cJSON* array = cJSON_AddArrayToObject(reply, "archives");
+		for (int archiveID : containing) {
+			YgoArchiveInfo info;
+			if (!ctx->m_archives.Get(archiveID, info)) continue;
+			cJSON* item = cJSON_CreateObject();
+			addArchive(item, info);
+			cJSON_AddItemToArray(array, item);
+		}
+		return finish(true, nullptr);
+	}
+	if (cmd == "verify") {
+		const int archiveID = cJSON_IsNumber(idItem) ? idItem->valueint : -1;
+		cJSON_Delete(root);
+		YgoVerifyResult result;
+		const bool ok = VerifyArchive(*ctx, archiveID, result);
+		cJSON_AddNumberToObject(reply, "files", static_cast<double>(result.m_files));
+		cJSON_AddNumberToObject(reply, "bytes", static_cast<double>(result.m_bytes));
+		cJSON_AddNumberToObject(reply, "problems", result.m_problems);
+		cJSON_AddNumberToObject(reply, "changed", result.m_changed);
+		return finish(ok, ok ? nullptr : "verify failed");
+	}
+	if (cmd == "patch") {
+		//{"cmd":"patch","field":"Gems","value":500,"ids":[1,2]|"archives":"all|1,2|keyword","file":"Players/Local/Player.json"}
+		cJSON* fieldItem = cJSON_GetObjectItem(root, "field");
+		cJSON* valueItem = cJSON_GetObjectItem(root, "value");
+		cJSON* idsItem = cJSON_GetObjectItem(root, "ids");
+		cJSON* archivesItem = cJSON_GetObjectItem(root, "archives");
+		cJSON* fileItem = cJSON_GetObjectItem(root, "file");
+		if (!cJSON_IsString(fieldItem) || !valueItem || (!cJSON_IsNumber(valueItem) && !cJSON_IsString(valueItem) && !cJSON_IsBool(valueItem))) {
+			cJSON_Delete(root);
+			return finish(false, "field and value are required");
+		}
+		const std::string fieldPath = fieldItem->valuestring;
+		const std::string relPath = cJSON_IsString(fileItem) ? fileItem->valuestring : sc_YgoPlayerJsonSearchPath;
+		char* valueText = cJSON_PrintUnformatted(valueItem);
+		const std::string value = valueText ? valueText : "";
+		cJSON_free(valueText);
+		std::vector<int> archiveIDs;
+		if (cJSON_IsArray(idsItem)) {
+			cJSON* item = nullptr;
+			cJSON_ArrayForEach(item, idsItem) {
+				if (cJSON_IsNumber(item)) {
+					archiveIDs.push_back(item->valueint);
+				}
 			}
-			else {
-				printf("Unknown target type for %s, skipping.\n", sourcePath.string().c_str());
+		}
+		else if (cJSON_IsNumber(archivesItem)) {
+			archiveIDs.push_back(archivesItem->valueint);
+		}
+		else {
+			SelectArchives(*ctx, cJSON_IsString(archivesItem) ? archivesItem->valuestring : "all", archiveIDs);
+		}
+		cJSON_Delete(root);
+		const int changed = BulkPatchField(*ctx, archiveIDs, relPath, fieldPath, value);
+		cJSON_AddNumberToObject(reply, "changed", changed);
+		return finish(true, nullptr);
+	}
+	if (cmd == "backup") {
+		cJSON* copyItem = cJSON_GetObjectItem(root, "copy");
+		cJSON* descItem = cJSON_GetObjectItem(root, "desc");
+		const bool copy = cJSON_IsTrue(copyItem);
+		const std::string desc = cJSON_IsString(descItem) ? descItem->valuestring : "";
+		int targetID;
+		{
+			std::shared_lock<std::shared_mutex> lock(ctx->m_dataMutex);
+			targetID = cJSON_IsNumber(idItem) ? idItem->valueint : ctx->m_currentArchiveIndex;
+		}
+		cJSON_Delete(root);
+		bool coalesced = false;
+		const int archiveID = CoalescedBackup(*ctx, targetID, copy, desc, coalesced);
+		cJSON_AddNumberToObject(reply, "id", archiveID);
+		cJSON_AddBoolToObject(reply, "coalesced", coalesced);
+		return finish(archiveID != -1, archiveID != -1 ? nullptr : "backup failed");
+	}
+	if (cmd == "restore") {
+		cJSON* backupItem = cJSON_GetObjectItem(root, "backup");
+		cJSON* pathsItem = cJSON_GetObjectItem(root, "paths");
+		cJSON* currentItem = cJSON_GetObjectItem(root, "current");
+		const bool backup = cJSON_IsTrue(backupItem);
+		const int archiveID = cJSON_IsNumber(idItem) ? idItem->valueint : -1;
+		YgoRestoreFilter filter;
+		SplitPatterns(cJSON_IsString(pathsItem) ? pathsItem->valuestring : "", filter.m_patterns);
+		const bool makeCurrent = cJSON_IsTrue(currentItem);
+		cJSON_Delete(root);
+		if (-1 == archiveID) {
+			return finish(false, "id is required");
+		}
+		if (!filter.m_patterns.empty()) {
+			//{"cmd":"restore","id":3,"paths":"Settings.json,Players/**/Player.json","current":false}
+			std::vector<std::string> restored;
+			const bool ok = RestoreArchiveFiles(*ctx, archiveID, filter, makeCurrent, &restored);
+			cJSON* array = cJSON_AddArrayToObject(reply, "files");
+			for (const auto& file : restored) {
+				cJSON_AddItemToArray(array, cJSON_CreateString(file.c_str()));
 			}
+			cJSON_AddNumberToObject(reply, "id", archiveID);
+			return finish(ok, ok ? nullptr : "restore failed");
 		}
-		catch (const fs::filesystem_error& e) {
-			printf("Error restoring %s to %s: %s\n",
-				sourcePath.string().c_str(),
-				destPath.string().c_str(),
-				e.what());
-			return false;
+		//The backup before restoring keeps the description of the current archive
+		std::string desc;
+		{
+			std::shared_lock<std::shared_mutex> lock(ctx->m_dataMutex);
+			const size_t row = ctx->m_archives.Find(ctx->m_currentArchiveIndex);
+			desc = (YgoArchiveTable::npos != row) ? std::string(ctx->m_archives.DescAt(row)) : "";
 		}
+		const bool ok = RestoreArchive(*ctx, archiveID, backup, &desc);
+		cJSON_AddNumberToObject(reply, "id", archiveID);
+		return finish(ok, ok ? nullptr : "restore failed");
 	}
-	printf("ArchiveID %d restored successfully.\n", archiveID);
-	//Update Currently in use ArchiveID in ArchiveList file
-	std::fstream file(m_YMListPath,
-		std::ios::in | std::ios::out | std::ios::binary);
-	if (!file.is_open()) {
-		printf("Open ArchiveList file failed for updating current archive index.\n");
-		return false;
+
+	if (cmd == "diff") {
+		//{"cmd":"diff","from":1,"to":2}, a missing side or -1 is the live Data directory
+		cJSON* fromItem = cJSON_GetObjectItem(root, "from");
+		cJSON* toItem = cJSON_GetObjectItem(root, "to");
+		const int beforeID = cJSON_IsNumber(fromItem) ? fromItem->valueint : DIFF_DATA_ID;
+		const int afterID = cJSON_IsNumber(toItem) ? toItem->valueint : DIFF_DATA_ID;
+		cJSON_Delete(root);
+		YgoArchiveDiff diff;
+		if (!DiffArchives(*ctx, beforeID, afterID, diff)) {
+			return finish(false, "compare failed");
+		}
+		static const char* const kinds[] = { "added", "removed", "changed" };
+		cJSON* array = cJSON_AddArrayToObject(reply, "changes");
+		for (const auto& change : diff.m_changes) {
+			std::string path;
+			for (const auto& key : change.m_path) {
+				path += (path.empty() ? "" : "/") + key;
+			}
+			cJSON* item = cJSON_CreateObject();
+			cJSON_AddStringToObject(item, "path", path.c_str());
+			cJSON_AddStringToObject(item, "change", kinds[change.m_kind]);
+			if (change.m_kind != YgoJsonChange::ADDED) {
+				cJSON_AddStringToObject(item, "before", change.m_before.c_str());
+			}
+			if (change.m_kind != YgoJsonChange::REMOVED) {
+				cJSON_AddStringToObject(item, "after", change.m_after.c_str());
+			}
+			if (change.m_path.size() >= 2 && "Decks" == change.m_path[0]) {
+				cJSON_AddStringToObject(item, "deck", diff.m_deckNames[change.m_path[1]].c_str());
+			}
+			cJSON_AddItemToArray(array, item);
+		}
+		cJSON_AddNumberToObject(reply, "visited", static_cast<double>(diff.m_visitedNodes));
+		cJSON_AddNumberToObject(reply, "nodes", static_cast<double>(diff.m_totalNodes));
+		return finish(true, nullptr);
 	}
-	std::string jsonContent((std::istreambuf_iterator<char>(file)),
-		std::istreambuf_iterator<char>());
-	cJSON* root = cJSON_Parse(jsonContent.c_str());
-	if (!root) {
-		printf("Parse ArchiveList file failed for updating current archive index.\n");
-		file.close();
-		return false;
+	if (cmd == "timeline") {
+		//{"cmd":"timeline","export":"timeline.csv"}, export is optional
+		cJSON* exportItem = cJSON_GetObjectItem(root, "export");
+		const std::string exportPath = cJSON_IsString(exportItem) ? exportItem->valuestring : "";
+		cJSON_Delete(root);
+		std::vector<YgoTimelinePoint> points;
+		size_t readCount = 0;
+		BuildTimeline(*ctx, points, &readCount);
+		if (!exportPath.empty()) {
+			const bool csv = fs::path(exportPath).extension() == ".csv";
+			if (!ReplaceFileContent(exportPath, csv ? FormatTimelineCsv(points) : FormatTimelineJson(points))) {
+				return finish(false, "export failed");
+			}
+		}
+		cJSON_AddItemToObject(reply, "points", cJSON_Parse(FormatTimelineJson(points).c_str()));
+		cJSON_AddNumberToObject(reply, "read", static_cast<double>(readCount));
+		return finish(true, nullptr);
 	}
-	cJSON* currentID = cJSON_GetObjectItem(root, "Currently in use ArchiveID");
-	if (!currentID || !cJSON_IsNumber(currentID)) {
-		printf("ArchiveList file format error: Currently in use ArchiveID is not a number..\n");
+	if (cmd == "export") {
+		//{"cmd":"export","archives":"1,2","file":"archives.ymbundle"}, archives is a selector as in bulk edit
+		cJSON* archivesItem = cJSON_GetObjectItem(root, "archives");
+		cJSON* fileItem = cJSON_GetObjectItem(root, "file");
+		const std::string bundlePath = cJSON_IsString(fileItem) ? fileItem->valuestring : "";
+		std::vector<int> archiveIDs;
+		if (cJSON_IsNumber(archivesItem)) {
+			archiveIDs.push_back(archivesItem->valueint);
+		}
+		else {
+			SelectArchives(*ctx, cJSON_IsString(archivesItem) ? archivesItem->valuestring : "all", archiveIDs);
+		}
 		cJSON_Delete(root);
-		file.close();
-		return false;
+		if (bundlePath.empty()) {
+			return finish(false, "file is required");
+		}
+		const bool ok = ExportArchives(*ctx, archiveIDs, bundlePath);
+		cJSON_AddNumberToObject(reply, "exported", ok ? static_cast<double>(archiveIDs.size()) : 0);
+		return finish(ok, ok ? nullptr : "export failed");
 	}
-	cJSON_SetNumberValue(currentID, archiveID);
-	//Write back to file
-	std::string jsonFileString = std::string(cJSON_Print(root));
-	file.seekp(0, std::ios::beg);
-	file.write(jsonFileString.c_str(), jsonFileString.size());
+	if (cmd == "import") {
+		//{"cmd":"import","file":"archives.ymbundle"}
+		cJSON* fileItem = cJSON_GetObjectItem(root, "file");
+		const std::string bundlePath = cJSON_IsString(fileItem) ? fileItem->valuestring : "";
+		cJSON_Delete(root);
+		if (bundlePath.empty()) {
+			return finish(false, "file is required");
+		}
+		std::vector<int> importedIDs;
+		const bool ok = ImportArchives(*ctx, bundlePath, &importedIDs);
+		cJSON* array = cJSON_AddArrayToObject(reply, "ids");
+		for (int archiveID : importedIDs) {
+			cJSON_AddItemToArray(array, cJSON_CreateNumber(archiveID));
+		}
+		return finish(ok, ok ? nullptr : "import failed");
+	}
+	if (cmd == "switch") {
+		const int archiveID = cJSON_IsNumber(idItem) ? idItem->valueint : -1;
+		cJSON_Delete(root);
+		if (-1 == archiveID) {
+			return finish(false, "id is required");
+		}
+		const bool ok = SwitchArchive(*ctx, archiveID);
+		cJSON_AddNumberToObject(reply, "id", archiveID);
+		return finish(ok, ok ? nullptr : "switch failed");
+	}
+
 	cJSON_Delete(root);
-	file.close();
-	//Update current archive index
-	m_currentArchiveIndex = archiveID;
-	printf("Current archive index updated successfully to ArchiveID %d.\n", archiveID);
-	return true;
+	return finish(false, "unknown cmd");
+}
+
+int RunYgoMasterClient(const std::string& socketPath, int argc, char** argv)
+{
+	if (argc < 1) {
+		printf("Usage: --client <ping|installs|list|search|detail|card|deck|verify|switch|diff|timeline|export|import|patch|backup|restore|shutdown> [key=value ...]\n");
+		return 1;
+	}
+
+	//Build the request from "key=value" arguments, values are strings except for the keys the daemon reads as numbers or flags
+	static const std::set<std::string> numberKeys = { "id", "min", "from", "to" };
+	static const std::set<std::string> flagKeys = { "copy", "backup", "current" };
+	cJSON* request = cJSON_CreateObject();
+	cJSON_AddStringToObject(request, "cmd", argv[0]);
+	for (int i = 1; i < argc; ++i) {
+		const std::string arg = argv[i];
+		const size_t split = arg.find('=');
+		if (split == std::string::npos) {
+			printf("Ignoring argument %s, expected key=value.\n", arg.c_str());
+			continue;
+		}
+		const std::string key = arg.substr(0, split);
+		const std::string value = arg.substr(split + 1);
+		char* end = nullptr;
+		const double number = strtod(value.c_str(), &end);
+		const bool isNumber = !value.empty() && end && *end == '\0';
+		const bool isFlag = value == "true" || value == "false";
+		//A patched field takes the type its value is written in
+		const bool typed = "value" == key;
+		if ((flagKeys.count(key) || typed) && isFlag) {
+			cJSON_AddBoolToObject(request, key.c_str(), value == "true");
+		}
+		else if ((numberKeys.count(key) || typed) && isNumber) {
+			cJSON_AddNumberToObject(request, key.c_str(), number);
+		}
+		else {
+			cJSON_AddStringToObject(request, key.c_str(), value.c_str());
+		}
+	}
+	char* text = cJSON_PrintUnformatted(request);
+	const std::string payload = text ? text : "";
+	cJSON_free(text);
+	cJSON_Delete(request);
+
+	const std::string path = socketPath.empty() ? (fs::current_path() / sc_daemonSocketName).string() : socketPath;
+	std::string reply;
+	if (!SendDaemonRequest(path, payload, reply)) {
+		printf("Cannot reach daemon at %s.\n", path.c_str());
+		return 1;
+	}
+	printf("%s\n", reply.c_str());
+	cJSON* root = cJSON_ParseWithLength(reply.data(), reply.size());
+	const bool ok = root && cJSON_IsTrue(cJSON_GetObjectItem(root, "ok"));
+	cJSON_Delete(root);
+	return ok ? 0 : 1;
 }
 
 void GetYgoMasterMgr(IYgoMasterMgr** imp)
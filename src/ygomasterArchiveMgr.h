@@ -1,5 +1,21 @@
 #include<interface.h>
 #include"public.h"
+#include"ygomasterPack.h"
+#include"ygomasterCardIndex.h"
+#include"ygomasterArchiveTable.h"
+#include"ygomasterBackupPolicy.h"
+#include"ygomasterIoThrottle.h"
+#include"ygomasterColdStore.h"
+#include"ygomasterUsage.h"
+#include"ygomasterJsonTree.h"
+#include"ygomasterTimeline.h"
+#include"ygomasterBundle.h"
+#include<future>
+#include<map>
+#include<tuple>
+#include<atomic>
+
+struct cJSON;
 
 //Input options
 enum class EInputOption: int
@@ -12,6 +28,18 @@ enum class EInputOption: int
 	DELETE_ARCHIVE, // Delete a specific archive
 	RESTORE_ARCHIVE, // Restore a specific archive
 	RESTORE_ARCHIVE_WITH_BACKUP, // Restore a specific archive with backup
+	SEARCH_ARCHIVE, // Search archives by name, description or time
+	SWITCH_INSTALL, // Switch the YgoMaster install the menu works on
+	SEARCH_CARD, // Find archives owning a card
+	DECK_HISTORY, // Find when a deck appeared and was lost
+	BULK_EDIT, // Change one Player.json field of many archives
+	VERIFY_ARCHIVE, // Check an archive is complete and compare it with Data
+	SWITCH_ARCHIVE, // Make an archive current by relinking its working copy
+	DIFF_ARCHIVES, // Show what differs between two archives or an archive and Data
+	TIMELINE, // Gems, collection size and deck count of every archive over time
+	EXPORT_ARCHIVES, // Write archives into a portable bundle
+	IMPORT_BUNDLE, // Add the archives of a bundle as new archives
+	RESTORE_FILES, // Restore only some targets or files of an archive
 	SIZE_OF_OPTIONS // Keep this as the last item
 };
 static const std::vector<std::pair<int, std::string>> sc_InputOptions = {
@@ -22,83 +50,277 @@ static const std::vector<std::pair<int, std::string>> sc_InputOptions = {
 	{ (int)EInputOption::DISPLAY_ARCHIVE_DETAIL, "Display a info of archive" },
 	{ (int)EInputOption::DELETE_ARCHIVE, "Delete a specific archive" },
     { (int)EInputOption::RESTORE_ARCHIVE, "Restore a specific archive" },
-    { (int)EInputOption::RESTORE_ARCHIVE_WITH_BACKUP, "Restore a specific archive after backup(replace)" }
+    { (int)EInputOption::RESTORE_ARCHIVE_WITH_BACKUP, "Restore a specific archive after backup(replace)" },
+	{ (int)EInputOption::SEARCH_ARCHIVE, "Search archives by keyword" },
+	{ (int)EInputOption::SWITCH_INSTALL, "Switch YgoMaster install" },
+	{ (int)EInputOption::SEARCH_CARD, "Find archives owning a card" },
+	{ (int)EInputOption::DECK_HISTORY, "Find when a deck was lost" },
+	{ (int)EInputOption::BULK_EDIT, "Edit a field of many archives" },
+	{ (int)EInputOption::VERIFY_ARCHIVE, "Verify a specific archive" },
+	{ (int)EInputOption::SWITCH_ARCHIVE, "Switch to a specific archive instantly (keeps a working copy per archive)" },
+	{ (int)EInputOption::DIFF_ARCHIVES, "Compare two archives, or an archive with the current Data" },
+	{ (int)EInputOption::TIMELINE, "Show gems, cards and decks over time (export to CSV/JSON)" },
+	{ (int)EInputOption::EXPORT_ARCHIVES, "Export archives to a bundle file" },
+	{ (int)EInputOption::IMPORT_BUNDLE, "Import archives from a bundle file" },
+	{ (int)EInputOption::RESTORE_FILES, "Restore some files of an archive (target names or path globs)" }
 };
 
-// Search paths for YgoMaster Data directory
+// Search paths for YgoMaster Data directory, relative to the working directory
 static const std::vector<std::string> sc_YgoArchiveSearchPaths = {
-	"\\..\\Data",
-	"\\Data",
-	"\\YgoMaster\\Data",
+	"../Data",
+	"Data",
+	"YgoMaster/Data",
 };
 
-static const std::string sc_YgoPlayerJsonSearchPath = "\\Players\\Local\\Player.json";
-static const std::string sc_YgoSettingsJsonSearchPath = "\\Settings.json";
+// Paths relative to the Data directory or an archive directory, joined with fs::path so they work on every platform
+static const std::string sc_YgoPlayerJsonSearchPath = "Players/Local/Player.json";
+static const std::string sc_YgoSettingsJsonSearchPath = "Settings.json";
+static const std::string sc_YgoDecksSearchPath = "Players/Local/Decks";
 
-// Backup targets: files or directories under the YgoMaster Data directory
-constexpr int IS_FILE = 0;
-constexpr int IS_DIRECTORY = 1;
-static const std::vector<std::pair<int, std::string>> sc_BackupTargets = {
-	{ IS_FILE, "Settings.json"},
-	{ IS_DIRECTORY, "Players"}
-};
+// ArchiveID standing for the live YgoMaster Data directory in a diff
+constexpr int DIFF_DATA_ID = -1;
+// Changes listed per section of a diff, the rest is only counted
+constexpr size_t DIFF_MAX_LISTED_CHANGES = 20;
+
+// Newest archives shown by the timeline, an export holds all of them
+constexpr size_t TIMELINE_DISPLAY_ROWS = 20;
+
+// Partial restores kept in "PartialRestores" of ArchiveList, and files listed per restore
+constexpr int PARTIAL_RESTORE_HISTORY_SIZE = 16;
+constexpr size_t PARTIAL_RESTORE_LISTED_FILES = 32;
 
 // Default maximum number of archives to display
 constexpr int DEFAULT_MAX_ARCHIVE_LIST_SIZE = 5;
 
-// Structure to hold YgoMaster Archive information
-struct YgoArchiveInfo
+// Archives are stored as <ArchivesPath>/<year>/<month>/<snapshot id>, flat archives of older versions are moved there
+constexpr int ARCHIVE_MIGRATION_BATCH_SIZE = 1024;
+
+// Deleted archives and working copies are renamed into <ArchivesPath>/Trash and unlinked there in the background
+static const std::string sc_trashDirName = "Trash";
+
+// Lock files of snapshots rewritten in place, <ArchivesPath>/Locks/<snapshot id>.lock, a replace-backup and the move to the trash take it
+static const std::string sc_snapshotLocksDirName = "Locks";
+
+// Name of the install described by the top level paths of config file
+static const std::string sc_defaultInstallName = "Default";
+
+// Player data read from Player.json of an archive, cached per archive
+struct YgoArchiveSummary
+{
+	int m_code;
+	int m_gems;
+	bool m_valid; // false if Player.json could not be read
+
+	YgoArchiveSummary() :m_code(0), m_gems(0), m_valid(false) {}
+};
+
+// Differences between two archives, see DiffArchives
+struct YgoArchiveDiff
+{
+	// Paths start with "Player" (Player.json), "Decks" (deck file name) or "Settings" (Settings.json)
+	std::vector<YgoJsonChange> m_changes;
+	// "name" of the changed deck files, by file name
+	std::unordered_map<std::string, std::string> m_deckNames;
+	uint64_t m_visitedNodes; // tree nodes compared
+	uint64_t m_totalNodes; // tree nodes of both sides
+
+	YgoArchiveDiff() :m_visitedNodes(0), m_totalNodes(0) {}
+};
+
+// A backup queued by the daemon, requests arriving before it starts share its result
+struct YgoBackupJob
+{
+	std::promise<int> m_promise; // ArchiveID backed up, -1 if failed
+	std::shared_future<int> m_result;
+
+	YgoBackupJob() :m_result(m_promise.get_future().share()) {}
+};
+
+// One YgoMaster install managed by the tool, each install has its own ArchiveList and archives
+struct YgoInstallContext
 {
-	int m_id;
 	std::string m_name;
-	std::string m_path;
-	std::string m_desc;
-	std::string m_time;
+	std::string m_YMDataPath;
+	std::string m_YMListPath;
+	std::string m_archivesPath;
+	// Files of archived directories smaller than this are packed, 0 disables packing
+	uint64_t m_smallFileThreshold;
+
+	int m_currentArchiveIndex;
+	YgoArchiveTable m_archives;
+
+	// Guards m_archives, m_currentArchiveIndex and ArchiveList file: shared for reads, unique for updates
+	mutable std::shared_mutex m_dataMutex;
+	// Serializes writers (backup, restore, delete, reset) of this install, recursive for restore with backup
+	std::recursive_mutex m_writeMutex;
+	// ArchiveList write time when m_archives was loaded, used to notice changes made by other processes
+	std::filesystem::file_time_type m_listWriteTime;
+	// m_archives holds edits of a running update not written to ArchiveList yet, a reload from the file would drop them, guarded by m_dataMutex
+	bool m_tableAhead;
+
+	// Summaries filled lazily by readers, so they have their own lock
+	std::mutex m_summaryMutex;
+	std::unordered_map<int, YgoArchiveSummary> m_summaries;
+
+	// Backups waiting for m_writeMutex by target ArchiveID, copy and description, a new daemon backup request
+	// joins the one asking for the same instead of copying Data again
+	std::mutex m_backupQueueMutex;
+	std::map<std::tuple<int, bool, std::string>, std::shared_ptr<YgoBackupJob>> m_pendingBackups;
+
+	// Last snapshot id handed out in milliseconds since epoch, snapshot ids only grow, guarded by m_writeMutex
+	uint64_t m_lastSnapshotMs;
 
-	YgoArchiveInfo() :m_id(0), m_name(""), m_path(""), m_desc("") {}
+	// Card index of the archives, loaded on first use, taken after m_dataMutex
+	std::mutex m_cardIndexMutex;
+	YgoCardIndex m_cardIndex;
 
-} *YgoMasterInfoPtr;
+	// One timeline run at a time per install, they share Timeline.bin
+	std::mutex m_timelineMutex;
+
+	// Disk usage of the archives, loaded by the background thread, taken after m_dataMutex
+	std::mutex m_usageMutex;
+	YgoUsageIndex m_usageIndex;
+
+	// Set when something was moved to the trash, the reaper starts with it set so trash left by an earlier run goes too
+	std::atomic<bool> m_trashPending;
+
+	// Fulfilled once the ArchiveList of the install was read at startup, the menu waits for it before a command
+	std::promise<bool> m_loadPromise;
+	std::shared_future<bool> m_loaded;
+
+	// ArchiveList being edited by the running writer, nested writers share it and the outermost one writes it, guarded by m_writeMutex
+	cJSON* m_listRoot;
+	int m_listDepth;
+	bool m_listChanged; // a level committed edits, the list is written when the outermost level ends
+	// ArchiveList as read when the update started, edits of other processes since then are merged on write
+	std::string m_listBaseText;
+
+	YgoInstallContext() :m_name(""), m_YMDataPath(""), m_YMListPath(""), m_archivesPath(""),
+		m_smallFileThreshold(DEFAULT_SMALL_FILE_THRESHOLD), m_currentArchiveIndex(0), m_tableAhead(false), m_lastSnapshotMs(0),
+		m_trashPending(true), m_loaded(m_loadPromise.get_future().share()), m_listRoot(nullptr), m_listDepth(0), m_listChanged(false), m_listBaseText("") {}
+};
 
 static const std::string sc_configDescText = 
 "This file must be placed in the same directory as test.exe."
 "YMListPath points to the save path of \'YgoMasterArchiveList.json\' file."
 "YMDataPath points to the \'Data\' directory of YgoMaster."
 "YMArchivesPath points to the directory where backups are stored."
+"SmallFileThreshold is the size in bytes below which archived Players files are packed into Players.pack, 0 disables packing."
+"Installs optionally lists more YgoMaster installs, each with Name, YMListPath, YMDataPath and ArchivesPath."
+"IoBudgets limits Backup, AutoBackup (before restore, daemon) and Restore with MBps and IOPS (0 is unlimited), "
+"IdlePriority (idle I/O class) and DropCache (keep copied data out of the page cache), Tiering budgets the move to cold storage, "
+"Purge the removal of deleted archives."
+"ColdStorage keeps the KeepRecent newest archives and those backed up within KeepDays as they are, "
+"older ones are compressed into a store shared by all archives (Enabled false turns this off)."
 "If there is a change in the positions of the above files or folders, "
 "the following paths need to be modified so that the program can accurately retrieve them!";
 
 
+class YgoDaemonServer;
+
 class YgoMasterArchiveMgr : public IYgoMasterMgr
 {
 public:
 	YgoMasterArchiveMgr();
-	virtual ~YgoMasterArchiveMgr() {};
+	virtual ~YgoMasterArchiveMgr();
 
 	virtual void Run()override;
+	virtual void RunDaemon(const std::string& socketPath)override;
+	virtual bool Start(const bool backgroundJobs = true)override;
+	virtual bool WaitReady()override;
 
 private:
-	// Read config file and set m_YMListPath
+	// Read config file and create install contexts
 	bool ReadConfig();
-	// Read YgoMasterList file and populate m_archives
-	bool ReadYMList();
-	// Backup the newst archive to YgoMasterList file
-	bool BackupArchive(const int targetID, const bool copy = false);
+	// Read YgoMasterList file and populate ctx.m_archives, display prints the newest archives
+	bool ReadYMList(YgoInstallContext& ctx, const bool display = true);
+	// Read config and ArchiveList of every install. deferred reads existing ArchiveLists on the background
+	// threads of the installs instead, so the caller can go on before they are loaded, see WaitInstallLoaded.
+	// Without backgroundJobs nothing is written: no first archive, migration, usage scan, tiering or trash reaping.
+	bool LoadInstalls(const bool deferred = false, const bool backgroundJobs = true);
+	// Wait until the ArchiveList of ctx was read at startup, false if it could not be read
+	bool WaitInstallLoaded(YgoInstallContext& ctx);
+	// Warn about a Data directory that is missing or holds no Player.json, runs on the background thread
+	void ValidateDataDir(YgoInstallContext& ctx);
+	// Backup the newst archive to YgoMasterList file, presetDesc skips the description prompt, io selects the I/O budget
+	bool BackupArchive(YgoInstallContext& ctx, const int targetID, const bool copy = false, const std::string* presetDesc = nullptr,
+		const EIoOperation io = EIoOperation::BACKUP);
 	// Backup the latest archive and save it as a new archive
-	bool BackupAndCreateNewArchive();
+	bool BackupAndCreateNewArchive(YgoInstallContext& ctx);
 	// Delete a specific archive by archiveID
-	bool DeleteArchive(const int archiveID);
-	// Restore a specific archive by archiveID
-	bool RestoreArchive(const int archiveID, const bool backup = false);
+	bool DeleteArchive(YgoInstallContext& ctx, const int archiveID);
+	// Restore a specific archive by archiveID, presetDesc is used by the backup before restoring, which runs as an automatic backup
+	bool RestoreArchive(YgoInstallContext& ctx, const int archiveID, const bool backup = false, const std::string* presetDesc = nullptr);
+	// Restore only the files of archiveID selected by filter, read from standalone files, packs or cold copies without
+	// unpacking the rest. The restore is recorded in "PartialRestores" of ArchiveList, Currently in use ArchiveID
+	// only changes if makeCurrent is set. restoredFiles receives the paths written, relative to Data.
+	bool RestoreArchiveFiles(YgoInstallContext& ctx, const int archiveID, const YgoRestoreFilter& filter, const bool makeCurrent = false,
+		std::vector<std::string>* restoredFiles = nullptr);
 
-	bool CheckYMDataDir();
-	// Display the archive list, if updateArchives is true, update m_archives
-	bool QuerryArchiveList(const int maxSize = DEFAULT_MAX_ARCHIVE_LIST_SIZE, const bool display = true, const bool updateArchives = false);
+	bool CheckYMDataDir(YgoInstallContext& ctx);
+	// Display the archive list, if updateArchives is true, update ctx.m_archives
+	bool QuerryArchiveList(YgoInstallContext& ctx, const int maxSize = DEFAULT_MAX_ARCHIVE_LIST_SIZE, const bool display = true, const bool updateArchives = false);
+	// Same as QuerryArchiveList, caller must hold ctx.m_dataMutex (unique if updateArchives is true)
+	bool QuerryArchiveListLocked(YgoInstallContext& ctx, const int maxSize, const bool display, const bool updateArchives);
+	// Replace ctx.m_archives and ctx.m_currentArchiveIndex with the entries of a parsed ArchiveList, caller holds ctx.m_dataMutex unique
+	void LoadArchiveTable(YgoInstallContext& ctx, cJSON* root);
+
+	// Start or join the ArchiveList update of ctx, nested updates share one parsed list, caller holds ctx.m_writeMutex.
+	// create starts from an empty list if the file does not exist. Return nullptr if the list cannot be read.
+	cJSON* BeginListUpdate(YgoInstallContext& ctx, const bool create = false);
+	// Leave the update, committed keeps its edits and reloads ctx.m_archives from the list unless reloadTable is false.
+	// The outermost level writes the list durably once if any level committed, so a batch costs one fsync.
+	// It holds the exclusive ArchiveList lock only for that write, merging what other processes committed meanwhile.
+	bool EndListUpdate(YgoInstallContext& ctx, const bool committed, const bool reloadTable = true);
+
+	// Scope of one logical ArchiveList update, edits must only be made right before Commit()
+	class ListUpdate
+	{
+	public:
+		ListUpdate(YgoMasterArchiveMgr& mgr, YgoInstallContext& ctx, const bool create = false)
+			:m_mgr(mgr), m_ctx(ctx), m_root(mgr.BeginListUpdate(ctx, create)), m_ended(false) {}
+		~ListUpdate() { if (m_root && !m_ended) m_mgr.EndListUpdate(m_ctx, false); }
+		ListUpdate(const ListUpdate&) = delete;
+		ListUpdate& operator=(const ListUpdate&) = delete;
+
+		cJSON* Root() const { return m_root; }
+		bool Commit(const bool reloadTable = true)
+		{
+			if (!m_root || m_ended) return false;
+			m_ended = true;
+			return m_mgr.EndListUpdate(m_ctx, true, reloadTable);
+		}
+
+	private:
+		YgoMasterArchiveMgr& m_mgr;
+		YgoInstallContext& m_ctx;
+		cJSON* m_root;
+		bool m_ended;
+	};
 	// Display detailed info for a specific archiveID, if archiveID is -1 display current archive
-	void DisplayArchiveDetail(const int archiveID);
-	// Get new YgoMaster archive info from user input
-	bool GetNewYgoArchiveInfo(YgoArchiveInfo& result, const bool needDesc = true);
-	// Copy target files from YgoMaster Data directory to result path
-	bool CopyTargetFiles(YgoArchiveInfo& result);
+	void DisplayArchiveDetail(YgoInstallContext& ctx, const int archiveID);
+	// Display archives whose name, description or time contains keyword
+	void SearchArchives(YgoInstallContext& ctx, const std::string& keyword);
+	// Get archive summary from cache or Player.json, caller must hold ctx.m_dataMutex
+	bool GetArchiveSummary(YgoInstallContext& ctx, const YgoArchiveInfo& archive, YgoArchiveSummary& result);
+	// Drop the cached summary of archiveID, or all summaries if archiveID is -1
+	void InvalidateSummary(YgoInstallContext& ctx, const int archiveID);
+	// Get new YgoMaster archive info from user input, or from presetDesc if given
+	bool GetNewYgoArchiveInfo(YgoInstallContext& ctx, YgoArchiveInfo& result, const bool needDesc = true, const std::string* presetDesc = nullptr,
+		const EIoOperation io = EIoOperation::BACKUP);
+	// Back up every target of YgoBackupTargets from YgoMaster Data directory to result path, inlined files go to result.m_inlineFiles
+	bool CopyTargetFiles(YgoInstallContext& ctx, YgoArchiveInfo& result, const EIoOperation io);
+	// Throttle for the budget of io, nullptr when the budget is unlimited
+	std::unique_ptr<YgoIoThrottle> CreateIoThrottle(const EIoOperation io) const;
+	// Point Data/targetName at the working copy of archive, caller holds ctx.m_writeMutex
+	bool LinkArchiveSlot(YgoInstallContext& ctx, const YgoArchiveInfo& archive, const std::string& targetName, YgoIoThrottle* throttle);
+	// Hand a linked working copy over to the current archive after a backup or restore changed it
+	void FollowCurrentSlot(YgoInstallContext& ctx);
+	// Trash the working copy of archiveID after the archive itself changed, unless Data shows it; the next switch builds it again
+	void DropArchiveSlot(YgoInstallContext& ctx, const int archiveID);
+	// Read the files inlined into the ArchiveList entry of archiveID, from list if given,
+	// else from ctx.m_archives, the caller holds ctx.m_dataMutex then
+	void ReadInlineFiles(YgoInstallContext& ctx, const int archiveID, std::vector<std::pair<std::string, std::string>>& result, cJSON* list = nullptr);
 
 	// Reset archive data for a specific archiveID
 	enum class YMArchiveData :int
@@ -109,15 +331,93 @@ private:
 		ARCHIVE_DATA_GEMS,
 		MAX_DATA
 	};
-	bool ResetData(const int archiveID, const YMArchiveData& YMdataID);
+	bool ResetData(YgoInstallContext& ctx, const int archiveID, const YMArchiveData& YMdataID);
+
+	// Load the card index and sync it with ctx.m_archives, caller must hold ctx.m_dataMutex and ctx.m_cardIndexMutex
+	void EnsureCardIndex(YgoInstallContext& ctx);
+	// Load the usage index and scan archives it misses, caller must hold ctx.m_dataMutex and ctx.m_usageMutex
+	void EnsureUsageIndex(YgoInstallContext& ctx);
+	// Rescan the archives of archiveIDs after their directories changed, archives no longer listed are dropped
+	void UpdateArchiveUsage(YgoInstallContext& ctx, const std::vector<int>& archiveIDs);
+	// Reindex archiveID from its archive directory, an empty archivePath only drops archives no longer listed
+	void UpdateCardIndex(YgoInstallContext& ctx, const int archiveID, const std::string& archivePath);
+	// Display archives owning at least minCount copies of cardId
+	void SearchCard(YgoInstallContext& ctx, const uint32_t cardId, const uint16_t minCount);
+	// Display first and last archives containing deckName and the archive where it disappeared
+	void DisplayDeckHistory(YgoInstallContext& ctx, const std::string& deckName);
+
+	// Make archiveID current without copying: linkable targets of Data point at the working copy of the archive,
+	// which is materialized from the archive on its first switch, other targets are restored
+	bool SwitchArchive(YgoInstallContext& ctx, const int archiveID);
+
+	// Compare Player.json, deck files and Settings.json of beforeID and afterID, DIFF_DATA_ID is the live Data directory.
+	// Archives are compared through their Player.tree, so only subtrees that differ are read.
+	bool DiffArchives(YgoInstallContext& ctx, const int beforeID, const int afterID, YgoArchiveDiff& result);
+	// Display DiffArchives grouped into gems, cards, decks, other Player.json fields and Settings.json
+	void DisplayArchiveDiff(YgoInstallContext& ctx, const int beforeID, const int afterID);
+	// Player tree and Settings.json tree of archiveID or the Data directory, caller holds ctx.m_dataMutex
+	bool LoadDiffSide(YgoInstallContext& ctx, const int archiveID, YgoJsonTree& player, YgoJsonTree& settings);
+
+	// Metrics of every archive ordered by backup time. Archives whose side files changed since Timeline.bin
+	// was written are read in parallel, the rest come from the cache. readCount receives the number read.
+	void BuildTimeline(YgoInstallContext& ctx, std::vector<YgoTimelinePoint>& result, size_t* readCount = nullptr);
+	// Display the newest points of the timeline, exportPath ending in .csv or .json also writes all of them there
+	void DisplayTimeline(YgoInstallContext& ctx, const std::string& exportPath);
+
+	// Stream the archives of archiveIDs with their ArchiveList entries into one bundle at bundlePath, paths inside are relative
+	bool ExportArchives(YgoInstallContext& ctx, const std::vector<int>& archiveIDs, const std::string& bundlePath);
+	// Add every archive of the bundle at bundlePath with a new ArchiveID and snapshot directory, nothing is listed
+	// unless the whole bundle was read. importedIDs receives the new ArchiveIDs.
+	bool ImportArchives(YgoInstallContext& ctx, const std::string& bundlePath, std::vector<int>* importedIDs = nullptr);
+
+	// Check every backup target of archiveID, the current archive is also compared with Data
+	bool VerifyArchive(YgoInstallContext& ctx, const int archiveID, YgoVerifyResult& result);
+
+	// Select archives by "all", a comma separated ArchiveID list, or a keyword of name, description or time
+	void SelectArchives(YgoInstallContext& ctx, const std::string& selector, std::vector<int>& result);
+	// Set fieldPath of relPath to valueText (JSON text) in every archive of archiveIDs in parallel, return the number changed
+	int BulkPatchField(YgoInstallContext& ctx, const std::vector<int>& archiveIDs, const std::string& relPath,
+		const std::string& fieldPath, const std::string& valueText);
+
+	// Create a new snapshot directory with a unique, increasing id, fill result.m_time and result.m_path
+	bool CreateSnapshotDir(YgoInstallContext& ctx, YgoArchiveInfo& result);
+	// Move flat archives of ctx into the sharded layout in batches, writers of the install run between batches
+	void MigrateFlatArchives(YgoInstallContext& ctx);
+	// Rename path into the trash of ctx, return the name it got there, empty if the rename failed
+	std::string MoveToTrash(YgoInstallContext& ctx, const std::filesystem::path& path);
+	// Unlink everything in the trash of ctx within the Purge budget, stops early when the tool exits
+	void ReapTrash(YgoInstallContext& ctx);
+	// Move archives that are neither recent nor current into cold storage, one archive per write lock,
+	// then drop objects of the cold store no archive refers to any more
+	void TierArchives(YgoInstallContext& ctx);
+
+	// Find an install context by name, return nullptr if not found
+	std::shared_ptr<YgoInstallContext> FindInstall(const std::string& name) const;
+	// Let user choose the install the menu works on
+	bool SwitchInstall();
+
+	// Handle one daemon request, both request and reply are JSON text
+	std::string HandleDaemonRequest(const std::string& request);
+	// Reload ctx.m_archives if ArchiveList was changed by another process
+	void RefreshArchivesIfChanged(YgoInstallContext& ctx);
+	// Backup coalesced with other daemon requests of the same install, return ArchiveID or -1
+	int CoalescedBackup(YgoInstallContext& ctx, const int targetID, const bool copy, const std::string& desc, bool& coalesced);
 
 private:
-	std::string m_YMDataPath;
-	std::string m_YMListPath;
 	std::string m_configPath;
-	std::string m_archivesPath;
 
-	int m_currentArchiveIndex;
-	std::unordered_map<int, YgoArchiveInfo> m_archives;
+	// All installs read from config file, guarded by m_installsMutex
+	mutable std::shared_mutex m_installsMutex;
+	std::vector<std::shared_ptr<YgoInstallContext>> m_installs;
+	// Install the interactive menu works on
+	std::shared_ptr<YgoInstallContext> m_activeInstall;
+	// Server of RunDaemon, used by the shutdown request
+	YgoDaemonServer* m_daemonServer;
+	// I/O budget of each operation, from "IoBudgets" of config file
+	YgoIoBudget m_ioBudgets[static_cast<int>(EIoOperation::SIZE_OF_OPERATIONS)];
+	// From "ColdStorage" of config file
+	YgoColdPolicy m_coldPolicy;
+	// Background work (archive migration, tiering, trash reaping) stops when this is set and is joined by the destructor
+	std::atomic<bool> m_stopping;
+	std::vector<std::thread> m_backgroundThreads;
 };
-
@@ -0,0 +1,297 @@
+#include "ygomasterArchiveTable.h"
+#include <algorithm>
+
+namespace fs = std::filesystem;
+
+// Time keys: bit 0 set when the time has milliseconds, bit 1 set when the time is an interned text
+constexpr uint64_t TIME_KEY_HAS_MS = 1;
+constexpr uint64_t TIME_KEY_IS_TEXT = 2;
+// Path suffix length marking a snapshot directory named after the backup time, nothing is stored for it
+constexpr uint32_t SUFFIX_IS_TIME = UINT32_MAX;
+
+uint32_t YgoStringPool::Intern(const std::string_view& value)
+{
+	auto it = m_index.find(value);
+	if (it != m_index.end()) {
+		return it->second;
+	}
+	const uint32_t index = static_cast<uint32_t>(m_strings.size());
+	m_strings.emplace_back(value);
+	m_index.emplace(std::string_view(m_strings.back()), index);
+	return index;
+}
+
+void YgoStringPool::Clear()
+{
+	m_index.clear();
+	m_strings.clear();
+}
+
+size_t YgoStringPool::MemoryUsage() const
+{
+	size_t bytes = m_strings.size() * (sizeof(std::string) + sizeof(std::string_view) + sizeof(uint32_t) + sizeof(void*));
+	for (const auto& value : m_strings) {
+		bytes += (value.capacity() > 15) ? value.capacity() + 1 : 0;
+	}
+	return bytes;
+}
+
+// "YYYY_MM_DD_HHMMSS" or "YYYY_MM_DD_HHMMSS_mmm" to a sortable key, false for any other text
+static bool ParseTimeKey(const std::string& time, uint64_t& key)
+{
+	if (time.size() != 17 && time.size() != 21) {
+		return false;
+	}
+	uint64_t digits = 0;
+	for (size_t i = 0; i < time.size(); ++i) {
+		const bool separator = (4 == i || 7 == i || 10 == i || 17 == i);
+		if (separator) {
+			if (time[i] != '_') return false;
+			continue;
+		}
+		if (time[i] < '0' || time[i] > '9') return false;
+		digits = digits * 10 + static_cast<uint64_t>(time[i] - '0');
+	}
+	const bool hasMs = (time.size() == 21);
+	key = ((hasMs ? digits : digits * 1000) << 2) | (hasMs ? TIME_KEY_HAS_MS : 0);
+	return true;
+}
+
+static uint32_t LiveLength(const YgoArchiveTable::Span& span)
+{
+	return (SUFFIX_IS_TIME == span.m_length) ? 0 : span.m_length;
+}
+
+YgoArchiveTable::YgoArchiveTable()
+	:m_deadBytes(0)
+{
+}
+
+void YgoArchiveTable::Clear()
+{
+	m_ids.clear();
+	m_timeKeys.clear();
+	m_nameRefs.clear();
+	m_pathRoots.clear();
+	m_pathSuffixes.clear();
+	m_descs.clear();
+	m_inlineSpans.clear();
+	m_inlineRefs.clear();
+	m_names.Clear();
+	m_paths.Clear();
+	m_inlineTexts.Clear();
+	m_arena.clear();
+	m_deadBytes = 0;
+}
+
+void YgoArchiveTable::Reserve(const size_t count)
+{
+	m_ids.reserve(count);
+	m_timeKeys.reserve(count);
+	m_nameRefs.reserve(count);
+	m_pathRoots.reserve(count);
+	m_pathSuffixes.reserve(count);
+	m_descs.reserve(count);
+	m_inlineSpans.reserve(count);
+}
+
+YgoArchiveTable::Span YgoArchiveTable::AppendText(const std::string_view& text)
+{
+	Span span = { static_cast<uint32_t>(m_arena.size()), static_cast<uint32_t>(text.size()) };
+	m_arena.append(text.data(), text.size());
+	return span;
+}
+
+void YgoArchiveTable::WriteRow(const size_t row, const YgoArchiveInfo& info)
+{
+	uint64_t timeKey = 0;
+	if (!ParseTimeKey(info.m_time, timeKey)) {
+		timeKey = (static_cast<uint64_t>(m_paths.Intern(info.m_time)) << 2) | TIME_KEY_IS_TEXT;
+	}
+	const fs::path path(info.m_path);
+	m_ids[row] = info.m_id;
+	m_timeKeys[row] = timeKey;
+	m_nameRefs[row] = m_names.Intern(info.m_name);
+	m_pathRoots[row] = m_paths.Intern(path.parent_path().string());
+	const std::string suffix = path.filename().string();
+	m_pathSuffixes[row] = (suffix == info.m_time) ? Span{ 0, SUFFIX_IS_TIME } : AppendText(suffix);
+	m_descs[row] = AppendText(info.m_desc);
+	//Refs of a replaced row stay behind, rows are only replaced when a list is loaded again
+	m_inlineSpans[row] = Span{ static_cast<uint32_t>(m_inlineRefs.size()), static_cast<uint32_t>(info.m_inlineFiles.size() * 2) };
+	for (const auto& file : info.m_inlineFiles) {
+		m_inlineRefs.push_back(m_inlineTexts.Intern(file.first));
+		m_inlineRefs.push_back(m_inlineTexts.Intern(file.second));
+	}
+}
+
+void YgoArchiveTable::Upsert(const YgoArchiveInfo& info)
+{
+	auto it = std::lower_bound(m_ids.begin(), m_ids.end(), info.m_id);
+	const size_t row = static_cast<size_t>(it - m_ids.begin());
+	if (it != m_ids.end() && *it == info.m_id) {
+		m_deadBytes += LiveLength(m_pathSuffixes[row]) + m_descs[row].m_length;
+	}
+	else {
+		//Rows arrive in ArchiveID order when a list is loaded, so this is normally an append
+		m_ids.insert(it, info.m_id);
+		m_timeKeys.insert(m_timeKeys.begin() + row, 0);
+		m_nameRefs.insert(m_nameRefs.begin() + row, 0);
+		m_pathRoots.insert(m_pathRoots.begin() + row, 0);
+		m_pathSuffixes.insert(m_pathSuffixes.begin() + row, Span());
+		m_descs.insert(m_descs.begin() + row, Span());
+		m_inlineSpans.insert(m_inlineSpans.begin() + row, Span());
+	}
+	WriteRow(row, info);
+	CompactArena();
+}
+
+bool YgoArchiveTable::Erase(const int archiveID)
+{
+	const size_t row = Find(archiveID);
+	if (npos == row) {
+		return false;
+	}
+	m_deadBytes += LiveLength(m_pathSuffixes[row]) + m_descs[row].m_length;
+	m_ids.erase(m_ids.begin() + row);
+	m_timeKeys.erase(m_timeKeys.begin() + row);
+	m_nameRefs.erase(m_nameRefs.begin() + row);
+	m_pathRoots.erase(m_pathRoots.begin() + row);
+	m_pathSuffixes.erase(m_pathSuffixes.begin() + row);
+	m_descs.erase(m_descs.begin() + row);
+	m_inlineSpans.erase(m_inlineSpans.begin() + row);
+	CompactArena();
+	return true;
+}
+
+bool YgoArchiveTable::SetPath(const int archiveID, const std::string& path)
+{
+	const size_t row = Find(archiveID);
+	if (npos == row) {
+		return false;
+	}
+	const fs::path value(path);
+	const std::string suffix = value.filename().string();
+	m_deadBytes += LiveLength(m_pathSuffixes[row]);
+	m_pathRoots[row] = m_paths.Intern(value.parent_path().string());
+	m_pathSuffixes[row] = (suffix == TimeAt(row)) ? Span{ 0, SUFFIX_IS_TIME } : AppendText(suffix);
+	CompactArena();
+	return true;
+}
+
+void YgoArchiveTable::CompactArena()
+{
+	if (m_deadBytes < 4096 || m_deadBytes * 2 < m_arena.size()) {
+		return;
+	}
+	std::string arena;
+	arena.reserve(m_arena.size() - m_deadBytes);
+	for (size_t row = 0; row < m_ids.size(); ++row) {
+		for (Span* span : { &m_pathSuffixes[row], &m_descs[row] }) {
+			if (SUFFIX_IS_TIME == span->m_length) continue;
+			const uint32_t offset = static_cast<uint32_t>(arena.size());
+			arena.append(m_arena, span->m_offset, span->m_length);
+			span->m_offset = offset;
+		}
+	}
+	m_arena.swap(arena);
+	m_deadBytes = 0;
+}
+
+size_t YgoArchiveTable::Find(const int archiveID) const
+{
+	auto it = std::lower_bound(m_ids.begin(), m_ids.end(), archiveID);
+	if (it == m_ids.end() || *it != archiveID) {
+		return npos;
+	}
+	return static_cast<size_t>(it - m_ids.begin());
+}
+
+bool YgoArchiveTable::Get(const int archiveID, YgoArchiveInfo& result) const
+{
+	const size_t row = Find(archiveID);
+	if (npos == row) {
+		return false;
+	}
+	GetRow(row, result);
+	return true;
+}
+
+void YgoArchiveTable::GetRow(const size_t row, YgoArchiveInfo& result) const
+{
+	result.m_id = m_ids[row];
+	result.m_name = NameAt(row);
+	result.m_path = PathAt(row);
+	result.m_desc = std::string(DescAt(row));
+	result.m_time = TimeAt(row);
+}
+
+void YgoArchiveTable::InlineFilesAt(const size_t row, std::vector<std::pair<std::string, std::string>>& result) const
+{
+	result.clear();
+	const Span& span = m_inlineSpans[row];
+	for (uint32_t i = span.m_offset; i + 1 < span.m_offset + span.m_length; i += 2) {
+		result.emplace_back(m_inlineTexts.Get(m_inlineRefs[i]), m_inlineTexts.Get(m_inlineRefs[i + 1]));
+	}
+}
+
+std::string_view YgoArchiveTable::DescAt(const size_t row) const
+{
+	return TextOf(m_descs[row]);
+}
+
+std::string YgoArchiveTable::PathAt(const size_t row) const
+{
+	const std::string& root = m_paths.Get(m_pathRoots[row]);
+	const std::string suffix = (SUFFIX_IS_TIME == m_pathSuffixes[row].m_length) ? TimeAt(row) : std::string(TextOf(m_pathSuffixes[row]));
+	if (root.empty()) {
+		return suffix;
+	}
+	return (fs::path(root) / suffix).string();
+}
+
+std::string YgoArchiveTable::TimeAt(const size_t row) const
+{
+	const uint64_t key = m_timeKeys[row];
+	if (key & TIME_KEY_IS_TEXT) {
+		return m_paths.Get(static_cast<uint32_t>(key >> 2));
+	}
+	const uint64_t value = key >> 2;
+	const uint64_t seconds = value / 1000;
+	char buffer[32];
+	snprintf(buffer, sizeof(buffer), "%04u_%02u_%02u_%02u%02u%02u",
+		static_cast<unsigned>(seconds / 10000000000ULL), static_cast<unsigned>(seconds / 100000000ULL % 100),
+		static_cast<unsigned>(seconds / 1000000ULL % 100), static_cast<unsigned>(seconds / 10000ULL % 100),
+		static_cast<unsigned>(seconds / 100ULL % 100), static_cast<unsigned>(seconds % 100));
+	std::string result(buffer);
+	if (key & TIME_KEY_HAS_MS) {
+		snprintf(buffer, sizeof(buffer), "_%03u", static_cast<unsigned>(value % 1000));
+		result += buffer;
+	}
+	return result;
+}
+
+void YgoArchiveTable::Filter(const std::string& keyword, std::vector<size_t>& rows) const
+{
+	rows.clear();
+	//Each distinct player name is tested once
+	std::vector<uint8_t> nameMatches(m_names.Size());
+	for (size_t i = 0; i < m_names.Size(); ++i) {
+		nameMatches[i] = m_names.Get(static_cast<uint32_t>(i)).find(keyword) != std::string::npos;
+	}
+	for (size_t row = 0; row < m_ids.size(); ++row) {
+		if (nameMatches[m_nameRefs[row]]
+			|| DescAt(row).find(keyword) != std::string_view::npos
+			|| TimeAt(row).find(keyword) != std::string::npos) {
+			rows.push_back(row);
+		}
+	}
+}
+
+size_t YgoArchiveTable::MemoryUsage() const
+{
+	return m_ids.capacity() * sizeof(int) + m_timeKeys.capacity() * sizeof(uint64_t)
+		+ m_nameRefs.capacity() * sizeof(uint32_t) + m_pathRoots.capacity() * sizeof(uint32_t)
+		+ (m_pathSuffixes.capacity() + m_descs.capacity() + m_inlineSpans.capacity()) * sizeof(Span)
+		+ m_inlineRefs.capacity() * sizeof(uint32_t)
+		+ m_arena.capacity() + m_names.MemoryUsage() + m_paths.MemoryUsage() + m_inlineTexts.MemoryUsage();
+}
@@ -0,0 +1,115 @@
+#ifndef YGOMASTER_ARCHIVE_TABLE_H
+#define YGOMASTER_ARCHIVE_TABLE_H
+
+#include"public.h"
+#include<deque>
+#include<string_view>
+
+// Structure to hold YgoMaster Archive information
+struct YgoArchiveInfo
+{
+	int m_id;
+	std::string m_name;
+	std::string m_path;
+	std::string m_desc;
+	std::string m_time;
+	// Files inlined into the ArchiveList entry by a backup, kept in YgoArchiveTable but only read with InlineFilesAt
+	std::vector<std::pair<std::string, std::string>> m_inlineFiles;
+
+	YgoArchiveInfo() :m_id(0), m_name(""), m_path(""), m_desc("") {}
+};
+
+// Interned strings, an index stays valid until Clear()
+class YgoStringPool
+{
+public:
+	uint32_t Intern(const std::string_view& value);
+	const std::string& Get(const uint32_t index) const { return m_strings[index]; }
+	size_t Size() const { return m_strings.size(); }
+	void Clear();
+	size_t MemoryUsage() const;
+
+private:
+	// deque keeps addresses stable, so the views in m_index stay valid
+	std::deque<std::string> m_strings;
+	std::unordered_map<std::string_view, uint32_t> m_index;
+};
+
+/*
+* Archives of one install, one row per archive, rows sorted by ArchiveID.
+* Columns are contiguous arrays: ids, backup times packed into integers, interned player names,
+* paths as an interned parent directory plus a suffix in the text arena, descriptions in the text arena,
+* inlined files as interned name and content pairs, so an unchanged Settings.json is held once for all archives.
+* Rows are materialized into YgoArchiveInfo only when a caller needs the full record.
+*/
+class YgoArchiveTable
+{
+public:
+	static constexpr size_t npos = static_cast<size_t>(-1);
+
+	YgoArchiveTable();
+
+	size_t Size() const { return m_ids.size(); }
+	bool Empty() const { return m_ids.empty(); }
+	void Clear();
+	void Reserve(const size_t count);
+
+	// Insert or replace the row of info.m_id
+	void Upsert(const YgoArchiveInfo& info);
+	bool Erase(const int archiveID);
+	bool SetPath(const int archiveID, const std::string& path);
+
+	// Row of archiveID, npos if not found
+	size_t Find(const int archiveID) const;
+	bool Contains(const int archiveID) const { return Find(archiveID) != npos; }
+	// Copy the row of archiveID into result, inlined files are left out
+	bool Get(const int archiveID, YgoArchiveInfo& result) const;
+	void GetRow(const size_t row, YgoArchiveInfo& result) const;
+	// Name and content of the files inlined into the row
+	void InlineFilesAt(const size_t row, std::vector<std::pair<std::string, std::string>>& result) const;
+
+	const std::vector<int>& Ids() const { return m_ids; }
+	const std::string& NameAt(const size_t row) const { return m_names.Get(m_nameRefs[row]); }
+	std::string_view DescAt(const size_t row) const;
+	std::string PathAt(const size_t row) const;
+	std::string TimeAt(const size_t row) const;
+	// Backup time as a sortable integer, later backups compare greater
+	uint64_t TimeKeyAt(const size_t row) const { return m_timeKeys[row]; }
+	// Rows whose name, description or time contains keyword, in ArchiveID order
+	void Filter(const std::string& keyword, std::vector<size_t>& rows) const;
+
+	// Bytes used by the table, for diagnostics
+	size_t MemoryUsage() const;
+
+	struct Span
+	{
+		uint32_t m_offset;
+		uint32_t m_length;
+	};
+
+private:
+	Span AppendText(const std::string_view& text);
+	std::string_view TextOf(const Span& span) const { return std::string_view(m_arena.data() + span.m_offset, span.m_length); }
+	void WriteRow(const size_t row, const YgoArchiveInfo& info);
+	// Drop arena bytes no row refers to once they outweigh the live ones
+	void CompactArena();
+
+	std::vector<int> m_ids;
+	std::vector<uint64_t> m_timeKeys;
+	std::vector<uint32_t> m_nameRefs;
+	std::vector<uint32_t> m_pathRoots;
+	std::vector<Span> m_pathSuffixes;
+	std::vector<Span> m_descs;
+	// Span of m_inlineRefs holding name and content indices into m_inlineTexts, in pairs
+	std::vector<Span> m_inlineSpans;
+	std::vector<uint32_t> m_inlineRefs;
+
+	YgoStringPool m_names;
+	// Parent directories of archive paths and backup times that do not follow the snapshot id format
+	YgoStringPool m_paths;
+	YgoStringPool m_inlineTexts;
+	std::string m_arena;
+	size_t m_deadBytes;
+};
+
+#endif // !YGOMASTER_ARCHIVE_TABLE_H
@@ -0,0 +1,368 @@
+#include "ygomasterBackupPolicy.h"
+#include "ygomasterPack.h"
+#include "ygomasterFileView.h"
+#include "ygomasterBinary.h"
+#include "ygomasterTreeWalker.h"
+#include "ygomasterIoThrottle.h"
+#include "ygomasterColdStore.h"
+
+namespace fs = std::filesystem;
+
+// Glob match of a '/' separated path, * and ? do not cross '/', ** matches any number of whole components
+static bool MatchPathGlob(const char* pattern, const char* path)
+{
+	while (*pattern) {
+		if ('*' == pattern[0] && '*' == pattern[1]) {
+			const char* rest = pattern + 2;
+			if ('/' == *rest) {
+				//"**/" also matches no component at all
+				if (MatchPathGlob(rest + 1, path)) {
+					return true;
+				}
+			}
+			for (const char* p = path; ; ++p) {
+				if (MatchPathGlob(rest, p)) {
+					return true;
+				}
+				if (!*p) {
+					return false;
+				}
+			}
+		}
+		if ('*' == *pattern) {
+			for (const char* p = path; ; ++p) {
+				if (MatchPathGlob(pattern + 1, p)) {
+					return true;
+				}
+				if (!*p || '/' == *p) {
+					return false;
+				}
+			}
+		}
+		if (!*path || ('?' == *pattern ? '/' == *path : *pattern != *path)) {
+			return false;
+		}
+		++pattern;
+		++path;
+	}
+	return !*path;
+}
+
+static bool IsLiteralPattern(const std::string& pattern)
+{
+	return pattern.find_first_of("*?") == std::string::npos;
+}
+
+bool YgoRestoreFilter::Matches(const std::string& relPath) const
+{
+	for (const auto& pattern : m_patterns) {
+		if (MatchPathGlob(pattern.c_str(), relPath.c_str())) {
+			return true;
+		}
+		//A directory selects what is under it
+		for (size_t slash = relPath.find('/'); slash != std::string::npos; slash = relPath.find('/', slash + 1)) {
+			if (MatchPathGlob(pattern.c_str(), relPath.substr(0, slash).c_str())) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+// The first component of pattern matches targetName, or pattern starts with **
+static bool PatternMayMatchTarget(const std::string& pattern, const std::string& targetName)
+{
+	const std::string first = pattern.substr(0, pattern.find('/'));
+	return first.find("**") != std::string::npos || MatchPathGlob(first.c_str(), targetName.c_str());
+}
+
+bool YgoRestoreFilter::MayMatchTarget(const std::string& targetName) const
+{
+	for (const auto& pattern : m_patterns) {
+		if (PatternMayMatchTarget(pattern, targetName)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool YgoRestoreFilter::IsSafe() const
+{
+	for (const auto& pattern : m_patterns) {
+		const fs::path path(pattern);
+		if (pattern.empty() || path.has_root_name() || path.has_root_directory()) {
+			return false;
+		}
+		for (const auto& part : path) {
+			if (part == "..") {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static const std::string* FindInlineFile(const YgoTargetContext& tc, const std::string& name)
+{
+	if (!tc.m_inlineFiles) {
+		return nullptr;
+	}
+	for (const auto& file : *tc.m_inlineFiles) {
+		if (file.first == name) {
+			return &file.second;
+		}
+	}
+	return nullptr;
+}
+
+bool BackupInlineFile(YgoTargetContext& tc, const std::string& name, const uint64_t maxSize)
+{
+	const fs::path sourcePath = fs::path(tc.m_dataPath) / name;
+	const fs::path destPath = fs::path(tc.m_archivePath) / name;
+	YgoFileView content;
+	if (!content.Open(sourcePath)) {
+		printf("Source path %s not exist, skipping.\n", sourcePath.string().c_str());
+		return true;
+	}
+	//Content goes into a JSON string, so it must fit and must not contain NUL
+	const bool fits = tc.m_inlineFiles && content.Size() <= maxSize
+		&& memchr(content.Data(), '\0', content.Size()) == nullptr;
+	std::error_code ec;
+	if (fits) {
+		tc.m_inlineFiles->emplace_back(name, std::string(content.View()));
+		//A replaced archive may still hold a standalone copy from an earlier backup
+		fs::remove(destPath, ec);
+		return true;
+	}
+	if (!CopyFileWithBudget(sourcePath, destPath, tc.m_throttle)) {
+		printf("Error copying %s to %s.\n", sourcePath.string().c_str(), destPath.string().c_str());
+		return false;
+	}
+	return true;
+}
+
+bool RestoreInlineFile(YgoTargetContext& tc, const std::string& name)
+{
+	const fs::path destPath = fs::path(tc.m_dataPath) / name;
+	const std::string* content = FindInlineFile(tc, name);
+	if (content) {
+		if (!ReplaceFileContent(destPath, *content)) {
+			printf("Write %s failed.\n", destPath.string().c_str());
+			return false;
+		}
+		return true;
+	}
+	//Archives of older versions and files too large to inline are standalone
+	const fs::path sourcePath = fs::path(tc.m_archivePath) / name;
+	std::error_code ec;
+	if (!fs::exists(sourcePath, ec)) {
+		printf("Source path %s not exist in the archive, skipping.\n", sourcePath.string().c_str());
+		return true;
+	}
+	if (!CopyFileWithBudget(sourcePath, destPath, tc.m_throttle)) {
+		printf("Error restoring %s to %s.\n", sourcePath.string().c_str(), destPath.string().c_str());
+		return false;
+	}
+	return true;
+}
+
+bool RestoreSelectedInlineFile(YgoTargetContext& tc, const std::string& name, const YgoRestoreFilter& filter,
+	std::vector<std::string>& restored)
+{
+	std::error_code ec;
+	if (!filter.IsSafe()) {
+		return false;
+	}
+	if (!filter.Matches(name) || (!FindInlineFile(tc, name) && !fs::exists(fs::path(tc.m_archivePath) / name, ec))) {
+		return true;
+	}
+	if (!RestoreInlineFile(tc, name)) {
+		return false;
+	}
+	restored.push_back(name);
+	return true;
+}
+
+void VerifyInlineFile(YgoTargetContext& tc, const std::string& name, YgoVerifyResult& result)
+{
+	const fs::path sourcePath = fs::path(tc.m_dataPath) / name;
+	std::error_code ec;
+	const std::string* content = FindInlineFile(tc, name);
+	if (content) {
+		++result.m_files;
+		result.m_bytes += content->size();
+		YgoFileView current;
+		if (tc.m_compareData && current.Open(sourcePath) && current.View() != *content) {
+			printf("\tChanged since backup: %s\n", name.c_str());
+			++result.m_changed;
+		}
+		return;
+	}
+	const uint64_t size = fs::file_size(fs::path(tc.m_archivePath) / name, ec);
+	if (ec) {
+		printf("\tMissing %s.\n", name.c_str());
+		++result.m_problems;
+		return;
+	}
+	++result.m_files;
+	result.m_bytes += size;
+	if (tc.m_compareData && fs::exists(sourcePath, ec) && fs::file_size(sourcePath, ec) != size) {
+		printf("\tChanged since backup: %s\n", name.c_str());
+		++result.m_changed;
+	}
+}
+
+bool BackupPackedTree(YgoTargetContext& tc, const std::string& name)
+{
+	const fs::path sourcePath = fs::path(tc.m_dataPath) / name;
+	std::error_code ec;
+	if (!fs::exists(sourcePath, ec)) {
+		printf("Source path %s not exist, skipping.\n", sourcePath.string().c_str());
+		return true;
+	}
+	//Small files go to one pack per target, large files stay standalone
+	YgoPackStats stats;
+	if (!PackDirectory(sourcePath, tc.m_archivePath, name, tc.m_smallFileThreshold, &stats, tc.m_referencePath, tc.m_throttle)) {
+		printf("Backup %s failed.\n", sourcePath.string().c_str());
+		return false;
+	}
+	printf("Backup %s done: %llu files packed, %llu files standalone (%llu shared with the previous archive).\n", name.c_str(),
+		static_cast<unsigned long long>(stats.m_packedFiles), static_cast<unsigned long long>(stats.m_looseFiles),
+		static_cast<unsigned long long>(stats.m_linkedFiles));
+	return true;
+}
+
+bool RestorePackedTree(YgoTargetContext& tc, const std::string& name)
+{
+	const fs::path sourcePath = fs::path(tc.m_archivePath) / name;
+	std::error_code ec;
+	if (!fs::exists(sourcePath, ec) && !fs::exists(GetPackPath(tc.m_archivePath, name), ec) && !IsColdTarget(tc.m_archivePath, name)) {
+		printf("Source path %s not exist in the archive, skipping.\n", sourcePath.string().c_str());
+		return true;
+	}
+	if (!UnpackDirectory(tc.m_archivePath, name, fs::path(tc.m_dataPath) / name, tc.m_throttle)) {
+		printf("Restore %s failed.\n", sourcePath.string().c_str());
+		return false;
+	}
+	return true;
+}
+
+bool RestoreSelectedPackedTree(YgoTargetContext& tc, const std::string& name, const YgoRestoreFilter& filter,
+	std::vector<std::string>& restored)
+{
+	//Literal patterns are joined to the archive and Data paths as they are
+	if (!filter.IsSafe()) {
+		return false;
+	}
+	if (!filter.MayMatchTarget(name)) {
+		return true;
+	}
+	auto write = [&](const std::string& relPath, const char* data, const size_t size) {
+		const fs::path destPath = fs::path(tc.m_dataPath) / relPath;
+		std::error_code ec;
+		fs::create_directories(destPath.parent_path(), ec);
+		if (!WriteFileWithBudget(destPath, data, size, tc.m_throttle)) {
+			printf("Write %s failed.\n", destPath.string().c_str());
+			return false;
+		}
+		restored.push_back(relPath);
+		return true;
+	};
+	//A file named exactly is read on its own, so its cost does not depend on the size of the archive
+	std::unordered_set<std::string> done;
+	bool listTarget = false;
+	for (const auto& pattern : filter.m_patterns) {
+		if (!PatternMayMatchTarget(pattern, name) || done.count(pattern)) continue;
+		if (!IsLiteralPattern(pattern) || pattern == name) {
+			listTarget = true;
+			continue;
+		}
+		YgoFileView content;
+		if (ReadArchiveFile(tc.m_archivePath, pattern, content)) {
+			if (!write(pattern, content.Data(), content.Size())) {
+				return false;
+			}
+			done.insert(pattern);
+		}
+		else {
+			//Not a file, may be a directory
+			listTarget = true;
+		}
+	}
+	if (!listTarget) {
+		return true;
+	}
+	const bool ok = ForEachArchiveFile(tc.m_archivePath, name,
+		[&](const std::string& relPath) { return !done.count(relPath) && filter.Matches(relPath); }, write);
+	if (!ok) {
+		printf("Restore from %s failed.\n", (fs::path(tc.m_archivePath) / name).string().c_str());
+	}
+	return ok;
+}
+
+void VerifyPackedTree(YgoTargetContext& tc, const std::string& name, YgoVerifyResult& result)
+{
+	const fs::path sourcePath = fs::path(tc.m_dataPath) / name;
+	const fs::path packPath = GetPackPath(tc.m_archivePath, name);
+	std::error_code ec;
+	const fs::path coldPath = GetColdPath(tc.m_archivePath, name);
+	std::string error;
+	if ((fs::exists(packPath, ec) && !VerifyPack(packPath, error))
+		|| (fs::exists(coldPath, ec) && !VerifyColdTarget(coldPath, error))) {
+		printf("\tDamaged: %s\n", error.c_str());
+		++result.m_problems;
+		return;
+	}
+	std::vector<std::string> files;
+	std::vector<uint64_t> sizes;
+	if (!ListArchiveFiles(tc.m_archivePath, name, files, &sizes) || files.empty()) {
+		printf("\tMissing %s.\n", name.c_str());
+		++result.m_problems;
+		return;
+	}
+	std::unordered_map<std::string, uint64_t> archived;
+	for (size_t i = 0; i < files.size(); ++i) {
+		archived[files[i]] = sizes[i];
+		++result.m_files;
+		result.m_bytes += sizes[i];
+	}
+	if (!tc.m_compareData || !fs::is_directory(sourcePath, ec)) {
+		return;
+	}
+	std::vector<YgoTreeEntry> current;
+	WalkTree(sourcePath, current, true);
+	size_t seen = 0;
+	for (const auto& entry : current) {
+		if (entry.m_type != YgoTreeEntry::FILE_ENTRY) continue;
+		auto found = archived.find(name + "/" + entry.m_path);
+		if (found == archived.end()) {
+			printf("\tNot in archive: %s/%s\n", name.c_str(), entry.m_path.c_str());
+			++result.m_changed;
+			continue;
+		}
+		++seen;
+		if (found->second != entry.m_size) {
+			printf("\tChanged since backup: %s/%s\n", name.c_str(), entry.m_path.c_str());
+			++result.m_changed;
+		}
+	}
+	if (seen < archived.size()) {
+		printf("\t%d archived files of %s no longer exist in Data.\n", static_cast<int>(archived.size() - seen), name.c_str());
+		result.m_changed += static_cast<int>(archived.size() - seen);
+	}
+}
+
+bool FreezePackedTree(YgoTargetContext& tc, const std::string& name)
+{
+	YgoColdStats stats;
+	if (!FreezeTarget(tc.m_archivePath, name, tc.m_coldStorePath, &stats, tc.m_throttle)) {
+		printf("Move %s of %s to cold storage failed.\n", name.c_str(), tc.m_archivePath.c_str());
+		return false;
+	}
+	if (stats.m_files > 0) {
+		printf("Cold storage of %s: %llu files, %llu bytes, %llu compressed bytes added, %llu files shared.\n", name.c_str(),
+			static_cast<unsigned long long>(stats.m_files), static_cast<unsigned long long>(stats.m_bytes),
+			static_cast<unsigned long long>(stats.m_storedBytes), static_cast<unsigned long long>(stats.m_sharedFiles));
+	}
+	return true;
+}
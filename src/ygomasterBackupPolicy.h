@@ -0,0 +1,151 @@
+#ifndef YGOMASTER_BACKUP_POLICY_H
+#define YGOMASTER_BACKUP_POLICY_H
+
+#include"public.h"
+#include<tuple>
+
+class YgoIoThrottle;
+
+/*
+* Backup targets under the YgoMaster Data directory, each one a policy type with its own strategy.
+* The target list is a std::tuple of policies, so ForEachBackupTarget expands to one direct call per
+* target and adding a target is adding a type to the tuple.
+* A policy provides
+*   static constexpr const char* Name;
+*   static constexpr bool Linkable; // Data/<Name> can be a symlink to a working copy, see ygomasterSlots.h
+*   static bool Backup(YgoTargetContext& tc);
+*   static bool Restore(YgoTargetContext& tc);
+*   static bool RestoreSelected(YgoTargetContext& tc, const YgoRestoreFilter& filter, std::vector<std::string>& restored);
+*   static void Verify(YgoTargetContext& tc, YgoVerifyResult& result);
+*   static bool Freeze(YgoTargetContext& tc); // move the archived copy into the cold store, see ygomasterColdStore.h
+*/
+
+// Files up to this size can be stored in the ArchiveList entry of an archive instead of the archive directory
+constexpr uint64_t INLINE_FILE_MAX_SIZE = 16 * 1024;
+
+// Result of verifying one archive
+struct YgoVerifyResult
+{
+	uint64_t m_files;
+	uint64_t m_bytes;
+	int m_problems; // damaged packs, missing targets, unreadable Player.json
+	int m_changed; // files differing from Data, only counted for the current archive
+
+	YgoVerifyResult() :m_files(0), m_bytes(0), m_problems(0), m_changed(0) {}
+};
+
+// Files of a partial restore. Patterns are paths relative to the Data directory: a target or directory name
+// selects everything under it, * and ? match within one path component and ** matches any number of components.
+struct YgoRestoreFilter
+{
+	std::vector<std::string> m_patterns;
+
+	// relPath is selected by a pattern, directly or through a selected directory
+	bool Matches(const std::string& relPath) const;
+	// Some pattern may select targetName or something under it
+	bool MayMatchTarget(const std::string& targetName) const;
+	// No pattern is absolute or has a ".." part, which could name files outside the archive and Data
+	bool IsSafe() const;
+};
+
+// Everything a policy needs for one archive
+struct YgoTargetContext
+{
+	std::string m_dataPath; // YgoMaster Data directory
+	std::string m_archivePath; // archive directory
+	std::string m_referencePath; // earlier archive whose large files can be shared, may be empty
+	uint64_t m_smallFileThreshold;
+	// Files stored in the ArchiveList entry, name and content
+	std::vector<std::pair<std::string, std::string>>* m_inlineFiles;
+	bool m_compareData; // Verify also compares with Data
+	YgoIoThrottle* m_throttle; // I/O budget of the operation, nullptr runs at full speed
+	std::string m_coldStorePath; // object store Freeze moves archived files into
+
+	YgoTargetContext() :m_dataPath(""), m_archivePath(""), m_referencePath(""),
+		m_smallFileThreshold(0), m_inlineFiles(nullptr), m_compareData(false), m_throttle(nullptr), m_coldStorePath("") {}
+};
+
+bool BackupInlineFile(YgoTargetContext& tc, const std::string& name, const uint64_t maxSize);
+bool RestoreInlineFile(YgoTargetContext& tc, const std::string& name);
+bool RestoreSelectedInlineFile(YgoTargetContext& tc, const std::string& name, const YgoRestoreFilter& filter,
+	std::vector<std::string>& restored);
+void VerifyInlineFile(YgoTargetContext& tc, const std::string& name, YgoVerifyResult& result);
+
+bool BackupPackedTree(YgoTargetContext& tc, const std::string& name);
+bool RestorePackedTree(YgoTargetContext& tc, const std::string& name);
+bool RestoreSelectedPackedTree(YgoTargetContext& tc, const std::string& name, const YgoRestoreFilter& filter,
+	std::vector<std::string>& restored);
+void VerifyPackedTree(YgoTargetContext& tc, const std::string& name, YgoVerifyResult& result);
+bool FreezePackedTree(YgoTargetContext& tc, const std::string& name);
+
+// Tiny file kept in the ArchiveList entry, larger versions of it fall back to a standalone copy
+template<const char* TargetName, uint64_t MaxSize = INLINE_FILE_MAX_SIZE>
+struct YgoInlineFileTarget
+{
+	static constexpr const char* Name = TargetName;
+	static constexpr bool Linkable = false;
+	static bool Backup(YgoTargetContext& tc) { return BackupInlineFile(tc, Name, MaxSize); }
+	static bool Restore(YgoTargetContext& tc) { return RestoreInlineFile(tc, Name); }
+	static bool RestoreSelected(YgoTargetContext& tc, const YgoRestoreFilter& filter, std::vector<std::string>& restored)
+	{
+		return RestoreSelectedInlineFile(tc, Name, filter, restored);
+	}
+	static void Verify(YgoTargetContext& tc, YgoVerifyResult& result) { VerifyInlineFile(tc, Name, result); }
+	// Already inside ArchiveList, a standalone copy is small enough to stay
+	static bool Freeze(YgoTargetContext&) { return true; }
+};
+
+// Directory tree, small files packed into one pack, large files standalone and hard linked to
+// the reference archive when unchanged, compressed into the cold store once the archive is old
+template<const char* TargetName>
+struct YgoPackedTreeTarget
+{
+	static constexpr const char* Name = TargetName;
+	static constexpr bool Linkable = true;
+	static bool Backup(YgoTargetContext& tc) { return BackupPackedTree(tc, Name); }
+	static bool Restore(YgoTargetContext& tc) { return RestorePackedTree(tc, Name); }
+	// Files named exactly are read directly, only patterns with wildcards or directories list the target
+	static bool RestoreSelected(YgoTargetContext& tc, const YgoRestoreFilter& filter, std::vector<std::string>& restored)
+	{
+		return RestoreSelectedPackedTree(tc, Name, filter, restored);
+	}
+	static void Verify(YgoTargetContext& tc, YgoVerifyResult& result) { VerifyPackedTree(tc, Name, result); }
+	static bool Freeze(YgoTargetContext& tc) { return FreezePackedTree(tc, Name); }
+};
+
+// Data YgoMaster rebuilds by itself, never archived and left as is on restore
+template<const char* TargetName>
+struct YgoSkippedTarget
+{
+	static constexpr const char* Name = TargetName;
+	static constexpr bool Linkable = false;
+	static bool Backup(YgoTargetContext&) { return true; }
+	static bool Restore(YgoTargetContext&) { return true; }
+	static bool RestoreSelected(YgoTargetContext&, const YgoRestoreFilter&, std::vector<std::string>&) { return true; }
+	static void Verify(YgoTargetContext&, YgoVerifyResult&) {}
+	static bool Freeze(YgoTargetContext&) { return true; }
+};
+
+inline constexpr char sc_settingsTargetName[] = "Settings.json";
+inline constexpr char sc_playersTargetName[] = "Players";
+
+using YgoBackupTargets = std::tuple<
+	YgoInlineFileTarget<sc_settingsTargetName>,
+	YgoPackedTreeTarget<sc_playersTargetName>
+>;
+
+// Call func(Policy{}) for every backup target, in order
+template<typename Func>
+void ForEachBackupTarget(Func&& func)
+{
+	std::apply([&func](auto... target) { (func(target), ...); }, YgoBackupTargets());
+}
+
+// Call func(Policy{}) for every backup target until one returns false
+template<typename Func>
+bool AllBackupTargets(Func&& func)
+{
+	return std::apply([&func](auto... target) { return (func(target) && ...); }, YgoBackupTargets());
+}
+
+#endif // !YGOMASTER_BACKUP_POLICY_H
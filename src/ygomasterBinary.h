@@ -0,0 +1,101 @@
+#ifndef YGOMASTER_BINARY_H
+#define YGOMASTER_BINARY_H
+
+#include"public.h"
+#include<cstring>
+
+// Little-endian helpers shared by the binary side files (packs, indexes)
+
+inline void PutLE(std::string& out, uint64_t value, const int bytes)
+{
+	for (int i = 0; i < bytes; ++i) {
+		out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+	}
+}
+
+inline uint64_t GetLE(const char* in, const int bytes)
+{
+	uint64_t value = 0;
+	for (int i = 0; i < bytes; ++i) {
+		value |= static_cast<uint64_t>(static_cast<unsigned char>(in[i])) << (8 * i);
+	}
+	return value;
+}
+
+// FNV-1a 64 of size bytes, continuing from hash
+inline uint64_t HashFnv1a(const void* data, const size_t size, uint64_t hash = 14695981039346656037ULL)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+// Sequential reader over a byte range, every read fails once the range is exhausted
+class YgoBinaryReader
+{
+public:
+	YgoBinaryReader(const char* data, const size_t size) :m_data(data), m_size(size), m_pos(0) {}
+
+	bool Read(uint64_t& value, const int bytes)
+	{
+		if (m_pos + bytes > m_size) {
+			return false;
+		}
+		value = GetLE(m_data + m_pos, bytes);
+		m_pos += bytes;
+		return true;
+	}
+	bool ReadString(std::string& value, const size_t length)
+	{
+		if (m_pos + length > m_size) {
+			return false;
+		}
+		value.assign(m_data + m_pos, length);
+		m_pos += length;
+		return true;
+	}
+	bool Skip(const size_t length)
+	{
+		if (m_pos + length > m_size) {
+			return false;
+		}
+		m_pos += length;
+		return true;
+	}
+	const char* Current() const { return m_data + m_pos; }
+	size_t Remaining() const { return m_size - m_pos; }
+
+private:
+	const char* m_data;
+	size_t m_size;
+	size_t m_pos;
+};
+
+// Write data to path + ".tmp" and rename it over path
+inline bool ReplaceFileContent(const std::filesystem::path& path, const std::string& data)
+{
+	std::filesystem::path tempPath = path;
+	tempPath += ".tmp";
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) {
+			return false;
+		}
+		file.write(data.data(), static_cast<std::streamsize>(data.size()));
+		if (!file) {
+			return false;
+		}
+	}
+	std::error_code ec;
+	std::filesystem::rename(tempPath, path, ec);
+	if (ec) {
+		std::filesystem::remove(tempPath, ec);
+		return false;
+	}
+	return true;
+}
+
+#endif // !YGOMASTER_BINARY_H
@@ -0,0 +1,569 @@
+#include "ygomasterBundle.h"
+#include "ygomasterBinary.h"
+#include "ygomasterColdStore.h"
+#include "ygomasterTreeWalker.h"
+#include <zlib.h>
+#include <fstream>
+#include <deque>
+#include <map>
+#include <condition_variable>
+
+namespace fs = std::filesystem;
+
+static const char sc_bundleMagic[4] = { 'Y', 'M', 'B', 'D' };
+constexpr uint32_t BUNDLE_VERSION = 1;
+
+enum EBundleRecord :uint8_t
+{
+	ARCHIVE_RECORD = 1,
+	DIRECTORY_RECORD = 2,
+	FILE_RECORD = 3,
+	BLOCK_RECORD = 4,
+	END_RECORD = 5
+};
+
+// One record on its way through the pipeline
+struct YgoBundleItem
+{
+	uint8_t m_type;
+	std::string m_header; // export: record bytes written before m_data, filled by the compression stage for blocks
+	std::string m_data; // block content, raw before the compression stage and stored after it, the other way round on import
+	std::string m_text; // import: path of directory and file records, entry of archive records
+	uint64_t m_size; // import: file size, archive count of the end record
+	uint32_t m_rawSize;
+	uint32_t m_crc;
+	bool m_compressed;
+
+	YgoBundleItem() :m_type(0), m_header(""), m_data(""), m_text(""), m_size(0), m_rawSize(0), m_crc(0), m_compressed(false) {}
+};
+
+// Items pushed by a producer thread are transformed on worker threads and consumed on the calling thread
+// in push order, at most maxInFlight items are between the producer and the consumer
+template<typename Item>
+class YgoOrderedPipeline
+{
+public:
+	YgoOrderedPipeline(const size_t workers, const size_t maxInFlight)
+		:m_workers(std::max<size_t>(workers, 1)), m_maxInFlight(std::max(maxInFlight, m_workers)),
+		m_pushed(0), m_consumed(0), m_produced(false), m_failed(false) {}
+
+	// Called by the producer, waits for room, false once a stage failed
+	bool Push(Item&& item)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_changed.wait(lock, [&]() { return m_failed || m_pushed - m_consumed < m_maxInFlight; });
+		if (m_failed) {
+			return false;
+		}
+		m_pending.emplace_back(m_pushed++, std::move(item));
+		m_changed.notify_all();
+		return true;
+	}
+
+	// Return false if any stage returned false, the other stages stop at their next item
+	bool Run(const std::function<bool(YgoOrderedPipeline&)>& produce, const std::function<bool(Item&)>& transform,
+		const std::function<bool(Item&)>& consume)
+	{
+		std::vector<std::thread> threads;
+		threads.emplace_back([&]() {
+			const bool ok = produce(*this);
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_produced = true;
+			m_failed = m_failed || !ok;
+			m_changed.notify_all();
+		});
+		for (size_t i = 0; i < m_workers; ++i) {
+			threads.emplace_back([&]() {
+				std::unique_lock<std::mutex> lock(m_mutex);
+				while (true) {
+					m_changed.wait(lock, [&]() { return m_failed || !m_pending.empty() || m_produced; });
+					if (m_failed || m_pending.empty()) {
+						break;
+					}
+					auto job = std::move(m_pending.front());
+					m_pending.pop_front();
+					lock.unlock();
+					const bool ok = transform(job.second);
+					lock.lock();
+					m_failed = m_failed || !ok;
+					m_done.emplace(job.first, std::move(job.second));
+					m_changed.notify_all();
+				}
+			});
+		}
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (true) {
+			m_changed.wait(lock, [&]() { return m_failed || m_done.count(m_consumed) || (m_produced && m_consumed == m_pushed); });
+			auto found = m_done.find(m_consumed);
+			if (m_failed || found == m_done.end()) {
+				break;
+			}
+			Item item = std::move(found->second);
+			m_done.erase(found);
+			lock.unlock();
+			const bool ok = consume(item);
+			lock.lock();
+			++m_consumed;
+			m_failed = m_failed || !ok;
+			m_changed.notify_all();
+		}
+		lock.unlock();
+		for (auto& thread : threads) {
+			thread.join();
+		}
+		return !m_failed;
+	}
+
+private:
+	const size_t m_workers;
+	const size_t m_maxInFlight;
+	std::mutex m_mutex;
+	std::condition_variable m_changed;
+	std::deque<std::pair<uint64_t, Item>> m_pending; // waiting for a worker, by push number
+	std::map<uint64_t, Item> m_done; // transformed, waiting for the consumer
+	uint64_t m_pushed;
+	uint64_t m_consumed;
+	bool m_produced;
+	bool m_failed;
+};
+
+using YgoBundlePipeline = YgoOrderedPipeline<YgoBundleItem>;
+
+static size_t GetBundleWorkers()
+{
+	return std::max<size_t>(std::thread::hardware_concurrency(), 1);
+}
+
+// Relative, without ".." and not empty, so an entry of a bundle cannot point outside its archive directory
+static bool IsSafeRelativePath(const std::string& path)
+{
+	const fs::path relPath(path);
+	if (path.empty() || relPath.has_root_name() || relPath.has_root_directory()) {
+		return false;
+	}
+	for (const auto& part : relPath) {
+		if (part == "..") {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool PushRecord(YgoBundlePipeline& pipeline, const uint8_t type, const std::string& text, const int lengthBytes)
+{
+	YgoBundleItem item;
+	item.m_type = type;
+	item.m_header.push_back(static_cast<char>(type));
+	PutLE(item.m_header, text.size(), lengthBytes);
+	item.m_header.append(text);
+	return pipeline.Push(std::move(item));
+}
+
+static bool PushFileRecord(YgoBundlePipeline& pipeline, const std::string& relPath, const uint64_t size)
+{
+	YgoBundleItem item;
+	item.m_type = FILE_RECORD;
+	item.m_header.push_back(static_cast<char>(FILE_RECORD));
+	PutLE(item.m_header, relPath.size(), 2);
+	item.m_header.append(relPath);
+	PutLE(item.m_header, size, 8);
+	return pipeline.Push(std::move(item));
+}
+
+static bool PushBlock(YgoBundlePipeline& pipeline, std::string&& data)
+{
+	YgoBundleItem item;
+	item.m_type = BLOCK_RECORD;
+	item.m_data = std::move(data);
+	return pipeline.Push(std::move(item));
+}
+
+// Stream a file of size bytes as a file record and its blocks
+static bool PushFile(YgoBundlePipeline& pipeline, const std::string& relPath, const fs::path& path, const uint64_t size)
+{
+	std::ifstream in(path, std::ios::binary);
+	if (!in || !PushFileRecord(pipeline, relPath, size)) {
+		printf("Read %s failed.\n", path.string().c_str());
+		return false;
+	}
+	uint64_t left = size;
+	while (left > 0) {
+		std::string data(static_cast<size_t>(std::min<uint64_t>(left, BUNDLE_BLOCK_SIZE)), '\0');
+		in.read(data.data(), static_cast<std::streamsize>(data.size()));
+		if (in.gcount() != static_cast<std::streamsize>(data.size())) {
+			printf("%s changed while exporting.\n", path.string().c_str());
+			return false;
+		}
+		left -= data.size();
+		if (!PushBlock(pipeline, std::move(data))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// "<dir>/<target>.cold" is written as the standalone files of "<dir>/<target>"
+static bool PushColdTarget(YgoBundlePipeline& pipeline, const std::string& relPath, const fs::path& coldPath, YgoBundleStats& stats)
+{
+	std::vector<YgoColdEntry> entries;
+	fs::path storeDir;
+	if (!ReadColdTable(coldPath, entries, storeDir)) {
+		printf("Read cold manifest %s failed.\n", coldPath.string().c_str());
+		return false;
+	}
+	const std::string targetPath = relPath.substr(0, relPath.size() - sc_coldExtension.size());
+	if (!PushRecord(pipeline, DIRECTORY_RECORD, targetPath, 2)) {
+		return false;
+	}
+	for (const auto& entry : entries) {
+		const std::string entryPath = targetPath + "/" + entry.m_path;
+		if (entry.m_type == YgoColdEntry::DIRECTORY_ENTRY) {
+			if (!PushRecord(pipeline, DIRECTORY_RECORD, entryPath, 2)) {
+				return false;
+			}
+			continue;
+		}
+		std::string content;
+		if (!ReadColdObject(storeDir, entry, content)) {
+			printf("Read object of %s failed.\n", entryPath.c_str());
+			return false;
+		}
+		if (!PushFileRecord(pipeline, entryPath, content.size())) {
+			return false;
+		}
+		for (size_t offset = 0; offset < content.size(); offset += BUNDLE_BLOCK_SIZE) {
+			if (!PushBlock(pipeline, content.substr(offset, BUNDLE_BLOCK_SIZE))) {
+				return false;
+			}
+		}
+		++stats.m_files;
+		stats.m_bytes += content.size();
+	}
+	return true;
+}
+
+static bool PushArchive(YgoBundlePipeline& pipeline, const YgoBundleSource& source, YgoBundleStats& stats)
+{
+	std::vector<YgoTreeEntry> entries;
+	if (!WalkTree(source.m_path, entries, true)) {
+		printf("Read archive %s failed.\n", source.m_path.c_str());
+		return false;
+	}
+	if (!PushRecord(pipeline, ARCHIVE_RECORD, source.m_entryJson, 4)) {
+		return false;
+	}
+	++stats.m_archives;
+	for (const auto& entry : entries) {
+		const fs::path path = fs::path(source.m_path) / entry.m_path;
+		if (entry.m_type == YgoTreeEntry::DIRECTORY_ENTRY) {
+			if (!PushRecord(pipeline, DIRECTORY_RECORD, entry.m_path, 2)) {
+				return false;
+			}
+			continue;
+		}
+		if (entry.m_type != YgoTreeEntry::FILE_ENTRY) continue;
+		const std::string extension = path.extension().string();
+		//Leftovers of an interrupted write
+		if (".tmp" == extension) continue;
+		if (sc_coldExtension == extension) {
+			if (!PushColdTarget(pipeline, entry.m_path, path, stats)) {
+				return false;
+			}
+			continue;
+		}
+		if (!PushFile(pipeline, entry.m_path, path, entry.m_size)) {
+			return false;
+		}
+		++stats.m_files;
+		stats.m_bytes += entry.m_size;
+	}
+	return true;
+}
+
+// Checksum and compress a block, kept raw if it does not get smaller
+static bool PackBlock(YgoBundleItem& item)
+{
+	if (item.m_type != BLOCK_RECORD) {
+		return true;
+	}
+	const Bytef* raw = reinterpret_cast<const Bytef*>(item.m_data.data());
+	const uLong rawSize = static_cast<uLong>(item.m_data.size());
+	const uint32_t crc = static_cast<uint32_t>(crc32(0L, raw, rawSize));
+	std::string stored(compressBound(rawSize), '\0');
+	uLongf length = static_cast<uLongf>(stored.size());
+	const bool compressed = compress2(reinterpret_cast<Bytef*>(stored.data()), &length, raw, rawSize, Z_BEST_SPEED) == Z_OK
+		&& length < rawSize;
+	if (compressed) {
+		stored.resize(length);
+	}
+	else {
+		stored = std::move(item.m_data);
+	}
+	item.m_header.push_back(static_cast<char>(BLOCK_RECORD));
+	PutLE(item.m_header, rawSize, 4);
+	PutLE(item.m_header, stored.size(), 4);
+	PutLE(item.m_header, crc, 4);
+	item.m_header.push_back(compressed ? 1 : 0);
+	item.m_data = std::move(stored);
+	return true;
+}
+
+bool ExportBundle(const fs::path& bundlePath, const std::vector<YgoBundleSource>& sources, YgoBundleStats* stats)
+{
+	const fs::path tempPath = bundlePath.string() + ".tmp";
+	std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+	if (!out) {
+		printf("Create %s failed.\n", tempPath.string().c_str());
+		return false;
+	}
+	YgoBundleStats localStats;
+	std::string header(sc_bundleMagic, sizeof(sc_bundleMagic));
+	PutLE(header, BUNDLE_VERSION, 4);
+	out.write(header.data(), static_cast<std::streamsize>(header.size()));
+	localStats.m_storedBytes += header.size();
+
+	//The producer counts archives and files, the consumer the bytes it writes
+	const size_t workers = GetBundleWorkers();
+	YgoBundlePipeline pipeline(workers, workers * BUNDLE_BLOCKS_IN_FLIGHT);
+	bool ok = pipeline.Run(
+		[&](YgoBundlePipeline& stage) {
+			for (const auto& source : sources) {
+				if (!PushArchive(stage, source, localStats)) {
+					return false;
+				}
+			}
+			YgoBundleItem end;
+			end.m_type = END_RECORD;
+			end.m_header.push_back(static_cast<char>(END_RECORD));
+			PutLE(end.m_header, sources.size(), 4);
+			return stage.Push(std::move(end));
+		},
+		PackBlock,
+		[&](YgoBundleItem& item) {
+			out.write(item.m_header.data(), static_cast<std::streamsize>(item.m_header.size()));
+			out.write(item.m_data.data(), static_cast<std::streamsize>(item.m_data.size()));
+			localStats.m_storedBytes += item.m_header.size() + item.m_data.size();
+			return out.good();
+		});
+	out.flush();
+	ok = ok && out.good();
+	out.close();
+	std::error_code ec;
+	if (ok) {
+		fs::rename(tempPath, bundlePath, ec);
+	}
+	if (!ok || ec) {
+		printf("Write bundle %s failed.\n", bundlePath.string().c_str());
+		fs::remove(tempPath, ec);
+		return false;
+	}
+	if (stats) {
+		*stats = localStats;
+	}
+	return true;
+}
+
+static bool ReadBundleValue(std::istream& in, uint64_t& value, const int bytes)
+{
+	char buffer[8];
+	in.read(buffer, bytes);
+	if (in.gcount() != bytes) {
+		return false;
+	}
+	value = GetLE(buffer, bytes);
+	return true;
+}
+
+static bool ReadBundleString(std::istream& in, std::string& value, const int lengthBytes)
+{
+	uint64_t length = 0;
+	if (!ReadBundleValue(in, length, lengthBytes)) {
+		return false;
+	}
+	value.resize(static_cast<size_t>(length));
+	in.read(value.data(), static_cast<std::streamsize>(length));
+	return in.gcount() == static_cast<std::streamsize>(length);
+}
+
+// Read the records of a bundle after its header, stops after the end record
+static bool PushBundleRecords(YgoBundlePipeline& pipeline, std::istream& in, YgoBundleStats& stats)
+{
+	const uint64_t maxStored = compressBound(static_cast<uLong>(BUNDLE_BLOCK_SIZE));
+	while (true) {
+		YgoBundleItem item;
+		uint64_t type = 0, value = 0;
+		bool ok = ReadBundleValue(in, type, 1);
+		item.m_type = static_cast<uint8_t>(type);
+		switch (item.m_type) {
+		case ARCHIVE_RECORD:
+			ok = ok && ReadBundleString(in, item.m_text, 4);
+			stats.m_storedBytes += 5 + item.m_text.size();
+			break;
+		case DIRECTORY_RECORD:
+			ok = ok && ReadBundleString(in, item.m_text, 2);
+			stats.m_storedBytes += 3 + item.m_text.size();
+			break;
+		case FILE_RECORD:
+			ok = ok && ReadBundleString(in, item.m_text, 2) && ReadBundleValue(in, item.m_size, 8);
+			stats.m_storedBytes += 11 + item.m_text.size();
+			break;
+		case BLOCK_RECORD:
+		{
+			uint64_t storedSize = 0;
+			ok = ok && ReadBundleValue(in, value, 4) && value <= BUNDLE_BLOCK_SIZE && ReadBundleValue(in, storedSize, 4)
+				&& storedSize <= maxStored;
+			item.m_rawSize = static_cast<uint32_t>(value);
+			ok = ok && ReadBundleValue(in, value, 4);
+			item.m_crc = static_cast<uint32_t>(value);
+			ok = ok && ReadBundleValue(in, value, 1);
+			item.m_compressed = (value != 0);
+			if (ok) {
+				item.m_data.resize(static_cast<size_t>(storedSize));
+				in.read(item.m_data.data(), static_cast<std::streamsize>(storedSize));
+				ok = in.gcount() == static_cast<std::streamsize>(storedSize);
+			}
+			stats.m_storedBytes += 14 + storedSize;
+			break;
+		}
+		case END_RECORD:
+			ok = ok && ReadBundleValue(in, item.m_size, 4);
+			stats.m_storedBytes += 5;
+			break;
+		default:
+			ok = false;
+			break;
+		}
+		if (!ok) {
+			printf("Bundle is damaged or incomplete.\n");
+			return false;
+		}
+		const bool end = (item.m_type == END_RECORD);
+		if (!pipeline.Push(std::move(item))) {
+			return false;
+		}
+		if (end) {
+			return true;
+		}
+	}
+}
+
+// Decompress a block and check its checksum
+static bool UnpackBlock(YgoBundleItem& item)
+{
+	if (item.m_type != BLOCK_RECORD) {
+		return true;
+	}
+	if (item.m_compressed) {
+		std::string raw(item.m_rawSize, '\0');
+		uLongf length = static_cast<uLongf>(raw.size());
+		if (uncompress(reinterpret_cast<Bytef*>(raw.data()), &length, reinterpret_cast<const Bytef*>(item.m_data.data()),
+			static_cast<uLong>(item.m_data.size())) != Z_OK || length != item.m_rawSize) {
+			printf("Bundle block cannot be decompressed.\n");
+			return false;
+		}
+		item.m_data = std::move(raw);
+	}
+	const uint32_t crc = static_cast<uint32_t>(crc32(0L, reinterpret_cast<const Bytef*>(item.m_data.data()),
+		static_cast<uInt>(item.m_data.size())));
+	if (item.m_data.size() != item.m_rawSize || crc != item.m_crc) {
+		printf("Bundle block checksum mismatch.\n");
+		return false;
+	}
+	return true;
+}
+
+bool ImportBundle(const fs::path& bundlePath, const std::function<std::string(const std::string& entryJson)>& beginArchive,
+	YgoBundleStats* stats)
+{
+	std::ifstream in(bundlePath, std::ios::binary);
+	char magic[sizeof(sc_bundleMagic)] = {};
+	uint64_t version = 0;
+	if (!in || !in.read(magic, sizeof(magic)) || memcmp(magic, sc_bundleMagic, sizeof(magic)) != 0) {
+		printf("%s is not a bundle.\n", bundlePath.string().c_str());
+		return false;
+	}
+	if (!ReadBundleValue(in, version, 4) || version != BUNDLE_VERSION) {
+		printf("Unsupported bundle version %u.\n", static_cast<unsigned>(version));
+		return false;
+	}
+
+	//The producer counts bundle bytes, the consumer what it writes
+	YgoBundleStats localStats;
+	localStats.m_storedBytes = sizeof(sc_bundleMagic) + 4;
+	fs::path archiveDir;
+	fs::path filePath;
+	std::ofstream file;
+	uint64_t fileLeft = 0;
+	bool ended = false;
+	auto closeFile = [&]() {
+		file.close();
+		if (file.fail()) {
+			printf("Write %s failed.\n", filePath.string().c_str());
+			return false;
+		}
+		return true;
+	};
+	const size_t workers = GetBundleWorkers();
+	YgoBundlePipeline pipeline(workers, workers * BUNDLE_BLOCKS_IN_FLIGHT);
+	const bool ok = pipeline.Run(
+		[&](YgoBundlePipeline& stage) { return PushBundleRecords(stage, in, localStats); },
+		UnpackBlock,
+		[&](YgoBundleItem& item) {
+			if (item.m_type != BLOCK_RECORD && fileLeft > 0) {
+				printf("Bundle is missing data of %s.\n", filePath.string().c_str());
+				return false;
+			}
+			if (item.m_type == ARCHIVE_RECORD) {
+				archiveDir = beginArchive(item.m_text);
+				if (archiveDir.empty()) {
+					return false;
+				}
+				++localStats.m_archives;
+				return true;
+			}
+			if (item.m_type == END_RECORD) {
+				ended = (item.m_size == localStats.m_archives);
+				return ended;
+			}
+			if (item.m_type == BLOCK_RECORD) {
+				if (!file.is_open() || item.m_rawSize > fileLeft) {
+					printf("Bundle is damaged, block outside of a file.\n");
+					return false;
+				}
+				file.write(item.m_data.data(), static_cast<std::streamsize>(item.m_data.size()));
+				fileLeft -= item.m_rawSize;
+				localStats.m_bytes += item.m_rawSize;
+				return (fileLeft > 0) ? file.good() : closeFile();
+			}
+			if (archiveDir.empty() || !IsSafeRelativePath(item.m_text)) {
+				printf("Bundle is damaged, bad path %s.\n", item.m_text.c_str());
+				return false;
+			}
+			const fs::path path = archiveDir / fs::path(item.m_text);
+			std::error_code ec;
+			if (item.m_type == DIRECTORY_RECORD) {
+				fs::create_directories(path, ec);
+				return !ec;
+			}
+			fs::create_directories(path.parent_path(), ec);
+			filePath = path;
+			file.open(path, std::ios::binary | std::ios::trunc);
+			if (!file) {
+				printf("Create %s failed.\n", path.string().c_str());
+				return false;
+			}
+			fileLeft = item.m_size;
+			++localStats.m_files;
+			return (fileLeft > 0) || closeFile();
+		});
+	if (file.is_open()) {
+		file.close();
+	}
+	if (!ok || !ended) {
+		return false;
+	}
+	if (stats) {
+		*stats = localStats;
+	}
+	return true;
+}
@@ -0,0 +1,54 @@
+#ifndef YGOMASTER_BUNDLE_H
+#define YGOMASTER_BUNDLE_H
+
+#include"public.h"
+#include<functional>
+
+/*
+* Portable bundles of archives, for moving a history to another machine or install.
+* A bundle is one stream of records, all integers little-endian, paths relative to the archive directory
+* and '/' separated, so nothing in it depends on where the archives were stored:
+*   header:    magic "YMBD", version u32
+*   archive:   type 1, entry length u32, the ArchiveList entry of the archive as JSON, starts a new archive
+*   directory: type 2, path length u16, path
+*   file:      type 3, path length u16, path, size u64, followed by the blocks of its content
+*   block:     type 4, raw size u32, stored size u32, CRC-32 of the raw bytes u32, compressed u8, stored bytes
+*   end:       type 5, archive count u32
+* Files are cut into BUNDLE_BLOCK_SIZE blocks. Reading, zlib compression with checksums and writing run as
+* overlapping stages with at most BUNDLE_BLOCKS_IN_FLIGHT blocks between them, import runs the same way
+* backwards. Frozen targets are written as their standalone files, so a bundle does not need the cold store.
+*/
+
+static const std::string sc_bundleExtension = ".ymbundle";
+
+constexpr size_t BUNDLE_BLOCK_SIZE = 1024 * 1024;
+// Blocks read but not yet written, per compression worker
+constexpr size_t BUNDLE_BLOCKS_IN_FLIGHT = 4;
+
+struct YgoBundleSource
+{
+	std::string m_path; // archive directory
+	std::string m_entryJson; // ArchiveList entry of the archive
+
+	YgoBundleSource() :m_path(""), m_entryJson("") {}
+};
+
+struct YgoBundleStats
+{
+	uint64_t m_archives;
+	uint64_t m_files;
+	uint64_t m_bytes; // size of the files
+	uint64_t m_storedBytes; // bytes of the bundle
+
+	YgoBundleStats() :m_archives(0), m_files(0), m_bytes(0), m_storedBytes(0) {}
+};
+
+// Write the archives of sources into bundlePath, which only appears once it is complete
+bool ExportBundle(const std::filesystem::path& bundlePath, const std::vector<YgoBundleSource>& sources,
+	YgoBundleStats* stats = nullptr);
+// Unpack every archive of bundlePath. beginArchive receives the ArchiveList entry of each archive and returns
+// the directory its files are written to, empty to stop. Every block is checked against its checksum before it is written.
+bool ImportBundle(const std::filesystem::path& bundlePath,
+	const std::function<std::string(const std::string& entryJson)>& beginArchive, YgoBundleStats* stats = nullptr);
+
+#endif // !YGOMASTER_BUNDLE_H
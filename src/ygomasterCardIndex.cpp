@@ -0,0 +1,328 @@
+#include "ygomasterCardIndex.h"
+#include "ygomasterBinary.h"
+#include "ygomasterFileView.h"
+#include "ygomasterPack.h"
+#include <cjson/cJSON.h>
+#include <algorithm>
+
+namespace fs = std::filesystem;
+
+static const char sc_inventoryMagic[4] = { 'Y', 'M', 'C', 'I' };
+static const char sc_indexMagic[4] = { 'Y', 'M', 'C', 'X' };
+constexpr uint32_t CARD_INDEX_VERSION = 1;
+
+uint16_t YgoCardInventory::CountOf(const uint32_t cardId) const
+{
+	auto it = std::lower_bound(m_cardIds.begin(), m_cardIds.end(), cardId);
+	if (it == m_cardIds.end() || *it != cardId) {
+		return 0;
+	}
+	return m_counts[it - m_cardIds.begin()];
+}
+
+// A card entry is either a plain count or an object holding "tn" (total) or per-style "*num" counts
+static uint16_t ReadCardCount(const cJSON* value)
+{
+	double count = 0;
+	if (cJSON_IsNumber(value)) {
+		count = value->valuedouble;
+	}
+	else if (cJSON_IsObject(value)) {
+		cJSON* total = cJSON_GetObjectItem(value, "tn");
+		if (cJSON_IsNumber(total)) {
+			count = total->valuedouble;
+		}
+		else {
+			for (const cJSON* item = value->child; item; item = item->next) {
+				const std::string key = item->string ? item->string : "";
+				if (cJSON_IsNumber(item) && key.size() >= 3 && key.compare(key.size() - 3, 3, "num") == 0) {
+					count += item->valuedouble;
+				}
+			}
+		}
+	}
+	if (count < 0) {
+		return 0;
+	}
+	return static_cast<uint16_t>(std::min(count, 65535.0));
+}
+
+bool ExtractCardInventory(const cJSON* playerRoot, const std::string& archivePath, const std::string& decksRelDir, YgoCardInventory& result)
+{
+	result = YgoCardInventory();
+	cJSON* cards = cJSON_GetObjectItem(playerRoot, "Cards");
+	if (!cJSON_IsObject(cards)) {
+		return false;
+	}
+	std::vector<std::pair<uint32_t, uint16_t>> owned;
+	for (const cJSON* item = cards->child; item; item = item->next) {
+		if (!item->string) continue;
+		char* end = nullptr;
+		const unsigned long cardId = strtoul(item->string, &end, 10);
+		const uint16_t count = ReadCardCount(item);
+		if (end == item->string || *end != '\0' || 0 == count) continue;
+		owned.emplace_back(static_cast<uint32_t>(cardId), count);
+	}
+	std::sort(owned.begin(), owned.end());
+	for (const auto& card : owned) {
+		result.m_cardIds.push_back(card.first);
+		result.m_counts.push_back(card.second);
+	}
+
+	//Deck files live next to Player.json, their "name" is what users recognize
+	const std::string generic = fs::path(decksRelDir).generic_string();
+	const size_t split = generic.find('/');
+	std::vector<std::string> files;
+	ListArchiveFiles(archivePath, generic.substr(0, split), files);
+	for (const auto& file : files) {
+		if (file.compare(0, generic.size() + 1, generic + "/") != 0 || fs::path(file).extension() != ".json") {
+			continue;
+		}
+		std::string name = fs::path(file).stem().string();
+		YgoFileView view;
+		if (ReadArchiveFile(archivePath, file, view)) {
+			cJSON* deck = cJSON_ParseWithLength(view.Data(), view.Size());
+			cJSON* nameItem = cJSON_GetObjectItem(deck, "name");
+			if (cJSON_IsString(nameItem) && nameItem->valuestring[0] != '\0') {
+				name = nameItem->valuestring;
+			}
+			cJSON_Delete(deck);
+		}
+		result.m_decks.push_back(name);
+	}
+	std::sort(result.m_decks.begin(), result.m_decks.end());
+	result.m_decks.erase(std::unique(result.m_decks.begin(), result.m_decks.end()), result.m_decks.end());
+	return true;
+}
+
+bool ExtractCardInventory(const std::string& archivePath, const std::string& playerRelPath, const std::string& decksRelDir, YgoCardInventory& result)
+{
+	YgoFileView view;
+	if (!ReadArchiveFile(archivePath, playerRelPath, view)) {
+		return false;
+	}
+	cJSON* root = cJSON_ParseWithLength(view.Data(), view.Size());
+	view.Close();
+	if (!root) {
+		return false;
+	}
+	const bool ok = ExtractCardInventory(root, archivePath, decksRelDir, result);
+	cJSON_Delete(root);
+	return ok;
+}
+
+bool WriteCardInventory(const std::string& archivePath, const YgoCardInventory& inventory)
+{
+	std::string out;
+	out.reserve(16 + inventory.m_cardIds.size() * 6);
+	out.append(sc_inventoryMagic, sizeof(sc_inventoryMagic));
+	PutLE(out, CARD_INDEX_VERSION, 4);
+	PutLE(out, inventory.m_cardIds.size(), 4);
+	PutLE(out, inventory.m_decks.size(), 4);
+	for (uint32_t cardId : inventory.m_cardIds) {
+		PutLE(out, cardId, 4);
+	}
+	for (uint16_t count : inventory.m_counts) {
+		PutLE(out, count, 2);
+	}
+	for (const auto& deck : inventory.m_decks) {
+		PutLE(out, deck.size(), 2);
+		out.append(deck);
+	}
+	return ReplaceFileContent(fs::path(archivePath) / sc_cardInventoryFileName, out);
+}
+
+bool ReadCardInventory(const std::string& archivePath, YgoCardInventory& inventory)
+{
+	YgoFileView view;
+	if (!view.Open(fs::path(archivePath) / sc_cardInventoryFileName)) {
+		return false;
+	}
+	YgoBinaryReader reader(view.Data(), view.Size());
+	uint64_t version = 0, cardCount = 0, deckCount = 0;
+	if (view.Size() < sizeof(sc_inventoryMagic) || memcmp(view.Data(), sc_inventoryMagic, sizeof(sc_inventoryMagic)) != 0
+		|| !reader.Skip(sizeof(sc_inventoryMagic))
+		|| !reader.Read(version, 4) || version != CARD_INDEX_VERSION
+		|| !reader.Read(cardCount, 4) || !reader.Read(deckCount, 4)
+		|| reader.Remaining() < cardCount * 6) {
+		return false;
+	}
+	inventory = YgoCardInventory();
+	inventory.m_cardIds.resize(static_cast<size_t>(cardCount));
+	inventory.m_counts.resize(static_cast<size_t>(cardCount));
+	uint64_t value = 0;
+	for (auto& cardId : inventory.m_cardIds) {
+		reader.Read(value, 4);
+		cardId = static_cast<uint32_t>(value);
+	}
+	for (auto& count : inventory.m_counts) {
+		reader.Read(value, 2);
+		count = static_cast<uint16_t>(value);
+	}
+	for (uint64_t i = 0; i < deckCount; ++i) {
+		std::string deck;
+		if (!reader.Read(value, 2) || !reader.ReadString(deck, static_cast<size_t>(value))) {
+			return false;
+		}
+		inventory.m_decks.push_back(std::move(deck));
+	}
+	return true;
+}
+
+YgoCardIndex::YgoCardIndex()
+	:m_indexPath(""), m_loaded(false)
+{
+}
+
+bool YgoCardIndex::Load(const std::string& indexPath)
+{
+	m_indexPath = indexPath;
+	m_cards.clear();
+	m_decks.clear();
+	m_archives.clear();
+	m_loaded = true;
+
+	YgoFileView view;
+	if (!view.Open(indexPath)) {
+		return true;
+	}
+	YgoBinaryReader reader(view.Data(), view.Size());
+	uint64_t version = 0, count = 0, value = 0, postings = 0;
+	bool ok = view.Size() >= sizeof(sc_indexMagic) && memcmp(view.Data(), sc_indexMagic, sizeof(sc_indexMagic)) == 0
+		&& reader.Skip(sizeof(sc_indexMagic)) && reader.Read(version, 4) && version == CARD_INDEX_VERSION
+		&& reader.Read(count, 4);
+	for (uint64_t i = 0; ok && i < count; ++i) {
+		ok = reader.Read(value, 4);
+		m_archives.insert(static_cast<int>(static_cast<int32_t>(value)));
+	}
+	ok = ok && reader.Read(count, 4);
+	for (uint64_t i = 0; ok && i < count; ++i) {
+		uint64_t cardId = 0;
+		ok = reader.Read(cardId, 4) && reader.Read(postings, 4);
+		auto& list = m_cards[static_cast<uint32_t>(cardId)];
+		for (uint64_t j = 0; ok && j < postings; ++j) {
+			uint64_t archiveID = 0, cardCount = 0;
+			ok = reader.Read(archiveID, 4) && reader.Read(cardCount, 2);
+			list.push_back({ static_cast<int>(static_cast<int32_t>(archiveID)), static_cast<uint16_t>(cardCount) });
+		}
+	}
+	ok = ok && reader.Read(count, 4);
+	for (uint64_t i = 0; ok && i < count; ++i) {
+		std::string deck;
+		ok = reader.Read(value, 2) && reader.ReadString(deck, static_cast<size_t>(value)) && reader.Read(postings, 4);
+		auto& list = m_decks[deck];
+		for (uint64_t j = 0; ok && j < postings; ++j) {
+			ok = reader.Read(value, 4);
+			list.push_back(static_cast<int>(static_cast<int32_t>(value)));
+		}
+	}
+	if (!ok) {
+		//A damaged index is rebuilt from the per-archive side files
+		printf("Card index %s is damaged, rebuilding.\n", indexPath.c_str());
+		m_cards.clear();
+		m_decks.clear();
+		m_archives.clear();
+	}
+	return true;
+}
+
+bool YgoCardIndex::Save() const
+{
+	if (!m_loaded || m_indexPath.empty()) {
+		return false;
+	}
+	std::string out;
+	out.append(sc_indexMagic, sizeof(sc_indexMagic));
+	PutLE(out, CARD_INDEX_VERSION, 4);
+	PutLE(out, m_archives.size(), 4);
+	for (int archiveID : m_archives) {
+		PutLE(out, static_cast<uint32_t>(archiveID), 4);
+	}
+	PutLE(out, m_cards.size(), 4);
+	for (const auto& card : m_cards) {
+		PutLE(out, card.first, 4);
+		PutLE(out, card.second.size(), 4);
+		for (const auto& posting : card.second) {
+			PutLE(out, static_cast<uint32_t>(posting.m_archiveID), 4);
+			PutLE(out, posting.m_count, 2);
+		}
+	}
+	PutLE(out, m_decks.size(), 4);
+	for (const auto& deck : m_decks) {
+		PutLE(out, deck.first.size(), 2);
+		out.append(deck.first);
+		PutLE(out, deck.second.size(), 4);
+		for (int archiveID : deck.second) {
+			PutLE(out, static_cast<uint32_t>(archiveID), 4);
+		}
+	}
+	if (!ReplaceFileContent(m_indexPath, out)) {
+		printf("Write card index %s failed.\n", m_indexPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+void YgoCardIndex::AddArchive(const int archiveID, const YgoCardInventory& inventory)
+{
+	RemoveArchive(archiveID);
+	for (size_t i = 0; i < inventory.m_cardIds.size(); ++i) {
+		auto& list = m_cards[inventory.m_cardIds[i]];
+		Posting posting = { archiveID, inventory.m_counts[i] };
+		list.insert(std::upper_bound(list.begin(), list.end(), posting,
+			[](const Posting& a, const Posting& b) { return a.m_archiveID < b.m_archiveID; }), posting);
+	}
+	for (const auto& deck : inventory.m_decks) {
+		auto& list = m_decks[deck];
+		list.insert(std::upper_bound(list.begin(), list.end(), archiveID), archiveID);
+	}
+	m_archives.insert(archiveID);
+}
+
+void YgoCardIndex::RemoveArchive(const int archiveID)
+{
+	if (!m_archives.erase(archiveID)) {
+		return;
+	}
+	//Posting lists are sorted, so each key costs one binary search
+	for (auto it = m_cards.begin(); it != m_cards.end();) {
+		auto& list = it->second;
+		auto pos = std::lower_bound(list.begin(), list.end(), archiveID,
+			[](const Posting& a, const int id) { return a.m_archiveID < id; });
+		if (pos != list.end() && pos->m_archiveID == archiveID) {
+			list.erase(pos);
+		}
+		it = list.empty() ? m_cards.erase(it) : std::next(it);
+	}
+	for (auto it = m_decks.begin(); it != m_decks.end();) {
+		auto& list = it->second;
+		auto pos = std::lower_bound(list.begin(), list.end(), archiveID);
+		if (pos != list.end() && *pos == archiveID) {
+			list.erase(pos);
+		}
+		it = list.empty() ? m_decks.erase(it) : std::next(it);
+	}
+}
+
+void YgoCardIndex::FindCard(const uint32_t cardId, const uint16_t minCount, std::vector<Posting>& result) const
+{
+	result.clear();
+	auto it = m_cards.find(cardId);
+	if (it == m_cards.end()) {
+		return;
+	}
+	for (const auto& posting : it->second) {
+		if (posting.m_count >= minCount) {
+			result.push_back(posting);
+		}
+	}
+}
+
+void YgoCardIndex::FindDeck(const std::string& deckName, std::vector<int>& result) const
+{
+	result.clear();
+	auto it = m_decks.find(deckName);
+	if (it != m_decks.end()) {
+		result = it->second;
+	}
+}
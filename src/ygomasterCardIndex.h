@@ -0,0 +1,75 @@
+#ifndef YGOMASTER_CARD_INDEX_H
+#define YGOMASTER_CARD_INDEX_H
+
+#include"public.h"
+
+struct cJSON;
+
+/*
+* Card ownership of archives.
+* Each archive gets a columnar side file "Cards.idx" written at backup time:
+*   header:  magic "YMCI", version u32, card count u32, deck count u32
+*   columns: card ids u32[card count] sorted ascending, counts u16[card count]
+*   decks:   per deck name length u16 + name
+* The archives directory holds "CardIndex.bin", an inverted index from card id and deck name
+* to the archives containing them, so queries never parse Player.json.
+*/
+
+static const std::string sc_cardInventoryFileName = "Cards.idx";
+static const std::string sc_cardIndexFileName = "CardIndex.bin";
+
+// Cards and decks owned in one archive
+struct YgoCardInventory
+{
+	std::vector<uint32_t> m_cardIds; // sorted ascending
+	std::vector<uint16_t> m_counts; // same order as m_cardIds
+	std::vector<std::string> m_decks;
+
+	// Count of cardId, 0 if not owned
+	uint16_t CountOf(const uint32_t cardId) const;
+};
+
+// Fill result from a parsed Player.json and the deck files of an archive under decksRelDir
+bool ExtractCardInventory(const cJSON* playerRoot, const std::string& archivePath, const std::string& decksRelDir, YgoCardInventory& result);
+// Same as above, reading Player.json (playerRelPath) from the archive
+bool ExtractCardInventory(const std::string& archivePath, const std::string& playerRelPath, const std::string& decksRelDir, YgoCardInventory& result);
+bool WriteCardInventory(const std::string& archivePath, const YgoCardInventory& inventory);
+bool ReadCardInventory(const std::string& archivePath, YgoCardInventory& inventory);
+
+class YgoCardIndex
+{
+public:
+	struct Posting
+	{
+		int m_archiveID;
+		uint16_t m_count;
+	};
+
+	YgoCardIndex();
+
+	// Load from indexPath, a missing file gives an empty loaded index
+	bool Load(const std::string& indexPath);
+	// Write the index back to the path it was loaded from
+	bool Save() const;
+	bool IsLoaded() const { return m_loaded; }
+
+	void AddArchive(const int archiveID, const YgoCardInventory& inventory);
+	void RemoveArchive(const int archiveID);
+	bool HasArchive(const int archiveID) const { return m_archives.count(archiveID) != 0; }
+	const std::unordered_set<int>& Archives() const { return m_archives; }
+
+	// Archives owning at least minCount copies of cardId, ordered by ArchiveID
+	void FindCard(const uint32_t cardId, const uint16_t minCount, std::vector<Posting>& result) const;
+	// Archives containing a deck named deckName, ordered by ArchiveID
+	void FindDeck(const std::string& deckName, std::vector<int>& result) const;
+
+private:
+	std::string m_indexPath;
+	bool m_loaded;
+	// Posting lists are kept sorted by ArchiveID
+	std::unordered_map<uint32_t, std::vector<Posting>> m_cards;
+	std::unordered_map<std::string, std::vector<int>> m_decks;
+	std::unordered_set<int> m_archives;
+};
+
+#endif // !YGOMASTER_CARD_INDEX_H
@@ -0,0 +1,373 @@
+#include "ygomasterColdStore.h"
+#include "ygomasterPack.h"
+#include "ygomasterFileView.h"
+#include "ygomasterBinary.h"
+#include "ygomasterTreeWalker.h"
+#include "ygomasterIoThrottle.h"
+#include "ygomasterDurableFile.h"
+#include "ygomasterFileLock.h"
+#include <zlib.h>
+#include <atomic>
+#include <deque>
+
+namespace fs = std::filesystem;
+
+static const char sc_coldMagic[4] = { 'Y', 'M', 'C', 'D' };
+constexpr uint32_t COLD_VERSION = 1;
+constexpr size_t COLD_HEADER_SIZE = 4 + 4 + 4 + 2;
+// Freezing runs in the background and restores only inflate, so compress as well as zlib can
+constexpr int COLD_COMPRESSION_LEVEL = Z_BEST_COMPRESSION;
+// Objects younger than this are never swept, a freeze in another process may not have written its manifest yet
+constexpr auto COLD_SWEEP_GRACE = std::chrono::hours(1);
+
+static std::string MakeObjectKey(const char* data, const size_t size)
+{
+	const uint64_t hash = HashFnv1a(data, size);
+	uLong crc = crc32(0L, Z_NULL, 0);
+	for (size_t done = 0; done < size;) {
+		const uInt length = static_cast<uInt>(std::min<size_t>(size - done, 1u << 30));
+		crc = crc32(crc, reinterpret_cast<const Bytef*>(data + done), length);
+		done += length;
+	}
+	char key[64];
+	snprintf(key, sizeof(key), "%016llx%08lx-%llx", static_cast<unsigned long long>(hash),
+		static_cast<unsigned long>(crc), static_cast<unsigned long long>(size));
+	return std::string(key);
+}
+
+static fs::path GetObjectPath(const fs::path& storeDir, const std::string& key)
+{
+	return storeDir / key.substr(0, 2) / key;
+}
+
+fs::path GetColdPath(const fs::path& archiveDir, const std::string& targetName)
+{
+	return archiveDir / (targetName + sc_coldExtension);
+}
+
+bool IsColdTarget(const fs::path& archiveDir, const std::string& targetName)
+{
+	std::error_code ec;
+	return fs::exists(GetColdPath(archiveDir, targetName), ec);
+}
+
+static std::string BuildColdTable(const std::vector<YgoColdEntry>& entries, const std::string& storeRelPath)
+{
+	std::string out;
+	out.append(sc_coldMagic, sizeof(sc_coldMagic));
+	PutLE(out, COLD_VERSION, 4);
+	PutLE(out, entries.size(), 4);
+	PutLE(out, storeRelPath.size(), 2);
+	out.append(storeRelPath);
+	for (const auto& entry : entries) {
+		out.push_back(static_cast<char>(entry.m_type));
+		PutLE(out, entry.m_path.size(), 2);
+		out.append(entry.m_path);
+		PutLE(out, entry.m_size, 8);
+		PutLE(out, entry.m_key.size(), 1);
+		out.append(entry.m_key);
+	}
+	return out;
+}
+
+bool ReadColdTable(const fs::path& coldPath, std::vector<YgoColdEntry>& entries, fs::path& storeDir)
+{
+	YgoFileView file;
+	if (!file.Open(coldPath) || file.Size() < COLD_HEADER_SIZE || memcmp(file.Data(), sc_coldMagic, sizeof(sc_coldMagic)) != 0) {
+		return false;
+	}
+	YgoBinaryReader reader(file.Data() + sizeof(sc_coldMagic), file.Size() - sizeof(sc_coldMagic));
+	uint64_t version = 0;
+	uint64_t count = 0;
+	uint64_t length = 0;
+	std::string storeRelPath;
+	if (!reader.Read(version, 4) || version != COLD_VERSION) {
+		printf("Unsupported cold manifest version %u.\n", static_cast<unsigned>(version));
+		return false;
+	}
+	if (!reader.Read(count, 4) || !reader.Read(length, 2) || !reader.ReadString(storeRelPath, static_cast<size_t>(length))) {
+		return false;
+	}
+	storeDir = (coldPath.parent_path() / storeRelPath).lexically_normal();
+	entries.clear();
+	entries.reserve(static_cast<size_t>(std::min<uint64_t>(count, reader.Remaining())));
+	for (uint64_t i = 0; i < count; ++i) {
+		YgoColdEntry entry;
+		uint64_t type = 0;
+		if (!reader.Read(type, 1) || !reader.Read(length, 2) || !reader.ReadString(entry.m_path, static_cast<size_t>(length))
+			|| !reader.Read(entry.m_size, 8) || !reader.Read(length, 1) || !reader.ReadString(entry.m_key, static_cast<size_t>(length))) {
+			return false;
+		}
+		entry.m_type = static_cast<uint8_t>(type);
+		entries.push_back(std::move(entry));
+	}
+	return true;
+}
+
+bool ReadColdObject(const fs::path& storeDir, const YgoColdEntry& entry, std::string& content)
+{
+	YgoFileView object;
+	if (!object.Open(GetObjectPath(storeDir, entry.m_key))) {
+		return false;
+	}
+	content.resize(static_cast<size_t>(entry.m_size));
+	uLongf length = static_cast<uLongf>(entry.m_size);
+	if (static_cast<uint64_t>(length) != entry.m_size) {
+		return false;
+	}
+	return uncompress(reinterpret_cast<Bytef*>(content.data()), &length,
+		reinterpret_cast<const Bytef*>(object.Data()), static_cast<uLong>(object.Size())) == Z_OK
+		&& length == entry.m_size;
+}
+
+fs::path GetColdLockPath(const fs::path& storeDir)
+{
+	return storeDir / sc_coldLockFileName;
+}
+
+bool FreezeTarget(const fs::path& archiveDir, const std::string& targetName, const fs::path& storeDir, YgoColdStats* stats, YgoIoThrottle* throttle)
+{
+	const fs::path looseDir = archiveDir / targetName;
+	const fs::path packPath = GetPackPath(archiveDir, targetName);
+	const fs::path coldPath = GetColdPath(archiveDir, targetName);
+	YgoColdStats localStats;
+	std::error_code ec;
+	//A manifest is only written once its objects are on disk, an interrupted freeze just removes the hot files
+	if (!fs::exists(coldPath, ec)) {
+		//A sweep of another process must not remove an object between finding it here and the manifest naming it
+		fs::create_directories(storeDir, ec);
+		YgoFileLock storeLock;
+		if (!storeLock.Lock(GetColdLockPath(storeDir), YgoFileLock::EXCLUSIVE)) {
+			return false;
+		}
+		std::vector<YgoColdEntry> entries;
+		std::vector<const char*> contents;
+		std::unordered_map<std::string, size_t> entryOf;
+		auto addEntry = [&](YgoColdEntry&& entry, const char* data) {
+			//A standalone file wins over a packed one of the same path, as when reading the archive
+			auto found = entryOf.find(entry.m_path);
+			if (found != entryOf.end()) {
+				entries[found->second] = std::move(entry);
+				contents[found->second] = data;
+				return;
+			}
+			entryOf.emplace(entry.m_path, entries.size());
+			entries.push_back(std::move(entry));
+			contents.push_back(data);
+		};
+
+		YgoFileView pack;
+		if (fs::exists(packPath, ec)) {
+			std::vector<YgoPackEntry> packEntries;
+			uint64_t dataOffset = 0;
+			if (!ReadPackTable(packPath, packEntries, dataOffset) || !pack.Open(packPath)) {
+				printf("Read pack %s failed.\n", packPath.string().c_str());
+				return false;
+			}
+			for (const auto& packEntry : packEntries) {
+				YgoColdEntry entry;
+				entry.m_path = packEntry.m_path;
+				if (packEntry.m_type == YgoPackEntry::DIRECTORY_ENTRY) {
+					entry.m_type = YgoColdEntry::DIRECTORY_ENTRY;
+					addEntry(std::move(entry), nullptr);
+					continue;
+				}
+				if (dataOffset + packEntry.m_offset + packEntry.m_size > pack.Size()) {
+					printf("Pack %s is damaged at %s.\n", packPath.string().c_str(), packEntry.m_path.c_str());
+					return false;
+				}
+				entry.m_size = packEntry.m_size;
+				addEntry(std::move(entry), pack.Data() + dataOffset + packEntry.m_offset);
+			}
+		}
+		//deque keeps the views in place while contents points into them
+		std::deque<YgoFileView> looseFiles;
+		if (fs::is_directory(looseDir, ec)) {
+			std::vector<YgoTreeEntry> items;
+			if (!WalkTree(looseDir, items, false)) {
+				return false;
+			}
+			for (const auto& item : items) {
+				YgoColdEntry entry;
+				entry.m_path = item.m_path;
+				if (item.m_type == YgoTreeEntry::DIRECTORY_ENTRY) {
+					entry.m_type = YgoColdEntry::DIRECTORY_ENTRY;
+					addEntry(std::move(entry), nullptr);
+				}
+				else if (item.m_type == YgoTreeEntry::FILE_ENTRY) {
+					looseFiles.emplace_back();
+					if (!looseFiles.back().Open(looseDir / item.m_path)) {
+						printf("Read %s failed.\n", (looseDir / item.m_path).string().c_str());
+						return false;
+					}
+					entry.m_size = looseFiles.back().Size();
+					addEntry(std::move(entry), looseFiles.back().Data());
+				}
+			}
+		}
+		if (entries.empty()) {
+			return true;
+		}
+
+		ParallelFor(entries.size(), [&](size_t i) {
+			if (entries[i].m_type == YgoColdEntry::FILE_ENTRY) {
+				entries[i].m_key = MakeObjectKey(contents[i], static_cast<size_t>(entries[i].m_size));
+			}
+			return true;
+		});
+		//Each object is written once, objects already in the store are shared
+		std::unordered_set<std::string> seenKeys;
+		std::vector<size_t> newObjects;
+		for (size_t i = 0; i < entries.size(); ++i) {
+			if (entries[i].m_type != YgoColdEntry::FILE_ENTRY) continue;
+			localStats.m_files++;
+			localStats.m_bytes += entries[i].m_size;
+			if (!seenKeys.insert(entries[i].m_key).second) {
+				localStats.m_sharedFiles++;
+				continue;
+			}
+			const fs::path objectPath = GetObjectPath(storeDir, entries[i].m_key);
+			if (fs::exists(objectPath, ec)) {
+				//An object left unreferenced by a thaw or delete gets the sweep grace again
+				fs::last_write_time(objectPath, fs::file_time_type::clock::now(), ec);
+				localStats.m_sharedFiles++;
+				continue;
+			}
+			newObjects.push_back(i);
+		}
+		std::atomic<uint64_t> storedBytes(0);
+		const bool stored = ParallelFor(newObjects.size(), [&](size_t i) {
+			const YgoColdEntry& entry = entries[newObjects[i]];
+			uLongf length = compressBound(static_cast<uLong>(entry.m_size));
+			std::string compressed(static_cast<size_t>(length), '\0');
+			if (static_cast<uint64_t>(static_cast<uLong>(entry.m_size)) != entry.m_size
+				|| compress2(reinterpret_cast<Bytef*>(compressed.data()), &length, reinterpret_cast<const Bytef*>(contents[newObjects[i]]),
+					static_cast<uLong>(entry.m_size), COLD_COMPRESSION_LEVEL) != Z_OK) {
+				printf("Compress %s failed.\n", entry.m_path.c_str());
+				return false;
+			}
+			compressed.resize(static_cast<size_t>(length));
+			if (throttle) {
+				throttle->Acquire(entry.m_size + compressed.size());
+			}
+			const fs::path objectPath = GetObjectPath(storeDir, entry.m_key);
+			std::error_code ec;
+			fs::create_directories(objectPath.parent_path(), ec);
+			if (!DurableReplaceFile(objectPath, compressed)) {
+				printf("Write object %s failed.\n", objectPath.string().c_str());
+				return false;
+			}
+			storedBytes += compressed.size();
+			return true;
+		});
+		if (!stored) {
+			return false;
+		}
+		localStats.m_storedBytes = storedBytes;
+
+		const std::string storeRelPath = fs::absolute(storeDir, ec).lexically_normal()
+			.lexically_relative(fs::absolute(archiveDir, ec).lexically_normal()).generic_string();
+		if (storeRelPath.empty() || !DurableReplaceFile(coldPath, BuildColdTable(entries, storeRelPath))) {
+			printf("Write cold manifest %s failed.\n", coldPath.string().c_str());
+			return false;
+		}
+	}
+	fs::remove(packPath, ec);
+	if (fs::exists(looseDir, ec) && !RemoveTree(looseDir)) {
+		printf("Remove %s failed, it stays next to its cold copy.\n", looseDir.string().c_str());
+	}
+	if (stats) {
+		*stats = localStats;
+	}
+	return true;
+}
+
+bool UnpackColdTarget(const fs::path& archiveDir, const std::string& targetName, const fs::path& destDir, YgoIoThrottle* throttle)
+{
+	const fs::path coldPath = GetColdPath(archiveDir, targetName);
+	std::vector<YgoColdEntry> entries;
+	fs::path storeDir;
+	if (!ReadColdTable(coldPath, entries, storeDir)) {
+		printf("Cold manifest %s is damaged.\n", coldPath.string().c_str());
+		return false;
+	}
+	std::error_code ec;
+	fs::create_directories(destDir, ec);
+	std::vector<const YgoColdEntry*> files;
+	for (const auto& entry : entries) {
+		if (entry.m_type == YgoColdEntry::DIRECTORY_ENTRY) {
+			fs::create_directories(destDir / fs::path(entry.m_path), ec);
+			continue;
+		}
+		fs::create_directories((destDir / fs::path(entry.m_path)).parent_path(), ec);
+		files.push_back(&entry);
+	}
+	return ParallelFor(files.size(), [&](size_t i) {
+		std::string content;
+		const fs::path destPath = destDir / fs::path(files[i]->m_path);
+		if (!ReadColdObject(storeDir, *files[i], content)) {
+			printf("Read object of %s failed.\n", files[i]->m_path.c_str());
+			return false;
+		}
+		if (!WriteFileWithBudget(destPath, content.data(), content.size(), throttle)) {
+			printf("Write %s failed.\n", destPath.string().c_str());
+			return false;
+		}
+		return true;
+	});
+}
+
+bool ThawTarget(const fs::path& archiveDir, const std::string& targetName)
+{
+	//Standalone files are read before the manifest, so the target stays readable throughout
+	if (!UnpackColdTarget(archiveDir, targetName, archiveDir / targetName)) {
+		return false;
+	}
+	std::error_code ec;
+	fs::remove(GetColdPath(archiveDir, targetName), ec);
+	return !ec;
+}
+
+bool VerifyColdTarget(const fs::path& coldPath, std::string& error)
+{
+	std::vector<YgoColdEntry> entries;
+	fs::path storeDir;
+	if (!ReadColdTable(coldPath, entries, storeDir)) {
+		error = "damaged manifest " + coldPath.string();
+		return false;
+	}
+	std::error_code ec;
+	for (const auto& entry : entries) {
+		if (entry.m_type == YgoColdEntry::FILE_ENTRY && !fs::exists(GetObjectPath(storeDir, entry.m_key), ec)) {
+			error = entry.m_path + " is missing from " + storeDir.string();
+			return false;
+		}
+	}
+	return true;
+}
+
+size_t SweepColdStore(const fs::path& storeDir, const std::unordered_set<std::string>& referencedKeys)
+{
+	std::error_code ec;
+	if (!fs::is_directory(storeDir, ec)) {
+		return 0;
+	}
+	const auto cutoff = fs::file_time_type::clock::now() - COLD_SWEEP_GRACE;
+	size_t removed = 0;
+	for (const auto& shard : fs::directory_iterator(storeDir, ec)) {
+		if (!shard.is_directory(ec)) continue;
+		for (const auto& object : fs::directory_iterator(shard.path(), ec)) {
+			const std::string key = object.path().filename().string();
+			if (referencedKeys.count(key) > 0 || object.last_write_time(ec) > cutoff || ec) {
+				ec.clear();
+				continue;
+			}
+			if (fs::remove(object.path(), ec)) {
+				++removed;
+			}
+		}
+		//Only succeeds once the shard is empty
+		fs::remove(shard.path(), ec);
+	}
+	return removed;
+}
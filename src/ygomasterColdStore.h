@@ -0,0 +1,88 @@
+#ifndef YGOMASTER_COLD_STORE_H
+#define YGOMASTER_COLD_STORE_H
+
+#include"public.h"
+
+class YgoIoThrottle;
+
+/*
+* Cold storage of archived targets that are rarely restored.
+* Freezing a target replaces "<target>.pack" and "<target>/" of an archive by one manifest "<target>.cold":
+*   header: magic "YMCD", version u32, entry count u32, store path length u16, store path
+*   table:  per entry type u8, path length u16, path (generic '/' separators), size u64, key length u8, key
+* The store path is relative to the archive directory. File contents are zlib-compressed objects of a
+* store shared by the archives of an install, "<store>/<first two key characters>/<key>", the key being
+* FNV-1a 64, CRC-32 and size of the content, so a file unchanged across archives is stored once.
+*/
+
+static const std::string sc_coldExtension = ".cold";
+static const std::string sc_coldStoreDirName = "Cold";
+// Lock file of a store, freezes and sweeps of every process of the install hold it exclusive
+static const std::string sc_coldLockFileName = ".lock";
+
+// Archives among the newest DEFAULT_COLD_KEEP_RECENT or backed up within DEFAULT_COLD_KEEP_DAYS stay hot
+constexpr int DEFAULT_COLD_KEEP_RECENT = 10;
+constexpr int DEFAULT_COLD_KEEP_DAYS = 30;
+// Seconds between tiering passes of a running tool
+constexpr int COLD_TIERING_INTERVAL = 6 * 60 * 60;
+
+// Which archives go to cold storage, from "ColdStorage" of config file
+struct YgoColdPolicy
+{
+	bool m_enabled;
+	int m_keepRecent;
+	int m_keepDays;
+
+	YgoColdPolicy() :m_enabled(true), m_keepRecent(DEFAULT_COLD_KEEP_RECENT), m_keepDays(DEFAULT_COLD_KEEP_DAYS) {}
+};
+
+struct YgoColdEntry
+{
+	enum Type :uint8_t { FILE_ENTRY = 0, DIRECTORY_ENTRY = 1 };
+	uint8_t m_type;
+	std::string m_path; // relative to the frozen directory, '/' separated
+	uint64_t m_size;
+	std::string m_key; // object key, empty for directories
+
+	YgoColdEntry() :m_type(FILE_ENTRY), m_path(""), m_size(0), m_key("") {}
+};
+
+struct YgoColdStats
+{
+	uint64_t m_files;
+	uint64_t m_bytes; // size of the frozen files
+	uint64_t m_storedBytes; // compressed bytes of objects added to the store
+	uint64_t m_sharedFiles; // files whose object was already in the store
+
+	YgoColdStats() :m_files(0), m_bytes(0), m_storedBytes(0), m_sharedFiles(0) {}
+};
+
+// Path of the manifest of targetName in archiveDir
+std::filesystem::path GetColdPath(const std::filesystem::path& archiveDir, const std::string& targetName);
+bool IsColdTarget(const std::filesystem::path& archiveDir, const std::string& targetName);
+
+// Read a manifest, storeDir receives the absolute store directory
+bool ReadColdTable(const std::filesystem::path& coldPath, std::vector<YgoColdEntry>& entries, std::filesystem::path& storeDir);
+// Decompress the object of entry from storeDir
+bool ReadColdObject(const std::filesystem::path& storeDir, const YgoColdEntry& entry, std::string& content);
+
+// Lock file of the store at storeDir
+std::filesystem::path GetColdLockPath(const std::filesystem::path& storeDir);
+
+// Move archiveDir/targetName (pack and standalone files) into the store at storeDir.
+// Objects and manifest are on disk before the hot files are removed, both are written under the store lock.
+bool FreezeTarget(const std::filesystem::path& archiveDir, const std::string& targetName, const std::filesystem::path& storeDir,
+	YgoColdStats* stats = nullptr, YgoIoThrottle* throttle = nullptr);
+// Write every file of a frozen target into destDir, existing files are overwritten
+bool UnpackColdTarget(const std::filesystem::path& archiveDir, const std::string& targetName, const std::filesystem::path& destDir,
+	YgoIoThrottle* throttle = nullptr);
+// Bring a frozen target back as standalone files of archiveDir/targetName, so it can be changed in place
+bool ThawTarget(const std::filesystem::path& archiveDir, const std::string& targetName);
+// Check the manifest parses and every object exists with the expected name, error describes the first problem
+bool VerifyColdTarget(const std::filesystem::path& coldPath, std::string& error);
+
+// Remove objects of storeDir no manifest refers to, returns the number of removed objects.
+// The caller holds the store lock from reading the manifests until this returns.
+size_t SweepColdStore(const std::filesystem::path& storeDir, const std::unordered_set<std::string>& referencedKeys);
+
+#endif // !YGOMASTER_COLD_STORE_H
@@ -0,0 +1,244 @@
+#include "ygomasterDaemon.h"
+
+#if !defined(_WIN32)
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+namespace fs = std::filesystem;
+
+#if !defined(_WIN32)
+
+static bool WriteAll(int fd, const char* data, size_t size)
+{
+	while (size > 0) {
+		ssize_t written = send(fd, data, size, MSG_NOSIGNAL);
+		if (written < 0) {
+			if (errno == EINTR) continue;
+			return false;
+		}
+		data += written;
+		size -= static_cast<size_t>(written);
+	}
+	return true;
+}
+
+static bool ReadAll(int fd, char* data, size_t size)
+{
+	while (size > 0) {
+		ssize_t got = recv(fd, data, size, 0);
+		if (got < 0) {
+			if (errno == EINTR) continue;
+			return false;
+		}
+		if (got == 0) {
+			return false;
+		}
+		data += got;
+		size -= static_cast<size_t>(got);
+	}
+	return true;
+}
+
+static bool FillSocketAddress(const std::string& socketPath, sockaddr_un& addr)
+{
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (socketPath.size() >= sizeof(addr.sun_path)) {
+		printf("Socket path %s is too long.\n", socketPath.c_str());
+		return false;
+	}
+	memcpy(addr.sun_path, socketPath.c_str(), socketPath.size());
+	return true;
+}
+
+bool SendDaemonFrame(int fd, const std::string& payload)
+{
+	if (payload.size() > DAEMON_MAX_FRAME_SIZE) {
+		return false;
+	}
+	const uint32_t size = static_cast<uint32_t>(payload.size());
+	const char header[4] = {
+		static_cast<char>(size & 0xff),
+		static_cast<char>((size >> 8) & 0xff),
+		static_cast<char>((size >> 16) & 0xff),
+		static_cast<char>((size >> 24) & 0xff)
+	};
+	return WriteAll(fd, header, sizeof(header)) && WriteAll(fd, payload.data(), payload.size());
+}
+
+bool RecvDaemonFrame(int fd, std::string& payload)
+{
+	unsigned char header[4];
+	if (!ReadAll(fd, reinterpret_cast<char*>(header), sizeof(header))) {
+		return false;
+	}
+	const uint32_t size = header[0] | (header[1] << 8) | (header[2] << 16) | (static_cast<uint32_t>(header[3]) << 24);
+	if (size > DAEMON_MAX_FRAME_SIZE) {
+		printf("Daemon frame of %u bytes exceeds the limit.\n", size);
+		return false;
+	}
+	payload.resize(size);
+	return size == 0 || ReadAll(fd, payload.data(), size);
+}
+
+YgoDaemonServer::YgoDaemonServer(const std::string& socketPath, Handler handler)
+	:m_socketPath(socketPath), m_handler(std::move(handler)), m_listenFd(-1), m_stop(false)
+{
+}
+
+YgoDaemonServer::~YgoDaemonServer()
+{
+	Stop();
+	if (m_listenFd >= 0) {
+		close(m_listenFd);
+	}
+}
+
+bool YgoDaemonServer::Run()
+{
+	sockaddr_un addr;
+	if (!FillSocketAddress(m_socketPath, addr)) {
+		return false;
+	}
+
+	//A socket file left by a crashed daemon is removed, a live daemon is not replaced
+	if (fs::exists(m_socketPath)) {
+		std::string reply;
+		if (SendDaemonRequest(m_socketPath, "{\"cmd\":\"ping\"}", reply)) {
+			printf("Another daemon is already listening on %s.\n", m_socketPath.c_str());
+			return false;
+		}
+		unlink(m_socketPath.c_str());
+	}
+
+	m_listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (m_listenFd < 0) {
+		printf("Create daemon socket failed: %s\n", strerror(errno));
+		return false;
+	}
+	if (bind(m_listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0
+		|| listen(m_listenFd, SOMAXCONN) != 0) {
+		printf("Listen on %s failed: %s\n", m_socketPath.c_str(), strerror(errno));
+		close(m_listenFd);
+		m_listenFd = -1;
+		return false;
+	}
+	printf("Daemon listening on %s\n", m_socketPath.c_str());
+
+	while (!m_stop) {
+		//Poll with a timeout so Stop is noticed without another connection
+		pollfd pfd = { m_listenFd, POLLIN, 0 };
+		int ready = poll(&pfd, 1, 200);
+		if (ready <= 0) {
+			continue;
+		}
+		int fd = accept4(m_listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+		if (fd < 0) {
+			continue;
+		}
+		{
+			std::lock_guard<std::mutex> lock(m_connectionsMutex);
+			m_connections.insert(fd);
+		}
+		std::thread(&YgoDaemonServer::ServeConnection, this, fd).detach();
+	}
+
+	close(m_listenFd);
+	m_listenFd = -1;
+	unlink(m_socketPath.c_str());
+
+	//Wake up connections blocked in recv and wait for their threads
+	std::unique_lock<std::mutex> lock(m_connectionsMutex);
+	for (int fd : m_connections) {
+		shutdown(fd, SHUT_RDWR);
+	}
+	m_connectionsDone.wait(lock, [this]() { return m_connections.empty(); });
+	printf("Daemon stopped.\n");
+	return true;
+}
+
+void YgoDaemonServer::Stop()
+{
+	m_stop = true;
+}
+
+void YgoDaemonServer::ServeConnection(int fd)
+{
+	std::string request;
+	while (!m_stop && RecvDaemonFrame(fd, request)) {
+		if (!SendDaemonFrame(fd, m_handler(request))) {
+			break;
+		}
+	}
+	//Close under the lock so accept cannot reuse the fd number before it leaves m_connections
+	std::lock_guard<std::mutex> lock(m_connectionsMutex);
+	m_connections.erase(fd);
+	close(fd);
+	m_connectionsDone.notify_all();
+}
+
+bool SendDaemonRequest(const std::string& socketPath, const std::string& request, std::string& reply)
+{
+	sockaddr_un addr;
+	if (!FillSocketAddress(socketPath, addr)) {
+		return false;
+	}
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		return false;
+	}
+	bool ok = connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0
+		&& SendDaemonFrame(fd, request)
+		&& RecvDaemonFrame(fd, reply);
+	close(fd);
+	return ok;
+}
+
+#else
+
+bool SendDaemonFrame(int fd, const std::string& payload)
+{
+	return false;
+}
+
+bool RecvDaemonFrame(int fd, std::string& payload)
+{
+	return false;
+}
+
+YgoDaemonServer::YgoDaemonServer(const std::string& socketPath, Handler handler)
+	:m_socketPath(socketPath), m_handler(std::move(handler)), m_listenFd(-1), m_stop(false)
+{
+}
+
+YgoDaemonServer::~YgoDaemonServer()
+{
+}
+
+bool YgoDaemonServer::Run()
+{
+	printf("Daemon mode is not supported on this platform.\n");
+	return false;
+}
+
+void YgoDaemonServer::Stop()
+{
+	m_stop = true;
+}
+
+void YgoDaemonServer::ServeConnection(int fd)
+{
+}
+
+bool SendDaemonRequest(const std::string& socketPath, const std::string& request, std::string& reply)
+{
+	printf("Daemon mode is not supported on this platform.\n");
+	return false;
+}
+
+#endif
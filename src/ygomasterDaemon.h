@@ -0,0 +1,57 @@
+#ifndef YGOMASTER_DAEMON_H
+#define YGOMASTER_DAEMON_H
+
+#include"public.h"
+#include<atomic>
+#include<condition_variable>
+#include<functional>
+
+/*
+* Local daemon transport over a Unix domain socket.
+* Each frame is a 4 byte little-endian payload length followed by a JSON payload,
+* a connection may carry any number of request/reply frame pairs.
+*/
+
+// Default socket file name, created in the working directory
+static const std::string sc_daemonSocketName = "YgoMasterArchiveTool.sock";
+// Frames larger than this are rejected
+constexpr uint32_t DAEMON_MAX_FRAME_SIZE = 16 * 1024 * 1024;
+
+// Send one frame, return false if the peer is gone
+bool SendDaemonFrame(int fd, const std::string& payload);
+// Receive one frame, return false on EOF, error or oversized frame
+bool RecvDaemonFrame(int fd, std::string& payload);
+
+class YgoDaemonServer
+{
+public:
+	// Handler turns a request payload into a reply payload, called concurrently from connection threads
+	using Handler = std::function<std::string(const std::string&)>;
+
+	YgoDaemonServer(const std::string& socketPath, Handler handler);
+	~YgoDaemonServer();
+
+	// Listen and serve until Stop is called, return false if the socket cannot be created
+	bool Run();
+	// Ask Run to return, safe to call from a handler
+	void Stop();
+
+private:
+	void ServeConnection(int fd);
+
+private:
+	std::string m_socketPath;
+	Handler m_handler;
+	int m_listenFd;
+	std::atomic<bool> m_stop;
+
+	// Open connections, served by detached threads, Run waits for them before returning
+	std::mutex m_connectionsMutex;
+	std::condition_variable m_connectionsDone;
+	std::unordered_set<int> m_connections;
+};
+
+// Send one request to the daemon at socketPath and wait for the reply
+bool SendDaemonRequest(const std::string& socketPath, const std::string& request, std::string& reply);
+
+#endif // !YGOMASTER_DAEMON_H
@@ -0,0 +1,92 @@
+#include "ygomasterDurableFile.h"
+#include <algorithm>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+namespace fs = std::filesystem;
+
+// Temp file of path, unique per process and thread, so concurrent writers of one path never share it
+static fs::path GetTempPath(const fs::path& path)
+{
+#if defined(_WIN32)
+	const unsigned long pid = GetCurrentProcessId();
+#else
+	const unsigned long pid = static_cast<unsigned long>(getpid());
+#endif
+	fs::path tempPath = path;
+	tempPath += "." + std::to_string(pid) + "_" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+	return tempPath;
+}
+
+#if defined(_WIN32)
+
+bool DurableReplaceFile(const fs::path& path, const std::string& data)
+{
+	const fs::path tempPath = GetTempPath(path);
+	HANDLE file = CreateFileW(tempPath.wstring().c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		printf("Create %s failed: %lu\n", tempPath.string().c_str(), GetLastError());
+		return false;
+	}
+	bool ok = true;
+	for (size_t written = 0; ok && written < data.size();) {
+		DWORD chunk = 0;
+		const DWORD want = static_cast<DWORD>(std::min<size_t>(data.size() - written, 1 << 30));
+		ok = WriteFile(file, data.data() + written, want, &chunk, nullptr) && chunk > 0;
+		written += chunk;
+	}
+	ok = ok && FlushFileBuffers(file);
+	CloseHandle(file);
+	//MOVEFILE_WRITE_THROUGH returns once the rename is on disk
+	if (!ok || !MoveFileExW(tempPath.wstring().c_str(), path.wstring().c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+		printf("Write %s failed: %lu\n", path.string().c_str(), GetLastError());
+		DeleteFileW(tempPath.wstring().c_str());
+		return false;
+	}
+	return true;
+}
+
+#else
+
+bool DurableReplaceFile(const fs::path& path, const std::string& data)
+{
+	const fs::path tempPath = GetTempPath(path);
+	int fd = open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		printf("Create %s failed: %s\n", tempPath.string().c_str(), strerror(errno));
+		return false;
+	}
+	bool ok = true;
+	for (size_t written = 0; ok && written < data.size();) {
+		const ssize_t chunk = write(fd, data.data() + written, data.size() - written);
+		if (chunk < 0 && errno == EINTR) {
+			continue;
+		}
+		ok = chunk > 0;
+		written += (chunk > 0) ? static_cast<size_t>(chunk) : 0;
+	}
+	ok = ok && 0 == fsync(fd);
+	ok = (0 == close(fd)) && ok;
+	if (!ok || rename(tempPath.c_str(), path.c_str()) != 0) {
+		printf("Write %s failed: %s\n", path.string().c_str(), strerror(errno));
+		unlink(tempPath.c_str());
+		return false;
+	}
+	//The rename itself is only durable once the directory is flushed
+	const fs::path dirPath = path.has_parent_path() ? path.parent_path() : fs::path(".");
+	int dirFd = open(dirPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (dirFd >= 0) {
+		fsync(dirFd);
+		close(dirFd);
+	}
+	return true;
+}
+
+#endif
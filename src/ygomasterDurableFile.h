@@ -0,0 +1,14 @@
+#ifndef YGOMASTER_DURABLE_FILE_H
+#define YGOMASTER_DURABLE_FILE_H
+
+#include"public.h"
+
+/*
+* Crash-safe replacement of small metadata files such as ArchiveList.json.
+* The new content is written to a temp file next to path, named after the process and thread so
+* concurrent writers do not share it, flushed to disk, renamed over path,
+* and the directory entry is flushed too, so after a crash path holds either the old or the new content.
+*/
+bool DurableReplaceFile(const std::filesystem::path& path, const std::string& data);
+
+#endif // !YGOMASTER_DURABLE_FILE_H
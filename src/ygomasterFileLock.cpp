@@ -0,0 +1,111 @@
+#include "ygomasterFileLock.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+namespace fs = std::filesystem;
+
+#if defined(_WIN32)
+
+YgoFileLock::YgoFileLock()
+	:m_handle(INVALID_HANDLE_VALUE), m_locked(false)
+{
+}
+
+bool YgoFileLock::Lock(const fs::path& lockPath, const Mode mode)
+{
+	Unlock();
+	HANDLE file = CreateFileW(lockPath.wstring().c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		printf("Open lock file %s failed: %lu\n", lockPath.string().c_str(), GetLastError());
+		return false;
+	}
+	//The whole byte range, without LOCKFILE_FAIL_IMMEDIATELY the call waits for other processes
+	OVERLAPPED overlapped = {};
+	const DWORD flags = (EXCLUSIVE == mode) ? LOCKFILE_EXCLUSIVE_LOCK : 0;
+	if (!LockFileEx(file, flags, 0, MAXDWORD, MAXDWORD, &overlapped)) {
+		printf("Lock %s failed: %lu\n", lockPath.string().c_str(), GetLastError());
+		CloseHandle(file);
+		return false;
+	}
+	m_handle = file;
+	m_locked = true;
+	return true;
+}
+
+void YgoFileLock::Unlock()
+{
+	if (m_handle == INVALID_HANDLE_VALUE) {
+		return;
+	}
+	if (m_locked) {
+		OVERLAPPED overlapped = {};
+		UnlockFileEx(m_handle, 0, MAXDWORD, MAXDWORD, &overlapped);
+	}
+	CloseHandle(m_handle);
+	m_handle = INVALID_HANDLE_VALUE;
+	m_locked = false;
+}
+
+#else
+
+YgoFileLock::YgoFileLock()
+	:m_fd(-1), m_locked(false)
+{
+}
+
+bool YgoFileLock::Lock(const fs::path& lockPath, const Mode mode)
+{
+	Unlock();
+	int fd = open(lockPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		printf("Open lock file %s failed: %s\n", lockPath.string().c_str(), strerror(errno));
+		return false;
+	}
+	//flock belongs to the open file, so threads of this process using their own YgoFileLock also exclude each other
+	int result = 0;
+	do {
+		result = flock(fd, (EXCLUSIVE == mode) ? LOCK_EX : LOCK_SH);
+	} while (result != 0 && errno == EINTR);
+	if (result != 0) {
+		printf("Lock %s failed: %s\n", lockPath.string().c_str(), strerror(errno));
+		close(fd);
+		return false;
+	}
+	m_fd = fd;
+	m_locked = true;
+	return true;
+}
+
+void YgoFileLock::Unlock()
+{
+	if (m_fd < 0) {
+		return;
+	}
+	//Closing the descriptor drops the lock
+	close(m_fd);
+	m_fd = -1;
+	m_locked = false;
+}
+
+#endif
+
+YgoFileLock::~YgoFileLock()
+{
+	Unlock();
+}
+
+YgoListLockGuard::YgoListLockGuard(const std::string& listPath, const YgoFileLock::Mode mode)
+{
+	if (!m_lock.Lock(listPath + sc_lockExtension, mode)) {
+		printf("Continuing without the ArchiveList lock, another instance of the tool may change it meanwhile.\n");
+	}
+}
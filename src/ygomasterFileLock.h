@@ -0,0 +1,53 @@
+#ifndef YGOMASTER_FILE_LOCK_H
+#define YGOMASTER_FILE_LOCK_H
+
+#include"public.h"
+
+/*
+* Advisory reader/writer lock shared by every process of one install.
+* The lock is held on a separate "<ArchiveList>.lock" file, ArchiveList.json itself is replaced by rename
+* on every write, so a lock on it would be lost with the old file.
+* Readers take it shared while parsing ArchiveList, writers take it exclusive only around the
+* read-merge-write of the commit, long copies run without it.
+* flock on POSIX, LockFileEx on Windows. Both are released by the system if the process dies.
+*/
+
+static const std::string sc_lockExtension = ".lock";
+
+class YgoFileLock
+{
+public:
+	enum Mode { SHARED, EXCLUSIVE };
+
+	YgoFileLock();
+	~YgoFileLock();
+	YgoFileLock(const YgoFileLock&) = delete;
+	YgoFileLock& operator=(const YgoFileLock&) = delete;
+
+	// Block until the lock on lockPath is held in mode, the lock file is created if missing
+	bool Lock(const std::filesystem::path& lockPath, const Mode mode);
+	void Unlock();
+	bool IsLocked() const { return m_locked; }
+
+private:
+#if defined(_WIN32)
+	void* m_handle;
+#else
+	int m_fd;
+#endif
+	bool m_locked;
+};
+
+// Lock of the ArchiveList at listPath for the scope, a failed lock is reported and the scope runs unlocked
+class YgoListLockGuard
+{
+public:
+	YgoListLockGuard(const std::string& listPath, const YgoFileLock::Mode mode);
+	YgoListLockGuard(const YgoListLockGuard&) = delete;
+	YgoListLockGuard& operator=(const YgoListLockGuard&) = delete;
+
+private:
+	YgoFileLock m_lock;
+};
+
+#endif // !YGOMASTER_FILE_LOCK_H
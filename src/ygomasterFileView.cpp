@@ -0,0 +1,171 @@
+#include "ygomasterFileView.h"
+#include <cjson/cJSON.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace fs = std::filesystem;
+
+YgoFileView::YgoFileView()
+	:m_data(nullptr), m_size(0), m_buffer(""), m_mapping(nullptr), m_mappingSize(0)
+{
+}
+
+YgoFileView::~YgoFileView()
+{
+	Close();
+}
+
+void YgoFileView::Close()
+{
+	if (m_mapping) {
+#if defined(_WIN32)
+		UnmapViewOfFile(m_mapping);
+#else
+		munmap(m_mapping, m_mappingSize);
+#endif
+	}
+	m_mapping = nullptr;
+	m_mappingSize = 0;
+	m_buffer.clear();
+	m_buffer.shrink_to_fit();
+	m_data = nullptr;
+	m_size = 0;
+}
+
+void YgoFileView::Assign(std::string&& content)
+{
+	Close();
+	m_buffer = std::move(content);
+	m_data = m_buffer.data();
+	m_size = m_buffer.size();
+}
+
+#if defined(_WIN32)
+
+bool YgoFileView::Open(const fs::path& path, const uint64_t offset, const uint64_t length)
+{
+	Close();
+	HANDLE file = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || offset > static_cast<uint64_t>(fileSize.QuadPart)) {
+		CloseHandle(file);
+		return false;
+	}
+	const uint64_t available = static_cast<uint64_t>(fileSize.QuadPart) - offset;
+	const uint64_t size = (length < available) ? length : available;
+
+	bool ok = true;
+	if (size >= FILE_VIEW_MMAP_THRESHOLD) {
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		const uint64_t alignedOffset = offset - (offset % info.dwAllocationGranularity);
+		HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping) {
+			m_mappingSize = static_cast<size_t>(size + (offset - alignedOffset));
+			m_mapping = MapViewOfFile(mapping, FILE_MAP_READ,
+				static_cast<DWORD>(alignedOffset >> 32), static_cast<DWORD>(alignedOffset & 0xffffffff), m_mappingSize);
+			CloseHandle(mapping);
+		}
+		if (m_mapping) {
+			m_data = static_cast<const char*>(m_mapping) + (offset - alignedOffset);
+			m_size = static_cast<size_t>(size);
+		}
+		else {
+			m_mappingSize = 0;
+			ok = false;
+		}
+	}
+	if (!m_mapping) {
+		//Small file or mapping failed: one sized read
+		m_buffer.resize(static_cast<size_t>(size));
+		LARGE_INTEGER position;
+		position.QuadPart = static_cast<LONGLONG>(offset);
+		DWORD got = 0;
+		ok = SetFilePointerEx(file, position, nullptr, FILE_BEGIN)
+			&& (size == 0 || (ReadFile(file, m_buffer.data(), static_cast<DWORD>(size), &got, nullptr) && got == size));
+		m_data = m_buffer.data();
+		m_size = m_buffer.size();
+	}
+	CloseHandle(file);
+	if (!ok) {
+		Close();
+	}
+	return ok;
+}
+
+#else
+
+bool YgoFileView::Open(const fs::path& path, const uint64_t offset, const uint64_t length)
+{
+	Close();
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || offset > static_cast<uint64_t>(st.st_size)) {
+		close(fd);
+		return false;
+	}
+	const uint64_t available = static_cast<uint64_t>(st.st_size) - offset;
+	const uint64_t size = (length < available) ? length : available;
+
+	if (size >= FILE_VIEW_MMAP_THRESHOLD) {
+		const uint64_t pageSize = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+		const uint64_t alignedOffset = offset - (offset % pageSize);
+		const size_t mappingSize = static_cast<size_t>(size + (offset - alignedOffset));
+		void* mapping = mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, fd, static_cast<off_t>(alignedOffset));
+		if (mapping != MAP_FAILED) {
+			madvise(mapping, mappingSize, MADV_SEQUENTIAL);
+			m_mapping = mapping;
+			m_mappingSize = mappingSize;
+			m_data = static_cast<const char*>(mapping) + (offset - alignedOffset);
+			m_size = static_cast<size_t>(size);
+			close(fd);
+			return true;
+		}
+	}
+
+	//Small file or mapping failed: one sized read, looping only if the kernel returns less
+	m_buffer.resize(static_cast<size_t>(size));
+	size_t done = 0;
+	while (done < size) {
+		ssize_t got = pread(fd, m_buffer.data() + done, static_cast<size_t>(size) - done, static_cast<off_t>(offset + done));
+		if (got < 0 && errno == EINTR) {
+			continue;
+		}
+		if (got <= 0) {
+			close(fd);
+			Close();
+			return false;
+		}
+		done += static_cast<size_t>(got);
+	}
+	close(fd);
+	m_data = m_buffer.data();
+	m_size = m_buffer.size();
+	return true;
+}
+
+#endif
+
+cJSON* ParseJsonFile(const fs::path& path)
+{
+	YgoFileView view;
+	if (!view.Open(path) || view.Size() == 0) {
+		return nullptr;
+	}
+	return cJSON_ParseWithLength(view.Data(), view.Size());
+}
@@ -0,0 +1,48 @@
+#ifndef YGOMASTER_FILE_VIEW_H
+#define YGOMASTER_FILE_VIEW_H
+
+#include"public.h"
+#include<string_view>
+
+struct cJSON;
+
+// Files at least this large are memory-mapped, smaller ones are loaded with one sized read
+constexpr uint64_t FILE_VIEW_MMAP_THRESHOLD = 256 * 1024;
+
+/*
+* Read-only view of a whole file or of a byte range of it.
+* Parsers get Data()/Size() directly, nothing is copied after the initial read or mapping.
+*/
+class YgoFileView
+{
+public:
+	YgoFileView();
+	~YgoFileView();
+	YgoFileView(const YgoFileView&) = delete;
+	YgoFileView& operator=(const YgoFileView&) = delete;
+
+	// Open length bytes starting at offset, length UINT64_MAX means up to the end of the file
+	bool Open(const std::filesystem::path& path, const uint64_t offset = 0, const uint64_t length = UINT64_MAX);
+	void Close();
+	// Take ownership of bytes that are not in a file, such as decompressed content
+	void Assign(std::string&& content);
+
+	const char* Data() const { return m_data; }
+	size_t Size() const { return m_size; }
+	std::string_view View() const { return std::string_view(m_data, m_size); }
+	bool IsMapped() const { return m_mapping != nullptr; }
+
+private:
+	const char* m_data;
+	size_t m_size;
+	// Used for small files
+	std::string m_buffer;
+	// Start and length of the mapping, the mapping may begin before m_data to respect page alignment
+	void* m_mapping;
+	size_t m_mappingSize;
+};
+
+// Parse a JSON file through a file view, return nullptr if it cannot be read or parsed
+cJSON* ParseJsonFile(const std::filesystem::path& path);
+
+#endif // !YGOMASTER_FILE_VIEW_H
@@ -0,0 +1,280 @@
+#include "ygomasterIoThrottle.h"
+#include <cjson/cJSON.h>
+#include <algorithm>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+namespace fs = std::filesystem;
+
+constexpr double IO_BUDGET_MB = 1024.0 * 1024.0;
+// Automatic backups and tiering run beside the game, so they are slow, idle and leave the page cache alone
+constexpr double DEFAULT_AUTO_BACKUP_MBPS = 32;
+constexpr double DEFAULT_AUTO_BACKUP_IOPS = 1000;
+
+YgoIoBudget GetDefaultIoBudget(const EIoOperation operation)
+{
+	YgoIoBudget budget;
+	if (EIoOperation::AUTO_BACKUP == operation || EIoOperation::TIERING == operation) {
+		budget.m_bytesPerSecond = DEFAULT_AUTO_BACKUP_MBPS * IO_BUDGET_MB;
+		budget.m_opsPerSecond = DEFAULT_AUTO_BACKUP_IOPS;
+		budget.m_idlePriority = true;
+		budget.m_dropCache = true;
+	}
+	else if (EIoOperation::PURGE == operation) {
+		//Unlinks move no data, only the number of them is limited
+		budget.m_opsPerSecond = DEFAULT_AUTO_BACKUP_IOPS;
+		budget.m_idlePriority = true;
+	}
+	return budget;
+}
+
+void ReadIoBudget(cJSON* item, YgoIoBudget& budget)
+{
+	cJSON* mbpsItem = cJSON_GetObjectItem(item, "MBps");
+	cJSON* iopsItem = cJSON_GetObjectItem(item, "IOPS");
+	cJSON* idleItem = cJSON_GetObjectItem(item, "IdlePriority");
+	cJSON* dropItem = cJSON_GetObjectItem(item, "DropCache");
+	if (cJSON_IsNumber(mbpsItem) && mbpsItem->valuedouble >= 0) {
+		budget.m_bytesPerSecond = mbpsItem->valuedouble * IO_BUDGET_MB;
+	}
+	if (cJSON_IsNumber(iopsItem) && iopsItem->valuedouble >= 0) {
+		budget.m_opsPerSecond = iopsItem->valuedouble;
+	}
+	if (cJSON_IsBool(idleItem)) {
+		budget.m_idlePriority = cJSON_IsTrue(idleItem);
+	}
+	if (cJSON_IsBool(dropItem)) {
+		budget.m_dropCache = cJSON_IsTrue(dropItem);
+	}
+}
+
+cJSON* CreateIoBudgetItem(const YgoIoBudget& budget)
+{
+	cJSON* item = cJSON_CreateObject();
+	cJSON_AddNumberToObject(item, "MBps", budget.m_bytesPerSecond / IO_BUDGET_MB);
+	cJSON_AddNumberToObject(item, "IOPS", budget.m_opsPerSecond);
+	cJSON_AddBoolToObject(item, "IdlePriority", budget.m_idlePriority);
+	cJSON_AddBoolToObject(item, "DropCache", budget.m_dropCache);
+	return item;
+}
+
+YgoIoThrottle::YgoIoThrottle(const YgoIoBudget& budget)
+	:m_budget(budget), m_byteTokens(budget.m_bytesPerSecond), m_opTokens(budget.m_opsPerSecond),
+	m_lastRefill(std::chrono::steady_clock::now())
+{
+}
+
+void YgoIoThrottle::Acquire(const uint64_t bytes)
+{
+	if (0 == m_budget.m_bytesPerSecond && 0 == m_budget.m_opsPerSecond) {
+		return;
+	}
+	double wait = 0;
+	{
+		//Tokens may go negative, the caller then sleeps off its own debt outside the lock
+		std::lock_guard<std::mutex> lock(m_mutex);
+		const auto now = std::chrono::steady_clock::now();
+		const double elapsed = std::chrono::duration<double>(now - m_lastRefill).count();
+		m_lastRefill = now;
+		if (m_budget.m_bytesPerSecond > 0) {
+			m_byteTokens = std::min(m_budget.m_bytesPerSecond, m_byteTokens + elapsed * m_budget.m_bytesPerSecond) - static_cast<double>(bytes);
+			wait = std::max(wait, -m_byteTokens / m_budget.m_bytesPerSecond);
+		}
+		if (m_budget.m_opsPerSecond > 0) {
+			m_opTokens = std::min(m_budget.m_opsPerSecond, m_opTokens + elapsed * m_budget.m_opsPerSecond) - 1;
+			wait = std::max(wait, -m_opTokens / m_budget.m_opsPerSecond);
+		}
+	}
+	if (wait > 0) {
+		std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+	}
+}
+
+#if defined(__linux__)
+
+constexpr int IOPRIO_WHO_PROCESS = 1;
+constexpr int IOPRIO_CLASS_SHIFT = 13;
+constexpr int IOPRIO_CLASS_IDLE = 3;
+
+//ioprio_set with who 0 only affects the calling thread
+YgoIoPriorityScope::YgoIoPriorityScope(const bool idle)
+	:m_previous(-1)
+{
+	if (idle) {
+		m_previous = static_cast<int>(syscall(SYS_ioprio_get, IOPRIO_WHO_PROCESS, 0));
+		syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+	}
+}
+
+YgoIoPriorityScope::~YgoIoPriorityScope()
+{
+	if (m_previous >= 0) {
+		syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, m_previous);
+	}
+}
+
+// Write a whole buffer, retrying short writes
+static bool WriteAll(const int fd, const char* data, size_t size)
+{
+	while (size > 0) {
+		const ssize_t written = write(fd, data, size);
+		if (written < 0 && errno == EINTR) continue;
+		if (written <= 0) return false;
+		data += written;
+		size -= static_cast<size_t>(written);
+	}
+	return true;
+}
+
+// Push written pages of fd to disk and drop them, dirty pages cannot be dropped
+static void DropWrittenRange(const int fd, const off_t offset, const off_t length)
+{
+	sync_file_range(fd, offset, length, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+	posix_fadvise(fd, offset, length, POSIX_FADV_DONTNEED);
+}
+
+bool CopyFileWithBudget(const fs::path& sourcePath, const fs::path& destPath, YgoIoThrottle* throttle)
+{
+	if (!throttle) {
+		std::error_code ec;
+		fs::copy_file(sourcePath, destPath, fs::copy_options::overwrite_existing, ec);
+		return !ec;
+	}
+	const YgoIoBudget& budget = throttle->Budget();
+	YgoIoPriorityScope priority(budget.m_idlePriority);
+	int in = open(sourcePath.c_str(), O_RDONLY | O_CLOEXEC);
+	if (in < 0) {
+		return false;
+	}
+	int out = open(destPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (out < 0) {
+		close(in);
+		return false;
+	}
+	posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+	std::vector<char> buffer(IO_THROTTLE_CHUNK_SIZE);
+	off_t offset = 0;
+	bool ok = true;
+	while (ok) {
+		const ssize_t got = read(in, buffer.data(), buffer.size());
+		if (got < 0 && errno == EINTR) continue;
+		if (got <= 0) {
+			ok = (0 == got);
+			break;
+		}
+		throttle->Acquire(static_cast<uint64_t>(got));
+		ok = WriteAll(out, buffer.data(), static_cast<size_t>(got));
+		if (ok && budget.m_dropCache) {
+			posix_fadvise(in, offset, got, POSIX_FADV_DONTNEED);
+			DropWrittenRange(out, offset, got);
+		}
+		offset += got;
+	}
+	close(in);
+	ok = (0 == close(out)) && ok;
+	return ok;
+}
+
+bool WriteFileWithBudget(const fs::path& path, const char* data, const size_t size, YgoIoThrottle* throttle)
+{
+	const YgoIoBudget budget = throttle ? throttle->Budget() : YgoIoBudget();
+	YgoIoPriorityScope priority(budget.m_idlePriority);
+	int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		return false;
+	}
+	bool ok = true;
+	for (size_t offset = 0; ok && offset < size; offset += IO_THROTTLE_CHUNK_SIZE) {
+		const size_t chunk = std::min(IO_THROTTLE_CHUNK_SIZE, size - offset);
+		if (throttle) {
+			throttle->Acquire(chunk);
+		}
+		ok = WriteAll(fd, data + offset, chunk);
+		if (ok && budget.m_dropCache) {
+			DropWrittenRange(fd, static_cast<off_t>(offset), static_cast<off_t>(chunk));
+		}
+	}
+	ok = (0 == close(fd)) && ok;
+	return ok;
+}
+
+void DropFileCache(const fs::path& path, YgoIoThrottle* throttle)
+{
+	if (!throttle || !throttle->Budget().m_dropCache) {
+		return;
+	}
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return;
+	}
+	fdatasync(fd);
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	close(fd);
+}
+
+#else
+
+//Other platforms only get the rate limit, I/O class and page cache hints are Linux only
+YgoIoPriorityScope::YgoIoPriorityScope(const bool idle)
+	:m_previous(-1)
+{
+}
+
+YgoIoPriorityScope::~YgoIoPriorityScope()
+{
+}
+
+bool CopyFileWithBudget(const fs::path& sourcePath, const fs::path& destPath, YgoIoThrottle* throttle)
+{
+	std::error_code ec;
+	if (!throttle) {
+		fs::copy_file(sourcePath, destPath, fs::copy_options::overwrite_existing, ec);
+		return !ec;
+	}
+	std::ifstream in(sourcePath, std::ios::binary);
+	std::ofstream out(destPath, std::ios::binary | std::ios::trunc);
+	if (!in.is_open() || !out.is_open()) {
+		return false;
+	}
+	std::vector<char> buffer(IO_THROTTLE_CHUNK_SIZE);
+	while (in) {
+		in.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+		const std::streamsize got = in.gcount();
+		if (got <= 0) break;
+		throttle->Acquire(static_cast<uint64_t>(got));
+		if (!out.write(buffer.data(), got)) {
+			return false;
+		}
+	}
+	return in.eof() && static_cast<bool>(out);
+}
+
+bool WriteFileWithBudget(const fs::path& path, const char* data, const size_t size, YgoIoThrottle* throttle)
+{
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) {
+		return false;
+	}
+	for (size_t offset = 0; offset < size; offset += IO_THROTTLE_CHUNK_SIZE) {
+		const size_t chunk = std::min(IO_THROTTLE_CHUNK_SIZE, size - offset);
+		if (throttle) {
+			throttle->Acquire(chunk);
+		}
+		if (!file.write(data + offset, static_cast<std::streamsize>(chunk))) {
+			return false;
+		}
+	}
+	return static_cast<bool>(file);
+}
+
+void DropFileCache(const fs::path& path, YgoIoThrottle* throttle)
+{
+}
+
+#endif
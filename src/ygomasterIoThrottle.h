@@ -0,0 +1,84 @@
+#ifndef YGOMASTER_IO_THROTTLE_H
+#define YGOMASTER_IO_THROTTLE_H
+
+#include"public.h"
+#include<chrono>
+
+struct cJSON;
+
+/*
+* I/O budget of archive copies, so a backup taken while YgoMaster runs does not stall the game.
+* A token bucket limits bytes and operations per second, copies can run in the idle I/O class
+* (Linux ioprio_set) and copied data can be dropped from the page cache (POSIX_FADV_DONTNEED).
+* Each operation (manual backup, automatic backup, restore, tiering) has its own budget in config file.
+*/
+
+// Operations with their own budget, order matches sc_ioOperationNames
+enum class EIoOperation :int
+{
+	BACKUP = 0, // backup asked for from the menu
+	AUTO_BACKUP, // backup before a restore and daemon backups
+	RESTORE,
+	TIERING, // moving old archives into cold storage in the background
+	PURGE, // unlinking deleted archives in the background
+	SIZE_OF_OPERATIONS
+};
+static const char* const sc_ioOperationNames[] = { "Backup", "AutoBackup", "Restore", "Tiering", "Purge" };
+
+// Bytes copied per read/write when a budget applies
+constexpr size_t IO_THROTTLE_CHUNK_SIZE = 1024 * 1024;
+
+struct YgoIoBudget
+{
+	double m_bytesPerSecond; // 0 means unlimited
+	double m_opsPerSecond; // 0 means unlimited
+	bool m_idlePriority; // run copies in the idle I/O class
+	bool m_dropCache; // drop copied data from the page cache
+
+	YgoIoBudget() :m_bytesPerSecond(0), m_opsPerSecond(0), m_idlePriority(false), m_dropCache(false) {}
+	bool Unlimited() const { return 0 == m_bytesPerSecond && 0 == m_opsPerSecond && !m_idlePriority && !m_dropCache; }
+};
+
+// Default budget of an operation: automatic backups and tiering are throttled, the others run at full speed
+YgoIoBudget GetDefaultIoBudget(const EIoOperation operation);
+// Read {"MBps": 32, "IOPS": 500, "IdlePriority": true, "DropCache": true}, missing fields keep the value of budget
+void ReadIoBudget(cJSON* item, YgoIoBudget& budget);
+cJSON* CreateIoBudgetItem(const YgoIoBudget& budget);
+
+// Token bucket shared by the worker threads of one operation, at most one second of burst
+class YgoIoThrottle
+{
+public:
+	explicit YgoIoThrottle(const YgoIoBudget& budget);
+
+	const YgoIoBudget& Budget() const { return m_budget; }
+	// Take one operation of bytes from the bucket, sleeping while the bucket is in debt
+	void Acquire(const uint64_t bytes);
+
+private:
+	YgoIoBudget m_budget;
+	std::mutex m_mutex;
+	double m_byteTokens;
+	double m_opTokens;
+	std::chrono::steady_clock::time_point m_lastRefill;
+};
+
+// Idle I/O class for the calling thread while in scope if idle is set, Linux only
+class YgoIoPriorityScope
+{
+public:
+	explicit YgoIoPriorityScope(const bool idle);
+	~YgoIoPriorityScope();
+
+private:
+	int m_previous;
+};
+
+// Copy one file within the budget of throttle, nullptr copies at full speed with fs::copy_file
+bool CopyFileWithBudget(const std::filesystem::path& sourcePath, const std::filesystem::path& destPath, YgoIoThrottle* throttle);
+// Write data to path within the budget of throttle, existing content is replaced
+bool WriteFileWithBudget(const std::filesystem::path& path, const char* data, const size_t size, YgoIoThrottle* throttle);
+// Flush path and drop it from the page cache if the budget of throttle asks for it
+void DropFileCache(const std::filesystem::path& path, YgoIoThrottle* throttle);
+
+#endif // !YGOMASTER_IO_THROTTLE_H
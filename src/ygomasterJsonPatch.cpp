@@ -0,0 +1,186 @@
+#include "ygomasterJsonPatch.h"
+#include "ygomasterFileView.h"
+#include "ygomasterPack.h"
+#include <cjson/cJSON.h>
+
+static size_t SkipSpace(const char* data, const size_t size, size_t pos)
+{
+	while (pos < size && (data[pos] == ' ' || data[pos] == '\t' || data[pos] == '\r' || data[pos] == '\n')) {
+		++pos;
+	}
+	return pos;
+}
+
+// pos is on the opening quote, returns the position after the closing quote or size if unterminated
+static size_t SkipString(const char* data, const size_t size, size_t pos)
+{
+	for (++pos; pos < size; ++pos) {
+		if (data[pos] == '\\') {
+			++pos;
+		}
+		else if (data[pos] == '"') {
+			return pos + 1;
+		}
+	}
+	return size;
+}
+
+// pos is on the first byte of a value, returns the position after it
+static size_t SkipValue(const char* data, const size_t size, size_t pos)
+{
+	if (pos >= size) {
+		return size;
+	}
+	if (data[pos] == '"') {
+		return SkipString(data, size, pos);
+	}
+	if (data[pos] == '{' || data[pos] == '[') {
+		int depth = 0;
+		while (pos < size) {
+			const char c = data[pos];
+			if (c == '"') {
+				pos = SkipString(data, size, pos);
+				continue;
+			}
+			++pos;
+			if (c == '{' || c == '[') {
+				++depth;
+			}
+			else if ((c == '}' || c == ']') && 0 == --depth) {
+				return pos;
+			}
+		}
+		return size;
+	}
+	//Number, true, false or null
+	while (pos < size && data[pos] != ',' && data[pos] != '}' && data[pos] != ']'
+		&& data[pos] != ' ' && data[pos] != '\t' && data[pos] != '\r' && data[pos] != '\n') {
+		++pos;
+	}
+	return pos;
+}
+
+bool FindJsonValue(const char* data, const size_t size, const std::string& fieldPath, size_t& begin, size_t& end)
+{
+	size_t pos = SkipSpace(data, size, 0);
+	size_t segmentBegin = 0;
+	while (true) {
+		const size_t dot = fieldPath.find('.', segmentBegin);
+		const std::string key = fieldPath.substr(segmentBegin, dot == std::string::npos ? std::string::npos : dot - segmentBegin);
+		if (pos >= size || data[pos] != '{') {
+			return false;
+		}
+		pos = SkipSpace(data, size, pos + 1);
+		bool found = false;
+		while (pos < size && data[pos] == '"') {
+			//Keys are compared as raw bytes, escaped keys are not used by YgoMaster
+			const size_t keyEnd = SkipString(data, size, pos);
+			const bool match = (keyEnd - pos - 2 == key.size()) && 0 == key.compare(0, key.size(), data + pos + 1, key.size());
+			pos = SkipSpace(data, size, keyEnd);
+			if (pos >= size || data[pos] != ':') {
+				return false;
+			}
+			pos = SkipSpace(data, size, pos + 1);
+			if (match) {
+				found = true;
+				break;
+			}
+			pos = SkipSpace(data, size, SkipValue(data, size, pos));
+			if (pos < size && data[pos] == ',') {
+				pos = SkipSpace(data, size, pos + 1);
+			}
+		}
+		if (!found) {
+			return false;
+		}
+		if (dot == std::string::npos) {
+			begin = pos;
+			end = SkipValue(data, size, pos);
+			return end > begin;
+		}
+		segmentBegin = dot + 1;
+	}
+}
+
+// -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?, what strtod accepts beyond that ("1.", "01", "0x1", "inf") is no JSON
+static bool IsJsonNumber(const std::string& value)
+{
+	size_t pos = 0;
+	auto digits = [&]() {
+		const size_t begin = pos;
+		while (pos < value.size() && value[pos] >= '0' && value[pos] <= '9') {
+			++pos;
+		}
+		return pos > begin;
+	};
+	if (pos < value.size() && value[pos] == '-') {
+		++pos;
+	}
+	if (pos < value.size() && value[pos] == '0') {
+		++pos;
+	}
+	else if (!digits()) {
+		return false;
+	}
+	if (pos < value.size() && value[pos] == '.') {
+		++pos;
+		if (!digits()) {
+			return false;
+		}
+	}
+	if (pos < value.size() && (value[pos] == 'e' || value[pos] == 'E')) {
+		++pos;
+		if (pos < value.size() && (value[pos] == '+' || value[pos] == '-')) {
+			++pos;
+		}
+		if (!digits()) {
+			return false;
+		}
+	}
+	return pos == value.size();
+}
+
+std::string MakeJsonValueText(const std::string& value)
+{
+	//Plain JSON numbers are written as they are, anything else becomes a string
+	if (IsJsonNumber(value)) {
+		return value;
+	}
+	cJSON* item = cJSON_CreateString(value.c_str());
+	char* text = cJSON_PrintUnformatted(item);
+	std::string result = text ? text : "\"\"";
+	cJSON_free(text);
+	cJSON_Delete(item);
+	return result;
+}
+
+EJsonPatchResult PatchArchiveJsonField(const std::string& archivePath, const std::string& relPath,
+	const std::string& fieldPath, const std::string& valueText)
+{
+	YgoFileView content;
+	if (!ReadArchiveFile(archivePath, relPath, content)) {
+		return EJsonPatchResult::FAILED;
+	}
+	size_t begin = 0, end = 0;
+	if (!FindJsonValue(content.Data(), content.Size(), fieldPath, begin, end)) {
+		return EJsonPatchResult::NOT_FOUND;
+	}
+	//Padding left by earlier patches is room for the new value too
+	size_t room = end;
+	while (room < content.Size() && content.Data()[room] == ' ') {
+		++room;
+	}
+	if (valueText.size() <= room - begin) {
+		std::string bytes = valueText;
+		bytes.append(room - begin - valueText.size(), ' ');
+		content.Close();
+		return PatchArchiveFile(archivePath, relPath, begin, bytes) ? EJsonPatchResult::PATCHED_IN_PLACE : EJsonPatchResult::FAILED;
+	}
+	std::string rebuilt;
+	rebuilt.reserve(content.Size() + valueText.size());
+	rebuilt.append(content.Data(), begin);
+	rebuilt.append(valueText);
+	rebuilt.append(content.Data() + end, content.Size() - end);
+	content.Close();
+	return WriteArchiveFile(archivePath, relPath, rebuilt) ? EJsonPatchResult::REWRITTEN : EJsonPatchResult::FAILED;
+}
@@ -0,0 +1,31 @@
+#ifndef YGOMASTER_JSON_PATCH_H
+#define YGOMASTER_JSON_PATCH_H
+
+#include"public.h"
+
+/*
+* Field edits of archived JSON files without re-printing the document.
+* A field is addressed by a dotted path of object keys ("Gems", "Cards.4007.tn").
+* When the new value text is not longer than the old one it is written over the old value
+* and padded with spaces, otherwise the file is rebuilt around the new value and replaced atomically.
+*/
+
+enum class EJsonPatchResult :int
+{
+	FAILED = 0, // File missing or not writable
+	NOT_FOUND, // Field path does not exist in the file
+	PATCHED_IN_PLACE,
+	REWRITTEN
+};
+
+// Find the value of fieldPath in a JSON document, [begin, end) receives its byte span
+bool FindJsonValue(const char* data, const size_t size, const std::string& fieldPath, size_t& begin, size_t& end);
+
+// JSON text of value: numbers are kept as typed, anything else becomes a JSON string
+std::string MakeJsonValueText(const std::string& value);
+
+// Set fieldPath of relPath in an archive to valueText (already JSON encoded)
+EJsonPatchResult PatchArchiveJsonField(const std::string& archivePath, const std::string& relPath,
+	const std::string& fieldPath, const std::string& valueText);
+
+#endif // !YGOMASTER_JSON_PATCH_H
@@ -0,0 +1,483 @@
+#include "ygomasterJsonTree.h"
+#include "ygomasterBinary.h"
+#include "ygomasterPack.h"
+#include <cjson/cJSON.h>
+#include <algorithm>
+
+namespace fs = std::filesystem;
+
+static const char sc_treeMagic[4] = { 'Y', 'M', 'J', 'T' };
+constexpr uint32_t JSON_TREE_VERSION = 1;
+constexpr size_t JSON_TREE_HEADER_SIZE = 4 + 4 + 8 + 4 + 8;
+// 4 bits of the key hash per bucket level
+constexpr uint8_t JSON_TREE_MAX_DEPTH = 64 / 4;
+
+enum EJsonNodeType :uint8_t { SCALAR_NODE = 0, OBJECT_NODE = 1, ARRAY_NODE = 2, BUCKET_NODE = 3 };
+enum EJsonNodeLayout :uint8_t { MEMBERS_LAYOUT = 0, BUCKETS_LAYOUT = 1 };
+
+static uint32_t GetBucket(const uint64_t keyHash, const uint8_t depth)
+{
+	return static_cast<uint32_t>((keyHash >> (4 * depth)) & (JSON_TREE_FANOUT - 1));
+}
+
+namespace
+{
+	// Writes nodes children first, so the hash of every node is known when it is written
+	class YgoJsonTreeWriter
+	{
+	public:
+		struct Member
+		{
+			std::string m_key;
+			uint64_t m_keyHash;
+			uint64_t m_offset;
+			uint64_t m_hash;
+		};
+
+		YgoJsonTreeWriter() :m_nodeCount(0) { m_out.assign(JSON_TREE_HEADER_SIZE, '\0'); }
+
+		uint64_t WriteValue(const cJSON* value, uint64_t& hash)
+		{
+			if (!cJSON_IsObject(value) && !cJSON_IsArray(value)) {
+				char* printed = cJSON_PrintUnformatted(value);
+				const std::string text = printed ? printed : "null";
+				cJSON_free(printed);
+				const uint8_t type = SCALAR_NODE;
+				hash = HashFnv1a(text.data(), text.size(), HashFnv1a(&type, 1));
+				const uint64_t offset = m_out.size();
+				PutLE(m_out, hash, 8);
+				PutLE(m_out, type, 1);
+				PutLE(m_out, text.size(), 4);
+				m_out.append(text);
+				++m_nodeCount;
+				return offset;
+			}
+			const bool isObject = cJSON_IsObject(value);
+			std::vector<Member> members;
+			uint32_t index = 0;
+			for (const cJSON* child = value->child; child; child = child->next, ++index) {
+				Member member;
+				member.m_key = isObject ? std::string(child->string ? child->string : "") : std::to_string(index);
+				member.m_keyHash = HashFnv1a(member.m_key.data(), member.m_key.size());
+				member.m_offset = WriteValue(child, member.m_hash);
+				members.push_back(std::move(member));
+			}
+			return WriteGroup(isObject ? OBJECT_NODE : ARRAY_NODE, members, 0, hash);
+		}
+
+		uint64_t WriteGroup(const uint8_t type, std::vector<Member>& members, const uint8_t depth, uint64_t& hash)
+		{
+			const uint32_t count = static_cast<uint32_t>(members.size());
+			hash = HashFnv1a(&type, 1);
+			hash = HashFnv1a(&count, sizeof(count), hash);
+			std::string body;
+			uint8_t layout = MEMBERS_LAYOUT;
+			if (members.size() <= JSON_TREE_FANOUT || depth >= JSON_TREE_MAX_DEPTH) {
+				//Sorted, so members written in another order hash the same
+				std::sort(members.begin(), members.end(), [](const Member& a, const Member& b) { return a.m_key < b.m_key; });
+				for (const auto& member : members) {
+					hash = HashFnv1a(member.m_key.data(), member.m_key.size() + 1, hash);
+					hash = HashFnv1a(&member.m_hash, sizeof(member.m_hash), hash);
+					PutLE(body, member.m_key.size(), 2);
+					body.append(member.m_key);
+					PutLE(body, member.m_offset, 8);
+				}
+			}
+			else {
+				layout = BUCKETS_LAYOUT;
+				std::vector<std::vector<Member>> buckets(JSON_TREE_FANOUT);
+				for (auto& member : members) {
+					buckets[GetBucket(member.m_keyHash, depth)].push_back(std::move(member));
+				}
+				for (auto& bucket : buckets) {
+					uint64_t bucketHash = 0, bucketOffset = 0;
+					if (!bucket.empty()) {
+						bucketOffset = WriteGroup(BUCKET_NODE, bucket, depth + 1, bucketHash);
+					}
+					hash = HashFnv1a(&bucketHash, sizeof(bucketHash), hash);
+					PutLE(body, bucketOffset, 8);
+				}
+			}
+			const uint64_t offset = m_out.size();
+			PutLE(m_out, hash, 8);
+			PutLE(m_out, type, 1);
+			PutLE(m_out, count, 4);
+			PutLE(m_out, layout, 1);
+			PutLE(m_out, depth, 1);
+			m_out.append(body);
+			++m_nodeCount;
+			return offset;
+		}
+
+		std::string Finish(const uint64_t rootOffset)
+		{
+			std::string header;
+			header.append(sc_treeMagic, sizeof(sc_treeMagic));
+			PutLE(header, JSON_TREE_VERSION, 4);
+			PutLE(header, m_out.size(), 8);
+			PutLE(header, m_nodeCount, 4);
+			PutLE(header, rootOffset, 8);
+			m_out.replace(0, header.size(), header);
+			return std::move(m_out);
+		}
+
+	private:
+		std::string m_out;
+		uint64_t m_nodeCount;
+	};
+}
+
+YgoJsonTree::YgoJsonTree()
+	:m_rootOffset(0), m_nodeCount(0)
+{
+}
+
+bool YgoJsonTree::Build(const cJSON* root)
+{
+	m_rootOffset = 0;
+	if (!root) {
+		return false;
+	}
+	YgoJsonTreeWriter writer;
+	uint64_t hash = 0;
+	const uint64_t rootOffset = writer.WriteValue(root, hash);
+	m_view.Assign(writer.Finish(rootOffset));
+	m_nodeCount = GetLE(m_view.Data() + 16, 4);
+	m_rootOffset = rootOffset;
+	return true;
+}
+
+bool YgoJsonTree::Open(const fs::path& path)
+{
+	m_rootOffset = 0;
+	if (!m_view.Open(path) || m_view.Size() < JSON_TREE_HEADER_SIZE) {
+		return false;
+	}
+	YgoBinaryReader reader(m_view.Data(), m_view.Size());
+	uint64_t version = 0, size = 0, nodeCount = 0, rootOffset = 0;
+	//A tree cut short by a crash fails the size check and is built again
+	if (memcmp(m_view.Data(), sc_treeMagic, sizeof(sc_treeMagic)) != 0 || !reader.Skip(sizeof(sc_treeMagic))
+		|| !reader.Read(version, 4) || version != JSON_TREE_VERSION || !reader.Read(size, 8) || size != m_view.Size()
+		|| !reader.Read(nodeCount, 4) || !reader.Read(rootOffset, 8) || rootOffset < JSON_TREE_HEADER_SIZE || rootOffset >= size) {
+		m_view.Close();
+		return false;
+	}
+	m_nodeCount = nodeCount;
+	m_rootOffset = rootOffset;
+	return true;
+}
+
+bool YgoJsonTree::Save(const fs::path& path) const
+{
+	return IsValid() && ReplaceFileContent(path, std::string(m_view.Data(), m_view.Size()));
+}
+
+bool YgoJsonTree::ReadNode(const uint64_t offset, Node& node) const
+{
+	const uint64_t size = m_view.Size();
+	if (offset < JSON_TREE_HEADER_SIZE || offset + 9 > size) {
+		return false;
+	}
+	const char* data = m_view.Data() + offset;
+	node.m_hash = GetLE(data, 8);
+	node.m_type = static_cast<uint8_t>(data[8]);
+	if (SCALAR_NODE == node.m_type) {
+		if (offset + 13 > size) {
+			return false;
+		}
+		node.m_count = 0;
+		node.m_layout = MEMBERS_LAYOUT;
+		node.m_depth = 0;
+		node.m_bodySize = static_cast<size_t>(GetLE(data + 9, 4));
+		node.m_body = data + 13;
+		return offset + 13 + node.m_bodySize <= size;
+	}
+	if (offset + 15 > size || node.m_type > BUCKET_NODE) {
+		return false;
+	}
+	node.m_count = static_cast<uint32_t>(GetLE(data + 9, 4));
+	node.m_layout = static_cast<uint8_t>(data[13]);
+	node.m_depth = static_cast<uint8_t>(data[14]);
+	node.m_body = data + 15;
+	node.m_bodySize = static_cast<size_t>(size - offset - 15);
+	return BUCKETS_LAYOUT != node.m_layout || node.m_bodySize >= JSON_TREE_FANOUT * 8;
+}
+
+void YgoJsonTree::CollectMembers(const Node& node, std::vector<std::pair<std::string, uint64_t>>& result) const
+{
+	if (SCALAR_NODE == node.m_type) {
+		return;
+	}
+	if (BUCKETS_LAYOUT == node.m_layout) {
+		for (uint32_t i = 0; i < JSON_TREE_FANOUT; ++i) {
+			Node bucket;
+			const uint64_t offset = GetLE(node.m_body + i * 8, 8);
+			if (offset && ReadNode(offset, bucket)) {
+				CollectMembers(bucket, result);
+			}
+		}
+		return;
+	}
+	YgoBinaryReader reader(node.m_body, node.m_bodySize);
+	for (uint32_t i = 0; i < node.m_count; ++i) {
+		uint64_t length = 0, offset = 0;
+		std::string key;
+		if (!reader.Read(length, 2) || !reader.ReadString(key, static_cast<size_t>(length)) || !reader.Read(offset, 8)) {
+			return;
+		}
+		result.emplace_back(std::move(key), offset);
+	}
+}
+
+uint64_t YgoJsonTree::FindMember(const Node& node, const std::string& key) const
+{
+	if (SCALAR_NODE == node.m_type) {
+		return 0;
+	}
+	if (BUCKETS_LAYOUT == node.m_layout) {
+		Node bucket;
+		const uint64_t keyHash = HashFnv1a(key.data(), key.size());
+		const uint64_t offset = GetLE(node.m_body + GetBucket(keyHash, node.m_depth) * 8, 8);
+		return (offset && ReadNode(offset, bucket)) ? FindMember(bucket, key) : 0;
+	}
+	std::vector<std::pair<std::string, uint64_t>> members;
+	CollectMembers(node, members);
+	for (const auto& member : members) {
+		if (member.first == key) {
+			return member.second;
+		}
+	}
+	return 0;
+}
+
+void YgoJsonTree::AppendText(const uint64_t offset, std::string& text, const size_t maxLength) const
+{
+	Node node;
+	if (!ReadNode(offset, node)) {
+		return;
+	}
+	if (SCALAR_NODE == node.m_type) {
+		text.append(node.m_body, node.m_bodySize);
+		return;
+	}
+	const bool isObject = OBJECT_NODE == node.m_type;
+	std::vector<std::pair<std::string, uint64_t>> members;
+	CollectMembers(node, members);
+	if (isObject) {
+		std::sort(members.begin(), members.end());
+	}
+	else {
+		std::sort(members.begin(), members.end(), [](const auto& a, const auto& b) { return std::stoul(a.first) < std::stoul(b.first); });
+	}
+	text.push_back(isObject ? '{' : '[');
+	for (size_t i = 0; i < members.size(); ++i) {
+		if (text.size() > maxLength) {
+			text.append("...");
+			break;
+		}
+		if (i > 0) {
+			text.push_back(',');
+		}
+		if (isObject) {
+			text.append("\"" + members[i].first + "\":");
+		}
+		AppendText(members[i].second, text, maxLength);
+	}
+	text.push_back(isObject ? '}' : ']');
+}
+
+uint64_t YgoJsonTree::FindPath(const std::vector<std::string>& path) const
+{
+	uint64_t offset = m_rootOffset;
+	for (const auto& key : path) {
+		Node node;
+		if (!ReadNode(offset, node) || !(offset = FindMember(node, key))) {
+			return 0;
+		}
+	}
+	return offset;
+}
+
+bool YgoJsonTree::FindText(const std::vector<std::string>& path, std::string& text, const size_t maxLength) const
+{
+	const uint64_t offset = FindPath(path);
+	if (!offset) {
+		return false;
+	}
+	text.clear();
+	AppendText(offset, text, maxLength);
+	return true;
+}
+
+bool YgoJsonTree::FindMemberCount(const std::vector<std::string>& path, uint64_t& count) const
+{
+	Node node;
+	const uint64_t offset = FindPath(path);
+	if (!offset || !ReadNode(offset, node) || SCALAR_NODE == node.m_type) {
+		return false;
+	}
+	count = node.m_count;
+	return true;
+}
+
+struct YgoJsonTree::DiffState
+{
+	const YgoJsonTree& m_before;
+	const YgoJsonTree& m_after;
+	std::vector<YgoJsonChange>& m_result;
+	std::vector<std::string> m_path;
+	uint64_t m_visited;
+
+	void Report(const YgoJsonChange::Kind kind, const uint64_t before, const uint64_t after)
+	{
+		YgoJsonChange change;
+		change.m_kind = kind;
+		change.m_path = m_path;
+		if (before) {
+			m_before.AppendText(before, change.m_before, 256);
+		}
+		if (after) {
+			m_after.AppendText(after, change.m_after, 256);
+		}
+		m_result.push_back(std::move(change));
+	}
+};
+
+void YgoJsonTree::DiffNode(DiffState& state, const uint64_t before, const uint64_t after)
+{
+	++state.m_visited;
+	Node beforeNode, afterNode;
+	if (!state.m_before.ReadNode(before, beforeNode) || !state.m_after.ReadNode(after, afterNode)) {
+		state.Report(YgoJsonChange::CHANGED, before, after);
+		return;
+	}
+	if (beforeNode.m_hash == afterNode.m_hash && beforeNode.m_type == afterNode.m_type) {
+		return;
+	}
+	if (beforeNode.m_type != afterNode.m_type || SCALAR_NODE == beforeNode.m_type) {
+		state.Report(YgoJsonChange::CHANGED, before, after);
+		return;
+	}
+	DiffMembers(state, beforeNode, afterNode);
+}
+
+void YgoJsonTree::DiffMembers(DiffState& state, const Node& before, const Node& after)
+{
+	//Same bucket of both sides holds the same keys, only buckets with different hashes are entered
+	if (BUCKETS_LAYOUT == before.m_layout && BUCKETS_LAYOUT == after.m_layout && before.m_depth == after.m_depth) {
+		for (uint32_t i = 0; i < JSON_TREE_FANOUT; ++i) {
+			const uint64_t beforeOffset = GetLE(before.m_body + i * 8, 8);
+			const uint64_t afterOffset = GetLE(after.m_body + i * 8, 8);
+			Node beforeBucket, afterBucket;
+			const bool hasBefore = beforeOffset && state.m_before.ReadNode(beforeOffset, beforeBucket);
+			const bool hasAfter = afterOffset && state.m_after.ReadNode(afterOffset, afterBucket);
+			if (!hasBefore && !hasAfter) continue;
+			++state.m_visited;
+			if (hasBefore && hasAfter) {
+				if (beforeBucket.m_hash != afterBucket.m_hash) {
+					DiffMembers(state, beforeBucket, afterBucket);
+				}
+				continue;
+			}
+			std::vector<std::pair<std::string, uint64_t>> members;
+			(hasBefore ? state.m_before : state.m_after).CollectMembers(hasBefore ? beforeBucket : afterBucket, members);
+			for (const auto& member : members) {
+				state.m_path.push_back(member.first);
+				state.Report(hasBefore ? YgoJsonChange::REMOVED : YgoJsonChange::ADDED,
+					hasBefore ? member.second : 0, hasBefore ? 0 : member.second);
+				state.m_path.pop_back();
+			}
+		}
+		return;
+	}
+	//Groups of different layout, at least one side is small
+	std::vector<std::pair<std::string, uint64_t>> beforeMembers, afterMembers;
+	state.m_before.CollectMembers(before, beforeMembers);
+	state.m_after.CollectMembers(after, afterMembers);
+	std::sort(beforeMembers.begin(), beforeMembers.end());
+	std::sort(afterMembers.begin(), afterMembers.end());
+	size_t i = 0, j = 0;
+	while (i < beforeMembers.size() || j < afterMembers.size()) {
+		const bool takeBefore = j >= afterMembers.size() || (i < beforeMembers.size() && beforeMembers[i].first < afterMembers[j].first);
+		const bool takeAfter = i >= beforeMembers.size() || (j < afterMembers.size() && afterMembers[j].first < beforeMembers[i].first);
+		if (takeBefore) {
+			state.m_path.push_back(beforeMembers[i].first);
+			state.Report(YgoJsonChange::REMOVED, beforeMembers[i++].second, 0);
+		}
+		else if (takeAfter) {
+			state.m_path.push_back(afterMembers[j].first);
+			state.Report(YgoJsonChange::ADDED, 0, afterMembers[j++].second);
+		}
+		else {
+			state.m_path.push_back(beforeMembers[i].first);
+			DiffNode(state, beforeMembers[i++].second, afterMembers[j++].second);
+		}
+		state.m_path.pop_back();
+	}
+}
+
+void YgoJsonTree::Diff(const YgoJsonTree& before, const YgoJsonTree& after, std::vector<YgoJsonChange>& result, uint64_t* visitedNodes)
+{
+	DiffState state{ before, after, result, {}, 0 };
+	//A missing document is reported as a whole
+	if (before.IsValid() && after.IsValid()) {
+		DiffNode(state, before.m_rootOffset, after.m_rootOffset);
+	}
+	else if (before.IsValid() || after.IsValid()) {
+		state.Report(before.IsValid() ? YgoJsonChange::REMOVED : YgoJsonChange::ADDED, before.m_rootOffset, after.m_rootOffset);
+	}
+	if (visitedNodes) {
+		*visitedNodes = state.m_visited;
+	}
+}
+
+bool BuildPlayerTree(const std::string& rootPath, const std::string& playerRelPath, const std::string& decksRelDir,
+	YgoJsonTree& result, const cJSON* playerRoot)
+{
+	cJSON* parsed = nullptr;
+	if (!playerRoot) {
+		YgoFileView view;
+		if (!ReadArchiveFile(rootPath, fs::path(playerRelPath).generic_string(), view)) {
+			return false;
+		}
+		parsed = cJSON_ParseWithLength(view.Data(), view.Size());
+		if (!parsed) {
+			return false;
+		}
+	}
+	//The tree owns nothing, so the documents are copied into one root, deck files are small
+	cJSON* root = cJSON_CreateObject();
+	cJSON_AddItemToObject(root, "Player", parsed ? parsed : cJSON_Duplicate(playerRoot, true));
+	cJSON* decks = cJSON_AddObjectToObject(root, "Decks");
+	const std::string generic = fs::path(decksRelDir).generic_string();
+	std::vector<std::string> files;
+	ListArchiveFiles(rootPath, generic.substr(0, generic.find('/')), files);
+	for (const auto& file : files) {
+		if (file.compare(0, generic.size() + 1, generic + "/") != 0 || fs::path(file).extension() != ".json") {
+			continue;
+		}
+		YgoFileView view;
+		cJSON* deck = ReadArchiveFile(rootPath, file, view) ? cJSON_ParseWithLength(view.Data(), view.Size()) : nullptr;
+		if (deck) {
+			cJSON_AddItemToObject(decks, file.substr(generic.size() + 1).c_str(), deck);
+		}
+	}
+	const bool ok = result.Build(root);
+	cJSON_Delete(root);
+	return ok;
+}
+
+bool LoadPlayerTree(const std::string& archivePath, const std::string& playerRelPath, const std::string& decksRelDir,
+	YgoJsonTree& result)
+{
+	const fs::path treePath = fs::path(archivePath) / sc_playerTreeFileName;
+	if (result.Open(treePath)) {
+		return true;
+	}
+	//Archives made before the side file existed build it once
+	if (!BuildPlayerTree(archivePath, playerRelPath, decksRelDir, result)) {
+		return false;
+	}
+	result.Save(treePath);
+	return true;
+}
@@ -0,0 +1,101 @@
+#ifndef YGOMASTER_JSON_TREE_H
+#define YGOMASTER_JSON_TREE_H
+
+#include"public.h"
+#include"ygomasterFileView.h"
+
+struct cJSON;
+
+/*
+* Hash trees of JSON documents, for diffs that skip identical subtrees.
+* Every node carries a 64-bit hash of its whole subtree. Members of objects and arrays (keyed by index)
+* are kept in groups of up to JSON_TREE_FANOUT, larger containers are split into JSON_TREE_FANOUT buckets
+* by 4 bits of the key hash per level, so one changed card of a large collection changes one path of buckets.
+* A tree is one byte buffer, all integers little-endian and offsets from the start of the buffer:
+*   header: magic "YMJT", version u32, buffer size u64, node count u32, root offset u64
+*   node:   hash u64, type u8, then
+*           scalar:                  text length u32, JSON text
+*           object, array or bucket: member count u32, layout u8, depth u8, then
+*             members layout:        per member key length u16, key, node offset u64, sorted by key
+*             buckets layout:        JSON_TREE_FANOUT bucket offsets u64, 0 for an empty bucket
+* Archives keep the tree of Player.json and their deck files in "Player.tree", written at backup time,
+* so diffing two archives only reads the nodes on the paths to what changed.
+*/
+
+static const std::string sc_playerTreeFileName = "Player.tree";
+
+constexpr uint32_t JSON_TREE_FANOUT = 16;
+
+struct YgoJsonChange
+{
+	enum Kind :uint8_t { ADDED = 0, REMOVED = 1, CHANGED = 2 };
+	Kind m_kind;
+	std::vector<std::string> m_path; // member keys from the root, array elements by index
+	std::string m_before; // JSON text, empty when added
+	std::string m_after; // JSON text, empty when removed
+
+	YgoJsonChange() :m_kind(CHANGED), m_before(""), m_after("") {}
+};
+
+class YgoJsonTree
+{
+public:
+	YgoJsonTree();
+
+	// Hash a parsed document
+	bool Build(const cJSON* root);
+	// Use the tree stored at path, checks the header and the size
+	bool Open(const std::filesystem::path& path);
+	bool Save(const std::filesystem::path& path) const;
+	bool IsValid() const { return m_rootOffset != 0; }
+	uint64_t NodeCount() const { return m_nodeCount; }
+
+	// JSON text of the node at path, containers abbreviated after maxLength characters
+	bool FindText(const std::vector<std::string>& path, std::string& text, const size_t maxLength = 256) const;
+	// Members of the object or array at path, read from its node without visiting them
+	bool FindMemberCount(const std::vector<std::string>& path, uint64_t& count) const;
+
+	// Append the differences from before to after to result, visitedNodes receives the number of nodes compared.
+	// An invalid tree stands for a missing document.
+	static void Diff(const YgoJsonTree& before, const YgoJsonTree& after, std::vector<YgoJsonChange>& result,
+		uint64_t* visitedNodes = nullptr);
+
+private:
+	struct Node
+	{
+		uint64_t m_hash;
+		uint8_t m_type;
+		uint32_t m_count; // members of the subtree for containers and buckets
+		uint8_t m_layout;
+		uint8_t m_depth;
+		const char* m_body; // text of a scalar, entries of a container or bucket
+		size_t m_bodySize;
+	};
+	struct DiffState;
+
+	bool ReadNode(const uint64_t offset, Node& node) const;
+	// Every member of a container or bucket node, key and node offset
+	void CollectMembers(const Node& node, std::vector<std::pair<std::string, uint64_t>>& result) const;
+	// Offset of the member key of a container node, 0 if missing
+	uint64_t FindMember(const Node& node, const std::string& key) const;
+	// Offset of the node at path, 0 if missing
+	uint64_t FindPath(const std::vector<std::string>& path) const;
+	void AppendText(const uint64_t offset, std::string& text, const size_t maxLength) const;
+
+	static void DiffNode(DiffState& state, const uint64_t before, const uint64_t after);
+	static void DiffMembers(DiffState& state, const Node& before, const Node& after);
+
+	YgoFileView m_view;
+	uint64_t m_rootOffset;
+	uint64_t m_nodeCount;
+};
+
+// Player.json (playerRelPath) and the deck files under decksRelDir of an archive or Data directory as one tree,
+// {"Player": Player.json, "Decks": {file name: deck}}. playerRoot is used instead of reading Player.json if given.
+bool BuildPlayerTree(const std::string& rootPath, const std::string& playerRelPath, const std::string& decksRelDir,
+	YgoJsonTree& result, const cJSON* playerRoot = nullptr);
+// Tree of an archive from its side file, built from the archive and stored as side file if missing
+bool LoadPlayerTree(const std::string& archivePath, const std::string& playerRelPath, const std::string& decksRelDir,
+	YgoJsonTree& result);
+
+#endif // !YGOMASTER_JSON_TREE_H
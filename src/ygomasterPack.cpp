@@ -0,0 +1,685 @@
+#include "ygomasterPack.h"
+#include "ygomasterFileView.h"
+#include "ygomasterBinary.h"
+#include "ygomasterTreeWalker.h"
+#include "ygomasterIoThrottle.h"
+#include "ygomasterColdStore.h"
+#include <atomic>
+
+namespace fs = std::filesystem;
+
+static const char sc_packMagic[4] = { 'Y', 'M', 'P', 'K' };
+constexpr uint32_t PACK_VERSION = 1;
+constexpr size_t PACK_HEADER_SIZE = 4 + 4 + 4 + 8;
+
+// Parse header and table from the start of a pack, size is the number of bytes available
+static bool ParsePackTable(const char* data, const size_t size, std::vector<YgoPackEntry>& entries, uint64_t& dataOffset)
+{
+	if (size < PACK_HEADER_SIZE || memcmp(data, sc_packMagic, sizeof(sc_packMagic)) != 0) {
+		return false;
+	}
+	if (GetLE(data + 4, 4) != PACK_VERSION) {
+		printf("Unsupported pack version %u.\n", static_cast<unsigned>(GetLE(data + 4, 4)));
+		return false;
+	}
+	const uint64_t count = GetLE(data + 8, 4);
+	dataOffset = GetLE(data + 12, 8);
+	if (dataOffset > size) {
+		return false;
+	}
+
+	entries.clear();
+	entries.reserve(static_cast<size_t>(count));
+	size_t pos = PACK_HEADER_SIZE;
+	for (uint64_t i = 0; i < count; ++i) {
+		if (pos + 3 > dataOffset) {
+			return false;
+		}
+		YgoPackEntry entry;
+		entry.m_type = static_cast<uint8_t>(data[pos]);
+		const size_t pathLength = static_cast<size_t>(GetLE(data + pos + 1, 2));
+		pos += 3;
+		if (pos + pathLength + 16 > dataOffset) {
+			return false;
+		}
+		entry.m_path.assign(data + pos, pathLength);
+		pos += pathLength;
+		entry.m_offset = GetLE(data + pos, 8);
+		entry.m_size = GetLE(data + pos + 8, 8);
+		pos += 16;
+		entries.push_back(std::move(entry));
+	}
+	return true;
+}
+
+fs::path GetPackPath(const fs::path& archiveDir, const std::string& targetName)
+{
+	return archiveDir / (targetName + sc_packExtension);
+}
+
+bool ReadPackTable(const fs::path& packPath, std::vector<YgoPackEntry>& entries, uint64_t& dataOffset)
+{
+	std::ifstream file(packPath, std::ios::binary);
+	if (!file.is_open()) {
+		return false;
+	}
+	char header[PACK_HEADER_SIZE];
+	if (!file.read(header, sizeof(header))) {
+		return false;
+	}
+	const uint64_t tableEnd = GetLE(header + 12, 8);
+	if (tableEnd < PACK_HEADER_SIZE) {
+		return false;
+	}
+	std::string table(static_cast<size_t>(tableEnd), '\0');
+	memcpy(table.data(), header, sizeof(header));
+	if (!file.read(table.data() + PACK_HEADER_SIZE, static_cast<std::streamsize>(tableEnd - PACK_HEADER_SIZE))) {
+		return false;
+	}
+	return ParsePackTable(table.data(), table.size(), entries, dataOffset);
+}
+
+bool WritePack(const fs::path& packPath, const std::vector<YgoPackEntry>& entries, const std::string& data)
+{
+	std::string table;
+	for (const auto& entry : entries) {
+		table.push_back(static_cast<char>(entry.m_type));
+		PutLE(table, entry.m_path.size(), 2);
+		table.append(entry.m_path);
+		PutLE(table, entry.m_offset, 8);
+		PutLE(table, entry.m_size, 8);
+	}
+
+	std::string out;
+	out.reserve(PACK_HEADER_SIZE + table.size() + data.size());
+	out.append(sc_packMagic, sizeof(sc_packMagic));
+	PutLE(out, PACK_VERSION, 4);
+	PutLE(out, entries.size(), 4);
+	PutLE(out, PACK_HEADER_SIZE + table.size(), 8);
+	out.append(table);
+	out.append(data);
+
+	//Write aside and rename so a failed backup never leaves a truncated pack
+	if (!ReplaceFileContent(packPath, out)) {
+		printf("Write pack %s failed.\n", packPath.string().c_str());
+		return false;
+	}
+	return true;
+}
+
+// Whether two files have the same size and content, both reads count against throttle
+static bool SameFileContent(const fs::path& a, const fs::path& b, const uint64_t size, YgoIoThrottle* throttle)
+{
+	std::error_code ec;
+	if (fs::file_size(b, ec) != size || ec) {
+		return false;
+	}
+	if (throttle) {
+		throttle->Acquire(2 * size);
+	}
+	YgoFileView first;
+	YgoFileView second;
+	return first.Open(a) && second.Open(b) && first.View() == second.View();
+}
+
+// Build the loose tree and pack of sourceDir at destDir and packPath, large files shared with the reference copy
+static bool BuildPackedCopy(const fs::path& sourceDir, const fs::path& destDir, const fs::path& packPath,
+	const std::string& targetName, const uint64_t threshold, YgoPackStats& localStats, const fs::path& referenceDir, YgoIoThrottle* throttle)
+{
+	if (0 == threshold) {
+		return CopyTree(sourceDir, destDir, TREE_WALKER_DEFAULT_THREADS, throttle);
+	}
+
+	//Lay out the pack from the walked list first, then read small files and copy large ones in parallel
+	std::vector<YgoTreeEntry> items;
+	if (!WalkTree(sourceDir, items, true)) {
+		return false;
+	}
+	std::vector<YgoPackEntry> entries;
+	std::vector<const YgoTreeEntry*> looseFiles;
+	std::vector<size_t> packedFiles;
+	uint64_t dataSize = 0;
+	for (const auto& item : items) {
+		if (item.m_type == YgoTreeEntry::DIRECTORY_ENTRY) {
+			YgoPackEntry entry;
+			entry.m_type = YgoPackEntry::DIRECTORY_ENTRY;
+			entry.m_path = item.m_path;
+			entries.push_back(std::move(entry));
+		}
+		else if (item.m_type == YgoTreeEntry::FILE_ENTRY && item.m_size < threshold) {
+			YgoPackEntry entry;
+			entry.m_path = item.m_path;
+			entry.m_offset = dataSize;
+			entry.m_size = item.m_size;
+			dataSize += item.m_size;
+			packedFiles.push_back(entries.size());
+			entries.push_back(std::move(entry));
+			localStats.m_packedFiles++;
+			localStats.m_packedBytes += item.m_size;
+		}
+		else if (item.m_type == YgoTreeEntry::FILE_ENTRY) {
+			fs::create_directories((destDir / item.m_path).parent_path());
+			looseFiles.push_back(&item);
+			localStats.m_looseFiles++;
+			localStats.m_looseBytes += item.m_size;
+		}
+	}
+
+	std::string data(static_cast<size_t>(dataSize), '\0');
+	const bool packed = ParallelFor(packedFiles.size(), [&](size_t i) {
+		const YgoPackEntry& entry = entries[packedFiles[i]];
+		if (throttle) {
+			throttle->Acquire(entry.m_size);
+		}
+		YgoFileView content;
+		if (!content.Open(sourceDir / entry.m_path) || content.Size() != entry.m_size) {
+			printf("Read %s failed or it changed during backup.\n", entry.m_path.c_str());
+			return false;
+		}
+		memcpy(data.data() + entry.m_offset, content.Data(), content.Size());
+		return true;
+	});
+	std::atomic<uint64_t> linkedFiles(0);
+	const bool copied = ParallelFor(looseFiles.size(), [&](size_t i) {
+		std::error_code ec;
+		const fs::path sourcePath = sourceDir / looseFiles[i]->m_path;
+		const fs::path destPath = destDir / looseFiles[i]->m_path;
+		//Large files rarely change between snapshots, an unchanged one shares the reference copy
+		if (!referenceDir.empty()) {
+			const fs::path referencePath = referenceDir / targetName / looseFiles[i]->m_path;
+			if (SameFileContent(sourcePath, referencePath, looseFiles[i]->m_size, throttle)) {
+				fs::create_hard_link(referencePath, destPath, ec);
+				if (!ec) {
+					++linkedFiles;
+					return true;
+				}
+				ec.clear();
+			}
+		}
+		if (!CopyFileWithBudget(sourcePath, destPath, throttle)) {
+			printf("Copy %s failed.\n", looseFiles[i]->m_path.c_str());
+			return false;
+		}
+		return true;
+	});
+	if (throttle) {
+		throttle->Acquire(data.size());
+	}
+	if (!packed || !copied || !WritePack(packPath, entries, data)) {
+		return false;
+	}
+	DropFileCache(packPath, throttle);
+	localStats.m_linkedFiles = linkedFiles;
+	return true;
+}
+
+bool PackDirectory(const fs::path& sourceDir, const fs::path& archiveDir,
+	const std::string& targetName, const uint64_t threshold, YgoPackStats* stats, const fs::path& referenceDir, YgoIoThrottle* throttle)
+{
+	const fs::path destDir = archiveDir / targetName;
+	const fs::path packPath = GetPackPath(archiveDir, targetName);
+	//Build beside the previous copy, which stays whole until the new one is complete
+	const fs::path stageDir = archiveDir / (targetName + ".new.tmp");
+	const fs::path stagePack = archiveDir / (targetName + ".pack.new.tmp");
+	const fs::path oldDir = archiveDir / (targetName + ".old.tmp");
+	YgoPackStats localStats;
+	try {
+		RemoveTree(stageDir);
+		fs::remove(stagePack);
+		if (!BuildPackedCopy(sourceDir, stageDir, stagePack, targetName, threshold, localStats, referenceDir, throttle)) {
+			RemoveTree(stageDir);
+			fs::remove(stagePack);
+			return false;
+		}
+
+		//Swap in the new copy, files deleted from Data do not linger from the previous one
+		RemoveTree(oldDir);
+		if (fs::exists(destDir)) {
+			fs::rename(destDir, oldDir);
+		}
+		if (fs::exists(stageDir)) {
+			fs::rename(stageDir, destDir);
+		}
+		if (fs::exists(stagePack)) {
+			fs::rename(stagePack, packPath);
+		}
+		else {
+			fs::remove(packPath);
+		}
+		fs::remove(GetColdPath(archiveDir, targetName));
+		RemoveTree(oldDir);
+	}
+	catch (const fs::filesystem_error& e) {
+		printf("Error packing %s: %s\n", sourceDir.string().c_str(), e.what());
+		std::error_code ec;
+		RemoveTree(stageDir);
+		fs::remove(stagePack, ec);
+		return false;
+	}
+	if (stats) {
+		*stats = localStats;
+	}
+	return true;
+}
+
+bool UnpackDirectory(const fs::path& archiveDir, const std::string& targetName, const fs::path& destDir, YgoIoThrottle* throttle)
+{
+	const fs::path looseDir = archiveDir / targetName;
+	const fs::path packPath = GetPackPath(archiveDir, targetName);
+	try {
+		fs::create_directories(destDir);
+		if (IsColdTarget(archiveDir, targetName) && !UnpackColdTarget(archiveDir, targetName, destDir, throttle)) {
+			return false;
+		}
+		if (fs::exists(packPath)) {
+			//One view of the whole pack, then write files straight from it
+			YgoFileView pack;
+			if (!pack.Open(packPath)) {
+				printf("Read pack %s failed.\n", packPath.string().c_str());
+				return false;
+			}
+			std::vector<YgoPackEntry> entries;
+			uint64_t dataOffset = 0;
+			if (!ParsePackTable(pack.Data(), pack.Size(), entries, dataOffset)) {
+				printf("Pack %s is damaged.\n", packPath.string().c_str());
+				return false;
+			}
+			std::vector<const YgoPackEntry*> files;
+			for (const auto& entry : entries) {
+				const fs::path destPath = destDir / fs::path(entry.m_path);
+				if (entry.m_type == YgoPackEntry::DIRECTORY_ENTRY) {
+					fs::create_directories(destPath);
+					continue;
+				}
+				if (dataOffset + entry.m_offset + entry.m_size > pack.Size()) {
+					printf("Pack %s is damaged at %s.\n", packPath.string().c_str(), entry.m_path.c_str());
+					return false;
+				}
+				fs::create_directories(destPath.parent_path());
+				files.push_back(&entry);
+			}
+			const bool written = ParallelFor(files.size(), [&](size_t i) {
+				const fs::path destPath = destDir / fs::path(files[i]->m_path);
+				if (!WriteFileWithBudget(destPath, pack.Data() + dataOffset + files[i]->m_offset, static_cast<size_t>(files[i]->m_size), throttle)) {
+					printf("Write %s failed.\n", destPath.string().c_str());
+					return false;
+				}
+				return true;
+			});
+			if (!written) {
+				return false;
+			}
+		}
+		if (fs::exists(looseDir) && !CopyTree(looseDir, destDir, TREE_WALKER_DEFAULT_THREADS, throttle)) {
+			return false;
+		}
+	}
+	catch (const fs::filesystem_error& e) {
+		printf("Error unpacking %s: %s\n", looseDir.string().c_str(), e.what());
+		return false;
+	}
+	return true;
+}
+
+bool VerifyPack(const fs::path& packPath, std::string& error)
+{
+	std::vector<YgoPackEntry> entries;
+	uint64_t dataOffset = 0;
+	std::error_code ec;
+	const uint64_t packSize = fs::file_size(packPath, ec);
+	if (ec) {
+		error = "cannot read " + packPath.string();
+		return false;
+	}
+	if (!ReadPackTable(packPath, entries, dataOffset)) {
+		error = "damaged table in " + packPath.string();
+		return false;
+	}
+	for (const auto& entry : entries) {
+		if (entry.m_type == YgoPackEntry::FILE_ENTRY && dataOffset + entry.m_offset + entry.m_size > packSize) {
+			error = entry.m_path + " is truncated in " + packPath.string();
+			return false;
+		}
+	}
+	return true;
+}
+
+// Split "Players/Local/Player.json" into the target "Players" and "Local/Player.json"
+static bool SplitTargetPath(const std::string& relPath, std::string& targetName, std::string& innerPath)
+{
+	const std::string generic = fs::path(relPath).generic_string();
+	const size_t split = generic.find('/');
+	if (split == std::string::npos) {
+		return false;
+	}
+	targetName = generic.substr(0, split);
+	innerPath = generic.substr(split + 1);
+	return true;
+}
+
+// Split "Players/Local/Player.json" into the pack of "Players" and "Local/Player.json"
+static bool SplitArchivePath(const std::string& archivePath, const std::string& relPath, fs::path& packPath, std::string& innerPath)
+{
+	std::string targetName;
+	if (!SplitTargetPath(relPath, targetName, innerPath)) {
+		return false;
+	}
+	packPath = GetPackPath(archivePath, targetName);
+	return true;
+}
+
+// Manifest entry of relPath when its target is frozen
+static bool FindColdFile(const std::string& archivePath, const std::string& relPath, YgoColdEntry& result, fs::path& storeDir)
+{
+	std::string targetName;
+	std::string innerPath;
+	std::vector<YgoColdEntry> entries;
+	if (!SplitTargetPath(relPath, targetName, innerPath) || !IsColdTarget(archivePath, targetName)
+		|| !ReadColdTable(GetColdPath(archivePath, targetName), entries, storeDir)) {
+		return false;
+	}
+	for (auto& entry : entries) {
+		if (entry.m_type == YgoColdEntry::FILE_ENTRY && entry.m_path == innerPath) {
+			result = std::move(entry);
+			return true;
+		}
+	}
+	return false;
+}
+
+// Frozen targets are brought back as standalone files before anything of them is changed
+static bool ThawForWrite(const std::string& archivePath, const std::string& relPath)
+{
+	std::string targetName;
+	std::string innerPath;
+	if (!SplitTargetPath(relPath, targetName, innerPath) || !IsColdTarget(archivePath, targetName)) {
+		return true;
+	}
+	if (!ThawTarget(archivePath, targetName)) {
+		printf("Thaw %s of %s failed.\n", targetName.c_str(), archivePath.c_str());
+		return false;
+	}
+	return true;
+}
+
+static const YgoPackEntry* FindPackEntry(const std::vector<YgoPackEntry>& entries, const std::string& innerPath)
+{
+	for (const auto& entry : entries) {
+		if (entry.m_type == YgoPackEntry::FILE_ENTRY && entry.m_path == innerPath) {
+			return &entry;
+		}
+	}
+	return nullptr;
+}
+
+bool ReadArchiveFile(const std::string& archivePath, const std::string& relPath, YgoFileView& content)
+{
+	const fs::path loosePath = fs::path(archivePath) / relPath;
+	if (fs::exists(loosePath)) {
+		return content.Open(loosePath);
+	}
+
+	fs::path packPath;
+	std::string innerPath;
+	if (SplitArchivePath(archivePath, relPath, packPath, innerPath) && fs::exists(packPath)) {
+		std::vector<YgoPackEntry> entries;
+		uint64_t dataOffset = 0;
+		if (!ReadPackTable(packPath, entries, dataOffset)) {
+			return false;
+		}
+		const YgoPackEntry* entry = FindPackEntry(entries, innerPath);
+		if (!entry) {
+			return false;
+		}
+		return content.Open(packPath, dataOffset + entry->m_offset, entry->m_size);
+	}
+
+	//A frozen target inflates just the one object
+	YgoColdEntry entry;
+	fs::path storeDir;
+	std::string data;
+	if (!FindColdFile(archivePath, relPath, entry, storeDir) || !ReadColdObject(storeDir, entry, data)) {
+		return false;
+	}
+	content.Assign(std::move(data));
+	return true;
+}
+
+bool ArchiveFileExists(const std::string& archivePath, const std::string& relPath)
+{
+	if (fs::exists(fs::path(archivePath) / relPath)) {
+		return true;
+	}
+	fs::path packPath;
+	std::string innerPath;
+	std::vector<YgoPackEntry> entries;
+	uint64_t dataOffset = 0;
+	if (SplitArchivePath(archivePath, relPath, packPath, innerPath)
+		&& fs::exists(packPath)
+		&& ReadPackTable(packPath, entries, dataOffset)
+		&& FindPackEntry(entries, innerPath) != nullptr) {
+		return true;
+	}
+	YgoColdEntry entry;
+	fs::path storeDir;
+	return FindColdFile(archivePath, relPath, entry, storeDir);
+}
+
+bool ListArchiveFiles(const std::string& archivePath, const std::string& targetName, std::vector<std::string>& relPaths, std::vector<uint64_t>* sizes)
+{
+	const fs::path looseDir = fs::path(archivePath) / targetName;
+	const fs::path packPath = GetPackPath(archivePath, targetName);
+	std::vector<YgoPackEntry> entries;
+	uint64_t dataOffset = 0;
+	if (fs::exists(packPath)) {
+		if (!ReadPackTable(packPath, entries, dataOffset)) {
+			return false;
+		}
+		for (const auto& entry : entries) {
+			if (entry.m_type == YgoPackEntry::FILE_ENTRY) {
+				relPaths.push_back(targetName + "/" + entry.m_path);
+				if (sizes) sizes->push_back(entry.m_size);
+			}
+		}
+	}
+	if (IsColdTarget(archivePath, targetName)) {
+		std::vector<YgoColdEntry> coldEntries;
+		fs::path storeDir;
+		if (!ReadColdTable(GetColdPath(archivePath, targetName), coldEntries, storeDir)) {
+			return false;
+		}
+		for (const auto& entry : coldEntries) {
+			if (entry.m_type == YgoColdEntry::FILE_ENTRY) {
+				relPaths.push_back(targetName + "/" + entry.m_path);
+				if (sizes) sizes->push_back(entry.m_size);
+			}
+		}
+	}
+	std::error_code ec;
+	if (fs::is_directory(looseDir, ec)) {
+		std::vector<YgoTreeEntry> items;
+		if (!WalkTree(looseDir, items, sizes != nullptr)) {
+			return false;
+		}
+		for (const auto& item : items) {
+			if (item.m_type == YgoTreeEntry::FILE_ENTRY) {
+				relPaths.push_back(targetName + "/" + item.m_path);
+				if (sizes) sizes->push_back(item.m_size);
+			}
+		}
+	}
+	return true;
+}
+
+bool ForEachArchiveFile(const std::string& archivePath, const std::string& targetName,
+	const std::function<bool(const std::string& relPath)>& filter,
+	const std::function<bool(const std::string& relPath, const char* data, const size_t size)>& visit)
+{
+	std::unordered_set<std::string> visited;
+	const fs::path looseDir = fs::path(archivePath) / targetName;
+	std::error_code ec;
+	if (fs::is_directory(looseDir, ec)) {
+		std::vector<YgoTreeEntry> items;
+		if (!WalkTree(looseDir, items, false)) {
+			return false;
+		}
+		for (const auto& item : items) {
+			const std::string relPath = targetName + "/" + item.m_path;
+			if (item.m_type != YgoTreeEntry::FILE_ENTRY || !filter(relPath)) continue;
+			YgoFileView content;
+			if (!content.Open(looseDir / item.m_path)) {
+				printf("Read %s failed.\n", relPath.c_str());
+				return false;
+			}
+			if (!visit(relPath, content.Data(), content.Size())) {
+				return false;
+			}
+			visited.insert(relPath);
+		}
+	}
+
+	const fs::path packPath = GetPackPath(archivePath, targetName);
+	if (fs::exists(packPath, ec)) {
+		YgoFileView pack;
+		std::vector<YgoPackEntry> entries;
+		uint64_t dataOffset = 0;
+		if (!pack.Open(packPath) || !ParsePackTable(pack.Data(), pack.Size(), entries, dataOffset)) {
+			printf("Pack %s is damaged.\n", packPath.string().c_str());
+			return false;
+		}
+		for (const auto& entry : entries) {
+			const std::string relPath = targetName + "/" + entry.m_path;
+			if (entry.m_type != YgoPackEntry::FILE_ENTRY || visited.count(relPath) || !filter(relPath)) continue;
+			if (dataOffset + entry.m_offset + entry.m_size > pack.Size()) {
+				printf("Pack %s is damaged at %s.\n", packPath.string().c_str(), entry.m_path.c_str());
+				return false;
+			}
+			if (!visit(relPath, pack.Data() + dataOffset + entry.m_offset, static_cast<size_t>(entry.m_size))) {
+				return false;
+			}
+			visited.insert(relPath);
+		}
+	}
+
+	if (IsColdTarget(archivePath, targetName)) {
+		std::vector<YgoColdEntry> entries;
+		fs::path storeDir;
+		if (!ReadColdTable(GetColdPath(archivePath, targetName), entries, storeDir)) {
+			return false;
+		}
+		//Only the objects of selected files are inflated
+		for (const auto& entry : entries) {
+			const std::string relPath = targetName + "/" + entry.m_path;
+			if (entry.m_type != YgoColdEntry::FILE_ENTRY || visited.count(relPath) || !filter(relPath)) continue;
+			std::string content;
+			if (!ReadColdObject(storeDir, entry, content)) {
+				printf("Read object of %s failed.\n", relPath.c_str());
+				return false;
+			}
+			if (!visit(relPath, content.data(), content.size())) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+bool WriteArchiveFile(const std::string& archivePath, const std::string& relPath, const std::string& content)
+{
+	if (!ThawForWrite(archivePath, relPath)) {
+		return false;
+	}
+	const fs::path loosePath = fs::path(archivePath) / relPath;
+	fs::path packPath;
+	std::string innerPath;
+	if (fs::exists(loosePath) || !SplitArchivePath(archivePath, relPath, packPath, innerPath) || !fs::exists(packPath)) {
+		std::error_code ec;
+		fs::create_directories(loosePath.parent_path(), ec);
+		return ReplaceFileContent(loosePath, content);
+	}
+
+	//Rebuild the pack with the new content, offsets of later entries shift
+	YgoFileView pack;
+	std::vector<YgoPackEntry> entries;
+	uint64_t dataOffset = 0;
+	if (!pack.Open(packPath) || !ParsePackTable(pack.Data(), pack.Size(), entries, dataOffset)) {
+		printf("Read pack %s failed.\n", packPath.string().c_str());
+		return false;
+	}
+	bool found = false;
+	std::string data;
+	for (auto& entry : entries) {
+		if (entry.m_type != YgoPackEntry::FILE_ENTRY) {
+			continue;
+		}
+		const uint64_t offset = data.size();
+		if (entry.m_path == innerPath) {
+			data.append(content);
+			found = true;
+		}
+		else {
+			data.append(pack.Data() + dataOffset + entry.m_offset, static_cast<size_t>(entry.m_size));
+		}
+		entry.m_offset = offset;
+		entry.m_size = data.size() - offset;
+	}
+	if (!found) {
+		YgoPackEntry entry;
+		entry.m_path = innerPath;
+		entry.m_offset = data.size();
+		entry.m_size = content.size();
+		data.append(content);
+		entries.push_back(std::move(entry));
+	}
+	pack.Close();
+	return WritePack(packPath, entries, data);
+}
+
+bool PatchArchiveFile(const std::string& archivePath, const std::string& relPath, const uint64_t offset, const std::string& bytes)
+{
+	if (!ThawForWrite(archivePath, relPath)) {
+		return false;
+	}
+	fs::path filePath = fs::path(archivePath) / relPath;
+	uint64_t fileOffset = offset;
+	uint64_t fileSize = 0;
+	std::error_code ec;
+	if (fs::exists(filePath)) {
+		fileSize = fs::file_size(filePath, ec);
+		//Writing through a shared hard link would change every archive sharing it
+		if (!ec && fs::hard_link_count(filePath, ec) > 1) {
+			fs::path tempPath = filePath;
+			tempPath += ".tmp";
+			fs::copy_file(filePath, tempPath, fs::copy_options::overwrite_existing, ec);
+			if (!ec) {
+				fs::rename(tempPath, filePath, ec);
+			}
+		}
+	}
+	else {
+		std::string innerPath;
+		std::vector<YgoPackEntry> entries;
+		uint64_t dataOffset = 0;
+		if (!SplitArchivePath(archivePath, relPath, filePath, innerPath)
+			|| !ReadPackTable(filePath, entries, dataOffset)) {
+			return false;
+		}
+		const YgoPackEntry* entry = FindPackEntry(entries, innerPath);
+		if (!entry) {
+			return false;
+		}
+		fileOffset += dataOffset + entry->m_offset;
+		fileSize = dataOffset + entry->m_offset + entry->m_size;
+	}
+	//Never write past the end of the file or of the pack entry
+	if (ec || fileOffset + bytes.size() > fileSize) {
+		return false;
+	}
+	std::fstream file(filePath, std::ios::in | std::ios::out | std::ios::binary);
+	if (!file.is_open()) {
+		return false;
+	}
+	file.seekp(static_cast<std::streamoff>(fileOffset), std::ios::beg);
+	file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+	return static_cast<bool>(file);
+}
@@ -0,0 +1,85 @@
+#ifndef YGOMASTER_PACK_H
+#define YGOMASTER_PACK_H
+
+#include"public.h"
+#include<functional>
+
+class YgoFileView;
+class YgoIoThrottle;
+
+/*
+* Small-file packing of archived directories.
+* Files smaller than a threshold are stored in "<target>.pack" next to the archived directory,
+* larger files stay standalone under "<target>/". A pack is
+*   header: magic "YMPK", version u32, entry count u32, data offset u64
+*   table:  per entry type u8, path length u16, path (generic '/' separators), offset u64, size u64
+*   data:   file contents back to back
+* all integers little-endian, offsets relative to data offset.
+*/
+
+// Default size below which files are packed, 0 in config disables packing
+constexpr uint64_t DEFAULT_SMALL_FILE_THRESHOLD = 64 * 1024;
+static const std::string sc_packExtension = ".pack";
+
+struct YgoPackEntry
+{
+	enum Type :uint8_t { FILE_ENTRY = 0, DIRECTORY_ENTRY = 1 };
+	uint8_t m_type;
+	std::string m_path; // relative to the packed directory, '/' separated
+	uint64_t m_offset;
+	uint64_t m_size;
+
+	YgoPackEntry() :m_type(FILE_ENTRY), m_path(""), m_offset(0), m_size(0) {}
+};
+
+struct YgoPackStats
+{
+	uint64_t m_packedFiles;
+	uint64_t m_packedBytes;
+	uint64_t m_looseFiles;
+	uint64_t m_looseBytes;
+	uint64_t m_linkedFiles; // standalone files hard linked to the reference archive, counted in m_looseFiles too
+
+	YgoPackStats() :m_packedFiles(0), m_packedBytes(0), m_looseFiles(0), m_looseBytes(0), m_linkedFiles(0) {}
+};
+
+// Path of the pack holding small files of targetName in archiveDir
+std::filesystem::path GetPackPath(const std::filesystem::path& archiveDir, const std::string& targetName);
+
+// Archive sourceDir as archiveDir/targetName, replacing a previous copy of it.
+// Standalone files identical to referenceDir/targetName/... are hard linked to it instead of copied.
+// Reads and writes stay within the I/O budget of throttle if given.
+bool PackDirectory(const std::filesystem::path& sourceDir, const std::filesystem::path& archiveDir,
+	const std::string& targetName, const uint64_t threshold, YgoPackStats* stats = nullptr,
+	const std::filesystem::path& referenceDir = std::filesystem::path(), YgoIoThrottle* throttle = nullptr);
+// Restore archiveDir/targetName (cold copy, pack and standalone files) into destDir, existing files are overwritten
+bool UnpackDirectory(const std::filesystem::path& archiveDir, const std::string& targetName, const std::filesystem::path& destDir,
+	YgoIoThrottle* throttle = nullptr);
+
+// Check that the table of a pack parses and every file lies inside it, error describes the first problem
+bool VerifyPack(const std::filesystem::path& packPath, std::string& error);
+// Read the entry table of a pack, dataOffset receives the start of file contents
+bool ReadPackTable(const std::filesystem::path& packPath, std::vector<YgoPackEntry>& entries, uint64_t& dataOffset);
+// Write a pack from entries and the matching data blob, atomically replaces packPath
+bool WritePack(const std::filesystem::path& packPath, const std::vector<YgoPackEntry>& entries, const std::string& data);
+
+// Read relPath ("Players/Local/Player.json") of an archive, from a standalone file, the pack or the cold copy of its target
+bool ReadArchiveFile(const std::string& archivePath, const std::string& relPath, YgoFileView& content);
+// Check whether relPath exists in an archive, standalone or packed
+bool ArchiveFileExists(const std::string& archivePath, const std::string& relPath);
+// List files of archivePath/targetName, standalone and packed, as "targetName/..." generic paths, sizes in the same order
+bool ListArchiveFiles(const std::string& archivePath, const std::string& targetName, std::vector<std::string>& relPaths,
+	std::vector<uint64_t>* sizes = nullptr);
+// Call visit with the content of every file of archivePath/targetName whose "targetName/..." path passes filter.
+// Only files that pass are read, standalone ones win over packed or frozen copies of the same path.
+bool ForEachArchiveFile(const std::string& archivePath, const std::string& targetName,
+	const std::function<bool(const std::string& relPath)>& filter,
+	const std::function<bool(const std::string& relPath, const char* data, const size_t size)>& visit);
+// Replace relPath of an archive, wherever it is stored, through a temporary file.
+// A frozen target is thawed to standalone files first.
+bool WriteArchiveFile(const std::string& archivePath, const std::string& relPath, const std::string& content);
+// Overwrite bytes.size() bytes of relPath at offset without changing its size, wherever it is stored.
+// A standalone file shared with other archives through a hard link is detached first.
+bool PatchArchiveFile(const std::string& archivePath, const std::string& relPath, const uint64_t offset, const std::string& bytes);
+
+#endif // !YGOMASTER_PACK_H
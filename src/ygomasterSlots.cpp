@@ -0,0 +1,69 @@
+#include "ygomasterSlots.h"
+#include "ygomasterTreeWalker.h"
+
+namespace fs = std::filesystem;
+
+fs::path GetSlotPath(const std::string& archivesPath, const int archiveID, const std::string& targetName)
+{
+	return fs::path(archivesPath) / sc_slotsDirName / std::to_string(archiveID) / targetName;
+}
+
+int GetLinkedSlot(const fs::path& livePath, const std::string& archivesPath)
+{
+	std::error_code ec;
+	if (!fs::is_symlink(fs::symlink_status(livePath, ec))) {
+		return -1;
+	}
+	const fs::path target = fs::read_symlink(livePath, ec);
+	if (ec) {
+		return -1;
+	}
+	//<ArchivesPath>/Slots/<ArchiveID>/<target>
+	const fs::path slotsDir = fs::absolute(fs::path(archivesPath) / sc_slotsDirName, ec).lexically_normal();
+	const fs::path idDir = target.lexically_normal().parent_path();
+	if (idDir.parent_path() != slotsDir) {
+		return -1;
+	}
+	const std::string id = idDir.filename().string();
+	if (id.empty() || id.find_first_not_of("0123456789") != std::string::npos) {
+		return -1;
+	}
+	return std::stoi(id);
+}
+
+bool RelinkDirectory(const fs::path& linkPath, const fs::path& targetPath)
+{
+	//Build the new link aside and rename it over the old one, the live path never disappears
+	fs::path tempPath = linkPath;
+	tempPath += ".relink";
+	std::error_code ec;
+	fs::remove(tempPath, ec);
+	//Absolute, a relative target would be resolved against the directory of the link
+	fs::create_directory_symlink(fs::absolute(targetPath, ec).lexically_normal(), tempPath, ec);
+	if (ec) {
+		printf("Create link %s failed: %s\n", tempPath.string().c_str(), ec.message().c_str());
+		return false;
+	}
+	fs::rename(tempPath, linkPath, ec);
+	if (ec) {
+		printf("Switch link %s failed: %s\n", linkPath.string().c_str(), ec.message().c_str());
+		fs::remove(tempPath, ec);
+		return false;
+	}
+	return true;
+}
+
+bool MoveDirectory(const fs::path& sourceDir, const fs::path& destDir)
+{
+	std::error_code ec;
+	fs::create_directories(destDir.parent_path(), ec);
+	fs::rename(sourceDir, destDir, ec);
+	if (!ec) {
+		return true;
+	}
+	if (ec != std::errc::cross_device_link) {
+		printf("Move %s to %s failed: %s\n", sourceDir.string().c_str(), destDir.string().c_str(), ec.message().c_str());
+		return false;
+	}
+	return CopyTree(sourceDir, destDir) && RemoveTree(sourceDir);
+}
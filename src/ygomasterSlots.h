@@ -0,0 +1,24 @@
+#ifndef YGOMASTER_SLOTS_H
+#define YGOMASTER_SLOTS_H
+
+#include"public.h"
+
+/*
+* Working copies for instant archive switching.
+* Archive directories stay immutable, a switch materializes the archive once into a writable slot
+* <ArchivesPath>/Slots/<ArchiveID>/<target> and points Data/<target> at it with a symlink.
+* Later switches only swap the symlink, so their cost does not depend on the size of the save.
+*/
+
+static const std::string sc_slotsDirName = "Slots";
+
+// Slot of targetName for archiveID
+std::filesystem::path GetSlotPath(const std::string& archivesPath, const int archiveID, const std::string& targetName);
+// ArchiveID whose slot livePath links to, -1 if livePath is not a symlink into the slots of archivesPath
+int GetLinkedSlot(const std::filesystem::path& livePath, const std::string& archivesPath);
+// Point linkPath at the absolute path of targetPath, an existing symlink at linkPath is replaced atomically
+bool RelinkDirectory(const std::filesystem::path& linkPath, const std::filesystem::path& targetPath);
+// Move a directory with one rename, copying only when source and destination are on different filesystems
+bool MoveDirectory(const std::filesystem::path& sourceDir, const std::filesystem::path& destDir);
+
+#endif // !YGOMASTER_SLOTS_H
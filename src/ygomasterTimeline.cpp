@@ -0,0 +1,189 @@
+#include "ygomasterTimeline.h"
+#include "ygomasterBinary.h"
+#include "ygomasterFileView.h"
+#include "ygomasterCardIndex.h"
+#include "ygomasterJsonTree.h"
+#include <cjson/cJSON.h>
+
+namespace fs = std::filesystem;
+
+static const char sc_timelineMagic[4] = { 'Y', 'M', 'T', 'L' };
+constexpr uint32_t TIMELINE_VERSION = 1;
+constexpr size_t TIMELINE_ENTRY_SIZE = 4 + 8 + 8 + 4 + 8 + 4;
+
+uint64_t GetTimelineKey(const std::string& archivePath)
+{
+	std::error_code treeError, cardsError;
+	const auto treeTime = fs::last_write_time(fs::path(archivePath) / sc_playerTreeFileName, treeError);
+	const auto cardsTime = fs::last_write_time(fs::path(archivePath) / sc_cardInventoryFileName, cardsError);
+	if (treeError || cardsError) {
+		return 0;
+	}
+	const int64_t times[2] = { treeTime.time_since_epoch().count(), cardsTime.time_since_epoch().count() };
+	const uint64_t key = HashFnv1a(times, sizeof(times), HashFnv1a(archivePath.data(), archivePath.size()));
+	//0 means no key
+	return key ? key : 1;
+}
+
+bool ReadTimelineMetrics(const std::string& archivePath, const std::string& playerRelPath, const std::string& decksRelDir,
+	YgoTimelinePoint& point)
+{
+	point.m_valid = false;
+	YgoJsonTree tree;
+	if (!LoadPlayerTree(archivePath, playerRelPath, decksRelDir, tree)) {
+		return false;
+	}
+	YgoCardInventory inventory;
+	if (!ReadCardInventory(archivePath, inventory)) {
+		if (!ExtractCardInventory(archivePath, playerRelPath, decksRelDir, inventory)) {
+			return false;
+		}
+		WriteCardInventory(archivePath, inventory);
+	}
+	std::string gemsText;
+	point.m_gems = tree.FindText({ "Player", "Gems" }, gemsText) ? strtoll(gemsText.c_str(), nullptr, 10) : 0;
+	uint64_t decks = 0;
+	tree.FindMemberCount({ "Decks" }, decks);
+	point.m_decks = static_cast<uint32_t>(decks);
+	point.m_distinctCards = static_cast<uint32_t>(inventory.m_cardIds.size());
+	point.m_totalCards = 0;
+	for (uint16_t count : inventory.m_counts) {
+		point.m_totalCards += count;
+	}
+	point.m_valid = true;
+	return true;
+}
+
+YgoTimelineCache::YgoTimelineCache()
+	:m_cachePath("")
+{
+}
+
+bool YgoTimelineCache::Load(const std::string& cachePath)
+{
+	m_cachePath = cachePath;
+	m_entries.clear();
+	YgoFileView view;
+	if (!view.Open(cachePath)) {
+		return true;
+	}
+	YgoBinaryReader reader(view.Data(), view.Size());
+	uint64_t version = 0, count = 0;
+	if (view.Size() < sizeof(sc_timelineMagic) || memcmp(view.Data(), sc_timelineMagic, sizeof(sc_timelineMagic)) != 0
+		|| !reader.Skip(sizeof(sc_timelineMagic)) || !reader.Read(version, 4) || version != TIMELINE_VERSION
+		|| !reader.Read(count, 4) || reader.Remaining() < count * TIMELINE_ENTRY_SIZE) {
+		//Rebuilt from the side files of the archives
+		printf("Timeline cache %s is damaged, rebuilding.\n", cachePath.c_str());
+		return true;
+	}
+	m_entries.reserve(static_cast<size_t>(count));
+	for (uint64_t i = 0; i < count; ++i) {
+		uint64_t archiveID = 0, gems = 0, distinct = 0, decks = 0;
+		Entry entry;
+		reader.Read(archiveID, 4);
+		reader.Read(entry.m_key, 8);
+		reader.Read(gems, 8);
+		reader.Read(distinct, 4);
+		reader.Read(entry.m_totalCards, 8);
+		reader.Read(decks, 4);
+		entry.m_gems = static_cast<int64_t>(gems);
+		entry.m_distinctCards = static_cast<uint32_t>(distinct);
+		entry.m_decks = static_cast<uint32_t>(decks);
+		m_entries[static_cast<int>(static_cast<int32_t>(archiveID))] = entry;
+	}
+	return true;
+}
+
+bool YgoTimelineCache::Save() const
+{
+	if (m_cachePath.empty()) {
+		return false;
+	}
+	std::string out;
+	out.reserve(12 + m_entries.size() * TIMELINE_ENTRY_SIZE);
+	out.append(sc_timelineMagic, sizeof(sc_timelineMagic));
+	PutLE(out, TIMELINE_VERSION, 4);
+	PutLE(out, m_entries.size(), 4);
+	for (const auto& entry : m_entries) {
+		PutLE(out, static_cast<uint32_t>(entry.first), 4);
+		PutLE(out, entry.second.m_key, 8);
+		PutLE(out, static_cast<uint64_t>(entry.second.m_gems), 8);
+		PutLE(out, entry.second.m_distinctCards, 4);
+		PutLE(out, entry.second.m_totalCards, 8);
+		PutLE(out, entry.second.m_decks, 4);
+	}
+	if (!ReplaceFileContent(m_cachePath, out)) {
+		printf("Write timeline cache %s failed.\n", m_cachePath.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool YgoTimelineCache::Find(const int archiveID, const uint64_t key, YgoTimelinePoint& point) const
+{
+	auto found = m_entries.find(archiveID);
+	if (0 == key || found == m_entries.end() || found->second.m_key != key) {
+		return false;
+	}
+	point.m_gems = found->second.m_gems;
+	point.m_distinctCards = found->second.m_distinctCards;
+	point.m_totalCards = found->second.m_totalCards;
+	point.m_decks = found->second.m_decks;
+	point.m_valid = true;
+	return true;
+}
+
+void YgoTimelineCache::Store(const uint64_t key, const YgoTimelinePoint& point)
+{
+	if (0 == key || !point.m_valid) {
+		m_entries.erase(point.m_archiveID);
+		return;
+	}
+	m_entries[point.m_archiveID] = Entry{ key, point.m_gems, point.m_distinctCards, point.m_totalCards, point.m_decks };
+}
+
+void YgoTimelineCache::Retain(const std::unordered_set<int>& archiveIDs)
+{
+	for (auto it = m_entries.begin(); it != m_entries.end();) {
+		it = archiveIDs.count(it->first) ? std::next(it) : m_entries.erase(it);
+	}
+}
+
+std::string FormatTimelineCsv(const std::vector<YgoTimelinePoint>& points)
+{
+	std::string out = "ArchiveID,LastBackupTime,Name,Gems,DistinctCards,TotalCards,Decks\n";
+	for (const auto& point : points) {
+		if (!point.m_valid) continue;
+		//Names are quoted, quotes inside are doubled
+		std::string name;
+		for (char c : point.m_name) {
+			name += (c == '"') ? "\"\"" : std::string(1, c);
+		}
+		out += std::to_string(point.m_archiveID) + "," + point.m_time + ",\"" + name + "\","
+			+ std::to_string(point.m_gems) + "," + std::to_string(point.m_distinctCards) + ","
+			+ std::to_string(point.m_totalCards) + "," + std::to_string(point.m_decks) + "\n";
+	}
+	return out;
+}
+
+std::string FormatTimelineJson(const std::vector<YgoTimelinePoint>& points)
+{
+	cJSON* array = cJSON_CreateArray();
+	for (const auto& point : points) {
+		if (!point.m_valid) continue;
+		cJSON* item = cJSON_CreateObject();
+		cJSON_AddNumberToObject(item, "ArchiveID", point.m_archiveID);
+		cJSON_AddStringToObject(item, "LastBackupTime", point.m_time.c_str());
+		cJSON_AddStringToObject(item, "Name", point.m_name.c_str());
+		cJSON_AddNumberToObject(item, "Gems", static_cast<double>(point.m_gems));
+		cJSON_AddNumberToObject(item, "DistinctCards", point.m_distinctCards);
+		cJSON_AddNumberToObject(item, "TotalCards", static_cast<double>(point.m_totalCards));
+		cJSON_AddNumberToObject(item, "Decks", point.m_decks);
+		cJSON_AddItemToArray(array, item);
+	}
+	char* text = cJSON_Print(array);
+	const std::string out = text ? text : "[]";
+	cJSON_free(text);
+	cJSON_Delete(array);
+	return out;
+}
@@ -0,0 +1,71 @@
+#ifndef YGOMASTER_TIMELINE_H
+#define YGOMASTER_TIMELINE_H
+
+#include"public.h"
+
+/*
+* Metrics of every archive over time: gems, collection size and deck count.
+* Metrics of an archive come from its side files, Player.tree for gems and decks and Cards.idx for cards,
+* which are rewritten whenever Player.json of the archive changes. The archives directory holds
+* "Timeline.bin", the metrics of every archive keyed on the path and write times of those side files,
+* so a run only reads archives that are new or changed since the last one:
+*   header:  magic "YMTL", version u32, entry count u32
+*   entries: per archive ArchiveID u32, key u64, gems i64, distinct cards u32, total cards u64, decks u32
+*/
+
+static const std::string sc_timelineCacheFileName = "Timeline.bin";
+
+struct YgoTimelinePoint
+{
+	int m_archiveID;
+	std::string m_time; // LastBackupTime of the archive
+	std::string m_name;
+	int64_t m_gems;
+	uint32_t m_distinctCards; // different cards owned
+	uint64_t m_totalCards; // copies of all cards
+	uint32_t m_decks;
+	bool m_valid; // false if the archive could not be read
+
+	YgoTimelinePoint() :m_archiveID(-1), m_time(""), m_name(""), m_gems(0), m_distinctCards(0), m_totalCards(0), m_decks(0), m_valid(false) {}
+};
+
+// Cache key of the metrics of archivePath, changes whenever its side files are written again, 0 if they are missing
+uint64_t GetTimelineKey(const std::string& archivePath);
+// Read the metrics of an archive into point, side files missing in older archives are written
+bool ReadTimelineMetrics(const std::string& archivePath, const std::string& playerRelPath, const std::string& decksRelDir,
+	YgoTimelinePoint& point);
+
+class YgoTimelineCache
+{
+public:
+	YgoTimelineCache();
+
+	// Load from cachePath, a missing or damaged file gives an empty cache
+	bool Load(const std::string& cachePath);
+	bool Save() const;
+
+	// Fill the metrics of point if archiveID is cached with key
+	bool Find(const int archiveID, const uint64_t key, YgoTimelinePoint& point) const;
+	void Store(const uint64_t key, const YgoTimelinePoint& point);
+	// Drop archives not in archiveIDs
+	void Retain(const std::unordered_set<int>& archiveIDs);
+
+private:
+	struct Entry
+	{
+		uint64_t m_key;
+		int64_t m_gems;
+		uint32_t m_distinctCards;
+		uint64_t m_totalCards;
+		uint32_t m_decks;
+	};
+
+	std::string m_cachePath;
+	std::unordered_map<int, Entry> m_entries;
+};
+
+// Timeline as CSV with a header line, or as a JSON array of objects
+std::string FormatTimelineCsv(const std::vector<YgoTimelinePoint>& points);
+std::string FormatTimelineJson(const std::vector<YgoTimelinePoint>& points);
+
+#endif // !YGOMASTER_TIMELINE_H
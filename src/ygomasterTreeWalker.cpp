@@ -0,0 +1,265 @@
+#include "ygomasterTreeWalker.h"
+#include "ygomasterIoThrottle.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+
+#if defined(__linux__)
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+namespace fs = std::filesystem;
+
+static size_t WorkerCount(const int threads, const size_t work)
+{
+	size_t count = (threads > 0) ? static_cast<size_t>(threads) : std::thread::hardware_concurrency();
+	count = std::max<size_t>(count, 1);
+	return std::min(count, std::max<size_t>(work, 1));
+}
+
+bool ParallelFor(const size_t count, const std::function<bool(size_t)>& work, const int threads)
+{
+	std::atomic<size_t> next(0);
+	std::atomic<bool> ok(true);
+	auto worker = [&]() {
+		for (size_t i = next++; i < count; i = next++) {
+			if (!work(i)) {
+				ok = false;
+			}
+		}
+	};
+	std::vector<std::thread> workers;
+	for (size_t i = 1; i < WorkerCount(threads, count); ++i) {
+		workers.emplace_back(worker);
+	}
+	worker();
+	for (auto& thread : workers) {
+		thread.join();
+	}
+	return ok;
+}
+
+#if defined(__linux__)
+
+// Layout of the records returned by getdents64
+struct YgoLinuxDirent64
+{
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+constexpr size_t GETDENTS_BUFFER_SIZE = 64 * 1024;
+
+// Read one directory, subdirectories are appended to subDirs as paths relative to root
+static bool ReadDirectory(const fs::path& root, const std::string& relDir, const bool wantSizes,
+	std::vector<YgoTreeEntry>& entries, std::vector<std::string>& subDirs)
+{
+	const fs::path dirPath = relDir.empty() ? root : root / relDir;
+	int fd = open(dirPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0) {
+		printf("Open directory %s failed: %s\n", dirPath.string().c_str(), strerror(errno));
+		return false;
+	}
+	std::vector<char> buffer(GETDENTS_BUFFER_SIZE);
+	while (true) {
+		const long got = syscall(SYS_getdents64, fd, buffer.data(), buffer.size());
+		if (got < 0 && errno == EINTR) {
+			continue;
+		}
+		if (got < 0) {
+			printf("Read directory %s failed: %s\n", dirPath.string().c_str(), strerror(errno));
+			close(fd);
+			return false;
+		}
+		if (0 == got) {
+			break;
+		}
+		for (long pos = 0; pos < got;) {
+			const YgoLinuxDirent64* dirent = reinterpret_cast<const YgoLinuxDirent64*>(buffer.data() + pos);
+			pos += dirent->d_reclen;
+			const char* name = dirent->d_name;
+			if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+				continue;
+			}
+			unsigned char type = dirent->d_type;
+			struct stat st;
+			bool statDone = false;
+			//Some filesystems do not fill d_type
+			if (DT_UNKNOWN == type) {
+				if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+					continue;
+				}
+				statDone = true;
+				type = S_ISDIR(st.st_mode) ? DT_DIR : (S_ISREG(st.st_mode) ? DT_REG : DT_LNK);
+			}
+			YgoTreeEntry entry;
+			entry.m_path = relDir.empty() ? std::string(name) : relDir + "/" + name;
+			if (DT_DIR == type) {
+				entry.m_type = YgoTreeEntry::DIRECTORY_ENTRY;
+				subDirs.push_back(entry.m_path);
+			}
+			else if (DT_REG == type) {
+				entry.m_type = YgoTreeEntry::FILE_ENTRY;
+				if (wantSizes) {
+					if (!statDone && fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+						continue;
+					}
+					entry.m_size = static_cast<uint64_t>(st.st_size);
+				}
+			}
+			else {
+				entry.m_type = YgoTreeEntry::OTHER_ENTRY;
+			}
+			entries.push_back(std::move(entry));
+		}
+	}
+	close(fd);
+	return true;
+}
+
+bool WalkTree(const fs::path& root, std::vector<YgoTreeEntry>& entries, const bool wantSizes, const int threads)
+{
+	entries.clear();
+	//Directories waiting to be read, workers sleep while it is empty and others are still reading
+	std::mutex queueMutex;
+	std::condition_variable queueCond;
+	std::vector<std::string> pending = { "" };
+	int busy = 0;
+	bool ok = true;
+
+	auto worker = [&]() {
+		std::vector<YgoTreeEntry> local;
+		std::vector<std::string> subDirs;
+		std::unique_lock<std::mutex> lock(queueMutex);
+		while (true) {
+			queueCond.wait(lock, [&]() { return !pending.empty() || 0 == busy; });
+			if (pending.empty()) {
+				break;
+			}
+			const std::string relDir = std::move(pending.back());
+			pending.pop_back();
+			++busy;
+			lock.unlock();
+
+			subDirs.clear();
+			const bool read = ReadDirectory(root, relDir, wantSizes, local, subDirs);
+
+			lock.lock();
+			ok = ok && read;
+			for (auto& dir : subDirs) {
+				pending.push_back(std::move(dir));
+			}
+			--busy;
+			queueCond.notify_all();
+		}
+		entries.insert(entries.end(), std::make_move_iterator(local.begin()), std::make_move_iterator(local.end()));
+	};
+
+	std::vector<std::thread> workers;
+	for (size_t i = 1; i < WorkerCount(threads, SIZE_MAX); ++i) {
+		workers.emplace_back(worker);
+	}
+	worker();
+	for (auto& thread : workers) {
+		thread.join();
+	}
+	std::sort(entries.begin(), entries.end(), [](const YgoTreeEntry& a, const YgoTreeEntry& b) { return a.m_path < b.m_path; });
+	return ok;
+}
+
+#else
+
+bool WalkTree(const fs::path& root, std::vector<YgoTreeEntry>& entries, const bool wantSizes, const int threads)
+{
+	entries.clear();
+	std::error_code ec;
+	for (auto it = fs::recursive_directory_iterator(root, ec); !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+		YgoTreeEntry entry;
+		entry.m_path = fs::relative(it->path(), root, ec).generic_string();
+		if (it->is_directory(ec)) {
+			entry.m_type = YgoTreeEntry::DIRECTORY_ENTRY;
+		}
+		else if (it->is_regular_file(ec)) {
+			entry.m_type = YgoTreeEntry::FILE_ENTRY;
+			entry.m_size = wantSizes ? it->file_size(ec) : 0;
+		}
+		else {
+			entry.m_type = YgoTreeEntry::OTHER_ENTRY;
+		}
+		entries.push_back(std::move(entry));
+	}
+	if (ec) {
+		printf("Walk %s failed: %s\n", root.string().c_str(), ec.message().c_str());
+		return false;
+	}
+	std::sort(entries.begin(), entries.end(), [](const YgoTreeEntry& a, const YgoTreeEntry& b) { return a.m_path < b.m_path; });
+	return true;
+}
+
+#endif
+
+bool RemoveTree(const fs::path& root, const int threads)
+{
+	std::error_code ec;
+	if (!fs::is_directory(fs::symlink_status(root, ec))) {
+		fs::remove(root, ec);
+		return !ec;
+	}
+	std::vector<YgoTreeEntry> entries;
+	WalkTree(root, entries, false, threads);
+	std::vector<const YgoTreeEntry*> files;
+	for (const auto& entry : entries) {
+		if (entry.m_type != YgoTreeEntry::DIRECTORY_ENTRY) {
+			files.push_back(&entry);
+		}
+	}
+	ParallelFor(files.size(), [&](size_t i) {
+		std::error_code removeError;
+		fs::remove(root / files[i]->m_path, removeError);
+		return !removeError;
+	}, threads);
+	//Deepest directories first, they are empty by now
+	for (auto it = entries.rbegin(); it != entries.rend(); ++it) {
+		if (it->m_type == YgoTreeEntry::DIRECTORY_ENTRY) {
+			fs::remove(root / it->m_path, ec);
+		}
+	}
+	//Anything a walk could not see is left to std::filesystem
+	fs::remove_all(root, ec);
+	return !ec && !fs::exists(root, ec);
+}
+
+bool CopyTree(const fs::path& sourceDir, const fs::path& destDir, const int threads, YgoIoThrottle* throttle)
+{
+	std::vector<YgoTreeEntry> entries;
+	if (!WalkTree(sourceDir, entries, false, threads)) {
+		return false;
+	}
+	std::error_code ec;
+	fs::create_directories(destDir, ec);
+	std::vector<const YgoTreeEntry*> files;
+	for (const auto& entry : entries) {
+		if (entry.m_type == YgoTreeEntry::DIRECTORY_ENTRY) {
+			fs::create_directories(destDir / entry.m_path, ec);
+		}
+		else if (entry.m_type == YgoTreeEntry::FILE_ENTRY) {
+			files.push_back(&entry);
+		}
+	}
+	return ParallelFor(files.size(), [&](size_t i) {
+		if (!CopyFileWithBudget(sourceDir / files[i]->m_path, destDir / files[i]->m_path, throttle)) {
+			printf("Copy %s failed.\n", files[i]->m_path.c_str());
+			return false;
+		}
+		return true;
+	}, threads);
+}
@@ -0,0 +1,44 @@
+#ifndef YGOMASTER_TREE_WALKER_H
+#define YGOMASTER_TREE_WALKER_H
+
+#include"public.h"
+#include<functional>
+
+class YgoIoThrottle;
+
+/*
+* Directory tree enumeration for backup, restore, delete and verify.
+* On Linux directories are read in large batches with getdents64, entry types come from d_type
+* so only regular files are stat'ed (and only when sizes are wanted), and subdirectories are
+* spread across worker threads. Other platforms fall back to std::filesystem.
+*/
+
+// Worker threads used when a walk does not ask for a count, 0 means hardware concurrency
+constexpr int TREE_WALKER_DEFAULT_THREADS = 0;
+
+struct YgoTreeEntry
+{
+	enum Type :uint8_t { FILE_ENTRY = 0, DIRECTORY_ENTRY = 1, OTHER_ENTRY = 2 };
+	uint8_t m_type;
+	std::string m_path; // relative to the walked root, '/' separated
+	uint64_t m_size; // files only, 0 unless sizes were requested
+
+	YgoTreeEntry() :m_type(FILE_ENTRY), m_path(""), m_size(0) {}
+};
+
+// Flat list of everything under root, sorted by path so a directory comes before its contents
+bool WalkTree(const std::filesystem::path& root, std::vector<YgoTreeEntry>& entries,
+	const bool wantSizes = true, const int threads = TREE_WALKER_DEFAULT_THREADS);
+
+// Remove root and everything under it, files are unlinked in parallel, return false if anything is left
+bool RemoveTree(const std::filesystem::path& root, const int threads = TREE_WALKER_DEFAULT_THREADS);
+
+// Copy every file of sourceDir into destDir, keeping relative paths and overwriting existing files,
+// within the I/O budget of throttle if given
+bool CopyTree(const std::filesystem::path& sourceDir, const std::filesystem::path& destDir,
+	const int threads = TREE_WALKER_DEFAULT_THREADS, YgoIoThrottle* throttle = nullptr);
+
+// Run work(i) for i in [0, count) on worker threads, return false if any call returned false
+bool ParallelFor(const size_t count, const std::function<bool(size_t)>& work, const int threads = TREE_WALKER_DEFAULT_THREADS);
+
+#endif // !YGOMASTER_TREE_WALKER_H
@@ -0,0 +1,259 @@
+#include "ygomasterUsage.h"
+#include "ygomasterColdStore.h"
+#include "ygomasterFileView.h"
+#include "ygomasterBinary.h"
+#include "ygomasterTreeWalker.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace fs = std::filesystem;
+
+static const char sc_usageMagic[4] = { 'Y', 'M', 'U', 'S' };
+constexpr uint32_t USAGE_INDEX_VERSION = 1;
+
+// Same name for every hard link of a file
+static bool GetFileIdentity(const fs::path& path, std::string& result)
+{
+	char buffer[64];
+#if defined(_WIN32)
+	HANDLE file = CreateFileW(path.wstring().c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	BY_HANDLE_FILE_INFORMATION info;
+	const bool ok = GetFileInformationByHandle(file, &info) != 0;
+	CloseHandle(file);
+	if (!ok) {
+		return false;
+	}
+	snprintf(buffer, sizeof(buffer), "f:%lx:%lx%08lx", static_cast<unsigned long>(info.dwVolumeSerialNumber),
+		static_cast<unsigned long>(info.nFileIndexHigh), static_cast<unsigned long>(info.nFileIndexLow));
+#else
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0) {
+		return false;
+	}
+	snprintf(buffer, sizeof(buffer), "f:%llx:%llx", static_cast<unsigned long long>(info.st_dev),
+		static_cast<unsigned long long>(info.st_ino));
+#endif
+	result = buffer;
+	return true;
+}
+
+bool ScanArchiveFootprint(const std::string& archivePath, YgoArchiveFootprint& result)
+{
+	result.m_blobs.clear();
+	std::vector<YgoTreeEntry> items;
+	std::error_code ec;
+	if (!fs::is_directory(archivePath, ec) || !WalkTree(archivePath, items, true)) {
+		return false;
+	}
+	for (const auto& item : items) {
+		if (item.m_type != YgoTreeEntry::FILE_ENTRY) continue;
+		const fs::path path = fs::path(archivePath) / item.m_path;
+		std::string identity;
+		if (!GetFileIdentity(path, identity)) {
+			continue;
+		}
+		result.m_blobs.emplace_back(identity, item.m_size);
+		if (path.extension() != sc_coldExtension) {
+			continue;
+		}
+		std::vector<YgoColdEntry> entries;
+		fs::path storeDir;
+		if (!ReadColdTable(path, entries, storeDir)) {
+			continue;
+		}
+		for (const auto& entry : entries) {
+			if (entry.m_type != YgoColdEntry::FILE_ENTRY) continue;
+			//Objects are compressed, what they take on disk is the object size
+			const uint64_t size = fs::file_size(storeDir / entry.m_key.substr(0, 2) / entry.m_key, ec);
+			result.m_blobs.emplace_back("c:" + entry.m_key, ec ? 0 : size);
+		}
+	}
+	return true;
+}
+
+YgoUsageIndex::YgoUsageIndex()
+	:m_indexPath(""), m_loaded(false), m_totalBytes(0), m_sharedBytes(0)
+{
+}
+
+bool YgoUsageIndex::Load(const std::string& indexPath)
+{
+	m_indexPath = indexPath;
+	m_blobs.clear();
+	m_archives.clear();
+	m_totalBytes = 0;
+	m_sharedBytes = 0;
+	m_loaded = true;
+
+	YgoFileView view;
+	if (!view.Open(indexPath)) {
+		return true;
+	}
+	YgoBinaryReader reader(view.Data(), view.Size());
+	uint64_t version = 0, blobCount = 0, archiveCount = 0, value = 0;
+	bool ok = view.Size() >= sizeof(sc_usageMagic) && memcmp(view.Data(), sc_usageMagic, sizeof(sc_usageMagic)) == 0
+		&& reader.Skip(sizeof(sc_usageMagic)) && reader.Read(version, 4) && version == USAGE_INDEX_VERSION
+		&& reader.Read(blobCount, 4) && reader.Read(archiveCount, 4);
+	std::vector<std::pair<std::string, uint64_t>> blobs;
+	for (uint64_t i = 0; ok && i < blobCount; ++i) {
+		std::string name;
+		uint64_t size = 0;
+		ok = reader.Read(value, 1) && reader.ReadString(name, static_cast<size_t>(value)) && reader.Read(size, 8);
+		blobs.emplace_back(std::move(name), size);
+	}
+	//Holders and totals are recounted by adding the archives again
+	for (uint64_t i = 0; ok && i < archiveCount; ++i) {
+		uint64_t archiveID = 0, count = 0;
+		ok = reader.Read(archiveID, 4) && reader.Read(count, 4);
+		YgoArchiveFootprint footprint;
+		for (uint64_t j = 0; ok && j < count; ++j) {
+			ok = reader.Read(value, 4) && value < blobs.size();
+			if (ok) {
+				footprint.m_blobs.push_back(blobs[static_cast<size_t>(value)]);
+			}
+		}
+		if (ok) {
+			AddArchive(static_cast<int>(static_cast<int32_t>(archiveID)), footprint);
+		}
+	}
+	if (!ok) {
+		//A damaged index is rebuilt from the archive directories
+		printf("Usage index %s is damaged, rebuilding.\n", indexPath.c_str());
+		m_blobs.clear();
+		m_archives.clear();
+		m_totalBytes = 0;
+		m_sharedBytes = 0;
+	}
+	return true;
+}
+
+bool YgoUsageIndex::Save() const
+{
+	if (!m_loaded || m_indexPath.empty()) {
+		return false;
+	}
+	std::string out;
+	out.append(sc_usageMagic, sizeof(sc_usageMagic));
+	PutLE(out, USAGE_INDEX_VERSION, 4);
+	PutLE(out, m_blobs.size(), 4);
+	PutLE(out, m_archives.size(), 4);
+	std::unordered_map<const BlobMap::value_type*, uint32_t> numbers;
+	numbers.reserve(m_blobs.size());
+	for (const auto& blob : m_blobs) {
+		numbers.emplace(&blob, static_cast<uint32_t>(numbers.size()));
+		PutLE(out, blob.first.size(), 1);
+		out.append(blob.first);
+		PutLE(out, blob.second.m_size, 8);
+	}
+	for (const auto& archive : m_archives) {
+		PutLE(out, static_cast<uint32_t>(archive.first), 4);
+		PutLE(out, archive.second.m_blobs.size(), 4);
+		for (const auto* blob : archive.second.m_blobs) {
+			PutLE(out, numbers[blob], 4);
+		}
+	}
+	if (!ReplaceFileContent(m_indexPath, out)) {
+		printf("Write usage index %s failed.\n", m_indexPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+void YgoUsageIndex::AddArchive(const int archiveID, const YgoArchiveFootprint& footprint)
+{
+	RemoveArchive(archiveID);
+	const uint32_t holder = static_cast<uint32_t>(archiveID);
+	Record record;
+	std::unordered_set<std::string> seen;
+	for (const auto& item : footprint.m_blobs) {
+		//Two files of one archive may share an object, the archive holds it once
+		if (item.first.size() > UINT8_MAX || !seen.insert(item.first).second) {
+			continue;
+		}
+		auto it = m_blobs.try_emplace(item.first, Blob{ item.second, 0, 0 }).first;
+		Blob& blob = it->second;
+		if (0 == blob.m_holders) {
+			m_totalBytes += blob.m_size;
+			record.m_usage.m_exclusiveBytes += blob.m_size;
+		}
+		else {
+			if (1 == blob.m_holders) {
+				//The only holder so far starts sharing it
+				Usage& other = m_archives[static_cast<int>(blob.m_holderXor)].m_usage;
+				other.m_exclusiveBytes -= blob.m_size;
+				other.m_sharedBytes += blob.m_size;
+				m_sharedBytes += blob.m_size;
+			}
+			record.m_usage.m_sharedBytes += blob.m_size;
+		}
+		++blob.m_holders;
+		blob.m_holderXor ^= holder;
+		record.m_blobs.push_back(&*it);
+	}
+	m_archives.emplace(archiveID, std::move(record));
+}
+
+void YgoUsageIndex::RemoveArchive(const int archiveID)
+{
+	auto found = m_archives.find(archiveID);
+	if (found == m_archives.end()) {
+		return;
+	}
+	const std::vector<BlobMap::value_type*> blobs = std::move(found->second.m_blobs);
+	m_archives.erase(found);
+	const uint32_t holder = static_cast<uint32_t>(archiveID);
+	for (auto* node : blobs) {
+		Blob& blob = node->second;
+		--blob.m_holders;
+		blob.m_holderXor ^= holder;
+		if (0 == blob.m_holders) {
+			m_totalBytes -= blob.m_size;
+			m_blobs.erase(m_blobs.find(node->first));
+		}
+		else if (1 == blob.m_holders) {
+			//The last remaining holder owns it alone again
+			Usage& other = m_archives[static_cast<int>(blob.m_holderXor)].m_usage;
+			other.m_sharedBytes -= blob.m_size;
+			other.m_exclusiveBytes += blob.m_size;
+			m_sharedBytes -= blob.m_size;
+		}
+	}
+}
+
+std::vector<int> YgoUsageIndex::ArchiveIDs() const
+{
+	std::vector<int> result;
+	result.reserve(m_archives.size());
+	for (const auto& archive : m_archives) {
+		result.push_back(archive.first);
+	}
+	return result;
+}
+
+YgoUsageIndex::Usage YgoUsageIndex::GetUsage(const int archiveID) const
+{
+	auto found = m_archives.find(archiveID);
+	return (found != m_archives.end()) ? found->second.m_usage : Usage();
+}
+
+std::string FormatByteSize(const uint64_t bytes)
+{
+	static const char* const units[] = { "B", "KB", "MB", "GB", "TB" };
+	double value = static_cast<double>(bytes);
+	int unit = 0;
+	while (value >= 1024 && unit < 4) {
+		value /= 1024;
+		++unit;
+	}
+	char buffer[32];
+	snprintf(buffer, sizeof(buffer), (0 == unit) ? "%.0f %s" : "%.1f %s", value, units[unit]);
+	return std::string(buffer);
+}
@@ -0,0 +1,88 @@
+#ifndef YGOMASTER_USAGE_H
+#define YGOMASTER_USAGE_H
+
+#include"public.h"
+
+/*
+* Disk usage of archives.
+* Everything an archive stores is a blob: each file of the archive directory, named by its file identity
+* so hard links shared with other archives are one blob, and each cold store object it refers to, named by key.
+* A blob held by one archive counts as exclusive bytes of it, a blob held by more archives as shared bytes of each.
+* The archives directory holds "Usage.bin" with the blobs of every archive:
+*   header:   magic "YMUS", version u32, blob count u32, archive count u32
+*   blobs:    per blob name length u8, name, size u64
+*   archives: per archive ArchiveID u32, blob count u32, blob numbers u32[blob count]
+* Adding or removing an archive only touches its own blobs, totals are kept as running sums.
+*/
+
+static const std::string sc_usageIndexFileName = "Usage.bin";
+
+// Blobs of one archive directory, name and size
+struct YgoArchiveFootprint
+{
+	std::vector<std::pair<std::string, uint64_t>> m_blobs;
+};
+
+// Walk archivePath and the cold objects its manifests refer to
+bool ScanArchiveFootprint(const std::string& archivePath, YgoArchiveFootprint& result);
+
+class YgoUsageIndex
+{
+public:
+	struct Usage
+	{
+		uint64_t m_exclusiveBytes; // freed when the archive is deleted
+		uint64_t m_sharedBytes; // also held by other archives
+
+		Usage() :m_exclusiveBytes(0), m_sharedBytes(0) {}
+	};
+
+	YgoUsageIndex();
+
+	// Load from indexPath, a missing file gives an empty loaded index
+	bool Load(const std::string& indexPath);
+	// Write the index back to the path it was loaded from
+	bool Save() const;
+	bool IsLoaded() const { return m_loaded; }
+
+	// Replace the blobs of archiveID
+	void AddArchive(const int archiveID, const YgoArchiveFootprint& footprint);
+	void RemoveArchive(const int archiveID);
+	bool HasArchive(const int archiveID) const { return m_archives.count(archiveID) != 0; }
+	std::vector<int> ArchiveIDs() const;
+
+	// Usage of archiveID, zero if it is not indexed
+	Usage GetUsage(const int archiveID) const;
+	// Bytes of every blob counted once
+	uint64_t TotalBytes() const { return m_totalBytes; }
+	// Bytes of blobs held by more than one archive, counted once
+	uint64_t SharedBytes() const { return m_sharedBytes; }
+
+private:
+	struct Blob
+	{
+		uint64_t m_size;
+		uint32_t m_holders;
+		// XOR of the ArchiveIDs holding the blob, the only holder when m_holders is 1
+		uint32_t m_holderXor;
+	};
+	using BlobMap = std::unordered_map<std::string, Blob>;
+	struct Record
+	{
+		Usage m_usage;
+		// Nodes of m_blobs, stable until the blob is erased with its last holder
+		std::vector<BlobMap::value_type*> m_blobs;
+	};
+
+	std::string m_indexPath;
+	bool m_loaded;
+	BlobMap m_blobs;
+	std::unordered_map<int, Record> m_archives;
+	uint64_t m_totalBytes;
+	uint64_t m_sharedBytes;
+};
+
+// "1.5 MB" style text for byte counts
+std::string FormatByteSize(const uint64_t bytes);
+
+#endif // !YGOMASTER_USAGE_H